@@ -0,0 +1,490 @@
+/*
+ * \file hyscan-async-executor.c
+ *
+ * \brief Исходный файл класса HyScanAsyncExecutor - пула потоков для HyScanAsync.
+ * \author agent (agent@local)
+ * \date 2026
+ * \license Проприетарная лицензия ООО "Экран"
+ *
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "hyscan-async-executor.h"
+
+#ifdef G_OS_UNIX
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifdef G_OS_WIN32
+#include <windows.h>
+#endif
+
+#define HYSCAN_ASYNC_EXECUTOR_THREAD_NAME       "hyscan-async-thread"
+
+/* Клиент пула потоков. */
+struct _HyScanAsyncExecutorClient
+{
+  GList                    link;        /* Элемент очереди готовых клиентов, link.data указывает на клиента. */
+  GList                    timer_link;  /* Элемент списка отложенных активаций, data указывает на клиента. */
+  HyScanAsyncExecutorFunc  func;        /* Функция выполнения шага. */
+  gpointer                 user_data;   /* Параметр функции выполнения шага. */
+
+  gboolean                 queued;      /* Признак нахождения клиента в очереди. */
+  gint64                   wakeup_time; /* Время отложенной активации или 0. */
+  gboolean                 detached;    /* Признак отключения клиента. */
+  guint                    n_active;    /* Число выполняющихся шагов клиента. */
+};
+
+enum
+{
+  PROP_O,
+  PROP_N_WORKERS,
+  PROP_SCHED_POLICY,
+  PROP_SCHED_PRIORITY,
+  PROP_CPU_AFFINITY
+};
+
+struct _HyScanAsyncExecutorPrivate
+{
+  guint             n_workers;           /* Число потоков. */
+  GThread         **workers;             /* Потоки выполнения шагов клиентов. */
+
+  HyScanAsyncSchedPolicy sched_policy;   /* Политика планирования потоков. */
+  gint              sched_priority;      /* Приоритет потоков в политике планирования. */
+  guint64           cpu_affinity;        /* Маска процессоров для потоков или 0. */
+  gint              sched_warned;        /* Признак выдачи предупреждения о политике планирования. */
+  gint              affinity_warned;     /* Признак выдачи предупреждения о маске процессоров. */
+
+  GMutex            mutex;               /* Мьютекс доступа к очереди клиентов. */
+  GCond             cond;                /* Условие появления работы для потоков. */
+  GCond             idle_cond;           /* Условие завершения шага клиента. */
+  GQueue            queue;               /* Очередь готовых клиентов. */
+  GQueue            timers;              /* Клиенты, ожидающие отложенной активации. */
+
+  gboolean          shutdown;            /* Флаг останова потоков. */
+};
+
+static void     hyscan_async_executor_set_property       (GObject            *object,
+                                                          guint               prop_id,
+                                                          const GValue       *value,
+                                                          GParamSpec         *pspec);
+static void     hyscan_async_executor_object_constructed (GObject            *object);
+static void     hyscan_async_executor_object_finalize    (GObject            *object);
+
+static gpointer hyscan_async_executor_thread_func        (gpointer            object);
+static void     hyscan_async_executor_thread_setup       (HyScanAsyncExecutorPrivate *priv);
+static gint64   hyscan_async_executor_timers_poll        (HyScanAsyncExecutorPrivate *priv);
+
+G_DEFINE_TYPE_WITH_PRIVATE (HyScanAsyncExecutor, hyscan_async_executor, G_TYPE_OBJECT)
+
+static void
+hyscan_async_executor_class_init (HyScanAsyncExecutorClass *klass)
+{
+  GObjectClass *obj_class = G_OBJECT_CLASS (klass);
+
+  obj_class->set_property = hyscan_async_executor_set_property;
+  obj_class->constructed = hyscan_async_executor_object_constructed;
+  obj_class->finalize = hyscan_async_executor_object_finalize;
+
+  g_object_class_install_property (obj_class, PROP_N_WORKERS,
+    g_param_spec_uint ("n-workers", "NWorkers", "Number of worker threads",
+                       1, HYSCAN_ASYNC_EXECUTOR_MAX_WORKERS, 1,
+                       G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (obj_class, PROP_SCHED_POLICY,
+    g_param_spec_int ("sched-policy", "SchedPolicy", "Scheduling policy of worker threads",
+                      HYSCAN_ASYNC_SCHED_DEFAULT, HYSCAN_ASYNC_SCHED_RR, HYSCAN_ASYNC_SCHED_DEFAULT,
+                      G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (obj_class, PROP_SCHED_PRIORITY,
+    g_param_spec_int ("sched-priority", "SchedPriority", "Real-time priority of worker threads",
+                      0, 99, 0,
+                      G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (obj_class, PROP_CPU_AFFINITY,
+    g_param_spec_uint64 ("cpu-affinity", "CpuAffinity", "CPU mask of worker threads, 0 - any CPU",
+                         0, G_MAXUINT64, 0,
+                         G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
+}
+
+static void
+hyscan_async_executor_init (HyScanAsyncExecutor *executor)
+{
+  HyScanAsyncExecutorPrivate *priv = hyscan_async_executor_get_instance_private (executor);
+
+  g_mutex_init (&priv->mutex);
+  g_cond_init (&priv->cond);
+  g_cond_init (&priv->idle_cond);
+  g_queue_init (&priv->queue);
+  g_queue_init (&priv->timers);
+
+  executor->priv = priv;
+}
+
+static void
+hyscan_async_executor_set_property (GObject      *object,
+                                    guint         prop_id,
+                                    const GValue *value,
+                                    GParamSpec   *pspec)
+{
+  HyScanAsyncExecutor *executor = HYSCAN_ASYNC_EXECUTOR (object);
+
+  switch (prop_id)
+    {
+    case PROP_N_WORKERS:
+      executor->priv->n_workers = g_value_get_uint (value);
+      break;
+
+    case PROP_SCHED_POLICY:
+      executor->priv->sched_policy = g_value_get_int (value);
+      break;
+
+    case PROP_SCHED_PRIORITY:
+      executor->priv->sched_priority = g_value_get_int (value);
+      break;
+
+    case PROP_CPU_AFFINITY:
+      executor->priv->cpu_affinity = g_value_get_uint64 (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+hyscan_async_executor_object_constructed (GObject *object)
+{
+  HyScanAsyncExecutor *executor = HYSCAN_ASYNC_EXECUTOR (object);
+  HyScanAsyncExecutorPrivate *priv = executor->priv;
+  guint i;
+
+  G_OBJECT_CLASS (hyscan_async_executor_parent_class)->constructed (object);
+
+  priv->shutdown = FALSE;
+  priv->workers = g_new0 (GThread *, priv->n_workers);
+  for (i = 0; i < priv->n_workers; i++)
+    {
+      priv->workers[i] = g_thread_new (HYSCAN_ASYNC_EXECUTOR_THREAD_NAME,
+                                       hyscan_async_executor_thread_func, executor);
+    }
+}
+
+static void
+hyscan_async_executor_object_finalize (GObject *object)
+{
+  HyScanAsyncExecutor *executor = HYSCAN_ASYNC_EXECUTOR (object);
+  HyScanAsyncExecutorPrivate *priv = executor->priv;
+  guint i;
+
+  /* Клиенты держат ссылку на пул, поэтому к этому моменту все они отключены. */
+  g_mutex_lock (&priv->mutex);
+  priv->shutdown = TRUE;
+  g_cond_broadcast (&priv->cond);
+  g_mutex_unlock (&priv->mutex);
+
+  for (i = 0; i < priv->n_workers; i++)
+    g_thread_join (priv->workers[i]);
+  g_free (priv->workers);
+
+  g_mutex_clear (&priv->mutex);
+  g_cond_clear (&priv->cond);
+  g_cond_clear (&priv->idle_cond);
+
+  G_OBJECT_CLASS (hyscan_async_executor_parent_class)->finalize (object);
+}
+
+/* Функция потока выполняет шаги клиентов в порядке очереди. */
+static gpointer
+hyscan_async_executor_thread_func (gpointer object)
+{
+  HyScanAsyncExecutor *executor = HYSCAN_ASYNC_EXECUTOR (object);
+  HyScanAsyncExecutorPrivate *priv = executor->priv;
+
+  hyscan_async_executor_thread_setup (priv);
+
+  g_mutex_lock (&priv->mutex);
+
+  while (TRUE)
+    {
+      HyScanAsyncExecutorClient *client;
+
+      /* Поток спит до появления готовых клиентов, до ближайшей отложенной активации
+       * или до останова. */
+      while (!priv->shutdown && g_queue_is_empty (&priv->queue))
+        {
+          gint64 wakeup_time = hyscan_async_executor_timers_poll (priv);
+
+          if (!g_queue_is_empty (&priv->queue))
+            break;
+
+          if (wakeup_time == 0)
+            g_cond_wait (&priv->cond, &priv->mutex);
+          else
+            g_cond_wait_until (&priv->cond, &priv->mutex, wakeup_time);
+        }
+
+      if (priv->shutdown)
+        break;
+
+      client = g_queue_pop_head_link (&priv->queue)->data;
+      client->queued = FALSE;
+      client->n_active++;
+
+      /* Шаг клиента выполняется без блокировки, клиент может снова встать в очередь. */
+      g_mutex_unlock (&priv->mutex);
+      client->func (client->user_data);
+      g_mutex_lock (&priv->mutex);
+
+      if (--client->n_active == 0 && client->detached)
+        g_cond_broadcast (&priv->idle_cond);
+    }
+
+  g_mutex_unlock (&priv->mutex);
+
+  return NULL;
+}
+
+/* Задаёт политику планирования и маску процессоров текущего потока. При нехватке прав
+ * поток продолжает работать с параметрами по умолчанию, предупреждение выдаётся один раз. */
+static void
+hyscan_async_executor_thread_setup (HyScanAsyncExecutorPrivate *priv)
+{
+#if defined (G_OS_UNIX)
+  if (priv->sched_policy != HYSCAN_ASYNC_SCHED_DEFAULT)
+    {
+      struct sched_param param = { 0 };
+      gint policy;
+      gint error;
+
+      policy = (priv->sched_policy == HYSCAN_ASYNC_SCHED_FIFO) ? SCHED_FIFO : SCHED_RR;
+      param.sched_priority = CLAMP (priv->sched_priority,
+                                    sched_get_priority_min (policy),
+                                    sched_get_priority_max (policy));
+
+      error = pthread_setschedparam (pthread_self (), policy, &param);
+      if (error != 0 && g_atomic_int_compare_and_exchange (&priv->sched_warned, FALSE, TRUE))
+        {
+          g_warning ("HyScanAsyncExecutor: can't set real-time scheduling policy, "
+                     "using default: %s", g_strerror (error));
+        }
+    }
+
+#if defined (__linux__)
+  if (priv->cpu_affinity != 0)
+    {
+      cpu_set_t cpu_set;
+      gint error;
+      guint i;
+
+      CPU_ZERO (&cpu_set);
+      for (i = 0; i < 64 && i < CPU_SETSIZE; i++)
+        {
+          if (priv->cpu_affinity & (G_GUINT64_CONSTANT (1) << i))
+            CPU_SET (i, &cpu_set);
+        }
+
+      error = pthread_setaffinity_np (pthread_self (), sizeof (cpu_set), &cpu_set);
+      if (error != 0 && g_atomic_int_compare_and_exchange (&priv->affinity_warned, FALSE, TRUE))
+        {
+          g_warning ("HyScanAsyncExecutor: can't set cpu affinity, using any cpu: %s",
+                     g_strerror (error));
+        }
+    }
+#else
+  if (priv->cpu_affinity != 0 && g_atomic_int_compare_and_exchange (&priv->affinity_warned, FALSE, TRUE))
+    g_warning ("HyScanAsyncExecutor: cpu affinity is not supported on this platform");
+#endif
+
+#elif defined (G_OS_WIN32)
+  if (priv->sched_policy != HYSCAN_ASYNC_SCHED_DEFAULT)
+    {
+      gint priority;
+
+      /* Приоритеты потоков Windows грубее, поэтому используется верхняя половина шкалы. */
+      priority = (priv->sched_priority >= 50) ? THREAD_PRIORITY_TIME_CRITICAL : THREAD_PRIORITY_HIGHEST;
+      if (!SetThreadPriority (GetCurrentThread (), priority) &&
+          g_atomic_int_compare_and_exchange (&priv->sched_warned, FALSE, TRUE))
+        {
+          g_warning ("HyScanAsyncExecutor: can't set thread priority, using default");
+        }
+    }
+
+  if (priv->cpu_affinity != 0)
+    {
+      if (!SetThreadAffinityMask (GetCurrentThread (), (DWORD_PTR) priv->cpu_affinity) &&
+          g_atomic_int_compare_and_exchange (&priv->affinity_warned, FALSE, TRUE))
+        {
+          g_warning ("HyScanAsyncExecutor: can't set cpu affinity, using any cpu");
+        }
+    }
+#endif
+}
+
+/* Переносит клиентов, время активации которых наступило, в очередь готовых.
+ * Возвращает время ближайшей отложенной активации или 0. Вызывается под мьютексом. */
+static gint64
+hyscan_async_executor_timers_poll (HyScanAsyncExecutorPrivate *priv)
+{
+  gint64 now = g_get_monotonic_time ();
+  gint64 wakeup_time = 0;
+  guint n_ready = 0;
+  GList *link, *next;
+
+  for (link = priv->timers.head; link != NULL; link = next)
+    {
+      HyScanAsyncExecutorClient *client = link->data;
+
+      next = link->next;
+
+      if (client->wakeup_time > now)
+        {
+          if (wakeup_time == 0 || client->wakeup_time < wakeup_time)
+            wakeup_time = client->wakeup_time;
+          continue;
+        }
+
+      g_queue_unlink (&priv->timers, link);
+      client->wakeup_time = 0;
+
+      if (!client->queued)
+        {
+          g_queue_push_tail_link (&priv->queue, &client->link);
+          client->queued = TRUE;
+          n_ready++;
+        }
+    }
+
+  /* Одного клиента заберёт текущий поток, остальных - другие. */
+  if (n_ready > 1)
+    g_cond_broadcast (&priv->cond);
+
+  return wakeup_time;
+}
+
+/* Создаёт новый пул потоков. */
+HyScanAsyncExecutor *
+hyscan_async_executor_new (guint n_workers)
+{
+  return g_object_new (HYSCAN_TYPE_ASYNC_EXECUTOR,
+                       "n-workers", n_workers,
+                       NULL);
+}
+
+/* Подключает клиента к пулу потоков. */
+HyScanAsyncExecutorClient *
+hyscan_async_executor_attach (HyScanAsyncExecutor     *executor,
+                              HyScanAsyncExecutorFunc  func,
+                              gpointer                 user_data)
+{
+  HyScanAsyncExecutorClient *client;
+
+  g_return_val_if_fail (HYSCAN_IS_ASYNC_EXECUTOR (executor), NULL);
+  g_return_val_if_fail (func != NULL, NULL);
+
+  client = g_new0 (HyScanAsyncExecutorClient, 1);
+  client->link.data = client;
+  client->timer_link.data = client;
+  client->func = func;
+  client->user_data = user_data;
+
+  return client;
+}
+
+/* Отключает клиента от пула потоков. */
+void
+hyscan_async_executor_detach (HyScanAsyncExecutor       *executor,
+                              HyScanAsyncExecutorClient *client)
+{
+  HyScanAsyncExecutorPrivate *priv;
+
+  g_return_if_fail (HYSCAN_IS_ASYNC_EXECUTOR (executor));
+
+  if (client == NULL)
+    return;
+
+  priv = executor->priv;
+
+  g_mutex_lock (&priv->mutex);
+
+  client->detached = TRUE;
+  if (client->queued)
+    {
+      g_queue_unlink (&priv->queue, &client->link);
+      client->queued = FALSE;
+    }
+  if (client->wakeup_time != 0)
+    {
+      g_queue_unlink (&priv->timers, &client->timer_link);
+      client->wakeup_time = 0;
+    }
+
+  /* Ожидание завершения шагов клиента, выполняющихся в других потоках. */
+  while (client->n_active > 0)
+    g_cond_wait (&priv->idle_cond, &priv->mutex);
+
+  g_mutex_unlock (&priv->mutex);
+
+  g_free (client);
+}
+
+/* Ставит клиента в очередь на выполнение очередного шага. */
+void
+hyscan_async_executor_wakeup (HyScanAsyncExecutor       *executor,
+                              HyScanAsyncExecutorClient *client)
+{
+  HyScanAsyncExecutorPrivate *priv;
+
+  g_return_if_fail (HYSCAN_IS_ASYNC_EXECUTOR (executor));
+
+  priv = executor->priv;
+
+  g_mutex_lock (&priv->mutex);
+
+  if (!client->queued && !client->detached)
+    {
+      g_queue_push_tail_link (&priv->queue, &client->link);
+      client->queued = TRUE;
+      g_cond_signal (&priv->cond);
+    }
+
+  g_mutex_unlock (&priv->mutex);
+}
+
+/* Ставит клиента в очередь на выполнение шага не позднее заданного времени. */
+void
+hyscan_async_executor_wakeup_at (HyScanAsyncExecutor       *executor,
+                                 HyScanAsyncExecutorClient *client,
+                                 gint64                     wakeup_time)
+{
+  HyScanAsyncExecutorPrivate *priv;
+
+  g_return_if_fail (HYSCAN_IS_ASYNC_EXECUTOR (executor));
+
+  if (wakeup_time <= g_get_monotonic_time ())
+    {
+      hyscan_async_executor_wakeup (executor, client);
+      return;
+    }
+
+  priv = executor->priv;
+
+  g_mutex_lock (&priv->mutex);
+
+  /* Из нескольких запрошенных активаций сохраняется самая ранняя. */
+  if (!client->detached && (client->wakeup_time == 0 || wakeup_time < client->wakeup_time))
+    {
+      if (client->wakeup_time == 0)
+        g_queue_push_tail_link (&priv->timers, &client->timer_link);
+      client->wakeup_time = wakeup_time;
+
+      /* Спящие потоки пересчитывают время ожидания. */
+      g_cond_broadcast (&priv->cond);
+    }
+
+  g_mutex_unlock (&priv->mutex);
+}
@@ -0,0 +1,153 @@
+/**
+ * \file hyscan-async-executor.h
+ *
+ * \brief Заголовочный файл класса HyScanAsyncExecutor - пула потоков для HyScanAsync.
+ * \author agent (agent@local)
+ * \date 2026
+ * \license Проприетарная лицензия ООО "Экран"
+ *
+ * \defgroup HyScanAsyncExecutor HyScanAsyncExecutor - пул потоков выполнения запросов.
+ *
+ * Класс содержит ограниченное число потоков, которые выполняют запросы нескольких
+ * объектов \link HyScanAsync \endlink (клиентов). Общий пул задаётся объектам
+ * \link HyScanAsync \endlink свойством "executor" при их создании, при этом число
+ * потоков не зависит от числа объектов. Если пул не задан, объект создаёт собственный.
+ *
+ * Клиенты обслуживаются по очереди: поток берёт первого клиента из очереди готовых,
+ * выполняет один его шаг (один запрос) и, если у клиента ещё есть работа, клиент
+ * становится в конец очереди. Поэтому длинный пакет запросов одного клиента не
+ * задерживает запросы других клиентов.
+ *
+ * Клиент может запросить активацию в заданный момент времени функцией
+ * #hyscan_async_executor_wakeup_at. Потоки пула ожидают ближайшего такого момента
+ * по монотонному времени (g_get_monotonic_time), поэтому активация не зависит
+ * от главного цикла и его таймеров.
+ *
+ * Свойства "sched-policy", "sched-priority" и "cpu-affinity", задаваемые при создании
+ * пула, позволяют выполнять запросы потоками с политикой планирования реального времени
+ * (#HyScanAsyncSchedPolicy) и на выбранных процессорах, чтобы задержка выполнения команд
+ * управления не зависела от загрузки процессора другими задачами. Если прав для изменения
+ * планирования недостаточно, потоки работают с параметрами по умолчанию, а пул выдаёт
+ * одно предупреждение. Маска процессоров задаёт номера процессоров битами, начиная с
+ * младшего, 0 - любой процессор. На Windows политика реального времени заменяется
+ * повышенным приоритетом потоков.
+ *
+ * Функции #hyscan_async_executor_attach, #hyscan_async_executor_detach,
+ * #hyscan_async_executor_wakeup и #hyscan_async_executor_wakeup_at используются
+ * классом \link HyScanAsync \endlink и могут использоваться для подключения других клиентов.
+ */
+
+#ifndef __HYSCAN_ASYNC_EXECUTOR_H__
+#define __HYSCAN_ASYNC_EXECUTOR_H__
+
+#include <glib-object.h>
+#include <hyscan-api.h>
+
+/** Максимальное число потоков пула и значение свойства "n-workers" \link HyScanAsync \endlink. */
+#define HYSCAN_ASYNC_EXECUTOR_MAX_WORKERS (64)
+
+/** Политика планирования потоков пула. */
+typedef enum
+{
+  HYSCAN_ASYNC_SCHED_DEFAULT,          /**< Политика по умолчанию. */
+  HYSCAN_ASYNC_SCHED_FIFO,             /**< Реальное время, SCHED_FIFO. */
+  HYSCAN_ASYNC_SCHED_RR                /**< Реальное время с квантованием, SCHED_RR. */
+} HyScanAsyncSchedPolicy;
+
+/** Функция выполнения одного шага клиента. */
+typedef void (*HyScanAsyncExecutorFunc) (gpointer user_data);
+
+G_BEGIN_DECLS
+
+#define HYSCAN_TYPE_ASYNC_EXECUTOR             (hyscan_async_executor_get_type ())
+#define HYSCAN_ASYNC_EXECUTOR(obj)             (G_TYPE_CHECK_INSTANCE_CAST ((obj), HYSCAN_TYPE_ASYNC_EXECUTOR, HyScanAsyncExecutor))
+#define HYSCAN_IS_ASYNC_EXECUTOR(obj)          (G_TYPE_CHECK_INSTANCE_TYPE ((obj), HYSCAN_TYPE_ASYNC_EXECUTOR))
+#define HYSCAN_ASYNC_EXECUTOR_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST ((klass), HYSCAN_TYPE_ASYNC_EXECUTOR, HyScanAsyncExecutorClass))
+#define HYSCAN_IS_ASYNC_EXECUTOR_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE ((klass), HYSCAN_TYPE_ASYNC_EXECUTOR))
+#define HYSCAN_ASYNC_EXECUTOR_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS ((obj), HYSCAN_TYPE_ASYNC_EXECUTOR, HyScanAsyncExecutorClass))
+
+typedef struct _HyScanAsyncExecutor HyScanAsyncExecutor;
+typedef struct _HyScanAsyncExecutorPrivate HyScanAsyncExecutorPrivate;
+typedef struct _HyScanAsyncExecutorClass HyScanAsyncExecutorClass;
+typedef struct _HyScanAsyncExecutorClient HyScanAsyncExecutorClient;
+
+struct _HyScanAsyncExecutor
+{
+  GObject parent_instance;
+
+  HyScanAsyncExecutorPrivate *priv;
+};
+
+struct _HyScanAsyncExecutorClass
+{
+  GObjectClass parent_class;
+};
+
+HYSCAN_API
+GType                      hyscan_async_executor_get_type (void);
+
+/**
+ * Создаёт новый пул потоков \link HyScanAsyncExecutor \endlink.
+ *
+ * \param n_workers число потоков, от 1 до #HYSCAN_ASYNC_EXECUTOR_MAX_WORKERS.
+ *
+ * \return указатель на класс \link HyScanAsyncExecutor \endlink.
+ */
+HYSCAN_API
+HyScanAsyncExecutor       *hyscan_async_executor_new      (guint                      n_workers);
+
+/**
+ * Подключает клиента к пулу потоков. Функция func вызывается в одном из потоков
+ * пула один раз после каждой активации клиента функцией #hyscan_async_executor_wakeup.
+ *
+ * \param executor указатель на класс \link HyScanAsyncExecutor \endlink;
+ * \param func функция выполнения одного шага клиента;
+ * \param user_data параметр функции func.
+ *
+ * \return Указатель на клиента пула.
+ */
+HYSCAN_API
+HyScanAsyncExecutorClient *hyscan_async_executor_attach   (HyScanAsyncExecutor       *executor,
+                                                           HyScanAsyncExecutorFunc    func,
+                                                           gpointer                   user_data);
+
+/**
+ * Отключает клиента от пула потоков. Функция дожидается завершения всех
+ * выполняющихся шагов клиента и освобождает его.
+ *
+ * \param executor указатель на класс \link HyScanAsyncExecutor \endlink;
+ * \param client указатель на клиента пула.
+ */
+HYSCAN_API
+void                       hyscan_async_executor_detach   (HyScanAsyncExecutor       *executor,
+                                                           HyScanAsyncExecutorClient *client);
+
+/**
+ * Ставит клиента в очередь на выполнение очередного шага. Если клиент уже находится
+ * в очереди, повторный вызов ничего не меняет. Функцию можно вызывать из любого потока.
+ *
+ * \param executor указатель на класс \link HyScanAsyncExecutor \endlink;
+ * \param client указатель на клиента пула.
+ */
+HYSCAN_API
+void                       hyscan_async_executor_wakeup   (HyScanAsyncExecutor       *executor,
+                                                           HyScanAsyncExecutorClient *client);
+
+/**
+ * Ставит клиента в очередь на выполнение шага не позднее заданного времени. Если
+ * для клиента уже запрошена более ранняя активация, вызов ничего не меняет. Если время
+ * уже наступило, функция работает как #hyscan_async_executor_wakeup. Функцию можно
+ * вызывать из любого потока.
+ *
+ * \param executor указатель на класс \link HyScanAsyncExecutor \endlink;
+ * \param client указатель на клиента пула;
+ * \param wakeup_time время активации (g_get_monotonic_time), мкс.
+ */
+HYSCAN_API
+void                       hyscan_async_executor_wakeup_at (HyScanAsyncExecutor       *executor,
+                                                            HyScanAsyncExecutorClient *client,
+                                                            gint64                     wakeup_time);
+
+G_END_DECLS
+
+#endif /* __HYSCAN_ASYNC_EXECUTOR_H__ */
@@ -0,0 +1,121 @@
+/*
+ * \file hyscan-async-histogram.c
+ *
+ * \brief Исходный файл гистограммы времени выполнения HyScanAsyncHistogram.
+ * \author agent (agent@local)
+ * \date 2026
+ * \license Проприетарная лицензия ООО "Экран"
+ *
+ */
+
+#include "hyscan-async-histogram.h"
+
+/* Добавляет значение в гистограмму. */
+void
+hyscan_async_histogram_add (HyScanAsyncHistogram *histogram,
+                            gint64                value)
+{
+  guint bucket;
+  guint max;
+  guint us;
+
+  g_return_if_fail (histogram != NULL);
+
+  us = (guint) CLAMP (value, 0, G_MAXUINT);
+
+  /* Номер корзины - число значащих бит значения. */
+  bucket = (us == 0) ? 0 : MIN (g_bit_storage (us), HYSCAN_ASYNC_HISTOGRAM_N_BUCKETS - 1);
+
+  g_atomic_int_inc (&histogram->buckets[bucket]);
+  g_atomic_pointer_add (&histogram->sum, us);
+  g_atomic_int_inc (&histogram->count);
+
+  do
+    max = g_atomic_int_get (&histogram->max);
+  while (us > max && !g_atomic_int_compare_and_exchange (&histogram->max, max, us));
+}
+
+/* Копирует гистограмму. */
+void
+hyscan_async_histogram_copy (const HyScanAsyncHistogram *histogram,
+                             HyScanAsyncHistogram       *copy)
+{
+  guint i;
+
+  g_return_if_fail (histogram != NULL && copy != NULL);
+
+  copy->count = g_atomic_int_get (&histogram->count);
+  copy->max = g_atomic_int_get (&histogram->max);
+  copy->sum = GPOINTER_TO_SIZE (g_atomic_pointer_get (&histogram->sum));
+  for (i = 0; i < HYSCAN_ASYNC_HISTOGRAM_N_BUCKETS; i++)
+    copy->buckets[i] = g_atomic_int_get (&histogram->buckets[i]);
+}
+
+/* Обнуляет гистограмму. */
+void
+hyscan_async_histogram_reset (HyScanAsyncHistogram *histogram)
+{
+  guint i;
+
+  g_return_if_fail (histogram != NULL);
+
+  g_atomic_int_set (&histogram->count, 0);
+  g_atomic_int_set (&histogram->max, 0);
+  g_atomic_pointer_set (&histogram->sum, 0);
+  for (i = 0; i < HYSCAN_ASYNC_HISTOGRAM_N_BUCKETS; i++)
+    g_atomic_int_set (&histogram->buckets[i], 0);
+}
+
+/* Возвращает среднее значение. */
+gdouble
+hyscan_async_histogram_mean (const HyScanAsyncHistogram *histogram)
+{
+  guint count;
+
+  g_return_val_if_fail (histogram != NULL, 0.0);
+
+  count = g_atomic_int_get (&histogram->count);
+  if (count == 0)
+    return 0.0;
+
+  return (gdouble) GPOINTER_TO_SIZE (g_atomic_pointer_get (&histogram->sum)) / count;
+}
+
+/* Возвращает оценку перцентиля. */
+guint
+hyscan_async_histogram_percentile (const HyScanAsyncHistogram *histogram,
+                                   gdouble                     percent)
+{
+  HyScanAsyncHistogram copy;
+  guint64 rank;
+  guint64 total;
+  guint i;
+
+  g_return_val_if_fail (histogram != NULL, 0);
+
+  hyscan_async_histogram_copy (histogram, &copy);
+
+  /* Число значений берётся по корзинам, так как счётчик мог измениться во время копирования. */
+  for (total = 0, i = 0; i < HYSCAN_ASYNC_HISTOGRAM_N_BUCKETS; i++)
+    total += copy.buckets[i];
+  if (total == 0)
+    return 0;
+
+  rank = (guint64) (CLAMP (percent, 0.0, 100.0) / 100.0 * total + 0.5);
+  rank = CLAMP (rank, 1, total);
+
+  for (i = 0; i < HYSCAN_ASYNC_HISTOGRAM_N_BUCKETS - 1; i++)
+    {
+      if (rank <= copy.buckets[i])
+        break;
+      rank -= copy.buckets[i];
+    }
+
+  /* Верхняя граница корзины i - 2^i - 1 мкс. */
+  if (i == 0)
+    return 0;
+  if (i == HYSCAN_ASYNC_HISTOGRAM_N_BUCKETS - 1)
+    return copy.max;
+
+  return MIN ((1u << i) - 1, copy.max);
+}
@@ -0,0 +1,98 @@
+/**
+ * \file hyscan-async-histogram.h
+ *
+ * \brief Заголовочный файл гистограммы времени выполнения HyScanAsyncHistogram.
+ * \author agent (agent@local)
+ * \date 2026
+ * \license Проприетарная лицензия ООО "Экран"
+ *
+ * \defgroup HyScanAsyncHistogram HyScanAsyncHistogram - гистограмма времени выполнения.
+ *
+ * Гистограмма накапливает значения интервалов времени в микросекундах. Интервалы
+ * раскладываются по #HYSCAN_ASYNC_HISTOGRAM_N_BUCKETS корзинам с границами, равными
+ * степеням двойки: в корзину 0 попадают значения меньше 1 мкс, в корзину i - значения
+ * от 2^(i-1) до 2^i мкс. Все значения больше 2^30 мкс попадают в последнюю корзину.
+ *
+ * Функция #hyscan_async_histogram_add использует только атомарные операции и может
+ * вызываться одновременно из разных потоков без блокировок. Снимок гистограммы,
+ * полученный функцией #hyscan_async_histogram_copy, может быть не согласован между
+ * полями, если значения добавляются во время копирования.
+ *
+ * Гистограмма не требует инициализации, кроме обнуления памяти.
+ */
+
+#ifndef __HYSCAN_ASYNC_HISTOGRAM_H__
+#define __HYSCAN_ASYNC_HISTOGRAM_H__
+
+#include <glib.h>
+#include <hyscan-api.h>
+
+G_BEGIN_DECLS
+
+/** Число корзин гистограммы. */
+#define HYSCAN_ASYNC_HISTOGRAM_N_BUCKETS (32)
+
+/** Гистограмма времени выполнения. */
+typedef struct
+{
+  guint        count;                                       /**< Число значений. */
+  guint        max;                                         /**< Максимальное значение, мкс. */
+  gsize        sum;                                         /**< Сумма значений, мкс. */
+  guint        buckets[HYSCAN_ASYNC_HISTOGRAM_N_BUCKETS];   /**< Число значений в корзинах. */
+} HyScanAsyncHistogram;
+
+/**
+ * Добавляет значение в гистограмму. Отрицательные значения считаются нулевыми.
+ *
+ * \param histogram указатель на гистограмму;
+ * \param value значение, мкс.
+ */
+HYSCAN_API
+void         hyscan_async_histogram_add        (HyScanAsyncHistogram       *histogram,
+                                                gint64                      value);
+
+/**
+ * Копирует гистограмму.
+ *
+ * \param histogram указатель на гистограмму;
+ * \param copy указатель на копию гистограммы.
+ */
+HYSCAN_API
+void         hyscan_async_histogram_copy       (const HyScanAsyncHistogram *histogram,
+                                                HyScanAsyncHistogram       *copy);
+
+/**
+ * Обнуляет гистограмму.
+ *
+ * \param histogram указатель на гистограмму.
+ */
+HYSCAN_API
+void         hyscan_async_histogram_reset      (HyScanAsyncHistogram       *histogram);
+
+/**
+ * Возвращает среднее значение.
+ *
+ * \param histogram указатель на гистограмму.
+ *
+ * \return Среднее значение, мкс, или 0, если значений нет.
+ */
+HYSCAN_API
+gdouble      hyscan_async_histogram_mean       (const HyScanAsyncHistogram *histogram);
+
+/**
+ * Возвращает оценку перцентиля - верхнюю границу корзины, в которую попадает
+ * значение с заданным процентом меньших значений. Оценка не превышает максимального
+ * значения.
+ *
+ * \param histogram указатель на гистограмму;
+ * \param percent процент значений, от 0 до 100.
+ *
+ * \return Оценка перцентиля, мкс, или 0, если значений нет.
+ */
+HYSCAN_API
+guint        hyscan_async_histogram_percentile (const HyScanAsyncHistogram *histogram,
+                                                gdouble                     percent);
+
+G_END_DECLS
+
+#endif /* __HYSCAN_ASYNC_HISTOGRAM_H__ */
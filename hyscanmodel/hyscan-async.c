@@ -9,31 +9,141 @@
  */
 
 #include <memory.h>
+#include <gio/gio.h>
 #include "hyscan-async.h"
 
-#define HYSCAN_ASYNC_IDLE                       (0)
-#define HYSCAN_ASYNC_BUSY                       (1)
+#define HYSCAN_ASYNC_DATA_ALIGN                 (16)
+#define HYSCAN_ASYNC_NO_DATA                    (G_MAXSIZE)
+#define HYSCAN_ASYNC_NO_EDGE                    (G_MAXUINT)
 
-#define HYSCAN_ASYNC_CONTINUE                   (0)
-#define HYSCAN_ASYNC_SHUTDOWN                   (1)
+#define HYSCAN_ASYNC_PREALLOC_QUERIES           (64)
+#define HYSCAN_ASYNC_PREALLOC_DATA              (4096)
 
-#define HYSCAN_ASYNC_THREAD_NAME                "hyscan-async-thread"
+/* Запрос - это команда плюс объект плюс данные.
+ * Данные хранятся в буфере пакета, в запросе хранится только их смещение,
+ * так как при добавлении новых запросов буфер может быть перераспределён.
+ * Данные, переданные во владение, не копируются и освобождаются при очистке пакета. */
+typedef struct
+{
+  HyScanAsyncCommand command;     /* Команда. */
+  gpointer           object;      /* Объект. */
+  gsize              data_offset; /* Смещение данных в буфере пакета или HYSCAN_ASYNC_NO_DATA. */
+  gsize              data_size;   /* Размер данных в буфере пакета. */
+  gpointer           taken;       /* Данные, переданные во владение. */
+  GDestroyNotify     destroy;     /* Функция освобождения данных, переданных во владение. */
+
+  guint              id;          /* Идентификатор запроса. */
+  guint              lane;        /* Полоса выполнения. */
+  gint               priority;    /* Приоритет. */
+  guint64            key;         /* Ключ объединения одинаковых запросов. */
+  gint64             deadline;    /* Время, после которого запрос не выполняется, или 0. */
+  gint64             append_time; /* Время добавления запроса. */
+  HyScanAsyncQueryStatus status;  /* Состояние выполнения запроса. */
+  GError            *error;       /* Ошибка выполнения запроса. */
+  gboolean           blocked;     /* Признак ошибки запроса, от которого зависит данный. */
+
+  guint              max_attempts;  /* Максимальное число попыток выполнения. */
+  guint              attempt;       /* Число начатых попыток выполнения. */
+  gint64             retry_backoff; /* Задержка перед второй попыткой. */
+  gint64             retry_budget;  /* Время от первой попытки, в течение которого допустимы повторы, или 0. */
+  gint64             first_time;    /* Время начала первой попытки. */
+  gint64             retry_time;    /* Время следующей попытки. */
+
+  guint              deps_offset; /* Индекс первой зависимости в массиве зависимостей пакета. */
+  guint              n_deps;      /* Число явных зависимостей. */
+  guint              order;       /* Индекс запроса до сортировки по приоритету. */
+
+  guint              n_pending;   /* Число невыполненных запросов, от которых зависит данный. */
+  guint              edge_head;   /* Индекс первой связи с зависимым запросом или HYSCAN_ASYNC_NO_EDGE. */
+} HyScanQuery;
 
-#define HYSCAN_ASYNC_COND_WAIT_TIMEOUT          (100 * G_TIME_SPAN_MILLISECOND)
-#define HYSCAN_ASYNC_RESULT_CHECK_TIMEOUT_MS    (100)
+/* Запрос, выполняемый по расписанию. */
+typedef struct
+{
+  guint              id;          /* Идентификатор запроса. */
+  HyScanAsyncCommand command;     /* Команда. */
+  gpointer           object;      /* Объект. */
+  gpointer           data;        /* Копия данных. */
+  gint64             next_time;   /* Время следующего выполнения. */
+  gint64             period;      /* Период повторения или 0. */
+  gboolean           running;     /* Признак выполнения команды. */
+  gboolean           removed;     /* Признак удаления запроса во время выполнения. */
+} HyScanScheduledQuery;
+
+/* Связь между запросами: запрос to ожидает выполнения запроса, которому принадлежит связь. */
+typedef struct
+{
+  guint              to;          /* Индекс зависимого запроса. */
+  guint              next;        /* Индекс следующей связи или HYSCAN_ASYNC_NO_EDGE. */
+} HyScanQueryEdge;
 
-/* Запрос - это команда плюс объект плюс данные. */
+/* Пакет запросов, выполняемых за один вызов hyscan_async_execute.
+ * Пакеты используются повторно, поэтому после прогрева память под запросы не выделяется. */
 typedef struct
 {
-  HyScanAsyncCommand command; /* Команда. */
-  gpointer           object;  /* Объект. */
-  gpointer           data;    /* Данные. */
-} HyScanQuery;
+  GList              link;        /* Элемент очереди пакетов, link.data указывает на пакет. */
+  GArray            *queries;     /* Массив запросов HyScanQuery. */
+  GByteArray        *data;        /* Буфер данных запросов. */
+
+  GArray            *edges;       /* Связи между запросами HyScanQueryEdge. */
+  GArray            *deps;        /* Идентификаторы запросов, от которых явно зависят запросы. */
+  GArray            *remap;       /* Индексы запросов после сортировки по индексам до сортировки. */
+  GHashTable        *ids;         /* Индексы запросов по идентификаторам. */
+  GArray            *free_tails;  /* Запросы без полосы после последнего барьера. */
+  GArray            *ready;       /* Двоичная куча индексов запросов, готовых к выполнению. */
+  GArray            *retries;     /* Индексы запросов, ожидающих повторного выполнения. */
+  GHashTable        *lane_tails;  /* Последние запросы полос после последнего барьера. */
+  GHashTable        *keys;        /* Индексы запросов по ключам объединения. */
+  guint              head;        /* Число вытесненных запросов в начале массива запросов. */
+  guint              n_running;   /* Число выполняющихся запросов. */
+  gboolean           prioritized; /* Признак наличия запросов с разными приоритетами. */
+  gboolean           owns_data;   /* Признак наличия данных, переданных во владение. */
+  gsize              garbage;     /* Объём данных и зависимостей удалённых и замещённых запросов. */
+  GCancellable      *cancellable; /* Объект отмены выполнения пакета. */
+  guint              n_cancelling; /* Число вызовов hyscan_async_cancel, отменяющих пакет. */
+  GSList            *tasks;       /* Задачи GTask, ожидающие выполнения пакета. */
+
+  gint64             start_time;    /* Время начала выполнения пакета. */
+  gint64             complete_time; /* Время завершения выполнения пакета. */
+
+  gboolean           abort;       /* Флаг прекращения выполнения пакета. */
+  gboolean           result;      /* Результат выполнения запросов (TRUE - успех, FALSE - ошибка). */
+} HyScanQueryBatch;
+
+enum
+{
+  PROP_O,
+  PROP_PIPELINE,
+  PROP_N_WORKERS,
+  PROP_COALESCE,
+  PROP_CONTINUE_ON_ERROR,
+  PROP_EXECUTOR,
+  PROP_SCHED_POLICY,
+  PROP_SCHED_PRIORITY,
+  PROP_CPU_AFFINITY,
+  PROP_MAX_ATTEMPTS,
+  PROP_RETRY_BACKOFF,
+  PROP_RETRY_BUDGET,
+  PROP_MAX_QUEUE_DEPTH,
+  PROP_OVERFLOW_POLICY,
+  PROP_QUEUE_PRESSURE,
+  PROP_N_BATCHES,
+  PROP_N_QUERIES,
+  PROP_N_FAILED,
+  PROP_QUEUE_DEPTH,
+  PROP_PEAK_QUEUE_DEPTH,
+  PROP_QUEUE_WAIT,
+  PROP_COMMAND_TIME,
+  PROP_COMMAND_TIME_MAX,
+  PROP_DELIVERY_DELAY,
+  PROP_SCHEDULE_JITTER
+};
 
 enum
 {
   SIGNAL_STARTED,
   SIGNAL_COMPLETED,
+  SIGNAL_QUEUE_PRESSURE,
   SIGNAL_LAST
 };
 
@@ -42,44 +152,250 @@ guint hyscan_async_signals[SIGNAL_LAST] = { 0 };
 
 struct _HyScanAsyncPrivate
 {
-  GList     *queries;             /* Очередь запросов. */
-
-  GThread   *sender;              /* Поток выполнения запросов. */
-  GMutex     mutex;               /* Мьютекс, для установки запроса на выполнение. */
-  GCond      cond;                /* Условие приостановки потока выполнения запросов. */
-
-  gint       busy;                /* Флаг, запрещающий выполнение новых запросов, пока не закончится выполнение текущих. */
-  gint       shutdown;            /* Флаг останова потока выполнения запросов. */
-
-  guint      timer_source_id;     /* Идентификатор таймера. */
-  gboolean   queries_ready;       /* Флаг готовности запросов к выполнению. */
-  gboolean   queries_completed;   /* Флаг завершения выполнения запросов. */
-  gboolean   queries_result;      /* Результат выполнения запроса (TRUE - успех, FALSE - ошибка). */
+  gboolean          pipeline;            /* Признак конвейерного режима. */
+  guint             n_workers;           /* Максимальное число одновременно выполняемых запросов. */
+  gboolean          coalesce;            /* Признак объединения запросов с одинаковым ключом. */
+  gboolean          continue_on_error;   /* Признак продолжения выполнения после ошибки. */
+  HyScanAsyncRetryPolicy retry;          /* Политика повторного выполнения по умолчанию. */
+  guint             max_queue_depth;     /* Максимальное число запросов в пакете или 0. */
+  HyScanAsyncOverflowPolicy overflow_policy; /* Политика переполнения пакета. */
+  gboolean          pressure;            /* Признак переполнения заполняемого пакета. */
+  gboolean          pressure_raised;     /* Признак переполнения после последнего сигнала. */
+  gboolean          pressure_reported;   /* Состояние переполнения, о котором сообщено сигналом. */
+
+  HyScanQueryBatch *filling;             /* Заполняемый пакет запросов. */
+  gboolean          filling_ready;       /* Флаг готовности заполняемого пакета к выполнению. */
+  HyScanQueryBatch *running;             /* Выполняемый пакет запросов. */
+  GQueue            completed;           /* Выполненные пакеты запросов. */
+  GQueue            spare;               /* Пакеты запросов для повторного использования. */
+  guint             n_active;            /* Число пакетов без сигнала "completed", изменяется атомарно. */
+  guint             next_id;             /* Идентификатор следующего запроса. */
+  GArray           *results;             /* Результаты выполнения запросов последнего пакета. */
+
+  HyScanAsyncStats  stats;               /* Статистика выполнения, изменяется атомарно. */
+  GHashTable       *command_stats;       /* Гистограммы времени выполнения команд. */
+
+  GPtrArray        *scheduled;           /* Запросы, выполняемые по расписанию. */
+
+  HyScanAsyncExecutor *executor;         /* Пул потоков выполнения запросов. */
+  HyScanAsyncSchedPolicy sched_policy;   /* Политика планирования потоков собственного пула. */
+  gint              sched_priority;      /* Приоритет потоков собственного пула. */
+  guint64           cpu_affinity;        /* Маска процессоров потоков собственного пула. */
+  HyScanAsyncExecutorClient *client;     /* Клиент пула потоков. */
+  GMutex            mutex;               /* Мьютекс, для установки запроса на выполнение. */
+  GMutex            filling_mutex;       /* Мьютекс заполняемого пакета и признаков переполнения. */
+  GCond             cond;                /* Условие завершения выполнения пакета. */
+
+  GMainContext     *context;             /* Контекст, в котором испускаются сигналы. */
+  GSource          *result_source;       /* Источник события завершения выполнения запросов. */
 };
 
-static void     hyscan_async_object_constructed (GObject        *object);
-static void     hyscan_async_object_finalize    (GObject        *object);
-
-static gboolean hyscan_async_is_busy            (HyScanAsync    *async);
-static gboolean hyscan_async_is_idle            (HyScanAsync    *async);
-static void     hyscan_async_set_busy           (HyScanAsync    *async);
-static void     hyscan_async_set_idle           (HyScanAsync    *async);
-static void     hyscan_async_shutdown           (HyScanAsync    *async);
-static gpointer hyscan_async_thread_func        (gpointer        object);
-static gboolean hyscan_async_result_func        (gpointer        object);
-
-static void     hyscan_async_query_free         (HyScanQuery    *query);
+static void     hyscan_async_set_property       (GObject            *object,
+                                                 guint               prop_id,
+                                                 const GValue       *value,
+                                                 GParamSpec         *pspec);
+static void     hyscan_async_get_property       (GObject            *object,
+                                                 guint               prop_id,
+                                                 GValue             *value,
+                                                 GParamSpec         *pspec);
+static void     hyscan_async_object_constructed (GObject            *object);
+static void     hyscan_async_object_finalize    (GObject            *object);
+
+static void     hyscan_async_step               (gpointer            object);
+static gboolean hyscan_async_result_func        (gpointer            object);
+static gboolean hyscan_async_source_dispatch    (GSource            *source,
+                                                 GSourceFunc         callback,
+                                                 gpointer            user_data);
+
+static gboolean hyscan_async_has_work           (HyScanAsyncPrivate *priv);
+static HyScanScheduledQuery *
+                hyscan_async_scheduled_next     (HyScanAsyncPrivate *priv);
+static void     hyscan_async_timers_arm         (HyScanAsyncPrivate *priv);
+static void     hyscan_async_scheduled_step     (HyScanAsyncPrivate *priv,
+                                                 HyScanScheduledQuery *scheduled);
+static void     hyscan_async_scheduled_free     (gpointer            data);
+static void     hyscan_async_batch_start        (HyScanAsyncPrivate *priv);
+static gboolean hyscan_async_batch_retry        (HyScanAsyncPrivate *priv,
+                                                 HyScanQueryBatch   *batch,
+                                                 guint               index);
+static void     hyscan_async_batch_retry_poll   (HyScanQueryBatch   *batch);
+static void     hyscan_async_batch_query_done   (HyScanAsyncPrivate *priv,
+                                                 HyScanQueryBatch   *batch,
+                                                 guint               index,
+                                                 HyScanAsyncQueryStatus status);
+static void     hyscan_async_batch_results      (HyScanAsyncPrivate *priv,
+                                                 HyScanQueryBatch   *batch);
+static void     hyscan_async_command_done       (HyScanAsyncPrivate *priv,
+                                                 HyScanAsyncCommand  command,
+                                                 HyScanAsyncQueryStatus status,
+                                                 gint64              time);
+static void     hyscan_async_result_clear       (gpointer            data);
+static GArray  *hyscan_async_results_copy       (GArray             *results);
+static gboolean hyscan_async_execute_real       (HyScanAsync        *async,
+                                                 GTask              *task);
+static void     hyscan_async_task_cancelled     (GCancellable       *cancellable,
+                                                 GCancellable       *batch_cancellable);
+static guint    hyscan_async_append_real        (HyScanAsync        *async,
+                                                 HyScanAsyncCommand  command,
+                                                 gpointer            object,
+                                                 gconstpointer       data,
+                                                 gsize               data_size,
+                                                 gpointer            taken,
+                                                 GDestroyNotify      destroy,
+                                                 const HyScanAsyncQueryOptions *options);
+
+static HyScanQueryBatch *
+                hyscan_async_batch_new          (void);
+static void     hyscan_async_batch_free         (HyScanQueryBatch   *batch);
+static void     hyscan_async_batch_clear        (HyScanQueryBatch   *batch);
+static void     hyscan_async_batch_add_edge     (HyScanQueryBatch   *batch,
+                                                 guint               from,
+                                                 guint               to);
+static guint    hyscan_async_batch_find_command (HyScanQueryBatch   *batch,
+                                                 HyScanAsyncCommand  command,
+                                                 gpointer            object);
+static gboolean hyscan_async_batch_can_replace  (HyScanQueryBatch   *batch,
+                                                 guint               replace,
+                                                 const HyScanAsyncQueryOptions *options);
+static void     hyscan_async_batch_drop_head    (HyScanQueryBatch   *batch,
+                                                 HyScanQuery        *dropped);
+static void     hyscan_async_batch_trim         (HyScanQueryBatch   *batch);
+static void     hyscan_async_batch_compact      (HyScanQueryBatch   *batch);
+static gint     hyscan_async_query_compare      (gconstpointer       a,
+                                                 gconstpointer       b);
+static guint    hyscan_async_query_key_hash     (guint64             key,
+                                                 gpointer            object);
+
+static void     hyscan_async_ready_push         (GArray             *ready,
+                                                 guint               index);
+static guint    hyscan_async_ready_pop          (GArray             *ready);
+
+/* Ошибка выполняемой в потоке команды. */
+static GPrivate hyscan_async_command_error = G_PRIVATE_INIT (NULL);
+
+/* Функции источника события завершения выполнения запросов. */
+static GSourceFuncs hyscan_async_source_funcs =
+{
+  NULL,                            /* prepare */
+  NULL,                            /* check */
+  hyscan_async_source_dispatch,    /* dispatch */
+  NULL,                            /* finalize */
+  NULL,
+  NULL
+};
 
 G_DEFINE_TYPE_WITH_PRIVATE (HyScanAsync, hyscan_async, G_TYPE_OBJECT)
 
+G_DEFINE_QUARK (hyscan-async-error-quark, hyscan_async_error)
+
 static void
 hyscan_async_class_init (HyScanAsyncClass *klass)
 {
   GObjectClass *obj_class = G_OBJECT_CLASS (klass);
 
+  obj_class->set_property = hyscan_async_set_property;
+  obj_class->get_property = hyscan_async_get_property;
   obj_class->constructed = hyscan_async_object_constructed;
   obj_class->finalize = hyscan_async_object_finalize;
 
+  g_object_class_install_property (obj_class, PROP_PIPELINE,
+    g_param_spec_boolean ("pipeline", "Pipeline", "Accept new queries while previous ones are executed",
+                          FALSE, G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (obj_class, PROP_N_WORKERS,
+    g_param_spec_uint ("n-workers", "NWorkers", "Maximum number of queries of different lanes executed in parallel",
+                       1, HYSCAN_ASYNC_EXECUTOR_MAX_WORKERS, 1, G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (obj_class, PROP_COALESCE,
+    g_param_spec_boolean ("coalesce", "Coalesce", "Replace pending queries having the same key",
+                          FALSE, G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (obj_class, PROP_CONTINUE_ON_ERROR,
+    g_param_spec_boolean ("continue-on-error", "ContinueOnError", "Execute independent queries after a failure",
+                          FALSE, G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (obj_class, PROP_EXECUTOR,
+    g_param_spec_object ("executor", "Executor", "Shared pool of worker threads",
+                         HYSCAN_TYPE_ASYNC_EXECUTOR, G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (obj_class, PROP_SCHED_POLICY,
+    g_param_spec_int ("sched-policy", "SchedPolicy", "Scheduling policy of own worker threads",
+                      HYSCAN_ASYNC_SCHED_DEFAULT, HYSCAN_ASYNC_SCHED_RR, HYSCAN_ASYNC_SCHED_DEFAULT,
+                      G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (obj_class, PROP_SCHED_PRIORITY,
+    g_param_spec_int ("sched-priority", "SchedPriority", "Real-time priority of own worker threads",
+                      0, 99, 0, G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (obj_class, PROP_CPU_AFFINITY,
+    g_param_spec_uint64 ("cpu-affinity", "CpuAffinity", "CPU mask of own worker threads, 0 - any CPU",
+                         0, G_MAXUINT64, 0, G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (obj_class, PROP_MAX_ATTEMPTS,
+    g_param_spec_uint ("max-attempts", "MaxAttempts", "Default maximum number of attempts to execute a query",
+                       1, G_MAXUINT, 1, G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (obj_class, PROP_RETRY_BACKOFF,
+    g_param_spec_int64 ("retry-backoff", "RetryBackoff", "Default delay before the second attempt, us",
+                        0, G_MAXINT64, 0, G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (obj_class, PROP_RETRY_BUDGET,
+    g_param_spec_int64 ("retry-budget", "RetryBudget", "Default time allowed for retries of a query, us, 0 - unlimited",
+                        0, G_MAXINT64, 0, G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (obj_class, PROP_MAX_QUEUE_DEPTH,
+    g_param_spec_uint ("max-queue-depth", "MaxQueueDepth", "Maximum number of queries in a batch, 0 - unlimited",
+                       0, G_MAXUINT, 0, G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (obj_class, PROP_OVERFLOW_POLICY,
+    g_param_spec_int ("overflow-policy", "OverflowPolicy", "HyScanAsyncOverflowPolicy applied to a full batch",
+                      HYSCAN_ASYNC_OVERFLOW_REJECT, HYSCAN_ASYNC_OVERFLOW_COALESCE, HYSCAN_ASYNC_OVERFLOW_REJECT,
+                      G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (obj_class, PROP_QUEUE_PRESSURE,
+    g_param_spec_boolean ("queue-pressure", "QueuePressure", "Filling batch has reached max-queue-depth",
+                          FALSE, G_PARAM_READABLE));
+
+  g_object_class_install_property (obj_class, PROP_N_BATCHES,
+    g_param_spec_uint ("n-batches", "NBatches", "Number of executed batches",
+                       0, G_MAXUINT, 0, G_PARAM_READABLE));
+
+  g_object_class_install_property (obj_class, PROP_N_QUERIES,
+    g_param_spec_uint ("n-queries", "NQueries", "Number of executed commands",
+                       0, G_MAXUINT, 0, G_PARAM_READABLE));
+
+  g_object_class_install_property (obj_class, PROP_N_FAILED,
+    g_param_spec_uint ("n-failed", "NFailed", "Number of failed commands",
+                       0, G_MAXUINT, 0, G_PARAM_READABLE));
+
+  g_object_class_install_property (obj_class, PROP_QUEUE_DEPTH,
+    g_param_spec_uint ("queue-depth", "QueueDepth", "Number of queries in the filling batch",
+                       0, G_MAXUINT, 0, G_PARAM_READABLE));
+
+  g_object_class_install_property (obj_class, PROP_PEAK_QUEUE_DEPTH,
+    g_param_spec_uint ("peak-queue-depth", "PeakQueueDepth", "Maximum number of queries in a batch",
+                       0, G_MAXUINT, 0, G_PARAM_READABLE));
+
+  g_object_class_install_property (obj_class, PROP_QUEUE_WAIT,
+    g_param_spec_double ("queue-wait", "QueueWait", "Mean time from append to batch start, us",
+                         0.0, G_MAXDOUBLE, 0.0, G_PARAM_READABLE));
+
+  g_object_class_install_property (obj_class, PROP_COMMAND_TIME,
+    g_param_spec_double ("command-time", "CommandTime", "Mean command execution time, us",
+                         0.0, G_MAXDOUBLE, 0.0, G_PARAM_READABLE));
+
+  g_object_class_install_property (obj_class, PROP_COMMAND_TIME_MAX,
+    g_param_spec_uint ("command-time-max", "CommandTimeMax", "Maximum command execution time, us",
+                       0, G_MAXUINT, 0, G_PARAM_READABLE));
+
+  g_object_class_install_property (obj_class, PROP_DELIVERY_DELAY,
+    g_param_spec_double ("delivery-delay", "DeliveryDelay", "Mean time from batch completion to signal, us",
+                         0.0, G_MAXDOUBLE, 0.0, G_PARAM_READABLE));
+
+  g_object_class_install_property (obj_class, PROP_SCHEDULE_JITTER,
+    g_param_spec_double ("schedule-jitter", "ScheduleJitter", "Mean delay of scheduled queries, us",
+                         0.0, G_MAXDOUBLE, 0.0, G_PARAM_READABLE));
+
   hyscan_async_signals[SIGNAL_STARTED] =
       g_signal_new ("started", HYSCAN_TYPE_ASYNC,
                     G_SIGNAL_RUN_LAST, 0, NULL, NULL,
@@ -91,6 +407,12 @@ hyscan_async_class_init (HyScanAsyncClass *klass)
                     G_SIGNAL_RUN_LAST, 0, NULL, NULL,
                     g_cclosure_marshal_VOID__BOOLEAN,
                     G_TYPE_NONE, 1, G_TYPE_BOOLEAN);
+
+  hyscan_async_signals[SIGNAL_QUEUE_PRESSURE] =
+      g_signal_new ("queue-pressure", HYSCAN_TYPE_ASYNC,
+                    G_SIGNAL_RUN_LAST, 0, NULL, NULL,
+                    g_cclosure_marshal_VOID__BOOLEAN,
+                    G_TYPE_NONE, 1, G_TYPE_BOOLEAN);
 }
 
 static void
@@ -98,18 +420,156 @@ hyscan_async_init (HyScanAsync *async)
 {
   HyScanAsyncPrivate *priv = hyscan_async_get_instance_private (async);
 
-  priv->sender = NULL;
   g_mutex_init (&priv->mutex);
+  g_mutex_init (&priv->filling_mutex);
   g_cond_init (&priv->cond);
 
-  priv->busy = HYSCAN_ASYNC_IDLE;
-  priv->queries_ready = FALSE;
-  priv->queries_completed = FALSE;
-  priv->queries = NULL;
+  priv->filling = hyscan_async_batch_new ();
+  priv->filling_ready = FALSE;
+  priv->running = NULL;
+  g_queue_init (&priv->completed);
+  g_queue_init (&priv->spare);
+  priv->n_active = 0;
+  priv->next_id = 1;
+  priv->results = g_array_new (FALSE, FALSE, sizeof (HyScanAsyncQueryResult));
+  g_array_set_clear_func (priv->results, hyscan_async_result_clear);
+  priv->command_stats = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+  priv->scheduled = g_ptr_array_new_with_free_func (hyscan_async_scheduled_free);
 
   async->priv = priv;
 }
 
+static void
+hyscan_async_set_property (GObject      *object,
+                           guint         prop_id,
+                           const GValue *value,
+                           GParamSpec   *pspec)
+{
+  HyScanAsync *async = HYSCAN_ASYNC (object);
+
+  switch (prop_id)
+    {
+    case PROP_PIPELINE:
+      async->priv->pipeline = g_value_get_boolean (value);
+      break;
+
+    case PROP_N_WORKERS:
+      async->priv->n_workers = g_value_get_uint (value);
+      break;
+
+    case PROP_COALESCE:
+      async->priv->coalesce = g_value_get_boolean (value);
+      break;
+
+    case PROP_CONTINUE_ON_ERROR:
+      async->priv->continue_on_error = g_value_get_boolean (value);
+      break;
+
+    case PROP_EXECUTOR:
+      async->priv->executor = g_value_dup_object (value);
+      break;
+
+    case PROP_SCHED_POLICY:
+      async->priv->sched_policy = g_value_get_int (value);
+      break;
+
+    case PROP_SCHED_PRIORITY:
+      async->priv->sched_priority = g_value_get_int (value);
+      break;
+
+    case PROP_CPU_AFFINITY:
+      async->priv->cpu_affinity = g_value_get_uint64 (value);
+      break;
+
+    case PROP_MAX_ATTEMPTS:
+      async->priv->retry.max_attempts = g_value_get_uint (value);
+      break;
+
+    case PROP_RETRY_BACKOFF:
+      async->priv->retry.backoff = g_value_get_int64 (value);
+      break;
+
+    case PROP_RETRY_BUDGET:
+      async->priv->retry.budget = g_value_get_int64 (value);
+      break;
+
+    case PROP_MAX_QUEUE_DEPTH:
+      async->priv->max_queue_depth = g_value_get_uint (value);
+      break;
+
+    case PROP_OVERFLOW_POLICY:
+      async->priv->overflow_policy = g_value_get_int (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
+static void
+hyscan_async_get_property (GObject    *object,
+                           guint       prop_id,
+                           GValue     *value,
+                           GParamSpec *pspec)
+{
+  HyScanAsync *async = HYSCAN_ASYNC (object);
+  HyScanAsyncPrivate *priv = async->priv;
+
+  switch (prop_id)
+    {
+    case PROP_QUEUE_PRESSURE:
+      g_mutex_lock (&priv->filling_mutex);
+      g_value_set_boolean (value, priv->pressure);
+      g_mutex_unlock (&priv->filling_mutex);
+      break;
+
+    case PROP_N_BATCHES:
+      g_value_set_uint (value, g_atomic_int_get (&priv->stats.n_batches));
+      break;
+
+    case PROP_N_QUERIES:
+      g_value_set_uint (value, g_atomic_int_get (&priv->stats.n_queries));
+      break;
+
+    case PROP_N_FAILED:
+      g_value_set_uint (value, g_atomic_int_get (&priv->stats.n_failed));
+      break;
+
+    case PROP_QUEUE_DEPTH:
+      g_mutex_lock (&priv->filling_mutex);
+      g_value_set_uint (value, priv->filling->queries->len - priv->filling->head);
+      g_mutex_unlock (&priv->filling_mutex);
+      break;
+
+    case PROP_PEAK_QUEUE_DEPTH:
+      g_value_set_uint (value, g_atomic_int_get (&priv->stats.peak_queue_depth));
+      break;
+
+    case PROP_QUEUE_WAIT:
+      g_value_set_double (value, hyscan_async_histogram_mean (&priv->stats.queue_wait));
+      break;
+
+    case PROP_COMMAND_TIME:
+      g_value_set_double (value, hyscan_async_histogram_mean (&priv->stats.command_time));
+      break;
+
+    case PROP_COMMAND_TIME_MAX:
+      g_value_set_uint (value, g_atomic_int_get (&priv->stats.command_time.max));
+      break;
+
+    case PROP_DELIVERY_DELAY:
+      g_value_set_double (value, hyscan_async_histogram_mean (&priv->stats.delivery_delay));
+      break;
+
+    case PROP_SCHEDULE_JITTER:
+      g_value_set_double (value, hyscan_async_histogram_mean (&priv->stats.schedule_jitter));
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    }
+}
+
 static void
 hyscan_async_object_constructed (GObject *object)
 {
@@ -118,9 +578,30 @@ hyscan_async_object_constructed (GObject *object)
 
   G_OBJECT_CLASS (hyscan_async_parent_class)->constructed (object);
 
-  /* Поток, в котором выполняются запросы. */
-  priv->shutdown = HYSCAN_ASYNC_CONTINUE;
-  priv->sender = g_thread_new (HYSCAN_ASYNC_THREAD_NAME, hyscan_async_thread_func, async);
+  /* Результат выполнения запросов доставляется в контекст, в котором создан объект.
+   * Поток выполнения запросов активирует источник сразу после завершения запросов. */
+  priv->context = g_main_context_ref_thread_default ();
+  priv->result_source = g_source_new (&hyscan_async_source_funcs, sizeof (GSource));
+  g_source_set_callback (priv->result_source, hyscan_async_result_func, async, NULL);
+  g_source_set_ready_time (priv->result_source, -1);
+  g_source_attach (priv->result_source, priv->context);
+
+  /* Запросы выполняются общим пулом потоков, либо собственным, если общий не задан.
+   * Число и параметры планирования потоков общего пула задаёт его владелец. */
+  if (priv->executor == NULL)
+    {
+      priv->executor = g_object_new (HYSCAN_TYPE_ASYNC_EXECUTOR,
+                                     "n-workers", priv->n_workers,
+                                     "sched-policy", priv->sched_policy,
+                                     "sched-priority", priv->sched_priority,
+                                     "cpu-affinity", priv->cpu_affinity,
+                                     NULL);
+    }
+  else if (priv->sched_policy != HYSCAN_ASYNC_SCHED_DEFAULT || priv->sched_priority != 0 || priv->cpu_affinity != 0)
+    {
+      g_warning ("HyScanAsync: sched-policy, sched-priority and cpu-affinity are ignored with a shared executor");
+    }
+  priv->client = hyscan_async_executor_attach (priv->executor, hyscan_async_step, async);
 }
 
 static void
@@ -128,215 +609,1814 @@ hyscan_async_object_finalize (GObject *object)
 {
   HyScanAsync *async = HYSCAN_ASYNC (object);
   HyScanAsyncPrivate *priv = async->priv;
+  GList *link;
+
+  hyscan_async_executor_detach (priv->executor, priv->client);
+  g_object_unref (priv->executor);
+
+  g_source_destroy (priv->result_source);
+  g_source_unref (priv->result_source);
+  g_main_context_unref (priv->context);
 
-  hyscan_async_shutdown (async);
+  hyscan_async_batch_free (priv->filling);
+  hyscan_async_batch_free (priv->running);
+  while ((link = g_queue_pop_head_link (&priv->completed)) != NULL)
+    hyscan_async_batch_free (link->data);
+  while ((link = g_queue_pop_head_link (&priv->spare)) != NULL)
+    hyscan_async_batch_free (link->data);
+  g_array_unref (priv->results);
+  g_hash_table_unref (priv->command_stats);
+  g_ptr_array_unref (priv->scheduled);
 
-  if (priv->timer_source_id)
-    g_source_remove (priv->timer_source_id);
-  
   g_mutex_clear (&priv->mutex);
+  g_mutex_clear (&priv->filling_mutex);
   g_cond_clear (&priv->cond);
 
   G_OBJECT_CLASS (hyscan_async_parent_class)->finalize (object);
 }
 
-/* Проверяет, что запросы выполняются, т.е. поток ЗАНЯТ выполнением запросов. */
-static gboolean
-hyscan_async_is_busy (HyScanAsync *async)
+/* Функция выполняет один готовый запрос. Вызывается в потоке пула потоков. */
+static void
+hyscan_async_step (gpointer object)
 {
-  return async->priv->busy == HYSCAN_ASYNC_BUSY;
-}
+  HyScanAsync *async = HYSCAN_ASYNC (object);
+  HyScanAsyncPrivate *priv = async->priv;
+  HyScanScheduledQuery *scheduled;
+  HyScanQueryBatch *batch;
+  HyScanQuery *query;
+  HyScanAsyncQueryStatus status;
+  gboolean retried = FALSE;
+  gpointer data;
+  gint64 time;
+  guint index;
 
-/* Проверяет, что запросы не выполняются, т.е. поток ОЖИДАЕТ выполнения запросов. */
-static gboolean
-hyscan_async_is_idle (HyScanAsync *async)
-{
-  return async->priv->busy == HYSCAN_ASYNC_IDLE;
-}
+  g_mutex_lock (&priv->mutex);
 
-/* Перевод в режим выполнения запроса. */
-static void
-hyscan_async_set_busy (HyScanAsync *async)
-{
-  if (hyscan_async_is_idle (async))
+  /* Запросы по расписанию выполняются в первую очередь. */
+  scheduled = hyscan_async_scheduled_next (priv);
+  if (scheduled != NULL && scheduled->next_time <= g_get_monotonic_time ())
     {
-      async->priv->busy = HYSCAN_ASYNC_BUSY;
-      g_signal_emit (async, hyscan_async_signals[SIGNAL_STARTED], 0);
+      hyscan_async_scheduled_step (priv, scheduled);
+      g_mutex_unlock (&priv->mutex);
+      return;
     }
-}
 
-/* Перевод в режим ожидания запроса. */
-static void
-hyscan_async_set_idle (HyScanAsync *async)
-{
-  if (hyscan_async_is_busy (async))
+  /* Запросы, время повторного выполнения которых наступило, становятся готовыми. */
+  if (priv->running != NULL)
+    hyscan_async_batch_retry_poll (priv->running);
+
+  if (!hyscan_async_has_work (priv))
     {
-      async->priv->busy = HYSCAN_ASYNC_IDLE;
-      g_signal_emit (async, hyscan_async_signals[SIGNAL_COMPLETED], 0,
-                     async->priv->queries_result);
+      hyscan_async_timers_arm (priv);
+      g_mutex_unlock (&priv->mutex);
+      return;
     }
-}
 
-/* Завершает поток отправки и выключает таймер опроса статуса. */
-static void
-hyscan_async_shutdown (HyScanAsync *async)
-{
-  HyScanAsyncPrivate *priv = async->priv;
+  if (priv->running == NULL)
+    hyscan_async_batch_start (priv);
 
-  g_atomic_int_set (&priv->shutdown, HYSCAN_ASYNC_SHUTDOWN);
-  g_cond_signal (&priv->cond);
-  g_thread_join (priv->sender);
-}
+  /* Очередной готовый запрос. Пока пакет выполняется, массив запросов не изменяется. */
+  batch = priv->running;
+  index = hyscan_async_ready_pop (batch->ready);
+  query = &g_array_index (batch->queries, HyScanQuery, index);
+  data = query->taken;
+  if (query->data_offset != HYSCAN_ASYNC_NO_DATA)
+    data = batch->data->data + query->data_offset;
 
-/* Функция выполняет запросы. */
-static gpointer
-hyscan_async_thread_func (gpointer object)
-{
-  HyScanAsync *async;
-  HyScanAsyncPrivate *priv;
+  /* Запросы отменённого пакета, запросы, зависящие от запросов с ошибкой,
+   * и запросы с истёкшим сроком не выполняются. */
+  if (g_cancellable_is_cancelled (batch->cancellable))
+    {
+      status = HYSCAN_ASYNC_QUERY_CANCELLED;
+    }
+  else if (query->blocked)
+    {
+      status = HYSCAN_ASYNC_QUERY_SKIPPED;
+    }
+  else if (query->deadline > 0 && g_get_monotonic_time () > query->deadline)
+    {
+      status = HYSCAN_ASYNC_QUERY_EXPIRED;
+    }
+  else
+    {
+      batch->n_running++;
+      if (query->attempt++ == 0)
+        query->first_time = g_get_monotonic_time ();
 
-  async = HYSCAN_ASYNC (object);
-  priv = async->priv;
+      /* Остальные готовые запросы могут выполняться в других потоках пула. */
+      if (hyscan_async_has_work (priv))
+        hyscan_async_executor_wakeup (priv->executor, priv->client);
 
-  while (g_atomic_int_get (&priv->shutdown) == HYSCAN_ASYNC_CONTINUE)
-    {
-      g_mutex_lock (&priv->mutex);
+      g_mutex_unlock (&priv->mutex);
 
-      if (priv->queries_completed || !priv->queries_ready)
-        {
-          gint64 end_time = g_get_monotonic_time () + HYSCAN_ASYNC_COND_WAIT_TIMEOUT;
-          g_cond_wait_until (&priv->cond, &priv->mutex, end_time);
-        }
+      /* Команда может получить объект отмены функцией g_cancellable_get_current
+       * и сообщить об ошибке функцией hyscan_async_set_command_error. */
+      g_cancellable_push_current (batch->cancellable);
+      g_private_set (&hyscan_async_command_error, &query->error);
+      time = g_get_monotonic_time ();
+      if ((*query->command) (query->object, data))
+        status = HYSCAN_ASYNC_QUERY_SUCCESS;
       else
-        {
-          GList *query_item = priv->queries;
-          priv->queries_result = TRUE;
+        status = HYSCAN_ASYNC_QUERY_FAILED;
+      time = g_get_monotonic_time () - time;
+      g_private_set (&hyscan_async_command_error, NULL);
+      g_cancellable_pop_current (batch->cancellable);
 
-          do
-            {
-              HyScanQuery *query = (HyScanQuery *) query_item->data;
-              /* Если одна из команд завершилась с ошибкой, остальные команды не выполняются. */
-              if (!(*query->command) (query->object, query->data))
-                {
-                  priv->queries_result = FALSE;
-                  break;
-                }
-            }
-          while (NULL != (query_item = g_list_next (query_item)));
+      g_mutex_lock (&priv->mutex);
+      batch->n_running--;
 
-          priv->queries_completed = TRUE;
-        }
+      /* Неудачная попытка, после которой запрос будет выполнен повторно, учитывается
+       * в статистике как выполненная команда, но не как ошибка. */
+      if (status == HYSCAN_ASYNC_QUERY_FAILED)
+        retried = hyscan_async_batch_retry (priv, batch, index);
 
-      g_mutex_unlock (&priv->mutex);
+      hyscan_async_command_done (priv, query->command,
+                                 retried ? HYSCAN_ASYNC_QUERY_PENDING : status, time);
+    }
+
+  if (!retried)
+    hyscan_async_batch_query_done (priv, batch, index, status);
+
+  /* Пакет выполнен, когда не осталось ни готовых, ни выполняющихся запросов,
+   * ни запросов, ожидающих повторного выполнения. */
+  if (batch->ready->len == 0 && batch->n_running == 0 && batch->retries->len == 0)
+    {
+      priv->running = NULL;
+      g_queue_push_tail_link (&priv->completed, &batch->link);
+
+      batch->complete_time = g_get_monotonic_time ();
+      hyscan_async_histogram_add (&priv->stats.batch_time, batch->complete_time - batch->start_time);
+      g_atomic_int_inc (&priv->stats.n_batches);
+
+      /* Немедленное уведомление контекста и потоков, ожидающих завершения выполнения запросов. */
+      g_source_set_ready_time (priv->result_source, 0);
+      g_cond_broadcast (&priv->cond);
     }
 
-  return NULL;
+  /* Разблокированные запросы или следующий пакет. */
+  if (hyscan_async_has_work (priv))
+    hyscan_async_executor_wakeup (priv->executor, priv->client);
+  hyscan_async_timers_arm (priv);
+
+  g_mutex_unlock (&priv->mutex);
 }
 
-/* Функция проверяет результат выполнения запросов. */
+/* Функция обрабатывает результат выполнения запросов. */
 static gboolean
 hyscan_async_result_func (gpointer object)
 {
   HyScanAsync *async = HYSCAN_ASYNC (object);
   HyScanAsyncPrivate *priv = async->priv;
+  GQueue completed = G_QUEUE_INIT;
+  GList *link;
+
+  gboolean pressure;
+  gboolean pressure_raised;
+
+  g_mutex_lock (&priv->mutex);
+  completed = priv->completed;
+  g_queue_init (&priv->completed);
+  g_mutex_unlock (&priv->mutex);
+
+  g_mutex_lock (&priv->filling_mutex);
+  pressure = priv->pressure;
+  pressure_raised = priv->pressure_raised;
+  priv->pressure_raised = FALSE;
+  g_mutex_unlock (&priv->filling_mutex);
+
+  /* О переполнении сообщается, даже если оно уже снято к моменту обработки. */
+  if (pressure_raised && !priv->pressure_reported)
+    {
+      priv->pressure_reported = TRUE;
+      g_signal_emit (async, hyscan_async_signals[SIGNAL_QUEUE_PRESSURE], 0, TRUE);
+    }
+  if (pressure != priv->pressure_reported)
+    {
+      priv->pressure_reported = pressure;
+      g_signal_emit (async, hyscan_async_signals[SIGNAL_QUEUE_PRESSURE], 0, pressure);
+    }
 
-  if (g_mutex_trylock (&priv->mutex))
+  /* Сигнал "completed" испускается для каждого выполненного пакета в порядке выполнения. */
+  while ((link = g_queue_pop_head_link (&completed)) != NULL)
     {
-      if (priv->queries_completed)
+      HyScanQueryBatch *batch = link->data;
+      gboolean result = batch->result;
+      GSList *tasks = batch->tasks;
+      GSList *task;
+
+      hyscan_async_batch_results (priv, batch);
+      hyscan_async_histogram_add (&priv->stats.delivery_delay, g_get_monotonic_time () - batch->complete_time);
+
+      /* Объекты отмены задач отключаются от пакета до его повторного использования. */
+      batch->tasks = NULL;
+      for (task = tasks; task != NULL; task = task->next)
         {
-          g_list_free_full (priv->queries, (GDestroyNotify) hyscan_async_query_free);
-          priv->queries = NULL;
-          priv->queries_ready = FALSE;
-          priv->queries_completed = FALSE;
+          GCancellable *cancellable = g_task_get_cancellable (task->data);
+          gulong handler = GPOINTER_TO_SIZE (g_task_get_task_data (task->data));
 
-          g_mutex_unlock (&priv->mutex);
+          if (cancellable != NULL)
+            g_cancellable_disconnect (cancellable, handler);
+        }
 
-          hyscan_async_set_idle (async);
+      /* Пакет очищается без освобождения памяти и возвращается для повторного использования. */
+      hyscan_async_batch_clear (batch);
 
-          priv->timer_source_id = 0;
+      g_mutex_lock (&priv->mutex);
 
-          return G_SOURCE_REMOVE;
+      /* Объект отмены не сбрасывается, а заменяется новым, если пакет был отменён или
+       * его ещё отменяет hyscan_async_cancel: иначе запоздавшая отмена попала бы
+       * в следующее выполнение пакета. */
+      if (batch->n_cancelling > 0 || g_cancellable_is_cancelled (batch->cancellable))
+        {
+          g_object_unref (batch->cancellable);
+          batch->cancellable = g_cancellable_new ();
         }
 
-        g_mutex_unlock (&priv->mutex);
+      g_queue_push_tail_link (&priv->spare, &batch->link);
+      g_atomic_int_add (&priv->n_active, -1);
+      g_mutex_unlock (&priv->mutex);
+
+      g_signal_emit (async, hyscan_async_signals[SIGNAL_COMPLETED], 0, result);
+
+      /* Задачи завершаются после сигнала, в порядке запуска. */
+      tasks = g_slist_reverse (tasks);
+      for (task = tasks; task != NULL; task = task->next)
+        {
+          g_task_return_pointer (task->data, hyscan_async_results_copy (priv->results),
+                                 (GDestroyNotify) g_array_unref);
+          g_object_unref (task->data);
+        }
+      g_slist_free (tasks);
     }
 
   return G_SOURCE_CONTINUE;
 }
 
-/* Освобождает память, распределенную под запрос. */
-static void
-hyscan_async_query_free (HyScanQuery *query)
+/* Функция обработки источника события завершения выполнения запросов. */
+static gboolean
+hyscan_async_source_dispatch (GSource     *source,
+                              GSourceFunc  callback,
+                              gpointer     user_data)
+{
+  /* Источник срабатывает однократно, до следующей активации потоком выполнения запросов. */
+  g_source_set_ready_time (source, -1);
+
+  return callback (user_data);
+}
+
+/* Проверяет наличие работы для потока выполнения запросов. Одновременно выполняется
+ * не более n-workers запросов. Вызывается под мьютексом. */
+static gboolean
+hyscan_async_has_work (HyScanAsyncPrivate *priv)
+{
+  if (priv->running != NULL)
+    return priv->running->ready->len > 0 && priv->running->n_running < priv->n_workers;
+
+  return priv->filling_ready;
+}
+
+/* Возвращает невыполняющийся запрос по расписанию с наименьшим временем выполнения.
+ * Вызывается под мьютексом. */
+static HyScanScheduledQuery *
+hyscan_async_scheduled_next (HyScanAsyncPrivate *priv)
 {
-  if (query != NULL)
+  HyScanScheduledQuery *next = NULL;
+  guint i;
+
+  /* Запросов по расписанию обычно немного, поэтому достаточно просмотра массива. */
+  for (i = 0; i < priv->scheduled->len; i++)
     {
-      g_free (query->data);
-      g_free (query);
+      HyScanScheduledQuery *scheduled = g_ptr_array_index (priv->scheduled, i);
+
+      if (!scheduled->running && (next == NULL || scheduled->next_time < next->next_time))
+        next = scheduled;
     }
+
+  return next;
 }
 
-/* Создаёт объект HyScanAsync. */
-HyScanAsync *
-hyscan_async_new (void)
+/* Запрашивает у пула потоков активацию к времени ближайшего запроса по расписанию
+ * или ближайшей повторной попытки выполнения запроса. Пул помнит только одно время
+ * активации, поэтому оно пересчитывается после каждого шага. Вызывается под мьютексом. */
+static void
+hyscan_async_timers_arm (HyScanAsyncPrivate *priv)
 {
-  return g_object_new (HYSCAN_TYPE_ASYNC, NULL);
+  HyScanScheduledQuery *next = hyscan_async_scheduled_next (priv);
+  gint64 wakeup_time = 0;
+  guint i;
+
+  if (next != NULL)
+    wakeup_time = next->next_time;
+
+  if (priv->running != NULL)
+    {
+      HyScanQueryBatch *batch = priv->running;
+
+      for (i = 0; i < batch->retries->len; i++)
+        {
+          HyScanQuery *query = &g_array_index (batch->queries, HyScanQuery,
+                                               g_array_index (batch->retries, guint, i));
+
+          if (wakeup_time == 0 || query->retry_time < wakeup_time)
+            wakeup_time = query->retry_time;
+        }
+    }
+
+  if (wakeup_time > 0)
+    hyscan_async_executor_wakeup_at (priv->executor, priv->client, wakeup_time);
 }
 
-/* Добавляет запрос в список. */
-gboolean
-hyscan_async_append_query (HyScanAsync        *async,
-                           HyScanAsyncCommand  command,
-                           gpointer            object,
-                           gconstpointer       data,
-                           gsize               data_size)
+/* Выполняет запрос по расписанию и планирует его следующее выполнение.
+ * Вызывается под мьютексом, команда выполняется без блокировки. */
+static void
+hyscan_async_scheduled_step (HyScanAsyncPrivate   *priv,
+                             HyScanScheduledQuery *scheduled)
 {
-  HyScanQuery *query;
+  GError *error = NULL;
+  gboolean result;
+  gint64 start;
+  gint64 time;
 
-  g_return_val_if_fail (HYSCAN_IS_ASYNC (async), FALSE);
+  scheduled->running = TRUE;
 
-  if (hyscan_async_is_busy (async) || (command == NULL))
-    return FALSE;
+  /* Остальные запросы могут выполняться в других потоках пула. */
+  hyscan_async_timers_arm (priv);
+  if (hyscan_async_has_work (priv))
+    hyscan_async_executor_wakeup (priv->executor, priv->client);
 
-  query = g_new0 (HyScanQuery, 1);
-  query->command = command;
-  query->object = object;
+  g_mutex_unlock (&priv->mutex);
 
-  if (data != NULL && data_size)
+  /* Отклонение от расписания - задержка начала выполнения команды. */
+  start = g_get_monotonic_time ();
+  hyscan_async_histogram_add (&priv->stats.schedule_jitter, start - scheduled->next_time);
+
+  /* Ошибки запросов по расписанию учитываются только в статистике. */
+  g_private_set (&hyscan_async_command_error, &error);
+  result = (*scheduled->command) (scheduled->object, scheduled->data);
+  g_private_set (&hyscan_async_command_error, NULL);
+  g_clear_error (&error);
+
+  time = g_get_monotonic_time ();
+
+  g_mutex_lock (&priv->mutex);
+
+  hyscan_async_command_done (priv, scheduled->command,
+                             result ? HYSCAN_ASYNC_QUERY_SUCCESS : HYSCAN_ASYNC_QUERY_FAILED,
+                             time - start);
+
+  scheduled->running = FALSE;
+
+  /* Следующее время отсчитывается от расписания, а не от фактического выполнения,
+   * поэтому задержки не накапливаются. Пропущенные периоды не выполняются. */
+  if (scheduled->period > 0 && !scheduled->removed)
+    {
+      scheduled->next_time += scheduled->period;
+      while (scheduled->next_time <= time)
+        {
+          scheduled->next_time += scheduled->period;
+          g_atomic_int_inc (&priv->stats.n_missed);
+        }
+    }
+  else
     {
-      query->data = g_malloc0 (data_size);
-      memcpy (query->data, data, data_size);
+      g_ptr_array_remove_fast (priv->scheduled, scheduled);
     }
 
-  async->priv->queries = g_list_append (async->priv->queries, (gpointer) query);
+  hyscan_async_timers_arm (priv);
+}
+
+/* Освобождает запрос по расписанию. */
+static void
+hyscan_async_scheduled_free (gpointer data)
+{
+  HyScanScheduledQuery *scheduled = data;
 
-  return TRUE;
+  g_free (scheduled->data);
+  g_free (scheduled);
 }
 
-/* Запускает выполнение списка запросов в отдельном потоке. */
-gboolean
-hyscan_async_execute (HyScanAsync *async)
+/* Забирает готовый пакет на выполнение и строит граф зависимостей запросов.
+ * Запросы одной полосы выполняются в порядке добавления, запросы барьерной полосы
+ * ожидают выполнения всех предыдущих запросов и задерживают все последующие.
+ * Вызывается под мьютексом. */
+static void
+hyscan_async_batch_start (HyScanAsyncPrivate *priv)
 {
-  HyScanAsyncPrivate *priv;
-  g_return_val_if_fail (HYSCAN_IS_ASYNC (async), FALSE);
+  HyScanQueryBatch *batch;
+  guint barrier = HYSCAN_ASYNC_NO_EDGE;
+  guint i;
+
+  /* Новые запросы попадают в следующий пакет. Забранный пакет больше не доступен
+   * добавляющим запросы потокам, поэтому дальше он обрабатывается без их мьютекса. */
+  g_mutex_lock (&priv->filling_mutex);
+  batch = priv->filling;
+  if (g_queue_is_empty (&priv->spare))
+    priv->filling = hyscan_async_batch_new ();
+  else
+    priv->filling = g_queue_pop_head_link (&priv->spare)->data;
+  priv->filling_ready = FALSE;
+
+  /* Новый пакет пуст, переполнение снимается. */
+  if (priv->pressure)
+    {
+      priv->pressure = FALSE;
+      g_source_set_ready_time (priv->result_source, 0);
+    }
+  g_mutex_unlock (&priv->filling_mutex);
 
-  priv = async->priv;
+  batch->result = TRUE;
+  batch->abort = FALSE;
+  batch->n_running = 0;
 
-  if (hyscan_async_is_busy (async) || (priv->queries == NULL))
-    return FALSE;
+  batch->start_time = g_get_monotonic_time ();
 
-  hyscan_async_set_busy (async);
+  /* Вытесненные запросы удаляются из пакета до построения графа выполнения. */
+  hyscan_async_batch_trim (batch);
 
-  g_mutex_lock (&priv->mutex);
+  /* Время ожидания отсчитывается от добавления каждого запроса. */
+  for (i = 0; i < batch->queries->len; i++)
+    {
+      HyScanQuery *query = &g_array_index (batch->queries, HyScanQuery, i);
 
-  priv->queries_ready = TRUE;
-  priv->queries_completed = FALSE;
+      hyscan_async_histogram_add (&priv->stats.queue_wait, batch->start_time - query->append_time);
+    }
 
-  g_cond_signal (&priv->cond);
-  g_mutex_unlock (&priv->mutex);
+  /* Явные зависимости заменяются индексами запросов. Запрос может зависеть только от ранее
+   * добавленных запросов пакета, остальные зависимости считаются выполненными. Запросы
+   * просматриваются от последнего к первому, поэтому приоритет зависимого запроса
+   * передаётся всей цепочке запросов, от которых он зависит. */
+  if (batch->deps->len > 0)
+    {
+      for (i = 0; i < batch->queries->len; i++)
+        {
+          HyScanQuery *query = &g_array_index (batch->queries, HyScanQuery, i);
 
-  /* Проверка результата выполнения запросов по таймауту. */
-  priv->timer_source_id = g_timeout_add (HYSCAN_ASYNC_RESULT_CHECK_TIMEOUT_MS,
-                                         hyscan_async_result_func, async);
+          query->order = i;
+          g_hash_table_insert (batch->ids, GUINT_TO_POINTER (query->id), GUINT_TO_POINTER (i + 1));
+        }
 
-  return TRUE;
+      for (i = batch->queries->len; i-- > 0;)
+        {
+          HyScanQuery *query = &g_array_index (batch->queries, HyScanQuery, i);
+          guint *deps = &g_array_index (batch->deps, guint, query->deps_offset);
+          guint j;
+
+          for (j = 0; j < query->n_deps; j++)
+            {
+              guint dep = GPOINTER_TO_UINT (g_hash_table_lookup (batch->ids, GUINT_TO_POINTER (deps[j])));
+              HyScanQuery *parent;
+
+              if (dep == 0 || dep - 1 >= i)
+                {
+                  deps[j] = HYSCAN_ASYNC_NO_EDGE;
+                  continue;
+                }
+
+              deps[j] = dep - 1;
+              parent = &g_array_index (batch->queries, HyScanQuery, dep - 1);
+              if (parent->priority > query->priority)
+                {
+                  parent->priority = query->priority;
+                  batch->prioritized = TRUE;
+                }
+            }
+        }
+    }
+
+  /* Запросы с более высоким приоритетом перемещаются в начало пакета. Сортировка
+   * устойчивая, поэтому запросы с равным приоритетом сохраняют порядок добавления.
+   * Благодаря передаче приоритета зависимости остаются перед зависимыми запросами. */
+  if (batch->prioritized)
+    g_array_sort (batch->queries, hyscan_async_query_compare);
+
+  if (batch->deps->len > 0)
+    {
+      g_array_set_size (batch->remap, batch->queries->len);
+      for (i = 0; i < batch->queries->len; i++)
+        {
+          HyScanQuery *query = &g_array_index (batch->queries, HyScanQuery, i);
+
+          g_array_index (batch->remap, guint, query->order) = i;
+        }
+    }
+
+  for (i = 0; i < batch->queries->len; i++)
+    {
+      HyScanQuery *query = &g_array_index (batch->queries, HyScanQuery, i);
+
+      query->n_pending = 0;
+      query->edge_head = HYSCAN_ASYNC_NO_EDGE;
+      query->status = HYSCAN_ASYNC_QUERY_PENDING;
+      query->blocked = FALSE;
+    }
+
+  for (i = 0; i < batch->queries->len; i++)
+    {
+      HyScanQuery *query = &g_array_index (batch->queries, HyScanQuery, i);
+      gpointer tail;
+      guint j;
+
+      if (query->lane == HYSCAN_ASYNC_LANE_BARRIER)
+        {
+          GHashTableIter iter;
+
+          /* Барьер ожидает последние запросы всех полос, все запросы без полосы,
+           * либо предыдущий барьер. */
+          g_hash_table_iter_init (&iter, batch->lane_tails);
+          while (g_hash_table_iter_next (&iter, NULL, &tail))
+            hyscan_async_batch_add_edge (batch, GPOINTER_TO_UINT (tail) - 1, i);
+
+          for (j = 0; j < batch->free_tails->len; j++)
+            hyscan_async_batch_add_edge (batch, g_array_index (batch->free_tails, guint, j), i);
+
+          if (query->n_pending == 0 && barrier != HYSCAN_ASYNC_NO_EDGE)
+            hyscan_async_batch_add_edge (batch, barrier, i);
+
+          g_hash_table_remove_all (batch->lane_tails);
+          g_array_set_size (batch->free_tails, 0);
+          barrier = i;
+        }
+      else if (query->lane == HYSCAN_ASYNC_LANE_NONE)
+        {
+          /* Запрос без полосы ожидает только последний барьер и свои зависимости. */
+          if (barrier != HYSCAN_ASYNC_NO_EDGE)
+            hyscan_async_batch_add_edge (batch, barrier, i);
+
+          g_array_append_val (batch->free_tails, i);
+        }
+      else
+        {
+          /* Запрос полосы ожидает предыдущий запрос этой полосы, либо последний барьер. */
+          tail = g_hash_table_lookup (batch->lane_tails, GUINT_TO_POINTER (query->lane));
+          if (tail != NULL)
+            hyscan_async_batch_add_edge (batch, GPOINTER_TO_UINT (tail) - 1, i);
+          else if (barrier != HYSCAN_ASYNC_NO_EDGE)
+            hyscan_async_batch_add_edge (batch, barrier, i);
+
+          g_hash_table_insert (batch->lane_tails, GUINT_TO_POINTER (query->lane), GUINT_TO_POINTER (i + 1));
+        }
+
+      /* Явные зависимости. После сортировки запросы, от которых зависит данный, стоят раньше. */
+      for (j = 0; j < query->n_deps; j++)
+        {
+          guint dep = g_array_index (batch->deps, guint, query->deps_offset + j);
+
+          if (dep != HYSCAN_ASYNC_NO_EDGE)
+            hyscan_async_batch_add_edge (batch, g_array_index (batch->remap, guint, dep), i);
+        }
+
+      if (query->n_pending == 0)
+        hyscan_async_ready_push (batch->ready, i);
+    }
+
+  priv->running = batch;
+}
+
+/* Планирует повторное выполнение запроса, завершившегося с ошибкой. Задержка перед
+ * каждой следующей попыткой вдвое больше предыдущей. Повтор не планируется, если
+ * попытки исчерпаны, пакет отменён или следующая попытка не укладывается в отведённое
+ * время или срок запроса. Вызывается под мьютексом. */
+static gboolean
+hyscan_async_batch_retry (HyScanAsyncPrivate *priv,
+                          HyScanQueryBatch   *batch,
+                          guint               index)
+{
+  HyScanQuery *query = &g_array_index (batch->queries, HyScanQuery, index);
+  gint64 retry_time;
+  gint64 backoff;
+  gint64 now;
+  guint shift;
+
+  if (query->attempt >= query->max_attempts || g_cancellable_is_cancelled (batch->cancellable))
+    return FALSE;
+
+  /* Задержка и время попытки ограничиваются G_MAXINT64, чтобы избежать переполнения. */
+  shift = MIN (query->attempt - 1, 16);
+  backoff = MAX (query->retry_backoff, 0);
+  backoff = (backoff > (G_MAXINT64 >> shift)) ? G_MAXINT64 : backoff << shift;
+  now = g_get_monotonic_time ();
+  retry_time = (backoff > G_MAXINT64 - now) ? G_MAXINT64 : now + backoff;
+  if (query->retry_budget > 0 && retry_time - query->first_time > query->retry_budget)
+    return FALSE;
+  if (query->deadline > 0 && retry_time > query->deadline)
+    return FALSE;
+
+  /* Ошибку сообщает только последняя попытка. */
+  g_clear_error (&query->error);
+
+  query->retry_time = retry_time;
+  g_array_append_val (batch->retries, index);
+  g_atomic_int_inc (&priv->stats.n_retries);
+
+  return TRUE;
+}
+
+/* Переносит запросы, время повторного выполнения которых наступило, в число готовых.
+ * Запросы отменённого пакета переносятся сразу, чтобы пакет завершился без ожидания.
+ * Вызывается под мьютексом. */
+static void
+hyscan_async_batch_retry_poll (HyScanQueryBatch *batch)
+{
+  gboolean cancelled;
+  gint64 now;
+  guint i;
+
+  if (batch->retries->len == 0)
+    return;
+
+  cancelled = g_cancellable_is_cancelled (batch->cancellable);
+  now = g_get_monotonic_time ();
+
+  for (i = 0; i < batch->retries->len;)
+    {
+      guint index = g_array_index (batch->retries, guint, i);
+      HyScanQuery *query = &g_array_index (batch->queries, HyScanQuery, index);
+
+      if (!cancelled && query->retry_time > now)
+        {
+          i++;
+          continue;
+        }
+
+      hyscan_async_ready_push (batch->ready, index);
+      g_array_remove_index_fast (batch->retries, i);
+    }
+}
+
+/* Обрабатывает результат выполнения запроса и разблокирует зависимые запросы.
+ * Вызывается под мьютексом. */
+static void
+hyscan_async_batch_query_done (HyScanAsyncPrivate     *priv,
+                               HyScanQueryBatch       *batch,
+                               guint                   index,
+                               HyScanAsyncQueryStatus  status)
+{
+  HyScanQuery *query = &g_array_index (batch->queries, HyScanQuery, index);
+  guint edge;
+
+  query->status = status;
+  if (status != HYSCAN_ASYNC_QUERY_SUCCESS)
+    batch->result = FALSE;
+
+  /* Если одна из команд завершилась с ошибкой или пакет отменён, невыполненные команды
+   * не выполняются. В режиме "continue-on-error" пропускаются только запросы, зависящие
+   * от запроса с ошибкой. Запрос с истёкшим сроком не мешает выполнению зависимых запросов. */
+  if ((status == HYSCAN_ASYNC_QUERY_FAILED && !priv->continue_on_error) ||
+      g_cancellable_is_cancelled (batch->cancellable))
+    {
+      batch->abort = TRUE;
+      g_array_set_size (batch->ready, 0);
+      g_array_set_size (batch->retries, 0);
+    }
+
+  if (batch->abort)
+    return;
+
+  for (edge = query->edge_head; edge != HYSCAN_ASYNC_NO_EDGE;)
+    {
+      HyScanQueryEdge *link = &g_array_index (batch->edges, HyScanQueryEdge, edge);
+      HyScanQuery *dependent = &g_array_index (batch->queries, HyScanQuery, link->to);
+
+      if (status == HYSCAN_ASYNC_QUERY_FAILED || status == HYSCAN_ASYNC_QUERY_SKIPPED)
+        dependent->blocked = TRUE;
+
+      if (--dependent->n_pending == 0)
+        hyscan_async_ready_push (batch->ready, link->to);
+
+      edge = link->next;
+    }
+}
+
+/* Формирует результаты выполнения запросов пакета. Запросы, до которых не дошло
+ * выполнение, считаются отменёнными, если пакет был отменён, или пропущенными из-за ошибки.
+ * Ошибки запросов переходят в массив результатов. */
+static void
+hyscan_async_batch_results (HyScanAsyncPrivate *priv,
+                            HyScanQueryBatch   *batch)
+{
+  gboolean cancelled = g_cancellable_is_cancelled (batch->cancellable);
+  guint i;
+
+  /* Ошибки предыдущего пакета освобождаются функцией очистки массива. */
+  g_array_set_size (priv->results, 0);
+  g_array_set_size (priv->results, batch->queries->len);
+
+  for (i = 0; i < batch->queries->len; i++)
+    {
+      HyScanQuery *query = &g_array_index (batch->queries, HyScanQuery, i);
+      HyScanAsyncQueryResult *result = &g_array_index (priv->results, HyScanAsyncQueryResult, i);
+
+      result->id = query->id;
+      result->status = query->status;
+      result->error = query->error;
+      query->error = NULL;
+
+      if (result->status == HYSCAN_ASYNC_QUERY_PENDING)
+        result->status = cancelled ? HYSCAN_ASYNC_QUERY_CANCELLED : HYSCAN_ASYNC_QUERY_SKIPPED;
+
+      /* Если команда не сообщила причину ошибки, описание формируется по состоянию запроса. */
+      if (result->error != NULL || result->status == HYSCAN_ASYNC_QUERY_SUCCESS)
+        continue;
+
+      switch (result->status)
+        {
+        case HYSCAN_ASYNC_QUERY_FAILED:
+          result->error = g_error_new (HYSCAN_ASYNC_ERROR, HYSCAN_ASYNC_ERROR_FAILED,
+                                       "query %u failed", result->id);
+          break;
+
+        case HYSCAN_ASYNC_QUERY_SKIPPED:
+          result->error = g_error_new (HYSCAN_ASYNC_ERROR, HYSCAN_ASYNC_ERROR_SKIPPED,
+                                       "query %u skipped due to a previous failure", result->id);
+          break;
+
+        case HYSCAN_ASYNC_QUERY_CANCELLED:
+          result->error = g_error_new (HYSCAN_ASYNC_ERROR, HYSCAN_ASYNC_ERROR_CANCELLED,
+                                       "query %u cancelled", result->id);
+          break;
+
+        case HYSCAN_ASYNC_QUERY_EXPIRED:
+          result->error = g_error_new (HYSCAN_ASYNC_ERROR, HYSCAN_ASYNC_ERROR_EXPIRED,
+                                       "query %u expired", result->id);
+          break;
+
+        default:
+          break;
+        }
+    }
+}
+
+/* Учитывает время выполнения команды в статистике. Вызывается под мьютексом,
+ * он нужен только для таблицы гистограмм команд, счётчики изменяются атомарно. */
+static void
+hyscan_async_command_done (HyScanAsyncPrivate     *priv,
+                           HyScanAsyncCommand      command,
+                           HyScanAsyncQueryStatus  status,
+                           gint64                  time)
+{
+  HyScanAsyncHistogram *command_stats;
+
+  command_stats = g_hash_table_lookup (priv->command_stats, command);
+  if (command_stats == NULL)
+    {
+      command_stats = g_new0 (HyScanAsyncHistogram, 1);
+      g_hash_table_insert (priv->command_stats, command, command_stats);
+    }
+
+  hyscan_async_histogram_add (command_stats, time);
+  hyscan_async_histogram_add (&priv->stats.command_time, time);
+
+  g_atomic_int_inc (&priv->stats.n_queries);
+  if (status == HYSCAN_ASYNC_QUERY_FAILED)
+    g_atomic_int_inc (&priv->stats.n_failed);
+}
+
+/* Освобождает ошибку результата выполнения запроса. */
+static void
+hyscan_async_result_clear (gpointer data)
+{
+  HyScanAsyncQueryResult *result = data;
+
+  g_clear_error (&result->error);
+}
+
+/* Создаёт копию массива результатов выполнения запросов. */
+static GArray *
+hyscan_async_results_copy (GArray *results)
+{
+  GArray *copy;
+  guint i;
+
+  copy = g_array_sized_new (FALSE, FALSE, sizeof (HyScanAsyncQueryResult), results->len);
+  g_array_set_clear_func (copy, hyscan_async_result_clear);
+  g_array_append_vals (copy, results->data, results->len);
+
+  for (i = 0; i < copy->len; i++)
+    {
+      HyScanAsyncQueryResult *result = &g_array_index (copy, HyScanAsyncQueryResult, i);
+
+      if (result->error != NULL)
+        result->error = g_error_copy (result->error);
+    }
+
+  return copy;
+}
+
+/* Отменяет выполнение пакета при отмене задачи. */
+static void
+hyscan_async_task_cancelled (GCancellable *cancellable,
+                             GCancellable *batch_cancellable)
+{
+  g_cancellable_cancel (batch_cancellable);
+}
+
+/* Создаёт пустой пакет запросов. */
+static HyScanQueryBatch *
+hyscan_async_batch_new (void)
+{
+  HyScanQueryBatch *batch;
+
+  batch = g_new0 (HyScanQueryBatch, 1);
+  batch->link.data = batch;
+  batch->queries = g_array_sized_new (FALSE, FALSE, sizeof (HyScanQuery), HYSCAN_ASYNC_PREALLOC_QUERIES);
+  batch->data = g_byte_array_sized_new (HYSCAN_ASYNC_PREALLOC_DATA);
+  batch->edges = g_array_sized_new (FALSE, FALSE, sizeof (HyScanQueryEdge), HYSCAN_ASYNC_PREALLOC_QUERIES);
+  batch->deps = g_array_new (FALSE, FALSE, sizeof (guint));
+  batch->remap = g_array_new (FALSE, FALSE, sizeof (guint));
+  batch->ids = g_hash_table_new (g_direct_hash, g_direct_equal);
+  batch->free_tails = g_array_new (FALSE, FALSE, sizeof (guint));
+  batch->ready = g_array_sized_new (FALSE, FALSE, sizeof (guint), HYSCAN_ASYNC_PREALLOC_QUERIES);
+  batch->retries = g_array_new (FALSE, FALSE, sizeof (guint));
+  batch->lane_tails = g_hash_table_new (g_direct_hash, g_direct_equal);
+  batch->keys = g_hash_table_new (g_direct_hash, g_direct_equal);
+  batch->cancellable = g_cancellable_new ();
+
+  return batch;
+}
+
+/* Освобождает память, распределенную под пакет запросов. */
+static void
+hyscan_async_batch_free (HyScanQueryBatch *batch)
+{
+  if (batch != NULL)
+    {
+      guint i;
+
+      for (i = 0; i < batch->queries->len; i++)
+        g_clear_error (&g_array_index (batch->queries, HyScanQuery, i).error);
+
+      hyscan_async_batch_clear (batch);
+
+      g_array_unref (batch->queries);
+      g_byte_array_unref (batch->data);
+      g_array_unref (batch->edges);
+      g_array_unref (batch->deps);
+      g_array_unref (batch->remap);
+      g_hash_table_unref (batch->ids);
+      g_array_unref (batch->free_tails);
+      g_array_unref (batch->ready);
+      g_array_unref (batch->retries);
+      g_hash_table_unref (batch->lane_tails);
+      g_hash_table_unref (batch->keys);
+      g_object_unref (batch->cancellable);
+      g_slist_free_full (batch->tasks, g_object_unref);
+      g_free (batch);
+    }
+}
+
+/* Очищает пакет запросов без освобождения памяти. */
+static void
+hyscan_async_batch_clear (HyScanQueryBatch *batch)
+{
+  /* Данные, переданные во владение, освобождаются независимо от того, выполнялся ли запрос. */
+  if (batch->owns_data)
+    {
+      guint i;
+
+      for (i = 0; i < batch->queries->len; i++)
+        {
+          HyScanQuery *query = &g_array_index (batch->queries, HyScanQuery, i);
+
+          if (query->destroy != NULL)
+            query->destroy (query->taken);
+        }
+
+      batch->owns_data = FALSE;
+    }
+
+  g_array_set_size (batch->queries, 0);
+  g_byte_array_set_size (batch->data, 0);
+  g_array_set_size (batch->edges, 0);
+  g_array_set_size (batch->deps, 0);
+  g_array_set_size (batch->remap, 0);
+  g_hash_table_remove_all (batch->ids);
+  g_array_set_size (batch->free_tails, 0);
+  g_array_set_size (batch->ready, 0);
+  g_array_set_size (batch->retries, 0);
+  g_hash_table_remove_all (batch->lane_tails);
+  g_hash_table_remove_all (batch->keys);
+  batch->head = 0;
+  batch->prioritized = FALSE;
+  batch->garbage = 0;
+}
+
+/* Добавляет зависимость запроса to от запроса from. */
+static void
+hyscan_async_batch_add_edge (HyScanQueryBatch *batch,
+                             guint             from,
+                             guint             to)
+{
+  HyScanQuery *query = &g_array_index (batch->queries, HyScanQuery, from);
+  HyScanQueryEdge edge;
+
+  edge.to = to;
+  edge.next = query->edge_head;
+  query->edge_head = batch->edges->len;
+  g_array_append_val (batch->edges, edge);
+
+  g_array_index (batch->queries, HyScanQuery, to).n_pending++;
+}
+
+/* Ищет последний запрос с той же командой и объектом. Возвращает индекс запроса,
+ * увеличенный на единицу, или 0. */
+static guint
+hyscan_async_batch_find_command (HyScanQueryBatch   *batch,
+                                 HyScanAsyncCommand  command,
+                                 gpointer            object)
+{
+  guint i;
+
+  for (i = batch->queries->len; i > batch->head; i--)
+    {
+      HyScanQuery *query = &g_array_index (batch->queries, HyScanQuery, i - 1);
+
+      if (query->command == command && query->object == object)
+        return i;
+    }
+
+  return 0;
+}
+
+/* Проверяет, может ли новый запрос занять место запроса с индексом replace - 1.
+ * Зависимости проверяются в пакете по порядку, поэтому на месте замещаемого запроса
+ * зависимости от него самого и от более поздних запросов были бы потеряны. */
+static gboolean
+hyscan_async_batch_can_replace (HyScanQueryBatch              *batch,
+                                guint                          replace,
+                                const HyScanAsyncQueryOptions *options)
+{
+  HyScanQuery *pending;
+  guint i;
+
+  if (replace == 0)
+    return FALSE;
+
+  if (options == NULL || options->depends_on == NULL)
+    return TRUE;
+
+  pending = &g_array_index (batch->queries, HyScanQuery, replace - 1);
+  for (i = 0; i < options->n_depends_on; i++)
+    {
+      if (options->depends_on[i] >= pending->id)
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Вытесняет самый старый запрос заполняемого пакета. Запрос остаётся в массиве,
+ * сдвигается только начало пакета, поэтому индексы остальных запросов в таблице
+ * ключей объединения не изменяются. Данные запроса остаются в буфере пакета
+ * до уплотнения, а данные, переданные во владение, освобождает вызывающий. */
+static void
+hyscan_async_batch_drop_head (HyScanQueryBatch *batch,
+                              HyScanQuery      *dropped)
+{
+  HyScanQuery *query = &g_array_index (batch->queries, HyScanQuery, batch->head);
+
+  *dropped = *query;
+
+  if (query->data_offset != HYSCAN_ASYNC_NO_DATA)
+    batch->garbage += query->data_size;
+  batch->garbage += query->n_deps * sizeof (guint);
+
+  if (query->key != 0)
+    {
+      gpointer hash = GUINT_TO_POINTER (hyscan_async_query_key_hash (query->key, query->object));
+
+      if (GPOINTER_TO_UINT (g_hash_table_lookup (batch->keys, hash)) == batch->head + 1)
+        g_hash_table_remove (batch->keys, hash);
+    }
+
+  /* Вытесненный запрос больше не ссылается на данные. */
+  query->data_offset = HYSCAN_ASYNC_NO_DATA;
+  query->n_deps = 0;
+  query->taken = NULL;
+  query->destroy = NULL;
+  batch->head++;
+
+  /* Вытесненные запросы удаляются из массива, когда их становится не меньше оставшихся,
+   * поэтому в среднем вытеснение выполняется за постоянное время. */
+  if (batch->head >= batch->queries->len - batch->head)
+    hyscan_async_batch_trim (batch);
+}
+
+/* Удаляет вытесненные запросы из начала массива запросов пакета. */
+static void
+hyscan_async_batch_trim (HyScanQueryBatch *batch)
+{
+  GHashTableIter iter;
+  gpointer index;
+  guint head = batch->head;
+
+  if (head == 0)
+    return;
+
+  g_array_remove_range (batch->queries, 0, head);
+  batch->head = 0;
+
+  /* Индексы запросов в таблице ключей объединения сдвигаются на число удалённых. */
+  g_hash_table_iter_init (&iter, batch->keys);
+  while (g_hash_table_iter_next (&iter, NULL, &index))
+    g_hash_table_iter_replace (&iter, GUINT_TO_POINTER (GPOINTER_TO_UINT (index) - head));
+}
+
+/* Переносит данные и зависимости запросов в новые буферы без данных удалённых
+ * и замещённых запросов. */
+static void
+hyscan_async_batch_compact (HyScanQueryBatch *batch)
+{
+  GByteArray *data;
+  GArray *deps;
+  guint i;
+
+  data = g_byte_array_sized_new (MAX (batch->data->len - batch->garbage, HYSCAN_ASYNC_PREALLOC_DATA));
+  deps = g_array_sized_new (FALSE, FALSE, sizeof (guint), batch->deps->len);
+
+  for (i = 0; i < batch->queries->len; i++)
+    {
+      HyScanQuery *query = &g_array_index (batch->queries, HyScanQuery, i);
+
+      if (query->data_offset != HYSCAN_ASYNC_NO_DATA)
+        {
+          gsize offset = (data->len + HYSCAN_ASYNC_DATA_ALIGN - 1) & ~((gsize) HYSCAN_ASYNC_DATA_ALIGN - 1);
+
+          g_byte_array_set_size (data, offset + query->data_size);
+          memcpy (data->data + offset, batch->data->data + query->data_offset, query->data_size);
+          query->data_offset = offset;
+        }
+
+      if (query->n_deps > 0)
+        {
+          guint offset = deps->len;
+
+          g_array_append_vals (deps, &g_array_index (batch->deps, guint, query->deps_offset), query->n_deps);
+          query->deps_offset = offset;
+        }
+    }
+
+  g_byte_array_unref (batch->data);
+  g_array_unref (batch->deps);
+  batch->data = data;
+  batch->deps = deps;
+  batch->garbage = 0;
+}
+
+/* Сравнивает запросы по приоритету. */
+static gint
+hyscan_async_query_compare (gconstpointer a,
+                            gconstpointer b)
+{
+  const HyScanQuery *query_a = a;
+  const HyScanQuery *query_b = b;
+
+  if (query_a->priority < query_b->priority)
+    return -1;
+  if (query_a->priority > query_b->priority)
+    return 1;
+
+  return 0;
+}
+
+/* Вычисляет значение хэша для ключа объединения запросов. При совпадении хэшей
+ * запросы дополнительно сравниваются по ключу и объекту. */
+static guint
+hyscan_async_query_key_hash (guint64  key,
+                             gpointer object)
+{
+  gsize hash;
+
+  hash = GPOINTER_TO_SIZE (object);
+  hash = (hash ^ (hash >> 16)) * 0x45d9f3b;
+  key = (key ^ (key >> 32)) * 2654435761u;
+
+  return (guint) hash ^ (guint) key;
+}
+
+/* Добавляет индекс запроса в кучу готовых запросов. Первым выполняется запрос
+ * с меньшим индексом, т.е. добавленный раньше. */
+static void
+hyscan_async_ready_push (GArray *ready,
+                         guint   index)
+{
+  guint *heap;
+  guint i;
+
+  g_array_append_val (ready, index);
+  heap = (guint *) ready->data;
+
+  for (i = ready->len - 1; i > 0 && heap[(i - 1) / 2] > heap[i]; i = (i - 1) / 2)
+    {
+      guint tmp = heap[i];
+      heap[i] = heap[(i - 1) / 2];
+      heap[(i - 1) / 2] = tmp;
+    }
+}
+
+/* Извлекает из кучи готовых запросов наименьший индекс запроса. */
+static guint
+hyscan_async_ready_pop (GArray *ready)
+{
+  guint *heap = (guint *) ready->data;
+  guint top = heap[0];
+  guint n, i;
+
+  n = ready->len - 1;
+  heap[0] = heap[n];
+  g_array_set_size (ready, n);
+
+  for (i = 0; ; )
+    {
+      guint min = i;
+      guint left = 2 * i + 1;
+      guint right = 2 * i + 2;
+      guint tmp;
+
+      if (left < n && heap[left] < heap[min])
+        min = left;
+      if (right < n && heap[right] < heap[min])
+        min = right;
+      if (min == i)
+        break;
+
+      tmp = heap[i];
+      heap[i] = heap[min];
+      heap[min] = tmp;
+      i = min;
+    }
+
+  return top;
+}
+
+/* Создаёт объект HyScanAsync. */
+HyScanAsync *
+hyscan_async_new (void)
+{
+  return g_object_new (HYSCAN_TYPE_ASYNC, NULL);
+}
+
+/* Добавляет запрос в список. */
+gboolean
+hyscan_async_append_query (HyScanAsync        *async,
+                           HyScanAsyncCommand  command,
+                           gpointer            object,
+                           gconstpointer       data,
+                           gsize               data_size)
+{
+  return hyscan_async_append_query_full (async, command, object, data, data_size, NULL) != 0;
+}
+
+/* Добавляет запрос в заполняемый пакет. Данные data копируются в буфер пакета,
+ * данные taken передаются во владение пакета. */
+static guint
+hyscan_async_append_real (HyScanAsync                   *async,
+                          HyScanAsyncCommand             command,
+                          gpointer                       object,
+                          gconstpointer                  data,
+                          gsize                          data_size,
+                          gpointer                       taken,
+                          GDestroyNotify                 destroy,
+                          const HyScanAsyncQueryOptions *options)
+{
+  HyScanAsyncPrivate *priv = async->priv;
+  const HyScanAsyncRetryPolicy *retry;
+  HyScanQueryBatch *batch;
+  HyScanQuery query;
+  HyScanQuery replaced = { 0 };
+  HyScanQuery dropped = { 0 };
+  gpointer hash = NULL;
+  guint replace = 0;
+
+  if (command == NULL)
+    {
+      if (destroy != NULL)
+        destroy (taken);
+      return 0;
+    }
+
+  query.command = command;
+  query.object = object;
+  query.data_offset = HYSCAN_ASYNC_NO_DATA;
+  query.data_size = 0;
+  query.taken = taken;
+  query.destroy = destroy;
+  query.deps_offset = 0;
+  query.n_deps = 0;
+  query.lane = (options != NULL) ? options->lane : HYSCAN_ASYNC_LANE_BARRIER;
+  query.priority = (options != NULL) ? options->priority : HYSCAN_ASYNC_PRIORITY_DEFAULT;
+  query.key = (options != NULL && priv->coalesce) ? options->key : 0;
+  query.deadline = (options != NULL) ? options->deadline : 0;
+  query.append_time = g_get_monotonic_time ();
+  query.status = HYSCAN_ASYNC_QUERY_PENDING;
+  query.error = NULL;
+
+  /* Политика повторного выполнения запроса или, если она не задана, объекта. */
+  retry = (options != NULL && options->retry.max_attempts > 0) ? &options->retry : &priv->retry;
+  query.max_attempts = MAX (retry->max_attempts, 1);
+  query.attempt = 0;
+  query.retry_backoff = retry->backoff;
+  query.retry_budget = retry->budget;
+
+  /* Запросы могут добавляться из любых потоков, а заполняемый пакет может быть забран
+   * потоком выполнения запросов в любой момент, поэтому всё остальное делается под
+   * мьютексом заполняемого пакета. Потоки выполнения запросов берут его только для
+   * замены пакета, поэтому добавление не ожидает завершения их шагов, а они - копирования
+   * данных. Отдельные очереди потоков, объединяемые при запуске, не используются:
+   * идентификатор, замещение и отклонение запроса определяются при добавлении и
+   * возвращаются вызывающему, поэтому решения разных потоков всё равно упорядочиваются. */
+  g_mutex_lock (&priv->filling_mutex);
+
+  /* Без конвейерного режима запросы не принимаются, пока выполняются предыдущие. */
+  if (!priv->pipeline && g_atomic_int_get (&priv->n_active) > 0)
+    {
+      g_mutex_unlock (&priv->filling_mutex);
+      if (destroy != NULL)
+        destroy (taken);
+      return 0;
+    }
+
+  batch = priv->filling;
+
+  /* Запрос с тем же ключом и объектом, ожидающий выполнения, заменяется новым независимо
+   * от команды. Замена не выполняется, если новый запрос зависит от замещаемого или более
+   * поздних запросов: на месте замещаемого запроса такие зависимости были бы потеряны. */
+  if (query.key != 0)
+    {
+      HyScanQuery *pending;
+
+      hash = GUINT_TO_POINTER (hyscan_async_query_key_hash (query.key, object));
+      replace = GPOINTER_TO_UINT (g_hash_table_lookup (batch->keys, hash));
+      pending = (replace > 0) ? &g_array_index (batch->queries, HyScanQuery, replace - 1) : NULL;
+
+      if (pending != NULL && (pending->key != query.key || pending->object != object))
+        replace = 0;
+
+      if (!hyscan_async_batch_can_replace (batch, replace, options))
+        replace = 0;
+    }
+
+  /* Переполненный пакет: новый запрос отклоняется, вытесняет самый старый запрос
+   * или заменяет последний запрос с той же командой и объектом. Замена запроса по ключу
+   * не увеличивает пакет и выполняется всегда. */
+  if (replace == 0 && priv->max_queue_depth > 0 && batch->queries->len - batch->head >= priv->max_queue_depth)
+    {
+      if (priv->overflow_policy == HYSCAN_ASYNC_OVERFLOW_DROP_OLDEST)
+        {
+          hyscan_async_batch_drop_head (batch, &dropped);
+          g_atomic_int_inc (&priv->stats.n_dropped);
+        }
+      else
+        {
+          if (priv->overflow_policy == HYSCAN_ASYNC_OVERFLOW_COALESCE)
+            replace = hyscan_async_batch_find_command (batch, command, object);
+
+          if (!hyscan_async_batch_can_replace (batch, replace, options))
+            replace = 0;
+
+          if (replace == 0)
+            {
+              g_atomic_int_inc (&priv->stats.n_rejected);
+              g_mutex_unlock (&priv->filling_mutex);
+              if (destroy != NULL)
+                destroy (taken);
+              return 0;
+            }
+        }
+    }
+
+  /* Данные копируются в буфер пакета с выравниванием. */
+  if (data != NULL && data_size)
+    {
+      query.data_offset = (batch->data->len + HYSCAN_ASYNC_DATA_ALIGN - 1) & ~((gsize) HYSCAN_ASYNC_DATA_ALIGN - 1);
+      query.data_size = data_size;
+      g_byte_array_set_size (batch->data, query.data_offset + data_size);
+      memcpy (batch->data->data + query.data_offset, data, data_size);
+    }
+
+  if (destroy != NULL)
+    batch->owns_data = TRUE;
+
+  /* Идентификаторы запросов, от которых зависит данный, хранятся в массиве пакета. */
+  if (options != NULL && options->n_depends_on > 0 && options->depends_on != NULL)
+    {
+      query.deps_offset = batch->deps->len;
+      query.n_deps = options->n_depends_on;
+      g_array_append_vals (batch->deps, options->depends_on, options->n_depends_on);
+    }
+
+  if (replace > 0)
+    {
+      HyScanQuery *pending = &g_array_index (batch->queries, HyScanQuery, replace - 1);
+
+      /* Замещённый запрос сохраняет своё место в пакете и идентификатор. Его данные
+       * остаются в буфере пакета до уплотнения, а данные, переданные во владение,
+       * освобождаются после снятия блокировки. */
+      replaced = *pending;
+      if (pending->data_offset != HYSCAN_ASYNC_NO_DATA)
+        batch->garbage += pending->data_size;
+      batch->garbage += pending->n_deps * sizeof (guint);
+
+      if (pending->priority != query.priority)
+        batch->prioritized = TRUE;
+
+      query.id = pending->id;
+      *pending = query;
+
+      if (hash != NULL)
+        g_hash_table_insert (batch->keys, hash, GUINT_TO_POINTER (replace));
+    }
+  else
+    {
+      if (hash != NULL)
+        g_hash_table_insert (batch->keys, hash, GUINT_TO_POINTER (batch->queries->len + 1));
+
+      /* Нулевой идентификатор означает ошибку. */
+      query.id = priv->next_id++;
+      if (priv->next_id == 0)
+        priv->next_id = 1;
+
+      /* Сортировка нужна, только если в пакете есть запросы с разными приоритетами. */
+      if (batch->queries->len > batch->head &&
+          g_array_index (batch->queries, HyScanQuery, batch->head).priority != query.priority)
+        {
+          batch->prioritized = TRUE;
+        }
+
+      g_array_append_val (batch->queries, query);
+
+      if (batch->queries->len - batch->head > priv->stats.peak_queue_depth)
+        g_atomic_int_set (&priv->stats.peak_queue_depth, batch->queries->len - batch->head);
+    }
+
+  /* Буфер уплотняется, когда данные удалённых и замещённых запросов занимают больше
+   * половины, поэтому при частой замене запросов память остаётся ограниченной. */
+  if (batch->garbage > HYSCAN_ASYNC_PREALLOC_DATA &&
+      batch->garbage > (batch->data->len + batch->deps->len * sizeof (guint)) / 2)
+    {
+      hyscan_async_batch_compact (batch);
+    }
+
+  /* О заполнении пакета сообщается в контексте объекта. */
+  if (priv->max_queue_depth > 0 && batch->queries->len - batch->head >= priv->max_queue_depth && !priv->pressure)
+    {
+      priv->pressure = TRUE;
+      priv->pressure_raised = TRUE;
+      g_source_set_ready_time (priv->result_source, 0);
+    }
+
+  g_mutex_unlock (&priv->filling_mutex);
+
+  if (replaced.destroy != NULL)
+    replaced.destroy (replaced.taken);
+  if (dropped.destroy != NULL)
+    dropped.destroy (dropped.taken);
+
+  return query.id;
+}
+
+/* Добавляет запрос с параметрами выполнения в список. */
+guint
+hyscan_async_append_query_full (HyScanAsync                   *async,
+                                HyScanAsyncCommand             command,
+                                gpointer                       object,
+                                gconstpointer                  data,
+                                gsize                          data_size,
+                                const HyScanAsyncQueryOptions *options)
+{
+  g_return_val_if_fail (HYSCAN_IS_ASYNC (async), 0);
+
+  return hyscan_async_append_real (async, command, object, data, data_size, NULL, NULL, options);
+}
+
+/* Добавляет запрос в список, передавая ему данные во владение. */
+guint
+hyscan_async_append_query_take (HyScanAsync                   *async,
+                                HyScanAsyncCommand             command,
+                                gpointer                       object,
+                                gpointer                       data,
+                                GDestroyNotify                 destroy,
+                                const HyScanAsyncQueryOptions *options)
+{
+  g_return_val_if_fail (HYSCAN_IS_ASYNC (async), 0);
+
+  return hyscan_async_append_real (async, command, object, NULL, 0, data, destroy, options);
+}
+
+/* Запускает выполнение списка запросов и связывает с ним задачу. */
+static gboolean
+hyscan_async_execute_real (HyScanAsync *async,
+                           GTask       *task)
+{
+  HyScanAsyncPrivate *priv = async->priv;
+  gboolean started;
+
+  g_mutex_lock (&priv->mutex);
+  g_mutex_lock (&priv->filling_mutex);
+
+  if ((!priv->pipeline && priv->n_active > 0) || (priv->filling->queries->len == priv->filling->head))
+    {
+      g_mutex_unlock (&priv->filling_mutex);
+      g_mutex_unlock (&priv->mutex);
+      return FALSE;
+    }
+
+  /* Задача завершается вместе с пакетом, её отмена отменяет пакет. */
+  if (task != NULL)
+    {
+      GCancellable *cancellable = g_task_get_cancellable (task);
+      gulong handler = 0;
+
+      if (cancellable != NULL)
+        {
+          handler = g_cancellable_connect (cancellable, G_CALLBACK (hyscan_async_task_cancelled),
+                                           priv->filling->cancellable, NULL);
+        }
+
+      g_task_set_task_data (task, GSIZE_TO_POINTER (handler), NULL);
+      priv->filling->tasks = g_slist_prepend (priv->filling->tasks, g_object_ref (task));
+    }
+
+  /* Пакет уже ожидает выполнения, добавленные запросы будут выполнены вместе с ним. */
+  started = !priv->filling_ready;
+  if (started)
+    {
+      priv->filling_ready = TRUE;
+      g_atomic_int_inc (&priv->n_active);
+
+      hyscan_async_executor_wakeup (priv->executor, priv->client);
+    }
+
+  g_mutex_unlock (&priv->filling_mutex);
+  g_mutex_unlock (&priv->mutex);
+
+  if (started)
+    g_signal_emit (async, hyscan_async_signals[SIGNAL_STARTED], 0);
+
+  return TRUE;
+}
+
+/* Запускает выполнение списка запросов в отдельном потоке. */
+gboolean
+hyscan_async_execute (HyScanAsync *async)
+{
+  g_return_val_if_fail (HYSCAN_IS_ASYNC (async), FALSE);
+
+  return hyscan_async_execute_real (async, NULL);
+}
+
+/* Асинхронно запускает выполнение списка запросов. */
+void
+hyscan_async_execute_async (HyScanAsync         *async,
+                            GMainContext        *context,
+                            GCancellable        *cancellable,
+                            GAsyncReadyCallback  callback,
+                            gpointer             user_data)
+{
+  GTask *task;
+
+  g_return_if_fail (HYSCAN_IS_ASYNC (async));
+
+  /* Задача завершается в контексте, который является контекстом по умолчанию при её создании. */
+  if (context != NULL)
+    g_main_context_push_thread_default (context);
+  task = g_task_new (async, cancellable, callback, user_data);
+  if (context != NULL)
+    g_main_context_pop_thread_default (context);
+
+  g_task_set_source_tag (task, hyscan_async_execute_async);
+
+  if (!hyscan_async_execute_real (async, task))
+    {
+      g_task_return_new_error (task, HYSCAN_ASYNC_ERROR, HYSCAN_ASYNC_ERROR_NOT_STARTED,
+                               "no queries to execute or previous queries are still executed");
+    }
+
+  g_object_unref (task);
+}
+
+/* Завершает асинхронное выполнение списка запросов. */
+GArray *
+hyscan_async_execute_finish (HyScanAsync   *async,
+                             GAsyncResult  *result,
+                             GError       **error)
+{
+  g_return_val_if_fail (HYSCAN_IS_ASYNC (async), NULL);
+  g_return_val_if_fail (g_task_is_valid (result, async), NULL);
+
+  return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/* Отменяет выполнение запросов. */
+void
+hyscan_async_cancel (HyScanAsync *async)
+{
+  HyScanAsyncPrivate *priv;
+  HyScanQueryBatch *running;
+  HyScanQueryBatch *ready;
+  GCancellable *running_cancellable = NULL;
+  GCancellable *ready_cancellable = NULL;
+
+  g_return_if_fail (HYSCAN_IS_ASYNC (async));
+
+  priv = async->priv;
+
+  /* Пока счётчик n_cancelling пакета не равен нулю, выполненный пакет не использует
+   * свой объект отмены повторно (см. hyscan_async_result_func). */
+  g_mutex_lock (&priv->mutex);
+  running = priv->running;
+  ready = priv->filling_ready ? priv->filling : NULL;
+  if (running != NULL)
+    {
+      running->n_cancelling++;
+      running_cancellable = g_object_ref (running->cancellable);
+    }
+  if (ready != NULL)
+    {
+      ready->n_cancelling++;
+      ready_cancellable = g_object_ref (ready->cancellable);
+    }
+  g_mutex_unlock (&priv->mutex);
+
+  /* Обработчики сигнала "cancelled" вызываются без блокировки мьютекса. Запросы,
+   * ожидающие повторного выполнения, завершаются при следующем шаге. */
+  if (running_cancellable != NULL)
+    {
+      g_cancellable_cancel (running_cancellable);
+      g_object_unref (running_cancellable);
+      hyscan_async_executor_wakeup (priv->executor, priv->client);
+    }
+  if (ready_cancellable != NULL)
+    {
+      g_cancellable_cancel (ready_cancellable);
+      g_object_unref (ready_cancellable);
+    }
+
+  g_mutex_lock (&priv->mutex);
+  if (running != NULL)
+    running->n_cancelling--;
+  if (ready != NULL)
+    ready->n_cancelling--;
+  g_mutex_unlock (&priv->mutex);
+}
+
+/* Возвращает результаты выполнения запросов последнего выполненного пакета. */
+const HyScanAsyncQueryResult *
+hyscan_async_get_results (HyScanAsync *async,
+                          guint       *n_results)
+{
+  g_return_val_if_fail (HYSCAN_IS_ASYNC (async), NULL);
+
+  if (n_results != NULL)
+    *n_results = async->priv->results->len;
+
+  return (const HyScanAsyncQueryResult *) async->priv->results->data;
+}
+
+/* Передаёт ошибку выполняемой команды. */
+void
+hyscan_async_set_command_error (GError *error)
+{
+  GError **command_error;
+
+  g_return_if_fail (error != NULL);
+
+  command_error = g_private_get (&hyscan_async_command_error);
+  if (command_error == NULL)
+    {
+      g_warning ("HyScanAsync: error can be set only by a command");
+      g_error_free (error);
+      return;
+    }
+
+  g_clear_error (command_error);
+  *command_error = error;
+}
+
+/* Ожидает завершения выполнения запущенных запросов. */
+gboolean
+hyscan_async_wait (HyScanAsync *async,
+                   gint64       timeout)
+{
+  HyScanAsyncPrivate *priv;
+  gint64 end_time;
+
+  g_return_val_if_fail (HYSCAN_IS_ASYNC (async), FALSE);
+
+  priv = async->priv;
+  end_time = g_get_monotonic_time () + timeout;
+
+  g_mutex_lock (&priv->mutex);
+  while (priv->running != NULL || priv->filling_ready)
+    {
+      if (timeout < 0)
+        {
+          g_cond_wait (&priv->cond, &priv->mutex);
+        }
+      else if (!g_cond_wait_until (&priv->cond, &priv->mutex, end_time))
+        {
+          g_mutex_unlock (&priv->mutex);
+          return FALSE;
+        }
+    }
+  g_mutex_unlock (&priv->mutex);
+
+  return TRUE;
+}
+
+/* Доставляет результаты выполненных пакетов в вызывающем потоке. */
+gboolean
+hyscan_async_dispatch (HyScanAsync *async)
+{
+  HyScanAsyncPrivate *priv;
+
+  g_return_val_if_fail (HYSCAN_IS_ASYNC (async), FALSE);
+
+  priv = async->priv;
+
+  /* Результаты доставляются только владельцем контекста объекта, как и при обработке
+   * источника событий, поэтому сигналы не испускаются одновременно из разных потоков. */
+  if (!g_main_context_acquire (priv->context))
+    return FALSE;
+
+  g_source_set_ready_time (priv->result_source, -1);
+  hyscan_async_result_func (async);
+  g_main_context_release (priv->context);
+
+  return TRUE;
+}
+
+/* Добавляет запрос, выполняемый по расписанию. */
+guint
+hyscan_async_schedule_query (HyScanAsync        *async,
+                             HyScanAsyncCommand  command,
+                             gpointer            object,
+                             gconstpointer       data,
+                             gsize               data_size,
+                             gint64              start_time,
+                             gint64              period)
+{
+  HyScanAsyncPrivate *priv;
+  HyScanScheduledQuery *scheduled;
+
+  g_return_val_if_fail (HYSCAN_IS_ASYNC (async), 0);
+
+  priv = async->priv;
+
+  if (command == NULL || period < 0)
+    return 0;
+
+  scheduled = g_new0 (HyScanScheduledQuery, 1);
+  scheduled->command = command;
+  scheduled->object = object;
+  scheduled->next_time = start_time;
+  scheduled->period = period;
+
+  if (data != NULL && data_size)
+    {
+      scheduled->data = g_malloc (data_size);
+      memcpy (scheduled->data, data, data_size);
+    }
+
+  g_mutex_lock (&priv->mutex);
+
+  /* Идентификаторы запросов выделяются под мьютексом заполняемого пакета. */
+  g_mutex_lock (&priv->filling_mutex);
+  scheduled->id = priv->next_id++;
+  if (priv->next_id == 0)
+    priv->next_id = 1;
+  g_mutex_unlock (&priv->filling_mutex);
+
+  g_ptr_array_add (priv->scheduled, scheduled);
+  hyscan_async_executor_wakeup_at (priv->executor, priv->client, start_time);
+
+  g_mutex_unlock (&priv->mutex);
+
+  return scheduled->id;
+}
+
+/* Удаляет запрос, выполняемый по расписанию. */
+gboolean
+hyscan_async_unschedule_query (HyScanAsync *async,
+                               guint        id)
+{
+  HyScanAsyncPrivate *priv;
+  gboolean found = FALSE;
+  guint i;
+
+  g_return_val_if_fail (HYSCAN_IS_ASYNC (async), FALSE);
+
+  priv = async->priv;
+
+  g_mutex_lock (&priv->mutex);
+
+  for (i = 0; i < priv->scheduled->len; i++)
+    {
+      HyScanScheduledQuery *scheduled = g_ptr_array_index (priv->scheduled, i);
+
+      if (scheduled->id != id || scheduled->removed)
+        continue;
+
+      /* Выполняющийся запрос удаляется после завершения команды. */
+      if (scheduled->running)
+        scheduled->removed = TRUE;
+      else
+        g_ptr_array_remove_index_fast (priv->scheduled, i);
+
+      found = TRUE;
+      break;
+    }
+
+  g_mutex_unlock (&priv->mutex);
+
+  return found;
+}
+
+/* Возвращает статистику выполнения запросов. */
+void
+hyscan_async_get_stats (HyScanAsync      *async,
+                        HyScanAsyncStats *stats)
+{
+  HyScanAsyncPrivate *priv;
+
+  g_return_if_fail (HYSCAN_IS_ASYNC (async));
+  g_return_if_fail (stats != NULL);
+
+  priv = async->priv;
+
+  stats->n_batches = g_atomic_int_get (&priv->stats.n_batches);
+  stats->n_queries = g_atomic_int_get (&priv->stats.n_queries);
+  stats->n_failed = g_atomic_int_get (&priv->stats.n_failed);
+  stats->peak_queue_depth = g_atomic_int_get (&priv->stats.peak_queue_depth);
+  hyscan_async_histogram_copy (&priv->stats.queue_wait, &stats->queue_wait);
+  hyscan_async_histogram_copy (&priv->stats.batch_time, &stats->batch_time);
+  hyscan_async_histogram_copy (&priv->stats.command_time, &stats->command_time);
+  hyscan_async_histogram_copy (&priv->stats.delivery_delay, &stats->delivery_delay);
+  stats->n_missed = g_atomic_int_get (&priv->stats.n_missed);
+  stats->n_rejected = g_atomic_int_get (&priv->stats.n_rejected);
+  stats->n_dropped = g_atomic_int_get (&priv->stats.n_dropped);
+  stats->n_retries = g_atomic_int_get (&priv->stats.n_retries);
+  hyscan_async_histogram_copy (&priv->stats.schedule_jitter, &stats->schedule_jitter);
+}
+
+/* Возвращает гистограмму времени выполнения команды. */
+gboolean
+hyscan_async_get_command_stats (HyScanAsync          *async,
+                                HyScanAsyncCommand    command,
+                                HyScanAsyncHistogram *stats)
+{
+  HyScanAsyncPrivate *priv;
+  HyScanAsyncHistogram *command_stats;
+
+  g_return_val_if_fail (HYSCAN_IS_ASYNC (async), FALSE);
+  g_return_val_if_fail (stats != NULL, FALSE);
+
+  priv = async->priv;
+
+  /* Гистограммы команд не удаляются до уничтожения объекта, поэтому копируются без блокировки. */
+  g_mutex_lock (&priv->mutex);
+  command_stats = g_hash_table_lookup (priv->command_stats, command);
+  g_mutex_unlock (&priv->mutex);
+
+  if (command_stats == NULL)
+    {
+      memset (stats, 0, sizeof (HyScanAsyncHistogram));
+      return FALSE;
+    }
+
+  hyscan_async_histogram_copy (command_stats, stats);
+
+  return stats->count > 0;
+}
+
+/* Сбрасывает статистику выполнения запросов. */
+void
+hyscan_async_reset_stats (HyScanAsync *async)
+{
+  HyScanAsyncPrivate *priv;
+  GHashTableIter iter;
+  gpointer command_stats;
+
+  g_return_if_fail (HYSCAN_IS_ASYNC (async));
+
+  priv = async->priv;
+
+  g_atomic_int_set (&priv->stats.n_batches, 0);
+  g_atomic_int_set (&priv->stats.n_queries, 0);
+  g_atomic_int_set (&priv->stats.n_failed, 0);
+  g_atomic_int_set (&priv->stats.peak_queue_depth, 0);
+  hyscan_async_histogram_reset (&priv->stats.queue_wait);
+  hyscan_async_histogram_reset (&priv->stats.batch_time);
+  hyscan_async_histogram_reset (&priv->stats.command_time);
+  hyscan_async_histogram_reset (&priv->stats.delivery_delay);
+  g_atomic_int_set (&priv->stats.n_missed, 0);
+  g_atomic_int_set (&priv->stats.n_rejected, 0);
+  g_atomic_int_set (&priv->stats.n_dropped, 0);
+  g_atomic_int_set (&priv->stats.n_retries, 0);
+  hyscan_async_histogram_reset (&priv->stats.schedule_jitter);
+
+  g_mutex_lock (&priv->mutex);
+  g_hash_table_iter_init (&iter, priv->command_stats);
+  while (g_hash_table_iter_next (&iter, NULL, &command_stats))
+    hyscan_async_histogram_reset (command_stats);
+  g_mutex_unlock (&priv->mutex);
 }
@@ -31,19 +31,178 @@
  *
  * Сигнал "completed" вернет в результате TRUE только в случае, если все запросы будут успешно
  * выполнены (т.е. команды вернут TRUE). Если команда из списка вернёт FALSE, выполнение запросов
- * прекращается, результатом выполнения запросов будет FALSE.
+ * прекращается (уже начатые команды других полос завершаются), результатом выполнения
+ * запросов будет FALSE. Со свойством "continue-on-error" после ошибки пропускаются только
+ * запросы, зависящие от запроса с ошибкой. Команда может сообщить причину ошибки функцией
+ * #hyscan_async_set_command_error, состояние каждого запроса возвращает функция
+ * #hyscan_async_get_results.
+ *
+ * Запросы выполняются потоками пула \link HyScanAsyncExecutor \endlink: собственного,
+ * из "n-workers" потоков, или общего для нескольких объектов (свойство "executor").
+ * По умолчанию запросы выполняются последовательно в порядке добавления. Функция
+ * #hyscan_async_append_query_full позволяет задать полосу, приоритет, зависимости, ключ
+ * объединения, срок и политику повторов запроса (см. \link HyScanAsyncQueryOptions \endlink).
+ * Поведение объекта настраивается свойствами, задаваемыми при создании: "pipeline" -
+ * приём запросов во время выполнения предыдущих, "coalesce" - замена запросов с одинаковым
+ * ключом, "max-queue-depth" и "overflow-policy" - ограничение пакета, "max-attempts",
+ * "retry-backoff" и "retry-budget" - политика повторов по умолчанию.
+ *
+ * Когда пакет заполняется до "max-queue-depth", испускается сигнал "queue-pressure"
+ * со значением TRUE, а когда пакет забирается на выполнение - со значением FALSE.
+ *
+ * Прототип обработчика сигнала "queue-pressure":
+ * \code
+ * void queue_pressure_cb (HyScanAsync *async,
+ *                         gboolean     pressure,
+ *                         gpointer     user_data);
+ * \endcode
+ *
+ * Функции добавления и запуска запросов, а также функции #hyscan_async_cancel и
+ * #hyscan_async_wait можно вызывать одновременно из разных потоков. Сигналы "completed"
+ * и "queue-pressure" испускаются в контексте GMainContext, который был контекстом по
+ * умолчанию (g_main_context_get_thread_default) для потока, создавшего объект, сигнал
+ * "started" - в потоке, запустившем выполнение. Без главного цикла результаты доставляются
+ * функцией #hyscan_async_dispatch.
  *
  */
 
 #ifndef __HYSCAN_ASYNC_H__
 #define __HYSCAN_ASYNC_H__
 
-#include <glib-object.h>
+#include <gio/gio.h>
 #include <hyscan-api.h>
+#include "hyscan-async-executor.h"
+#include "hyscan-async-histogram.h"
 
 /** Асинхронная команда. */
 typedef gboolean (*HyScanAsyncCommand) (gpointer object, gpointer data);
 
+/** Барьерная полоса выполнения запросов. */
+#define HYSCAN_ASYNC_LANE_BARRIER     (0)
+
+/** Запрос вне полос: выполняется после последнего барьера и своих зависимостей. */
+#define HYSCAN_ASYNC_LANE_NONE        (G_MAXUINT)
+
+/** Приоритеты запросов. Как и в GLib, меньшее значение соответствует более высокому приоритету. */
+#define HYSCAN_ASYNC_PRIORITY_HIGH    (-100)
+#define HYSCAN_ASYNC_PRIORITY_DEFAULT (0)
+#define HYSCAN_ASYNC_PRIORITY_LOW     (100)
+
+/**
+ * Политика повторного выполнения запроса, команда которого вернула FALSE из-за
+ * кратковременного сбоя. Задержка перед каждой следующей попыткой вдвое больше
+ * предыдущей. Повторная попытка выполняется потоком пула после задержки: пока запрос
+ * ожидает повтора, зависящие от него запросы не выполняются, а остальные запросы пакета
+ * продолжают выполняться. Ошибкой запрос считается, только если не удалась последняя
+ * попытка. Повторять следует только команды, повторное выполнение которых безопасно.
+ */
+typedef struct
+{
+  guint        max_attempts;  /**< Максимальное число попыток или 0 - политика объекта. */
+  gint64       backoff;       /**< Задержка перед второй попыткой, мкс. */
+  gint64       budget;        /**< Наибольшее время от начала первой попытки до начала последней, мкс, или 0. */
+} HyScanAsyncRetryPolicy;
+
+/**
+ * Параметры выполнения запроса.
+ *
+ * Запросы одной полосы выполняются строго в порядке добавления, запросы разных полос
+ * могут выполняться одновременно (до "n-workers" запросов). Запрос барьерной полосы
+ * #HYSCAN_ASYNC_LANE_BARRIER выполняется после всех ранее добавленных запросов, а все
+ * последующие запросы - после него. Запрос полосы #HYSCAN_ASYNC_LANE_NONE упорядочивается
+ * только барьерами и своими зависимостями.
+ *
+ * Зависимости depends_on - идентификаторы ранее добавленных запросов того же пакета.
+ * Если одна из них завершилась с ошибкой, в режиме "continue-on-error" запрос пропускается.
+ * Зависимости от уже выполненных или неизвестных запросов не учитываются.
+ *
+ * Запросы с более высоким приоритетом перемещаются в начало пакета перед выполнением,
+ * правила полос применяются к порядку после перемещения. Запросы, от которых явно
+ * зависит запрос, получают его приоритет, если их собственный приоритет ниже.
+ *
+ * Если к моменту начала выполнения срок deadline истёк, запрос не выполняется, а
+ * выполнение остальных запросов продолжается.
+ */
+typedef struct
+{
+  guint        lane;          /**< Полоса выполнения запроса. */
+  gint         priority;      /**< Приоритет запроса. */
+  guint64      key;           /**< Ключ объединения запросов или 0. */
+  gint64       deadline;      /**< Время (g_get_monotonic_time), после которого запрос не выполняется, или 0. */
+  const guint *depends_on;    /**< Идентификаторы запросов, после которых выполняется запрос, или NULL. */
+  guint        n_depends_on;  /**< Число идентификаторов в depends_on. */
+  HyScanAsyncRetryPolicy retry; /**< Политика повторного выполнения запроса. */
+} HyScanAsyncQueryOptions;
+
+/** Состояние выполнения запроса. */
+typedef enum
+{
+  HYSCAN_ASYNC_QUERY_PENDING,               /**< Запрос не выполнялся. */
+  HYSCAN_ASYNC_QUERY_SUCCESS,               /**< Команда выполнена успешно. */
+  HYSCAN_ASYNC_QUERY_FAILED,                /**< Команда завершилась с ошибкой. */
+  HYSCAN_ASYNC_QUERY_SKIPPED,               /**< Запрос пропущен из-за ошибки другого запроса. */
+  HYSCAN_ASYNC_QUERY_CANCELLED,             /**< Выполнение запроса отменено. */
+  HYSCAN_ASYNC_QUERY_EXPIRED                /**< Срок выполнения запроса истёк. */
+} HyScanAsyncQueryStatus;
+
+/** Коды ошибок выполнения запросов. */
+typedef enum
+{
+  HYSCAN_ASYNC_ERROR_FAILED,                /**< Команда завершилась с ошибкой. */
+  HYSCAN_ASYNC_ERROR_SKIPPED,               /**< Запрос пропущен из-за ошибки другого запроса. */
+  HYSCAN_ASYNC_ERROR_CANCELLED,             /**< Выполнение запроса отменено. */
+  HYSCAN_ASYNC_ERROR_EXPIRED,               /**< Срок выполнения запроса истёк. */
+  HYSCAN_ASYNC_ERROR_NOT_STARTED            /**< Выполнение запросов не удалось запустить. */
+} HyScanAsyncError;
+
+/**
+ * Политика переполнения пакета запросов, задаётся свойством "overflow-policy".
+ * Удалённые запросы не попадают в результаты выполнения, их данные, переданные
+ * во владение, освобождаются сразу. Замена запроса по ключу объединения пакет
+ * не увеличивает и выполняется при любой политике.
+ */
+typedef enum
+{
+  HYSCAN_ASYNC_OVERFLOW_REJECT,             /**< Новый запрос отклоняется. */
+  HYSCAN_ASYNC_OVERFLOW_DROP_OLDEST,        /**< Самый старый запрос пакета удаляется. */
+  HYSCAN_ASYNC_OVERFLOW_COALESCE            /**< Новый запрос заменяет последний запрос с той же командой и объектом. */
+} HyScanAsyncOverflowPolicy;
+
+/** Домен ошибок \link HyScanAsync \endlink. */
+#define HYSCAN_ASYNC_ERROR            (hyscan_async_error_quark ())
+
+/** Результат выполнения запроса. */
+typedef struct
+{
+  guint                   id;               /**< Идентификатор запроса. */
+  HyScanAsyncQueryStatus  status;           /**< Состояние выполнения запроса. */
+  GError                 *error;            /**< Ошибка, если запрос не выполнен успешно, иначе NULL. */
+} HyScanAsyncQueryResult;
+
+/**
+ * Статистика выполнения запросов. Времена указаны в микросекундах и накапливаются
+ * в гистограммах без блокировок. Основные значения доступны также через свойства
+ * только для чтения "n-batches", "n-queries", "n-failed", "queue-depth",
+ * "peak-queue-depth", "queue-wait", "command-time", "command-time-max",
+ * "delivery-delay" и "schedule-jitter".
+ */
+typedef struct
+{
+  guint                   n_batches;        /**< Число выполненных пакетов. */
+  guint                   n_queries;        /**< Число выполненных команд. */
+  guint                   n_failed;         /**< Число команд, завершившихся с ошибкой. */
+  guint                   peak_queue_depth; /**< Наибольшее число запросов в пакете. */
+  HyScanAsyncHistogram    queue_wait;       /**< Время от добавления запросов до начала выполнения их пакета. */
+  HyScanAsyncHistogram    batch_time;       /**< Время выполнения пакетов. */
+  HyScanAsyncHistogram    command_time;     /**< Время выполнения команд. */
+  HyScanAsyncHistogram    delivery_delay;   /**< Время от завершения пакета до сигнала "completed". */
+  guint                   n_missed;         /**< Число пропущенных периодов запросов по расписанию. */
+  guint                   n_rejected;       /**< Число запросов, отклонённых из-за переполнения. */
+  guint                   n_dropped;        /**< Число запросов, удалённых из-за переполнения. */
+  guint                   n_retries;        /**< Число повторных попыток выполнения запросов. */
+  HyScanAsyncHistogram    schedule_jitter;  /**< Отклонение начала запросов по расписанию от заданного времени. */
+} HyScanAsyncStats;
+
 G_BEGIN_DECLS
 
 #define HYSCAN_TYPE_ASYNC             (hyscan_async_get_type ())
@@ -72,8 +231,17 @@ struct _HyScanAsyncClass
 HYSCAN_API
 GType        hyscan_async_get_type      (void);
 
+HYSCAN_API
+GQuark       hyscan_async_error_quark   (void);
+
 /**
- * Создаёт новый объект \link HyScanAsync \endlink.
+ * Создаёт новый объект \link HyScanAsync \endlink с собственным пулом из одного потока.
+ *
+ * Для собственного пула при создании объекта функцией g_object_new можно задать
+ * политику планирования, приоритет и маску процессоров потоков (свойства "sched-policy",
+ * "sched-priority" и "cpu-affinity"). С общим пулом (свойство "executor") эти свойства
+ * не используются - их задают самому пулу, а "n-workers" ограничивает только число
+ * одновременно выполняемых запросов объекта.
  *
  * \return указатель на класс \link HyScanAsync \endlink.
  */
@@ -85,7 +253,14 @@ HyScanAsync *hyscan_async_new           (void);
  * Данная функция создаёт копию данных, переданных в data, которые удаляются
  * после выполнения запроса. Если данные data содержат указатели на динамически
  * распеределенную память, её необходимо самостоятельно освободить после
- * выполнения запроса.
+ * выполнения запроса, либо добавить запрос функцией #hyscan_async_append_query_take.
+ * Копия данных размещается в буфере пакета запросов с выравниванием на 16 байт
+ * и действительна только во время выполнения команды.
+ *
+ * Запрос относится к барьерной полосе и имеет приоритет #HYSCAN_ASYNC_PRIORITY_DEFAULT,
+ * т.е. такие запросы выполняются последовательно. Параллельное выполнение включается
+ * явно функцией #hyscan_async_append_query_full, так как команды разных полос
+ * вызываются одновременно и должны допускать это.
  *
  * \param async указатель на класс \link HyScanAsync \endlink;
  * \param command указатель на функцию типа \link HyScanAsyncCommand \endlink;
@@ -102,17 +277,269 @@ gboolean     hyscan_async_append_query  (HyScanAsync        *async,
                                          gconstpointer       data,
                                          gsize               data_size);
 
+/**
+ * Добавляет запрос с параметрами выполнения в список. Данные копируются так же,
+ * как в функции #hyscan_async_append_query.
+ *
+ * Если задано свойство "coalesce", запрос с ненулевым ключом объединения заменяет ранее
+ * добавленный и ещё не выполненный запрос с тем же ключом и тем же объектом, даже если
+ * команды запросов различаются: новые команда, данные, полоса и приоритет занимают место
+ * старого запроса в пакете, а функция возвращает его идентификатор. Если новый запрос
+ * зависит от замещаемого или более поздних запросов, замена не выполняется и запрос
+ * добавляется в конец пакета. Замещённые данные не передаются команде, поэтому
+ * они не должны содержать указателей на память, которую освобождает команда.
+ *
+ * Если пакет заполнен до "max-queue-depth", запрос обрабатывается в соответствии
+ * со свойством "overflow-policy" (\link HyScanAsyncOverflowPolicy \endlink).
+ *
+ * \param async указатель на класс \link HyScanAsync \endlink;
+ * \param command указатель на функцию типа \link HyScanAsyncCommand \endlink;
+ * \param object первый параметр, передаваемый в HyScanAsyncCommand;
+ * \param data второй параметр, передаваемый в HyScanAsyncCommand;
+ * \param data_size размер данных data;
+ * \param options параметры выполнения запроса или NULL.
+ *
+ * \return Идентификатор запроса или 0, если произошла ошибка.
+ */
+HYSCAN_API
+guint        hyscan_async_append_query_full (HyScanAsync                   *async,
+                                             HyScanAsyncCommand             command,
+                                             gpointer                       object,
+                                             gconstpointer                  data,
+                                             gsize                          data_size,
+                                             const HyScanAsyncQueryOptions *options);
+
+/**
+ * Добавляет запрос с параметрами выполнения в список, передавая ему данные во владение.
+ * Данные не копируются: команда получает указатель data, а после выполнения пакета
+ * данные освобождаются функцией destroy. Функция destroy вызывается в любом случае -
+ * если запрос выполнен, пропущен, отменён, заменён объединённым запросом, не принят
+ * или объект уничтожен до выполнения пакета. Выполненные пакеты освобождают данные
+ * в контексте, в котором испускается сигнал "completed", перед его испусканием.
+ *
+ * \param async указатель на класс \link HyScanAsync \endlink;
+ * \param command указатель на функцию типа \link HyScanAsyncCommand \endlink;
+ * \param object первый параметр, передаваемый в HyScanAsyncCommand;
+ * \param data второй параметр, передаваемый в HyScanAsyncCommand;
+ * \param destroy функция освобождения данных data или NULL;
+ * \param options параметры выполнения запроса или NULL.
+ *
+ * \return Идентификатор запроса или 0, если произошла ошибка.
+ */
+HYSCAN_API
+guint        hyscan_async_append_query_take (HyScanAsync                   *async,
+                                             HyScanAsyncCommand             command,
+                                             gpointer                       object,
+                                             gpointer                       data,
+                                             GDestroyNotify                 destroy,
+                                             const HyScanAsyncQueryOptions *options);
+
 /**
  * Запускает выполнение списка запросов в отдельном потоке.
  *
+ * В конвейерном режиме (свойство "pipeline") запросы можно добавлять и запускать во время
+ * выполнения предыдущих: они собираются в следующий пакет, выполнение которого начнётся
+ * сразу после завершения текущего. Повторный вызов, пока пакет ожидает выполнения,
+ * только подтверждает его запуск. Сигналы "started" и "completed" испускаются по одному
+ * разу для каждого пакета.
+ *
  * \param async указатель на класс \link HyScanAsync \endlink.
  *
  * \return TRUE, если удалось запустить выполнение запросов, либо FALSE,
- * если список запросов пуст, запросы ещё выполняются, или в случае ошибки.
+ * если список запросов пуст, запросы ещё выполняются (без конвейерного режима),
+ * или в случае ошибки.
  */
 HYSCAN_API
 gboolean     hyscan_async_execute       (HyScanAsync    *async);
 
+/**
+ * Асинхронно запускает выполнение списка запросов. После выполнения пакета в контексте
+ * context вызывается функция callback, в которой необходимо вызвать функцию
+ * #hyscan_async_execute_finish. Отмена cancellable отменяет выполнение пакета
+ * так же, как функция #hyscan_async_cancel. Сигналы "started" и "completed" при этом
+ * также испускаются.
+ *
+ * \param async указатель на класс \link HyScanAsync \endlink;
+ * \param context контекст вызова callback или NULL для контекста по умолчанию текущего потока;
+ * \param cancellable объект отмены или NULL;
+ * \param callback функция, вызываемая по завершении выполнения запросов;
+ * \param user_data пользовательские данные для callback.
+ */
+HYSCAN_API
+void         hyscan_async_execute_async (HyScanAsync         *async,
+                                         GMainContext        *context,
+                                         GCancellable        *cancellable,
+                                         GAsyncReadyCallback  callback,
+                                         gpointer             user_data);
+
+/**
+ * Завершает асинхронное выполнение списка запросов и возвращает результаты
+ * выполнения запросов пакета (см. #hyscan_async_get_results). Если выполнение
+ * не удалось запустить или задача была отменена, возвращается NULL и ошибка.
+ *
+ * \param async указатель на класс \link HyScanAsync \endlink;
+ * \param result результат асинхронной операции;
+ * \param error ошибка или NULL.
+ *
+ * \return Массив HyScanAsyncQueryResult или NULL. Массив необходимо освободить
+ * функцией g_array_unref.
+ */
+HYSCAN_API
+GArray      *hyscan_async_execute_finish (HyScanAsync   *async,
+                                          GAsyncResult  *result,
+                                          GError       **error);
+
+/**
+ * Отменяет выполнение запущенных запросов, включая пакет, ожидающий выполнения в
+ * конвейерном режиме. Запросы, которые ещё не начали выполняться, выполнены не будут,
+ * выполняющиеся команды завершаются самостоятельно, но могут получить объект
+ * GCancellable пакета функцией g_cancellable_get_current и прервать по нему длительную
+ * операцию. Сигнал "completed" испускается как обычно, с результатом FALSE.
+ *
+ * \param async указатель на класс \link HyScanAsync \endlink.
+ */
+HYSCAN_API
+void         hyscan_async_cancel        (HyScanAsync    *async);
+
+/**
+ * Возвращает результаты выполнения запросов последнего выполненного пакета в порядке
+ * следования запросов в пакете после сортировки по приоритету. Массив принадлежит
+ * объекту и действителен до следующего сигнала "completed", поэтому функцию следует
+ * вызывать из обработчика этого сигнала.
+ *
+ * \param async указатель на класс \link HyScanAsync \endlink;
+ * \param n_results число результатов.
+ *
+ * \return Массив результатов выполнения запросов.
+ */
+HYSCAN_API
+const HyScanAsyncQueryResult *
+             hyscan_async_get_results   (HyScanAsync    *async,
+                                         guint          *n_results);
+
+/**
+ * Ожидает завершения выполнения всех запущенных пакетов запросов. Функцию можно
+ * вызывать из любого потока, кроме потоков выполнения запросов. Функция только
+ * ожидает: сигналы "completed" испускаются позже в контексте объекта, либо функцией
+ * #hyscan_async_dispatch. Без конвейерного режима новые запросы принимаются только
+ * после доставки результатов.
+ *
+ * \param async указатель на класс \link HyScanAsync \endlink;
+ * \param timeout время ожидания в микросекундах или отрицательное значение для
+ * ожидания без ограничения времени.
+ *
+ * \return TRUE, если запросы выполнены, FALSE, если истекло время ожидания.
+ */
+HYSCAN_API
+gboolean     hyscan_async_wait          (HyScanAsync    *async,
+                                         gint64          timeout);
+
+/**
+ * Доставляет результаты выполненных пакетов в вызывающем потоке: испускает сигналы
+ * "queue-pressure" и "completed" и завершает задачи #hyscan_async_execute_async так же,
+ * как при обработке событий контекста, в котором создан объект. Функция предназначена
+ * для программ без главного цикла и используется вместе с #hyscan_async_wait.
+ * Результаты доставляются, только если вызывающий поток может стать владельцем
+ * контекста объекта (g_main_context_acquire), то есть контекст не обрабатывается
+ * другим потоком.
+ *
+ * \param async указатель на класс \link HyScanAsync \endlink.
+ *
+ * \return TRUE, если результаты доставлены (или доставлять было нечего), FALSE,
+ * если контекст объекта занят другим потоком.
+ */
+HYSCAN_API
+gboolean     hyscan_async_dispatch      (HyScanAsync    *async);
+
+/**
+ * Добавляет запрос, выполняемый по расписанию. Данные копируются так же, как в функции
+ * #hyscan_async_append_query, и хранятся до удаления запроса. Ошибки выполнения
+ * запроса учитываются только в статистике. Функцию можно вызывать из любого потока.
+ *
+ * Запрос выполняется потоком пула без участия главного цикла в момент start_time по
+ * монотонным часам и, если задан период, повторяется до удаления функцией
+ * #hyscan_async_unschedule_query. Следующее выполнение планируется от заданного времени,
+ * а не от фактического, поэтому задержки не накапливаются; если выполнение опоздало
+ * больше чем на период, пропущенные периоды не выполняются. Запросы по расписанию
+ * не входят в пакеты: они выполняются раньше готовых запросов пакета, не влияют на
+ * сигналы "started" и "completed", не отменяются функцией #hyscan_async_cancel и могут
+ * выполняться одновременно с запросами пакета.
+ *
+ * \param async указатель на класс \link HyScanAsync \endlink;
+ * \param command указатель на функцию типа \link HyScanAsyncCommand \endlink;
+ * \param object первый параметр, передаваемый в HyScanAsyncCommand;
+ * \param data второй параметр, передаваемый в HyScanAsyncCommand;
+ * \param data_size размер данных data;
+ * \param start_time время первого выполнения (g_get_monotonic_time), мкс;
+ * \param period период повторения, мкс, или 0 для однократного выполнения.
+ *
+ * \return Идентификатор запроса или 0, если произошла ошибка.
+ */
+HYSCAN_API
+guint        hyscan_async_schedule_query (HyScanAsync        *async,
+                                          HyScanAsyncCommand  command,
+                                          gpointer            object,
+                                          gconstpointer       data,
+                                          gsize               data_size,
+                                          gint64              start_time,
+                                          gint64              period);
+
+/**
+ * Удаляет запрос, выполняемый по расписанию. Если команда запроса выполняется,
+ * она завершается, но больше не повторяется. Однократный запрос удаляется
+ * автоматически после выполнения.
+ *
+ * \param async указатель на класс \link HyScanAsync \endlink;
+ * \param id идентификатор запроса.
+ *
+ * \return TRUE, если запрос удалён, FALSE, если запрос не найден.
+ */
+HYSCAN_API
+gboolean     hyscan_async_unschedule_query (HyScanAsync  *async,
+                                            guint         id);
+
+/**
+ * Возвращает статистику выполнения запросов. Функцию можно вызывать из любого потока.
+ *
+ * \param async указатель на класс \link HyScanAsync \endlink;
+ * \param stats указатель на структуру для статистики.
+ */
+HYSCAN_API
+void         hyscan_async_get_stats     (HyScanAsync       *async,
+                                         HyScanAsyncStats  *stats);
+
+/**
+ * Возвращает гистограмму времени выполнения команды. Функцию можно вызывать из любого потока.
+ *
+ * \param async указатель на класс \link HyScanAsync \endlink;
+ * \param command указатель на функцию команды;
+ * \param stats указатель на гистограмму.
+ *
+ * \return TRUE, если команда выполнялась после сброса статистики, иначе FALSE.
+ */
+HYSCAN_API
+gboolean     hyscan_async_get_command_stats (HyScanAsync          *async,
+                                             HyScanAsyncCommand    command,
+                                             HyScanAsyncHistogram *stats);
+
+/**
+ * Сбрасывает статистику выполнения запросов.
+ *
+ * \param async указатель на класс \link HyScanAsync \endlink.
+ */
+HYSCAN_API
+void         hyscan_async_reset_stats   (HyScanAsync    *async);
+
+/**
+ * Передаёт причину ошибки выполняемой команды. Функцию можно вызывать только из
+ * команды, выполняемой \link HyScanAsync \endlink, перед возвратом FALSE. Ошибка
+ * попадает в результат выполнения запроса, см. #hyscan_async_get_results.
+ *
+ * \param error ошибка, объект становится её владельцем.
+ */
+HYSCAN_API
+void         hyscan_async_set_command_error (GError     *error);
+
 G_END_DECLS
 
 #endif /* __HYSCAN_ASYNC_H__ */
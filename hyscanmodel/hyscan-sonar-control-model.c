@@ -7,6 +7,26 @@
  */
 #include "hyscan-sonar-control-model.h"
 
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Журнал команд: метка формата ("HSCJ"), версия, размер буфера записи и время,
+ * после которого накопленные записи сбрасываются в файл рабочим потоком. */
+#define HYSCAN_SONAR_CONTROL_MODEL_JOURNAL_MAGIC       (0x4a435348)
+#define HYSCAN_SONAR_CONTROL_MODEL_JOURNAL_VERSION     (3)
+#define HYSCAN_SONAR_CONTROL_MODEL_JOURNAL_BUFFER      (64 * 1024)
+#define HYSCAN_SONAR_CONTROL_MODEL_JOURNAL_FLUSH_TIME  (200 * G_TIME_SPAN_MILLISECOND)
+
+/* Размер строки параметров в записи журнала, обозначающий строку NULL. */
+#define HYSCAN_SONAR_CONTROL_MODEL_JOURNAL_NULL_STRING (G_MAXUINT16)
+
+/* Полосы выполнения запросов: запросы одного источника данных или одного датчика
+ * выполняются по порядку, общие команды гидролокатора - барьеры. */
+#define HYSCAN_SONAR_CONTROL_MODEL_SOURCE_LANE(source) (((guint) (source) << 1) | 1)
+#define HYSCAN_SONAR_CONTROL_MODEL_SENSOR_LANE(name)   ((guint) g_quark_from_string (name) << 1)
+
 /* Параметры запроса установки режима синхронизации. */
 typedef struct
 {
@@ -114,7 +134,7 @@ typedef struct
 /* Параметры запроса установки режима работы виртуального порта. */
 typedef struct
 {
-  gchar                     *name;          /* Название датчика. */
+  const gchar               *name;          /* Название датчика. */
   guint                      channel;       /* Канал. */
   gint64                     time_offset;   /* Коррекция времени приёма данных. */
 } HyScanParamsSensorVirtualPortParam;
@@ -122,7 +142,7 @@ typedef struct
 /* Параметры запроса установки режима работы UART порта. */
 typedef struct
 {
-  gchar                     *name;          /* Название датчика. */
+  const gchar               *name;          /* Название датчика. */
   guint                      channel;       /* Канал. */
   gint64                     time_offset;   /* Коррекция времени приёма данных. */
   HyScanSensorProtocolType   protocol;      /* Протокол обмена данными с датчиком. */
@@ -133,7 +153,7 @@ typedef struct
 /* Параметры запроса установки режима работы UDP/IP порта. */
 typedef struct
 {
-  gchar                     *name;          /* Название датчика. */
+  const gchar               *name;          /* Название датчика. */
   guint                      channel;       /* Канал. */
   gint64                     time_offset;   /* Коррекция времени приёма данных. */
   HyScanSensorProtocolType   protocol;      /* Протокол обмена данными с датчиком. */
@@ -144,26 +164,163 @@ typedef struct
 /* Параметры запроса установки местоположения датчика. */
 typedef struct
 {
-  gchar                     *name;          /* Название датчика. */
+  const gchar               *name;          /* Название датчика. */
   HyScanAntennaPosition      position;      /* Местоположение датчика. */
 } HyScanParamsSensorPosition;
 
 /* Параметры запроса включения/выключения датчика. */
 typedef struct
 {
-  gchar                     *name;          /* Название датчика. */
+  const gchar               *name;          /* Название датчика. */
   gboolean                   enable;        /* Включён или выключен. */
 } HyScanParamsSensorEnable;
 
+/* Группы команд транзакции. Из нескольких изменений одной группы для одного источника
+ * данных или датчика гидролокатору передаётся только последнее: например, из нескольких
+ * режимов генератора одного источника остаётся последний установленный. */
+typedef enum
+{
+  HYSCAN_SONAR_CONTROL_MODEL_SLOT_NONE,                 /* Команда не объединяется, например пуск. */
+  HYSCAN_SONAR_CONTROL_MODEL_SLOT_SENSOR_PORT,          /* Режим работы порта датчика. */
+  HYSCAN_SONAR_CONTROL_MODEL_SLOT_SENSOR_POSITION,      /* Местоположение датчика. */
+  HYSCAN_SONAR_CONTROL_MODEL_SLOT_SENSOR_ENABLE,        /* Включение датчика. */
+  HYSCAN_SONAR_CONTROL_MODEL_SLOT_GENERATOR_MODE,       /* Режим работы генератора. */
+  HYSCAN_SONAR_CONTROL_MODEL_SLOT_GENERATOR_ENABLE,     /* Включение генератора. */
+  HYSCAN_SONAR_CONTROL_MODEL_SLOT_TVG_MODE,             /* Режим работы ВАРУ. */
+  HYSCAN_SONAR_CONTROL_MODEL_SLOT_TVG_ENABLE,           /* Включение ВАРУ. */
+  HYSCAN_SONAR_CONTROL_MODEL_SLOT_SYNC_TYPE,            /* Тип синхронизации. */
+  HYSCAN_SONAR_CONTROL_MODEL_SLOT_SONAR_POSITION,       /* Местоположение антенн. */
+  HYSCAN_SONAR_CONTROL_MODEL_SLOT_RECEIVE_TIME          /* Время приёма. */
+} HyScanSonarControlModelSlot;
+
+/* Команды гидролокатора - индексы в hyscan_sonar_control_model_commands. Индекс команды
+ * записывается в журнал, поэтому новые команды добавляются только в конец списка. */
+typedef enum
+{
+  HYSCAN_SONAR_CONTROL_MODEL_CMD_SENSOR_SET_VIRTUAL_PORT_PARAM,
+  HYSCAN_SONAR_CONTROL_MODEL_CMD_SENSOR_SET_UART_PORT_PARAM,
+  HYSCAN_SONAR_CONTROL_MODEL_CMD_SENSOR_SET_UDP_IP_PORT_PARAM,
+  HYSCAN_SONAR_CONTROL_MODEL_CMD_SENSOR_SET_POSITION,
+  HYSCAN_SONAR_CONTROL_MODEL_CMD_SENSOR_SET_ENABLE,
+  HYSCAN_SONAR_CONTROL_MODEL_CMD_GENERATOR_SET_PRESET,
+  HYSCAN_SONAR_CONTROL_MODEL_CMD_GENERATOR_SET_AUTO,
+  HYSCAN_SONAR_CONTROL_MODEL_CMD_GENERATOR_SET_SIMPLE,
+  HYSCAN_SONAR_CONTROL_MODEL_CMD_GENERATOR_SET_EXTENDED,
+  HYSCAN_SONAR_CONTROL_MODEL_CMD_GENERATOR_SET_ENABLE,
+  HYSCAN_SONAR_CONTROL_MODEL_CMD_TVG_SET_AUTO,
+  HYSCAN_SONAR_CONTROL_MODEL_CMD_TVG_SET_CONSTANT,
+  HYSCAN_SONAR_CONTROL_MODEL_CMD_TVG_SET_LINEAR_DB,
+  HYSCAN_SONAR_CONTROL_MODEL_CMD_TVG_SET_LOGARITHMIC,
+  HYSCAN_SONAR_CONTROL_MODEL_CMD_TVG_SET_ENABLE,
+  HYSCAN_SONAR_CONTROL_MODEL_CMD_SONAR_SET_SYNC_TYPE,
+  HYSCAN_SONAR_CONTROL_MODEL_CMD_SONAR_SET_POSITION,
+  HYSCAN_SONAR_CONTROL_MODEL_CMD_SONAR_SET_RECEIVE_TIME,
+  HYSCAN_SONAR_CONTROL_MODEL_CMD_SONAR_START,
+  HYSCAN_SONAR_CONTROL_MODEL_CMD_SONAR_STOP,
+  HYSCAN_SONAR_CONTROL_MODEL_CMD_SONAR_PING
+} HyScanSonarControlModelCommandId;
+
+/* Изменение, накопленное в транзакции. */
+typedef struct
+{
+  HyScanSonarControlModelCommandId id;     /* Команда. */
+  HyScanSonarControlModelSlot slot;         /* Группа команды. */
+  guint                      lane;          /* Полоса выполнения: источник данных или датчик. */
+  gint                       priority;      /* Приоритет команды. */
+  guint                      max_attempts;  /* Число попыток пуска, останова или зондирования. */
+  gpointer                   params;        /* Параметры команды. */
+  GDestroyNotify             destroy;       /* Функция освобождения параметров. */
+} HyScanSonarControlModelChange;
+
+/* Транзакция - изменения, добавляемые в список запросов одновременно. */
+typedef struct
+{
+  GArray                    *changes;       /* Изменения HyScanSonarControlModelChange. */
+  guint                      barrier;       /* Индекс первого изменения после последней необъединяемой команды. */
+} HyScanSonarControlModelTransaction;
+
+/* Последнее успешно применённое значение параметра. */
+typedef struct
+{
+  gint64                     key;           /* Ключ: группа команды и полоса выполнения. */
+  HyScanSonarControlModelCommandId id;     /* Команда. */
+  guint8                     params[];      /* Параметры команды. */
+} HyScanSonarControlModelShadow;
+
+/* Заголовок журнала команд. Поля заголовка и записей журнала хранятся в порядке байтов
+ * little-endian. Параметры команд записываются в представлении архитектуры, записавшей
+ * журнал, поэтому в заголовке сохраняются порядок байтов и размер указателя, а за ним
+ * следуют размеры параметров команд (guint16) в порядке HyScanSonarControlModelCommandId. */
+typedef struct
+{
+  guint32                    magic;         /* Метка формата. */
+  guint32                    version;       /* Версия формата. */
+  guint32                    byte_order;    /* Порядок байтов параметров команд. */
+  guint16                    pointer_size;  /* Размер указателя в параметрах команд. */
+  guint16                    n_commands;    /* Число команд. */
+} HyScanSonarControlModelJournalHeader;
+
+/* Запись журнала команд. За записью следуют строка параметров (название датчика
+ * или галса) без завершающего нуля и параметры команды. Строка NULL записывается
+ * без данных с размером HYSCAN_SONAR_CONTROL_MODEL_JOURNAL_NULL_STRING, более
+ * длинные строки обрезаются. */
+typedef struct
+{
+  gint64                     time;          /* Время начала выполнения команды, мкс. */
+  gint64                     duration;      /* Время выполнения команды, мкс. */
+  guint16                    command;       /* Индекс команды в hyscan_sonar_control_model_commands. */
+  guint16                    result;        /* Результат выполнения команды. */
+  guint16                    string_size;   /* Размер строки параметров. */
+  guint16                    params_size;   /* Размер параметров команды. */
+} HyScanSonarControlModelJournalRecord;
+
+/* Функция определения полосы выполнения команды по её параметрам. */
+typedef guint (*HyScanSonarControlModelLaneFunc) (gconstpointer params);
+
+/* Функция вызова команды интерфейса управления гидролокатором. */
+typedef gboolean (*HyScanSonarControlModelApplyFunc) (HyScanSonarControl *sonar_control,
+                                                      gpointer            params);
+
+/* Описание команды гидролокатора. */
+typedef struct
+{
+  HyScanAsyncCommand         command;       /* Команда HyScanAsync. */
+  HyScanSonarControlModelApplyFunc apply;   /* Вызов интерфейса управления ГЛ. */
+  HyScanSonarControlModelLaneFunc lane;     /* Функция определения полосы выполнения. */
+  HyScanSonarControlModelSlot slot;         /* Группа команды. */
+  const gchar               *name;          /* Название команды. */
+  gsize                      size;          /* Размер параметров команды. */
+  gboolean                   string;        /* Первое поле параметров - строка. */
+} HyScanSonarControlModelCommandInfo;
+
 enum
 {
   PROP_O,
-  PROP_SONAR_CONTROL
+  PROP_SONAR_CONTROL,
+  PROP_SHADOW_CACHE,
+  PROP_JOURNAL
 };
 
 struct _HyScanSonarControlModelPrivate
 {
   HyScanSonarControl   *sonar_control;   /* Интерфейс синхронного управления ГЛ. */
+
+  guint                 last_run;        /* Идентификатор последнего запроса пуска, останова или зондирования. */
+
+  HyScanSonarControlModelTransaction *transaction; /* Открытая транзакция или NULL. */
+  guint                 transaction_depth; /* Число вложенных вызовов hyscan_sonar_control_model_begin. */
+
+  gboolean              shadow_cache;    /* Признак пропуска команд, не изменяющих параметры. */
+  GHashTable           *shadow;          /* Применённые значения HyScanSonarControlModelShadow. */
+  GMutex                shadow_lock;     /* Блокировка доступа к применённым значениям. */
+
+  gchar                *journal_path;    /* Путь к файлу журнала команд. */
+  FILE                 *journal;         /* Журнал команд или NULL. */
+  gchar                *journal_buffer;  /* Буфер записи журнала. */
+  gint64                journal_flushed; /* Время последнего сброса журнала в файл. */
+  GMutex                journal_lock;    /* Блокировка записи журнала. */
+
+  HyScanSonarControlModelCommandStats *stats; /* Статистика команд по индексу в hyscan_sonar_control_model_commands. */
 };
 
 static void
@@ -176,6 +333,88 @@ static void
 static void
     hyscan_sonar_control_model_finalize                            (GObject                             *object);
 
+static gboolean
+    hyscan_sonar_control_model_append                              (HyScanSonarControlModel             *model,
+                                                                    HyScanSonarControlModelCommandId     id,
+                                                                    gint                                 priority,
+                                                                    gconstpointer                        params);
+static gboolean
+    hyscan_sonar_control_model_append_take                         (HyScanSonarControlModel             *model,
+                                                                    HyScanSonarControlModelCommandId     id,
+                                                                    guint                                lane,
+                                                                    gint                                 priority,
+                                                                    gpointer                             params,
+                                                                    GDestroyNotify                       destroy);
+static gboolean
+    hyscan_sonar_control_model_append_run                          (HyScanSonarControlModel             *model,
+                                                                    HyScanSonarControlModelCommandId     id,
+                                                                    gint                                 priority,
+                                                                    guint                                max_attempts,
+                                                                    gpointer                             params,
+                                                                    GDestroyNotify                       destroy);
+static void
+    hyscan_sonar_control_model_params_sonar_start_free             (HyScanParamsSonarStart              *params);
+
+static void
+    hyscan_sonar_control_model_transaction_add                     (HyScanSonarControlModelTransaction  *transaction,
+                                                                    HyScanSonarControlModelCommandId     id,
+                                                                    guint                                lane,
+                                                                    gint                                 priority,
+                                                                    guint                                max_attempts,
+                                                                    gpointer                             params,
+                                                                    GDestroyNotify                       destroy);
+static void
+    hyscan_sonar_control_model_transaction_free                    (HyScanSonarControlModelTransaction  *transaction);
+
+static guint
+    hyscan_sonar_control_model_source_lane                         (gconstpointer                        params);
+static guint
+    hyscan_sonar_control_model_sensor_lane                         (gconstpointer                        params);
+static guint
+    hyscan_sonar_control_model_barrier_lane                        (gconstpointer                        params);
+static gboolean
+    hyscan_sonar_control_model_run                                 (HyScanSonarControlModel             *model,
+                                                                    HyScanSonarControlModelCommandId     id,
+                                                                    gpointer                             params);
+
+static gint64
+    hyscan_sonar_control_model_shadow_key                          (HyScanSonarControlModelCommandId     id,
+                                                                    guint                                lane);
+static gboolean
+    hyscan_sonar_control_model_shadow_match                        (HyScanSonarControlModel             *model,
+                                                                    HyScanSonarControlModelCommandId     id,
+                                                                    guint                                lane,
+                                                                    gconstpointer                        params);
+static gboolean
+    hyscan_sonar_control_model_shadow_update                       (HyScanSonarControlModel             *model,
+                                                                    HyScanSonarControlModelCommandId     id,
+                                                                    guint                                lane,
+                                                                    gconstpointer                        params,
+                                                                    gboolean                             result);
+
+static void
+    hyscan_sonar_control_model_executed                            (HyScanSonarControlModel             *model,
+                                                                    HyScanSonarControlModelCommandId     id,
+                                                                    gint64                               start,
+                                                                    gconstpointer                        params,
+                                                                    gboolean                             result);
+static void
+    hyscan_sonar_control_model_journal_write_header                (FILE                                *journal);
+static void
+    hyscan_sonar_control_model_journal_flush                       (HyScanSonarControlModel             *model,
+                                                                    gboolean                             result,
+                                                                    gpointer                             user_data);
+static gboolean
+    hyscan_sonar_control_model_journal_read_header                 (const gchar                         *data,
+                                                                    gsize                                size,
+                                                                    gsize                               *offset);
+static const HyScanSonarControlModelCommandInfo *
+    hyscan_sonar_control_model_journal_read                        (const gchar                         *data,
+                                                                    gsize                                size,
+                                                                    gsize                               *offset,
+                                                                    HyScanSonarControlModelJournalRecord *record,
+                                                                    gpointer                             params);
+
 static gboolean
     hyscan_sonar_control_model_cmd_sensor_set_virtual_port_param   (HyScanSonarControlModel             *model,
                                                                     HyScanParamsSensorVirtualPortParam  *params);
@@ -243,6 +482,162 @@ static gboolean
     hyscan_sonar_control_model_cmd_sonar_ping                      (HyScanSonarControlModel             *model,
                                                                     gpointer                             unused);
 
+static gboolean
+    hyscan_sonar_control_model_apply_sensor_set_virtual_port_param (HyScanSonarControl                  *sonar_control,
+                                                                    HyScanParamsSensorVirtualPortParam  *params);
+static gboolean
+    hyscan_sonar_control_model_apply_sensor_set_uart_port_param    (HyScanSonarControl                  *sonar_control,
+                                                                    HyScanParamsSensorUartPortParam     *params);
+static gboolean
+    hyscan_sonar_control_model_apply_sensor_set_udp_ip_port_param  (HyScanSonarControl                  *sonar_control,
+                                                                    HyScanParamsSensorUdpIpPortParam    *params);
+static gboolean
+    hyscan_sonar_control_model_apply_sensor_set_position           (HyScanSonarControl                  *sonar_control,
+                                                                    HyScanParamsSensorPosition          *params);
+static gboolean
+    hyscan_sonar_control_model_apply_sensor_set_enable             (HyScanSonarControl                  *sonar_control,
+                                                                    HyScanParamsSensorEnable            *params);
+
+static gboolean
+    hyscan_sonar_control_model_apply_generator_set_preset          (HyScanSonarControl                  *sonar_control,
+                                                                    HyScanParamsGeneratorPreset         *params);
+static gboolean
+    hyscan_sonar_control_model_apply_generator_set_auto            (HyScanSonarControl                  *sonar_control,
+                                                                    HyScanParamsGeneratorAuto           *params);
+static gboolean
+    hyscan_sonar_control_model_apply_generator_set_simple          (HyScanSonarControl                  *sonar_control,
+                                                                    HyScanParamsGeneratorSimple         *params);
+static gboolean
+    hyscan_sonar_control_model_apply_generator_set_extended        (HyScanSonarControl                  *sonar_control,
+                                                                    HyScanParamsGeneratorExtended       *params);
+static gboolean
+    hyscan_sonar_control_model_apply_generator_set_enable          (HyScanSonarControl                  *sonar_control,
+                                                                    HyScanParamsGeneratorEnable         *params);
+
+static gboolean
+    hyscan_sonar_control_model_apply_tvg_set_auto                  (HyScanSonarControl                  *sonar_control,
+                                                                    HyScanParamsTVGAuto                 *params);
+static gboolean
+    hyscan_sonar_control_model_apply_tvg_set_constant              (HyScanSonarControl                  *sonar_control,
+                                                                    HyScanParamsTVGConstant             *params);
+static gboolean
+    hyscan_sonar_control_model_apply_tvg_set_linear_db             (HyScanSonarControl                  *sonar_control,
+                                                                    HyScanParamsTVGLinearDB             *params);
+static gboolean
+    hyscan_sonar_control_model_apply_tvg_set_logarithmic           (HyScanSonarControl                  *sonar_control,
+                                                                    HyScanParamsTVGLogarithmic          *params);
+static gboolean
+    hyscan_sonar_control_model_apply_tvg_set_enable                (HyScanSonarControl                  *sonar_control,
+                                                                    HyScanParamsTVGEnable               *params);
+
+static gboolean
+    hyscan_sonar_control_model_apply_sonar_set_sync_type           (HyScanSonarControl                  *sonar_control,
+                                                                    HyScanParamsSonarSyncType           *params);
+static gboolean
+    hyscan_sonar_control_model_apply_sonar_set_position            (HyScanSonarControl                  *sonar_control,
+                                                                    HyScanParamsSonarPosition           *params);
+static gboolean
+    hyscan_sonar_control_model_apply_sonar_set_receive_time        (HyScanSonarControl                  *sonar_control,
+                                                                    HyScanParamsSonarReceiveTime        *params);
+static gboolean
+    hyscan_sonar_control_model_apply_sonar_start                   (HyScanSonarControl                  *sonar_control,
+                                                                    HyScanParamsSonarStart              *params);
+static gboolean
+    hyscan_sonar_control_model_apply_sonar_stop                    (HyScanSonarControl                  *sonar_control,
+                                                                    gpointer                             unused);
+static gboolean
+    hyscan_sonar_control_model_apply_sonar_ping                    (HyScanSonarControl                  *sonar_control,
+                                                                    gpointer                             unused);
+
+/* Команды гидролокатора в порядке HyScanSonarControlModelCommandId. */
+static const HyScanSonarControlModelCommandInfo hyscan_sonar_control_model_commands[] =
+{
+  { (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_sensor_set_virtual_port_param,
+    (HyScanSonarControlModelApplyFunc) hyscan_sonar_control_model_apply_sensor_set_virtual_port_param,
+    hyscan_sonar_control_model_sensor_lane, HYSCAN_SONAR_CONTROL_MODEL_SLOT_SENSOR_PORT,
+    "sensor-set-virtual-port-param", sizeof (HyScanParamsSensorVirtualPortParam), TRUE },
+  { (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_sensor_set_uart_port_param,
+    (HyScanSonarControlModelApplyFunc) hyscan_sonar_control_model_apply_sensor_set_uart_port_param,
+    hyscan_sonar_control_model_sensor_lane, HYSCAN_SONAR_CONTROL_MODEL_SLOT_SENSOR_PORT,
+    "sensor-set-uart-port-param", sizeof (HyScanParamsSensorUartPortParam), TRUE },
+  { (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_sensor_set_udp_ip_port_param,
+    (HyScanSonarControlModelApplyFunc) hyscan_sonar_control_model_apply_sensor_set_udp_ip_port_param,
+    hyscan_sonar_control_model_sensor_lane, HYSCAN_SONAR_CONTROL_MODEL_SLOT_SENSOR_PORT,
+    "sensor-set-udp-ip-port-param", sizeof (HyScanParamsSensorUdpIpPortParam), TRUE },
+  { (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_sensor_set_position,
+    (HyScanSonarControlModelApplyFunc) hyscan_sonar_control_model_apply_sensor_set_position,
+    hyscan_sonar_control_model_sensor_lane, HYSCAN_SONAR_CONTROL_MODEL_SLOT_SENSOR_POSITION,
+    "sensor-set-position", sizeof (HyScanParamsSensorPosition), TRUE },
+  { (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_sensor_set_enable,
+    (HyScanSonarControlModelApplyFunc) hyscan_sonar_control_model_apply_sensor_set_enable,
+    hyscan_sonar_control_model_sensor_lane, HYSCAN_SONAR_CONTROL_MODEL_SLOT_SENSOR_ENABLE,
+    "sensor-set-enable", sizeof (HyScanParamsSensorEnable), TRUE },
+  { (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_generator_set_preset,
+    (HyScanSonarControlModelApplyFunc) hyscan_sonar_control_model_apply_generator_set_preset,
+    hyscan_sonar_control_model_source_lane, HYSCAN_SONAR_CONTROL_MODEL_SLOT_GENERATOR_MODE,
+    "generator-set-preset", sizeof (HyScanParamsGeneratorPreset), FALSE },
+  { (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_generator_set_auto,
+    (HyScanSonarControlModelApplyFunc) hyscan_sonar_control_model_apply_generator_set_auto,
+    hyscan_sonar_control_model_source_lane, HYSCAN_SONAR_CONTROL_MODEL_SLOT_GENERATOR_MODE,
+    "generator-set-auto", sizeof (HyScanParamsGeneratorAuto), FALSE },
+  { (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_generator_set_simple,
+    (HyScanSonarControlModelApplyFunc) hyscan_sonar_control_model_apply_generator_set_simple,
+    hyscan_sonar_control_model_source_lane, HYSCAN_SONAR_CONTROL_MODEL_SLOT_GENERATOR_MODE,
+    "generator-set-simple", sizeof (HyScanParamsGeneratorSimple), FALSE },
+  { (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_generator_set_extended,
+    (HyScanSonarControlModelApplyFunc) hyscan_sonar_control_model_apply_generator_set_extended,
+    hyscan_sonar_control_model_source_lane, HYSCAN_SONAR_CONTROL_MODEL_SLOT_GENERATOR_MODE,
+    "generator-set-extended", sizeof (HyScanParamsGeneratorExtended), FALSE },
+  { (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_generator_set_enable,
+    (HyScanSonarControlModelApplyFunc) hyscan_sonar_control_model_apply_generator_set_enable,
+    hyscan_sonar_control_model_source_lane, HYSCAN_SONAR_CONTROL_MODEL_SLOT_GENERATOR_ENABLE,
+    "generator-set-enable", sizeof (HyScanParamsGeneratorEnable), FALSE },
+  { (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_tvg_set_auto,
+    (HyScanSonarControlModelApplyFunc) hyscan_sonar_control_model_apply_tvg_set_auto,
+    hyscan_sonar_control_model_source_lane, HYSCAN_SONAR_CONTROL_MODEL_SLOT_TVG_MODE,
+    "tvg-set-auto", sizeof (HyScanParamsTVGAuto), FALSE },
+  { (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_tvg_set_constant,
+    (HyScanSonarControlModelApplyFunc) hyscan_sonar_control_model_apply_tvg_set_constant,
+    hyscan_sonar_control_model_source_lane, HYSCAN_SONAR_CONTROL_MODEL_SLOT_TVG_MODE,
+    "tvg-set-constant", sizeof (HyScanParamsTVGConstant), FALSE },
+  { (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_tvg_set_linear_db,
+    (HyScanSonarControlModelApplyFunc) hyscan_sonar_control_model_apply_tvg_set_linear_db,
+    hyscan_sonar_control_model_source_lane, HYSCAN_SONAR_CONTROL_MODEL_SLOT_TVG_MODE,
+    "tvg-set-linear-db", sizeof (HyScanParamsTVGLinearDB), FALSE },
+  { (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_tvg_set_logarithmic,
+    (HyScanSonarControlModelApplyFunc) hyscan_sonar_control_model_apply_tvg_set_logarithmic,
+    hyscan_sonar_control_model_source_lane, HYSCAN_SONAR_CONTROL_MODEL_SLOT_TVG_MODE,
+    "tvg-set-logarithmic", sizeof (HyScanParamsTVGLogarithmic), FALSE },
+  { (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_tvg_set_enable,
+    (HyScanSonarControlModelApplyFunc) hyscan_sonar_control_model_apply_tvg_set_enable,
+    hyscan_sonar_control_model_source_lane, HYSCAN_SONAR_CONTROL_MODEL_SLOT_TVG_ENABLE,
+    "tvg-set-enable", sizeof (HyScanParamsTVGEnable), FALSE },
+  { (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_sonar_set_sync_type,
+    (HyScanSonarControlModelApplyFunc) hyscan_sonar_control_model_apply_sonar_set_sync_type,
+    hyscan_sonar_control_model_barrier_lane, HYSCAN_SONAR_CONTROL_MODEL_SLOT_SYNC_TYPE,
+    "sonar-set-sync-type", sizeof (HyScanParamsSonarSyncType), FALSE },
+  { (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_sonar_set_position,
+    (HyScanSonarControlModelApplyFunc) hyscan_sonar_control_model_apply_sonar_set_position,
+    hyscan_sonar_control_model_source_lane, HYSCAN_SONAR_CONTROL_MODEL_SLOT_SONAR_POSITION,
+    "sonar-set-position", sizeof (HyScanParamsSonarPosition), FALSE },
+  { (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_sonar_set_receive_time,
+    (HyScanSonarControlModelApplyFunc) hyscan_sonar_control_model_apply_sonar_set_receive_time,
+    hyscan_sonar_control_model_source_lane, HYSCAN_SONAR_CONTROL_MODEL_SLOT_RECEIVE_TIME,
+    "sonar-set-receive-time", sizeof (HyScanParamsSonarReceiveTime), FALSE },
+  { (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_sonar_start,
+    (HyScanSonarControlModelApplyFunc) hyscan_sonar_control_model_apply_sonar_start,
+    hyscan_sonar_control_model_barrier_lane, HYSCAN_SONAR_CONTROL_MODEL_SLOT_NONE,
+    "sonar-start", sizeof (HyScanParamsSonarStart), TRUE },
+  { (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_sonar_stop,
+    (HyScanSonarControlModelApplyFunc) hyscan_sonar_control_model_apply_sonar_stop,
+    hyscan_sonar_control_model_barrier_lane, HYSCAN_SONAR_CONTROL_MODEL_SLOT_NONE,
+    "sonar-stop", 0, FALSE },
+  { (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_sonar_ping,
+    (HyScanSonarControlModelApplyFunc) hyscan_sonar_control_model_apply_sonar_ping,
+    hyscan_sonar_control_model_barrier_lane, HYSCAN_SONAR_CONTROL_MODEL_SLOT_NONE,
+    "sonar-ping", 0, FALSE }
+};
+
 G_DEFINE_TYPE_WITH_PRIVATE (HyScanSonarControlModel, hyscan_sonar_control_model, HYSCAN_TYPE_ASYNC)
 
 static void
@@ -262,12 +657,34 @@ hyscan_sonar_control_model_class_init (HyScanSonarControlModelClass *klass)
                                                         "HyScan Sonar Control interface",
                                                         HYSCAN_TYPE_SONAR_CONTROL,
                                                         G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (gobject_class,
+                                   PROP_SHADOW_CACHE,
+                                   g_param_spec_boolean ("shadow-cache",
+                                                         "ShadowCache",
+                                                         "Skip commands matching the last applied parameters",
+                                                         FALSE,
+                                                         G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
+
+  g_object_class_install_property (gobject_class,
+                                   PROP_JOURNAL,
+                                   g_param_spec_string ("journal",
+                                                        "Journal",
+                                                        "Path to the binary journal of executed commands",
+                                                        NULL,
+                                                        G_PARAM_WRITABLE | G_PARAM_CONSTRUCT_ONLY));
 }
 
 static void
 hyscan_sonar_control_model_init (HyScanSonarControlModel *sonar_control_model)
 {
   sonar_control_model->priv = hyscan_sonar_control_model_get_instance_private (sonar_control_model);
+
+  g_mutex_init (&sonar_control_model->priv->shadow_lock);
+  g_mutex_init (&sonar_control_model->priv->journal_lock);
+  sonar_control_model->priv->shadow = g_hash_table_new_full (g_int64_hash, g_int64_equal, NULL, g_free);
+  sonar_control_model->priv->stats = g_new0 (HyScanSonarControlModelCommandStats,
+                                             G_N_ELEMENTS (hyscan_sonar_control_model_commands));
 }
 
 static void
@@ -282,6 +699,14 @@ hyscan_sonar_control_model_set_property (GObject      *object,
       HYSCAN_SONAR_CONTROL_MODEL (object)->priv->sonar_control = g_value_dup_object (value);
       break;
 
+    case PROP_SHADOW_CACHE:
+      HYSCAN_SONAR_CONTROL_MODEL (object)->priv->shadow_cache = g_value_get_boolean (value);
+      break;
+
+    case PROP_JOURNAL:
+      HYSCAN_SONAR_CONTROL_MODEL (object)->priv->journal_path = g_value_dup_string (value);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -291,83 +716,639 @@ hyscan_sonar_control_model_set_property (GObject      *object,
 static void
 hyscan_sonar_control_model_constructed (GObject *object)
 {
+  HyScanSonarControlModelPrivate *priv = HYSCAN_SONAR_CONTROL_MODEL (object)->priv;
+
   G_OBJECT_CLASS (hyscan_sonar_control_model_parent_class)->constructed (object);
+
+  if (priv->journal_path == NULL)
+    return;
+
+  /* Записи журнала накапливаются в буфере и сбрасываются в файл после выполнения
+   * каждого пакета запросов. Запросы по расписанию пакет не завершают, поэтому
+   * записи, накопленные дольше HYSCAN_SONAR_CONTROL_MODEL_JOURNAL_FLUSH_TIME,
+   * сбрасывает рабочий поток. */
+  priv->journal = g_fopen (priv->journal_path, "wb");
+  if (priv->journal == NULL)
+    {
+      g_warning ("HyScanSonarControlModel: can't open journal %s: %s",
+                 priv->journal_path, g_strerror (errno));
+      return;
+    }
+
+  priv->journal_buffer = g_malloc (HYSCAN_SONAR_CONTROL_MODEL_JOURNAL_BUFFER);
+  setvbuf (priv->journal, priv->journal_buffer, _IOFBF, HYSCAN_SONAR_CONTROL_MODEL_JOURNAL_BUFFER);
+
+  hyscan_sonar_control_model_journal_write_header (priv->journal);
+  priv->journal_flushed = g_get_monotonic_time ();
+
+  g_signal_connect (object, "completed", G_CALLBACK (hyscan_sonar_control_model_journal_flush), NULL);
 }
 
 static void
 hyscan_sonar_control_model_finalize (GObject *object)
 {
-  g_clear_object (&HYSCAN_SONAR_CONTROL_MODEL (object)->priv->sonar_control);
+  HyScanSonarControlModelPrivate *priv = HYSCAN_SONAR_CONTROL_MODEL (object)->priv;
+
+  g_clear_pointer (&priv->transaction, hyscan_sonar_control_model_transaction_free);
+  g_clear_object (&priv->sonar_control);
+
+  g_hash_table_unref (priv->shadow);
+  g_mutex_clear (&priv->shadow_lock);
+
+  if (priv->journal != NULL)
+    fclose (priv->journal);
+  g_free (priv->journal_buffer);
+  g_free (priv->journal_path);
+  g_mutex_clear (&priv->journal_lock);
+
+  g_free (priv->stats);
 
   G_OBJECT_CLASS (hyscan_sonar_control_model_parent_class)->finalize (object);
 }
 
-/* Команда запроса установки режима синхронизации. */
+/* Добавляет запрос в список запросов модели. */
 static gboolean
-hyscan_sonar_control_model_cmd_sonar_set_sync_type (HyScanSonarControlModel   *model,
-                                                    HyScanParamsSonarSyncType *params)
+hyscan_sonar_control_model_append (HyScanSonarControlModel          *model,
+                                   HyScanSonarControlModelCommandId  id,
+                                   gint                              priority,
+                                   gconstpointer                     params)
+{
+  const HyScanSonarControlModelCommandInfo *command = &hyscan_sonar_control_model_commands[id];
+  HyScanAsyncQueryOptions options = { 0 };
+  guint lane;
+
+  lane = (*command->lane) (params);
+
+  /* В открытой транзакции изменения накапливаются до её завершения. */
+  if (model->priv->transaction != NULL)
+    {
+      hyscan_sonar_control_model_transaction_add (model->priv->transaction, id, lane, priority, 0,
+                                                  g_memdup (params, command->size), g_free);
+      return TRUE;
+    }
+
+  /* Изменения одной группы для того же источника или датчика замещают друг друга. */
+  options.lane = lane;
+  options.priority = priority;
+  options.key = hyscan_sonar_control_model_shadow_key (id, lane);
+
+  return hyscan_async_append_query_full (HYSCAN_ASYNC (model), command->command, model,
+                                         params, command->size, &options) != 0;
+}
+
+/* Добавляет запрос изменения параметров из транзакции, передавая ему параметры во владение. */
+static gboolean
+hyscan_sonar_control_model_append_take (HyScanSonarControlModel          *model,
+                                        HyScanSonarControlModelCommandId  id,
+                                        guint                             lane,
+                                        gint                              priority,
+                                        gpointer                          params,
+                                        GDestroyNotify                    destroy)
+{
+  HyScanAsyncQueryOptions options = { 0 };
+
+  options.lane = lane;
+  options.priority = priority;
+  options.key = hyscan_sonar_control_model_shadow_key (id, lane);
+
+  return hyscan_async_append_query_take (HYSCAN_ASYNC (model), hyscan_sonar_control_model_commands[id].command,
+                                         model, params, destroy, &options) != 0;
+}
+
+/* Добавляет запрос пуска, останова или зондирования. Каждый такой запрос зависит от
+ * предыдущего, поэтому они выполняются в порядке вызова: останов с высоким приоритетом
+ * обгоняет изменения параметров, но передаёт свой приоритет ранее добавленным пуску
+ * и зондированию и выполняется после них. Запрос с max_attempts, равным единице,
+ * не повторяется. Параметры передаются во владение запросу. */
+static gboolean
+hyscan_sonar_control_model_append_run (HyScanSonarControlModel          *model,
+                                       HyScanSonarControlModelCommandId  id,
+                                       gint                              priority,
+                                       guint                             max_attempts,
+                                       gpointer                          params,
+                                       GDestroyNotify                    destroy)
 {
   HyScanSonarControlModelPrivate *priv = model->priv;
+  HyScanAsyncQueryOptions options = { 0 };
+  guint query;
 
-  if (priv->sonar_control == NULL)
-    return FALSE;
+  if (priv->transaction != NULL)
+    {
+      hyscan_sonar_control_model_transaction_add (priv->transaction, id, HYSCAN_ASYNC_LANE_BARRIER,
+                                                  priority, max_attempts, params, destroy);
+      return TRUE;
+    }
+
+  options.lane = HYSCAN_ASYNC_LANE_BARRIER;
+  options.priority = priority;
+  options.key = HYSCAN_ASYNC_LANE_BARRIER;
+  options.retry.max_attempts = max_attempts;
+
+  /* Зависимость от запроса уже выполненного пакета не учитывается. */
+  if (priv->last_run != 0)
+    {
+      options.depends_on = &priv->last_run;
+      options.n_depends_on = 1;
+    }
 
-  if (params == NULL)
+  query = hyscan_async_append_query_take (HYSCAN_ASYNC (model), hyscan_sonar_control_model_commands[id].command,
+                                          model, params, destroy, &options);
+  if (query == 0)
     return FALSE;
 
-  return hyscan_sonar_control_set_sync_type (priv->sonar_control, params->sync_type);
+  priv->last_run = query;
+
+  return TRUE;
 }
 
-/* Команда запроса установки местоположения антенн ГЛ. */
+/* Освобождает параметры запроса запуска ГЛ. */
+static void
+hyscan_sonar_control_model_params_sonar_start_free (HyScanParamsSonarStart *params)
+{
+  g_free (params->track_name);
+  g_free (params);
+}
+
+/* Добавляет изменение в транзакцию. Изменение той же группы для того же источника
+ * данных или датчика, добавленное после последней необъединяемой команды (пуска,
+ * останова или зондирования), удаляется, а новое изменение добавляется в конец,
+ * поэтому порядок применения сохраняется. */
+static void
+hyscan_sonar_control_model_transaction_add (HyScanSonarControlModelTransaction *transaction,
+                                            HyScanSonarControlModelCommandId    id,
+                                            guint                               lane,
+                                            gint                                priority,
+                                            guint                               max_attempts,
+                                            gpointer                            params,
+                                            GDestroyNotify                      destroy)
+{
+  HyScanSonarControlModelChange change;
+  guint i;
+
+  change.id = id;
+  change.slot = hyscan_sonar_control_model_commands[id].slot;
+  change.lane = lane;
+  change.priority = priority;
+  change.max_attempts = max_attempts;
+  change.params = params;
+  change.destroy = destroy;
+
+  if (change.slot == HYSCAN_SONAR_CONTROL_MODEL_SLOT_NONE)
+    {
+      g_array_append_val (transaction->changes, change);
+      transaction->barrier = transaction->changes->len;
+      return;
+    }
+
+  for (i = transaction->barrier; i < transaction->changes->len; i++)
+    {
+      HyScanSonarControlModelChange *pending;
+
+      pending = &g_array_index (transaction->changes, HyScanSonarControlModelChange, i);
+      if (pending->slot == change.slot && pending->lane == change.lane)
+        {
+          if (pending->destroy != NULL)
+            pending->destroy (pending->params);
+          g_array_remove_index (transaction->changes, i);
+          break;
+        }
+    }
+
+  g_array_append_val (transaction->changes, change);
+}
+
+/* Освобождает транзакцию. */
+static void
+hyscan_sonar_control_model_transaction_free (HyScanSonarControlModelTransaction *transaction)
+{
+  guint i;
+
+  for (i = 0; i < transaction->changes->len; i++)
+    {
+      HyScanSonarControlModelChange *change;
+
+      change = &g_array_index (transaction->changes, HyScanSonarControlModelChange, i);
+      if (change->destroy != NULL)
+        change->destroy (change->params);
+    }
+
+  g_array_unref (transaction->changes);
+  g_free (transaction);
+}
+
+/* Возвращает ключ группы команды для источника данных или датчика. Он используется
+ * для поиска применённого значения и как ключ объединения запросов. */
+static gint64
+hyscan_sonar_control_model_shadow_key (HyScanSonarControlModelCommandId id,
+                                       guint                            lane)
+{
+  return ((gint64) hyscan_sonar_control_model_commands[id].slot << 32) | lane;
+}
+
+/* Проверяет, совпадает ли команда с последней успешно применённой командой той же группы. */
 static gboolean
-hyscan_sonar_control_model_cmd_sonar_set_position (HyScanSonarControlModel   *model,
-                                                   HyScanParamsSonarPosition *params)
+hyscan_sonar_control_model_shadow_match (HyScanSonarControlModel          *model,
+                                         HyScanSonarControlModelCommandId  id,
+                                         guint                             lane,
+                                         gconstpointer                     params)
 {
   HyScanSonarControlModelPrivate *priv = model->priv;
+  HyScanSonarControlModelShadow *shadow;
+  gsize size = hyscan_sonar_control_model_commands[id].size;
+  gint64 key;
+  gboolean match;
 
-  if (priv->sonar_control == NULL)
+  if (!priv->shadow_cache || hyscan_sonar_control_model_commands[id].slot == HYSCAN_SONAR_CONTROL_MODEL_SLOT_NONE)
     return FALSE;
 
-  if (params == NULL)
-    return FALSE;
+  key = hyscan_sonar_control_model_shadow_key (id, lane);
+
+  g_mutex_lock (&priv->shadow_lock);
+  shadow = g_hash_table_lookup (priv->shadow, &key);
+  match = (shadow != NULL && shadow->id == id && memcmp (shadow->params, params, size) == 0);
+  g_mutex_unlock (&priv->shadow_lock);
 
-  return hyscan_sonar_control_set_position (priv->sonar_control, params->source, &params->position);
+  if (match)
+    g_atomic_int_inc (&priv->stats[id].n_cached);
+
+  return match;
 }
 
-/* Команда запроса установки времени приёма ГЛ. */
+/* Запоминает параметры успешно применённой команды. После ошибки состояние
+ * гидролокатора неизвестно, поэтому применённое значение группы забывается. */
 static gboolean
-hyscan_sonar_control_model_cmd_sonar_set_receive_time (HyScanSonarControlModel      *model,
-                                                       HyScanParamsSonarReceiveTime *params)
+hyscan_sonar_control_model_shadow_update (HyScanSonarControlModel          *model,
+                                          HyScanSonarControlModelCommandId  id,
+                                          guint                             lane,
+                                          gconstpointer                     params,
+                                          gboolean                          result)
 {
   HyScanSonarControlModelPrivate *priv = model->priv;
+  HyScanSonarControlModelShadow *shadow;
+  gsize size = hyscan_sonar_control_model_commands[id].size;
+  gint64 key;
 
-  if (priv->sonar_control == NULL)
+  if (!priv->shadow_cache || hyscan_sonar_control_model_commands[id].slot == HYSCAN_SONAR_CONTROL_MODEL_SLOT_NONE)
+    return result;
+
+  key = hyscan_sonar_control_model_shadow_key (id, lane);
+
+  g_mutex_lock (&priv->shadow_lock);
+  if (result)
+    {
+      shadow = g_malloc (sizeof (HyScanSonarControlModelShadow) + size);
+      shadow->key = key;
+      shadow->id = id;
+      memcpy (shadow->params, params, size);
+      g_hash_table_replace (priv->shadow, &shadow->key, shadow);
+    }
+  else
+    {
+      g_hash_table_remove (priv->shadow, &key);
+    }
+  g_mutex_unlock (&priv->shadow_lock);
+
+  return result;
+}
+
+/* Учитывает команду, переданную гидролокатору: обновляет статистику команды и записывает
+ * команду в журнал. Статистика обновляется атомарными операциями без блокировок, запись
+ * журнала формируется на стеке и копируется в буфер файла без выделения памяти. */
+static void
+hyscan_sonar_control_model_executed (HyScanSonarControlModel          *model,
+                                     HyScanSonarControlModelCommandId  id,
+                                     gint64                            start,
+                                     gconstpointer                     params,
+                                     gboolean                          result)
+{
+  HyScanSonarControlModelPrivate *priv = model->priv;
+  HyScanSonarControlModelCommandStats *stats;
+  HyScanSonarControlModelJournalRecord record;
+  const gchar *string = NULL;
+  guint16 string_size = 0;
+  guint16 params_size;
+  gint64 now, duration;
+
+  now = g_get_monotonic_time ();
+  duration = now - start;
+
+  stats = &priv->stats[id];
+  g_atomic_int_inc (&stats->n_calls);
+  if (!result)
+    g_atomic_int_inc (&stats->n_failed);
+  hyscan_async_histogram_add (&stats->time, duration);
+
+  if (priv->journal == NULL)
+    return;
+
+  if (hyscan_sonar_control_model_commands[id].string && params != NULL)
+    {
+      memcpy (&string, params, sizeof (string));
+
+      if (string != NULL)
+        string_size = MIN (strlen (string), HYSCAN_SONAR_CONTROL_MODEL_JOURNAL_NULL_STRING - 1);
+      else
+        string_size = HYSCAN_SONAR_CONTROL_MODEL_JOURNAL_NULL_STRING;
+    }
+
+  params_size = (params != NULL) ? hyscan_sonar_control_model_commands[id].size : 0;
+
+  record.time = GINT64_TO_LE (start);
+  record.duration = GINT64_TO_LE (duration);
+  record.command = GUINT16_TO_LE (id);
+  record.result = GUINT16_TO_LE (result ? 1 : 0);
+  record.string_size = GUINT16_TO_LE (string_size);
+  record.params_size = GUINT16_TO_LE (params_size);
+
+  if (string_size == HYSCAN_SONAR_CONTROL_MODEL_JOURNAL_NULL_STRING)
+    string_size = 0;
+
+  g_mutex_lock (&priv->journal_lock);
+  fwrite (&record, sizeof (record), 1, priv->journal);
+  fwrite (string, 1, string_size, priv->journal);
+  fwrite (params, 1, params_size, priv->journal);
+
+  if (now - priv->journal_flushed > HYSCAN_SONAR_CONTROL_MODEL_JOURNAL_FLUSH_TIME)
+    {
+      fflush (priv->journal);
+      priv->journal_flushed = now;
+    }
+  g_mutex_unlock (&priv->journal_lock);
+}
+
+/* Записывает заголовок журнала команд. */
+static void
+hyscan_sonar_control_model_journal_write_header (FILE *journal)
+{
+  HyScanSonarControlModelJournalHeader header;
+  guint i;
+
+  header.magic = GUINT32_TO_LE (HYSCAN_SONAR_CONTROL_MODEL_JOURNAL_MAGIC);
+  header.version = GUINT32_TO_LE (HYSCAN_SONAR_CONTROL_MODEL_JOURNAL_VERSION);
+  header.byte_order = GUINT32_TO_LE (G_BYTE_ORDER);
+  header.pointer_size = GUINT16_TO_LE (sizeof (gpointer));
+  header.n_commands = GUINT16_TO_LE (G_N_ELEMENTS (hyscan_sonar_control_model_commands));
+  fwrite (&header, sizeof (header), 1, journal);
+
+  for (i = 0; i < G_N_ELEMENTS (hyscan_sonar_control_model_commands); i++)
+    {
+      guint16 size = GUINT16_TO_LE (hyscan_sonar_control_model_commands[i].size);
+
+      fwrite (&size, sizeof (size), 1, journal);
+    }
+}
+
+/* Обработчик сигнала "completed": сбрасывает записи журнала в файл. */
+static void
+hyscan_sonar_control_model_journal_flush (HyScanSonarControlModel *model,
+                                          gboolean                 result,
+                                          gpointer                 user_data)
+{
+  HyScanSonarControlModelPrivate *priv = model->priv;
+
+  g_mutex_lock (&priv->journal_lock);
+  fflush (priv->journal);
+  priv->journal_flushed = g_get_monotonic_time ();
+  g_mutex_unlock (&priv->journal_lock);
+}
+
+/* Проверяет заголовок журнала. Журнал читается, если его параметры команд записаны
+ * в представлении текущей архитектуры: совпадают порядок байтов, размер указателя
+ * и размеры параметров всех известных команд. Команды, добавленные в более новой
+ * версии, отвергаются при чтении записей. */
+static gboolean
+hyscan_sonar_control_model_journal_read_header (const gchar *data,
+                                                gsize        size,
+                                                gsize       *offset)
+{
+  HyScanSonarControlModelJournalHeader header;
+  guint n_commands;
+  guint i;
+
+  if (size < sizeof (header))
     return FALSE;
 
-  if (params == NULL)
+  memcpy (&header, data, sizeof (header));
+  if (GUINT32_FROM_LE (header.magic) != HYSCAN_SONAR_CONTROL_MODEL_JOURNAL_MAGIC ||
+      GUINT32_FROM_LE (header.version) != HYSCAN_SONAR_CONTROL_MODEL_JOURNAL_VERSION ||
+      GUINT32_FROM_LE (header.byte_order) != G_BYTE_ORDER ||
+      GUINT16_FROM_LE (header.pointer_size) != sizeof (gpointer))
+    {
+      return FALSE;
+    }
+
+  n_commands = GUINT16_FROM_LE (header.n_commands);
+  if ((size - sizeof (header)) / sizeof (guint16) < n_commands)
     return FALSE;
 
-  return hyscan_sonar_control_set_receive_time (priv->sonar_control, params->source, params->receive_time);
+  for (i = 0; i < n_commands && i < G_N_ELEMENTS (hyscan_sonar_control_model_commands); i++)
+    {
+      guint16 command_size;
+
+      memcpy (&command_size, data + sizeof (header) + i * sizeof (guint16), sizeof (guint16));
+      if (GUINT16_FROM_LE (command_size) != hyscan_sonar_control_model_commands[i].size)
+        return FALSE;
+    }
+
+  *offset = sizeof (header) + n_commands * sizeof (guint16);
+
+  return TRUE;
 }
 
-/* Команда запроса запуска ГЛ. */
+/* Читает очередную запись журнала и её параметры. Строка параметров заменяется
+ * указателем на строку из таблицы строк GLib или NULL, если команда была выполнена
+ * без строки. Возвращает описание команды или NULL, если данные журнала повреждены. */
+static const HyScanSonarControlModelCommandInfo *
+hyscan_sonar_control_model_journal_read (const gchar                          *data,
+                                         gsize                                 size,
+                                         gsize                                *offset,
+                                         HyScanSonarControlModelJournalRecord *record,
+                                         gpointer                              params)
+{
+  const HyScanSonarControlModelCommandInfo *command;
+  gboolean null_string;
+
+  if (size - *offset < sizeof (*record))
+    return NULL;
+
+  memcpy (record, data + *offset, sizeof (*record));
+  *offset += sizeof (*record);
+
+  record->time = GINT64_FROM_LE (record->time);
+  record->duration = GINT64_FROM_LE (record->duration);
+  record->command = GUINT16_FROM_LE (record->command);
+  record->result = GUINT16_FROM_LE (record->result);
+  record->string_size = GUINT16_FROM_LE (record->string_size);
+  record->params_size = GUINT16_FROM_LE (record->params_size);
+
+  null_string = (record->string_size == HYSCAN_SONAR_CONTROL_MODEL_JOURNAL_NULL_STRING);
+  if (null_string)
+    record->string_size = 0;
+
+  if (record->command >= G_N_ELEMENTS (hyscan_sonar_control_model_commands))
+    return NULL;
+
+  command = &hyscan_sonar_control_model_commands[record->command];
+  if (record->params_size != command->size)
+    return NULL;
+  if (null_string && !command->string)
+    return NULL;
+  if (size - *offset < (gsize) record->string_size + record->params_size)
+    return NULL;
+
+  memcpy (params, data + *offset + record->string_size, record->params_size);
+
+  if (command->string)
+    {
+      const gchar *interned = NULL;
+
+      if (!null_string)
+        {
+          gchar *string = g_strndup (data + *offset, record->string_size);
+
+          interned = g_intern_string (string);
+          g_free (string);
+        }
+
+      memcpy (params, &interned, sizeof (interned));
+    }
+
+  *offset += record->string_size + record->params_size;
+
+  return command;
+}
+
+/* Возвращает полосу выполнения команды источника данных. */
+static guint
+hyscan_sonar_control_model_source_lane (gconstpointer params)
+{
+  HyScanSourceType source;
+
+  memcpy (&source, params, sizeof (source));
+
+  return HYSCAN_SONAR_CONTROL_MODEL_SOURCE_LANE (source);
+}
+
+/* Возвращает полосу выполнения команды датчика. */
+static guint
+hyscan_sonar_control_model_sensor_lane (gconstpointer params)
+{
+  const gchar *name;
+
+  memcpy (&name, params, sizeof (name));
+
+  return HYSCAN_SONAR_CONTROL_MODEL_SENSOR_LANE (name);
+}
+
+/* Возвращает полосу выполнения общей команды гидролокатора. */
+static guint
+hyscan_sonar_control_model_barrier_lane (gconstpointer params)
+{
+  return HYSCAN_ASYNC_LANE_BARRIER;
+}
+
+/* Выполняет команду гидролокатора. Команда, совпадающая с последним применённым значением
+ * той же группы, пропускается. Переданная гидролокатору команда учитывается в статистике
+ * и журнале, её параметры запоминаются как применённое значение группы. */
 static gboolean
-hyscan_sonar_control_model_cmd_sonar_start (HyScanSonarControlModel *model,
-                                            HyScanParamsSonarStart  *params)
+hyscan_sonar_control_model_run (HyScanSonarControlModel          *model,
+                                HyScanSonarControlModelCommandId  id,
+                                gpointer                          params)
 {
+  const HyScanSonarControlModelCommandInfo *command = &hyscan_sonar_control_model_commands[id];
   HyScanSonarControlModelPrivate *priv = model->priv;
-  gboolean res;
+  guint lane;
+  gboolean result;
+  gint64 start;
 
   if (priv->sonar_control == NULL)
     return FALSE;
 
-  if (params == NULL)
+  if (params == NULL && command->size > 0)
     return FALSE;
 
-  res = hyscan_sonar_control_start (priv->sonar_control, params->track_name, params->track_type);
-  g_free (params->track_name);
+  lane = (*command->lane) (params);
+  if (hyscan_sonar_control_model_shadow_match (model, id, lane, params))
+    return TRUE;
+
+  start = g_get_monotonic_time ();
+  result = (*command->apply) (priv->sonar_control, params);
 
-  return res;
+  hyscan_sonar_control_model_executed (model, id, start, params, result);
+
+  return hyscan_sonar_control_model_shadow_update (model, id, lane, params, result);
+}
+
+/* Передаёт гидролокатору запрос установки режима синхронизации. */
+static gboolean
+hyscan_sonar_control_model_apply_sonar_set_sync_type (HyScanSonarControl        *sonar_control,
+                                                      HyScanParamsSonarSyncType *params)
+{
+  return hyscan_sonar_control_set_sync_type (sonar_control, params->sync_type);
+}
+
+/* Команда запроса установки режима синхронизации. */
+static gboolean
+hyscan_sonar_control_model_cmd_sonar_set_sync_type (HyScanSonarControlModel   *model,
+                                                    HyScanParamsSonarSyncType *params)
+{
+  return hyscan_sonar_control_model_run (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_SONAR_SET_SYNC_TYPE, params);
+}
+
+/* Передаёт гидролокатору запрос установки местоположения антенн ГЛ. */
+static gboolean
+hyscan_sonar_control_model_apply_sonar_set_position (HyScanSonarControl        *sonar_control,
+                                                     HyScanParamsSonarPosition *params)
+{
+  return hyscan_sonar_control_set_position (sonar_control, params->source, &params->position);
+}
+
+/* Команда запроса установки местоположения антенн ГЛ. */
+static gboolean
+hyscan_sonar_control_model_cmd_sonar_set_position (HyScanSonarControlModel   *model,
+                                                   HyScanParamsSonarPosition *params)
+{
+  return hyscan_sonar_control_model_run (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_SONAR_SET_POSITION, params);
+}
+
+/* Передаёт гидролокатору запрос установки времени приёма ГЛ. */
+static gboolean
+hyscan_sonar_control_model_apply_sonar_set_receive_time (HyScanSonarControl           *sonar_control,
+                                                         HyScanParamsSonarReceiveTime *params)
+{
+  return hyscan_sonar_control_set_receive_time (sonar_control, params->source, params->receive_time);
+}
+
+/* Команда запроса установки времени приёма ГЛ. */
+static gboolean
+hyscan_sonar_control_model_cmd_sonar_set_receive_time (HyScanSonarControlModel      *model,
+                                                       HyScanParamsSonarReceiveTime *params)
+{
+  return hyscan_sonar_control_model_run (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_SONAR_SET_RECEIVE_TIME, params);
+}
+
+/* Передаёт гидролокатору запрос запуска ГЛ. */
+static gboolean
+hyscan_sonar_control_model_apply_sonar_start (HyScanSonarControl     *sonar_control,
+                                              HyScanParamsSonarStart *params)
+{
+  return hyscan_sonar_control_start (sonar_control, params->track_name, params->track_type);
+}
+
+/* Команда запроса запуска ГЛ. */
+static gboolean
+hyscan_sonar_control_model_cmd_sonar_start (HyScanSonarControlModel *model,
+                                            HyScanParamsSonarStart  *params)
+{
+  return hyscan_sonar_control_model_run (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_SONAR_START, params);
+}
+
+/* Передаёт гидролокатору запрос останова ГЛ. */
+static gboolean
+hyscan_sonar_control_model_apply_sonar_stop (HyScanSonarControl *sonar_control,
+                                             gpointer            unused)
+{
+  return hyscan_sonar_control_stop (sonar_control);
 }
 
 /* Команда запроса останова ГЛ. */
@@ -375,12 +1356,15 @@ static gboolean
 hyscan_sonar_control_model_cmd_sonar_stop (HyScanSonarControlModel *model,
                                            gpointer                 unused)
 {
-  HyScanSonarControlModelPrivate *priv = model->priv;
-
-  if (priv->sonar_control == NULL)
-    return FALSE;
+  return hyscan_sonar_control_model_run (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_SONAR_STOP, NULL);
+}
 
-  return hyscan_sonar_control_stop (priv->sonar_control);
+/* Передаёт гидролокатору запрос выполнения одиночного зондирования. */
+static gboolean
+hyscan_sonar_control_model_apply_sonar_ping (HyScanSonarControl *sonar_control,
+                                             gpointer            unused)
+{
+  return hyscan_sonar_control_ping (sonar_control);
 }
 
 /* Команда запроса выполнения одиночного зондирования. */
@@ -388,12 +1372,16 @@ static gboolean
 hyscan_sonar_control_model_cmd_sonar_ping (HyScanSonarControlModel *model,
                                            gpointer                 unused)
 {
-  HyScanSonarControlModelPrivate *priv = model->priv;
-
-  if (priv->sonar_control == NULL)
-    return FALSE;
+  return hyscan_sonar_control_model_run (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_SONAR_PING, NULL);
+}
 
-  return hyscan_sonar_control_ping (priv->sonar_control);
+/* Передаёт гидролокатору запрос установки автоматического режима ВАРУ. */
+static gboolean
+hyscan_sonar_control_model_apply_tvg_set_auto (HyScanSonarControl  *sonar_control,
+                                               HyScanParamsTVGAuto *params)
+{
+  return hyscan_tvg_control_set_auto (HYSCAN_TVG_CONTROL (sonar_control),
+                                      params->source, params->level, params->sensitivity);
 }
 
 /* Команда запроса установки автоматического режима ВАРУ. */
@@ -401,16 +1389,15 @@ static gboolean
 hyscan_sonar_control_model_cmd_tvg_set_auto (HyScanSonarControlModel *model,
                                              HyScanParamsTVGAuto     *params)
 {
-  HyScanSonarControlModelPrivate *priv = model->priv;
-
-  if (priv->sonar_control == NULL)
-    return FALSE;
-
-  if (params == NULL)
-    return FALSE;
+  return hyscan_sonar_control_model_run (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_TVG_SET_AUTO, params);
+}
 
-  return hyscan_tvg_control_set_auto (HYSCAN_TVG_CONTROL (priv->sonar_control),
-                                      params->source, params->level, params->sensitivity);
+/* Передаёт гидролокатору запрос установки постоянного уровня усиления. */
+static gboolean
+hyscan_sonar_control_model_apply_tvg_set_constant (HyScanSonarControl      *sonar_control,
+                                                   HyScanParamsTVGConstant *params)
+{
+  return hyscan_tvg_control_set_constant (HYSCAN_TVG_CONTROL (sonar_control), params->source, params->gain);
 }
 
 /* Команда запроса установки постоянного уровня усиления. */
@@ -418,16 +1405,16 @@ static gboolean
 hyscan_sonar_control_model_cmd_tvg_set_constant (HyScanSonarControlModel *model,
                                                  HyScanParamsTVGConstant *params)
 {
-  HyScanSonarControlModelPrivate *priv = model->priv;
-
-  if (priv->sonar_control == NULL)
-    return FALSE;
-
-  if (params == NULL)
-    return FALSE;
+  return hyscan_sonar_control_model_run (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_TVG_SET_CONSTANT, params);
+}
 
-  return hyscan_tvg_control_set_constant (HYSCAN_TVG_CONTROL (priv->sonar_control),
-                                          params->source, params->gain);
+/* Передаёт гидролокатору запрос установки линейного увеличения усиления. */
+static gboolean
+hyscan_sonar_control_model_apply_tvg_set_linear_db (HyScanSonarControl      *sonar_control,
+                                                    HyScanParamsTVGLinearDB *params)
+{
+  return hyscan_tvg_control_set_linear_db (HYSCAN_TVG_CONTROL (sonar_control),
+                                           params->source, params->gain0, params->step);
 }
 
 /* Команда запроса установки линейного увеличения усиления. */
@@ -435,16 +1422,16 @@ static gboolean
 hyscan_sonar_control_model_cmd_tvg_set_linear_db (HyScanSonarControlModel *model,
                                                   HyScanParamsTVGLinearDB *params)
 {
-  HyScanSonarControlModelPrivate *priv = model->priv;
-
-  if (priv->sonar_control == NULL)
-    return FALSE;
-
-  if (params == NULL)
-    return FALSE;
+  return hyscan_sonar_control_model_run (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_TVG_SET_LINEAR_DB, params);
+}
 
-  return hyscan_tvg_control_set_linear_db (HYSCAN_TVG_CONTROL (priv->sonar_control),
-                                           params->source, params->gain0, params->step);
+/* Передаёт гидролокатору запрос установки логарифмического закона изменения усиления. */
+static gboolean
+hyscan_sonar_control_model_apply_tvg_set_logarithmic (HyScanSonarControl         *sonar_control,
+                                                      HyScanParamsTVGLogarithmic *params)
+{
+  return hyscan_tvg_control_set_logarithmic (HYSCAN_TVG_CONTROL (sonar_control),
+                                             params->source, params->gain0, params->beta, params->alpha);
 }
 
 /* Команда запроса установки логарифмического закона изменения усиления. */
@@ -452,16 +1439,15 @@ static gboolean
 hyscan_sonar_control_model_cmd_tvg_set_logarithmic (HyScanSonarControlModel    *model,
                                                     HyScanParamsTVGLogarithmic *params)
 {
-  HyScanSonarControlModelPrivate *priv = model->priv;
-
-  if (priv->sonar_control == NULL)
-    return FALSE;
-
-  if (params == NULL)
-    return FALSE;
+  return hyscan_sonar_control_model_run (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_TVG_SET_LOGARITHMIC, params);
+}
 
-  return hyscan_tvg_control_set_logarithmic (HYSCAN_TVG_CONTROL (priv->sonar_control),
-                                             params->source, params->gain0, params->beta, params->alpha);
+/* Передаёт гидролокатору запрос включения/выключения системы ВАРУ. */
+static gboolean
+hyscan_sonar_control_model_apply_tvg_set_enable (HyScanSonarControl    *sonar_control,
+                                                 HyScanParamsTVGEnable *params)
+{
+  return hyscan_tvg_control_set_enable (HYSCAN_TVG_CONTROL (sonar_control), params->source, params->enable);
 }
 
 /* Команда запроса включения/выключения системы ВАРУ. */
@@ -469,15 +1455,16 @@ static gboolean
 hyscan_sonar_control_model_cmd_tvg_set_enable (HyScanSonarControlModel *model,
                                                HyScanParamsTVGEnable   *params)
 {
-  HyScanSonarControlModelPrivate *priv = model->priv;
-
-  if (priv->sonar_control == NULL)
-    return FALSE;
-
-  if (params == NULL)
-    return FALSE;
+  return hyscan_sonar_control_model_run (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_TVG_SET_ENABLE, params);
+}
 
-  return hyscan_tvg_control_set_enable (HYSCAN_TVG_CONTROL (priv->sonar_control), params->source, params->enable);
+/* Передаёт гидролокатору запрос установки режима работы генератора по преднастройкам. */
+static gboolean
+hyscan_sonar_control_model_apply_generator_set_preset (HyScanSonarControl          *sonar_control,
+                                                       HyScanParamsGeneratorPreset *params)
+{
+  return hyscan_generator_control_set_preset (HYSCAN_GENERATOR_CONTROL (sonar_control),
+                                              params->source, params->preset);
 }
 
 /* Команда запроса установки режима работы генератора по преднастройкам. */
@@ -485,16 +1472,16 @@ static gboolean
 hyscan_sonar_control_model_cmd_generator_set_preset (HyScanSonarControlModel     *model,
                                                      HyScanParamsGeneratorPreset *params)
 {
-  HyScanSonarControlModelPrivate *priv = model->priv;
-
-  if (priv->sonar_control == NULL)
-    return FALSE;
-
-  if (params == NULL)
-    return FALSE;
+  return hyscan_sonar_control_model_run (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_GENERATOR_SET_PRESET, params);
+}
 
-  return hyscan_generator_control_set_preset (HYSCAN_GENERATOR_CONTROL (priv->sonar_control),
-                                              params->source, params->preset);
+/* Передаёт гидролокатору запрос установки автоматического режима генератора. */
+static gboolean
+hyscan_sonar_control_model_apply_generator_set_auto (HyScanSonarControl        *sonar_control,
+                                                     HyScanParamsGeneratorAuto *params)
+{
+  return hyscan_generator_control_set_auto (HYSCAN_GENERATOR_CONTROL (sonar_control),
+                                            params->source, params->signal);
 }
 
 /* Команда запроса установки автоматического режима генератора. */
@@ -502,16 +1489,16 @@ static gboolean
 hyscan_sonar_control_model_cmd_generator_set_auto (HyScanSonarControlModel   *model,
                                                    HyScanParamsGeneratorAuto *params)
 {
-  HyScanSonarControlModelPrivate *priv = model->priv;
-
-  if (priv->sonar_control == NULL)
-    return FALSE;
-
-  if (params == NULL)
-    return FALSE;
+  return hyscan_sonar_control_model_run (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_GENERATOR_SET_AUTO, params);
+}
 
-  return hyscan_generator_control_set_auto (HYSCAN_GENERATOR_CONTROL (priv->sonar_control),
-                                            params->source, params->signal);
+/* Передаёт гидролокатору запрос установки упрощённого режима генератора. */
+static gboolean
+hyscan_sonar_control_model_apply_generator_set_simple (HyScanSonarControl          *sonar_control,
+                                                       HyScanParamsGeneratorSimple *params)
+{
+  return hyscan_generator_control_set_simple (HYSCAN_GENERATOR_CONTROL (sonar_control),
+                                              params->source, params->signal, params->power);
 }
 
 /* Команда запроса установки упрощённого режима генератора. */
@@ -519,16 +1506,16 @@ static gboolean
 hyscan_sonar_control_model_cmd_generator_set_simple (HyScanSonarControlModel     *model,
                                                      HyScanParamsGeneratorSimple *params)
 {
-  HyScanSonarControlModelPrivate *priv = model->priv;
-
-  if (priv->sonar_control == NULL)
-    return FALSE;
-
-  if (params == NULL)
-    return FALSE;
+  return hyscan_sonar_control_model_run (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_GENERATOR_SET_SIMPLE, params);
+}
 
-  return hyscan_generator_control_set_simple (HYSCAN_GENERATOR_CONTROL (priv->sonar_control),
-                                              params->source, params->signal, params->power);
+/* Передаёт гидролокатору запрос установки расширенного режима генератора. */
+static gboolean
+hyscan_sonar_control_model_apply_generator_set_extended (HyScanSonarControl            *sonar_control,
+                                                         HyScanParamsGeneratorExtended *params)
+{
+  return hyscan_generator_control_set_extended (HYSCAN_GENERATOR_CONTROL (sonar_control),
+                                                params->source, params->signal, params->duration, params->power);
 }
 
 /* Команда запроса установки расширенного режима генератора. */
@@ -536,16 +1523,16 @@ static gboolean
 hyscan_sonar_control_model_cmd_generator_set_extended (HyScanSonarControlModel       *model,
                                                        HyScanParamsGeneratorExtended *params)
 {
-  HyScanSonarControlModelPrivate *priv = model->priv;
-
-  if (priv->sonar_control == NULL)
-    return FALSE;
-
-  if (params == NULL)
-    return FALSE;
+  return hyscan_sonar_control_model_run (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_GENERATOR_SET_EXTENDED, params);
+}
 
-  return hyscan_generator_control_set_extended (HYSCAN_GENERATOR_CONTROL (priv->sonar_control),
-                                                params->source, params->signal, params->duration, params->power);
+/* Передаёт гидролокатору запрос включения/выключения генератора. */
+static gboolean
+hyscan_sonar_control_model_apply_generator_set_enable (HyScanSonarControl          *sonar_control,
+                                                       HyScanParamsGeneratorEnable *params)
+{
+  return hyscan_generator_control_set_enable (HYSCAN_GENERATOR_CONTROL (sonar_control),
+                                              params->source, params->enable);
 }
 
 /* Команда запроса включения/выключения генератора. */
@@ -553,16 +1540,16 @@ static gboolean
 hyscan_sonar_control_model_cmd_generator_set_enable (HyScanSonarControlModel     *model,
                                                      HyScanParamsGeneratorEnable *params)
 {
-  HyScanSonarControlModelPrivate *priv = model->priv;
-
-  if (priv->sonar_control == NULL)
-    return FALSE;
-
-  if (params == NULL)
-    return FALSE;
+  return hyscan_sonar_control_model_run (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_GENERATOR_SET_ENABLE, params);
+}
 
-  return hyscan_generator_control_set_enable (HYSCAN_GENERATOR_CONTROL (priv->sonar_control),
-                                              params->source, params->enable);
+/* Передаёт гидролокатору запрос установки режима работы виртуального порта. */
+static gboolean
+hyscan_sonar_control_model_apply_sensor_set_virtual_port_param (HyScanSonarControl                 *sonar_control,
+                                                                HyScanParamsSensorVirtualPortParam *params)
+{
+  return hyscan_sensor_control_set_virtual_port_param (HYSCAN_SENSOR_CONTROL (sonar_control),
+                                                       params->name, params->channel, params->time_offset);
 }
 
 /* Команда запроса установки режима работы виртуального порта. */
@@ -570,19 +1557,17 @@ static gboolean
 hyscan_sonar_control_model_cmd_sensor_set_virtual_port_param (HyScanSonarControlModel            *model,
                                                               HyScanParamsSensorVirtualPortParam *params)
 {
-  HyScanSonarControlModelPrivate *priv = model->priv;
-  gboolean res;
-
-  if (priv->sonar_control == NULL)
-    return FALSE;
-
-  if (params == NULL)
-    return FALSE;
+  return hyscan_sonar_control_model_run (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_SENSOR_SET_VIRTUAL_PORT_PARAM, params);
+}
 
-  res = hyscan_sensor_control_set_virtual_port_param (HYSCAN_SENSOR_CONTROL (priv->sonar_control),
-                                                      params->name, params->channel, params->time_offset);
-  g_free (params->name);
-  return res;
+/* Передаёт гидролокатору запрос установки режима работы UART порта. */
+static gboolean
+hyscan_sonar_control_model_apply_sensor_set_uart_port_param (HyScanSonarControl              *sonar_control,
+                                                             HyScanParamsSensorUartPortParam *params)
+{
+  return hyscan_sensor_control_set_uart_port_param (HYSCAN_SENSOR_CONTROL (sonar_control),
+                                                    params->name, params->channel, params->time_offset,
+                                                    params->protocol, params->uart_device, params->uart_mode);
 }
 
 /* Команда запроса установки режима работы UART порта. */
@@ -590,20 +1575,17 @@ static gboolean
 hyscan_sonar_control_model_cmd_sensor_set_uart_port_param (HyScanSonarControlModel         *model,
                                                            HyScanParamsSensorUartPortParam *params)
 {
-  HyScanSonarControlModelPrivate *priv = model->priv;
-  gboolean res;
-
-  if (priv->sonar_control == NULL)
-    return FALSE;
-
-  if (params == NULL)
-    return FALSE;
+  return hyscan_sonar_control_model_run (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_SENSOR_SET_UART_PORT_PARAM, params);
+}
 
-  res = hyscan_sensor_control_set_uart_port_param (HYSCAN_SENSOR_CONTROL (priv->sonar_control),
-                                                   params->name, params->channel, params->time_offset,
-                                                   params->protocol, params->uart_device, params->uart_mode);
-  g_free (params->name);
-  return res;
+/* Передаёт гидролокатору запрос установки режима работы UDP/IP порта. */
+static gboolean
+hyscan_sonar_control_model_apply_sensor_set_udp_ip_port_param (HyScanSonarControl               *sonar_control,
+                                                               HyScanParamsSensorUdpIpPortParam *params)
+{
+  return hyscan_sensor_control_set_udp_ip_port_param (HYSCAN_SENSOR_CONTROL (sonar_control),
+                                                      params->name, params->channel, params->time_offset,
+                                                      params->protocol, params->ip_address, params->udp_port);
 }
 
 /* Команда запроса установки режима работы UDP/IP порта. */
@@ -611,20 +1593,16 @@ static gboolean
 hyscan_sonar_control_model_cmd_sensor_set_udp_ip_port_param (HyScanSonarControlModel          *model,
                                                              HyScanParamsSensorUdpIpPortParam *params)
 {
-  HyScanSonarControlModelPrivate *priv = model->priv;
-  gboolean res;
-
-  if (priv->sonar_control == NULL)
-    return FALSE;
-
-  if (params == NULL)
-    return FALSE;
+  return hyscan_sonar_control_model_run (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_SENSOR_SET_UDP_IP_PORT_PARAM, params);
+}
 
-  res = hyscan_sensor_control_set_udp_ip_port_param (HYSCAN_SENSOR_CONTROL (priv->sonar_control),
-                                                     params->name, params->channel, params->time_offset,
-                                                     params->protocol, params->ip_address, params->udp_port);
-  g_free (params->name);
-  return res;
+/* Передаёт гидролокатору запрос установки местоположения датчика. */
+static gboolean
+hyscan_sonar_control_model_apply_sensor_set_position (HyScanSonarControl         *sonar_control,
+                                                      HyScanParamsSensorPosition *params)
+{
+  return hyscan_sensor_control_set_position (HYSCAN_SENSOR_CONTROL (sonar_control),
+                                             params->name, &params->position);
 }
 
 /* Команда запроса установки местоположения датчика. */
@@ -632,19 +1610,15 @@ static gboolean
 hyscan_sonar_control_model_cmd_sensor_set_position (HyScanSonarControlModel    *model,
                                                     HyScanParamsSensorPosition *params)
 {
-  HyScanSonarControlModelPrivate *priv = model->priv;
-  gboolean res;
-
-  if (priv->sonar_control == NULL)
-    return FALSE;
-
-  if (params == NULL)
-    return FALSE;
+  return hyscan_sonar_control_model_run (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_SENSOR_SET_POSITION, params);
+}
 
-  res = hyscan_sensor_control_set_position (HYSCAN_SENSOR_CONTROL (priv->sonar_control),
-                                            params->name, &params->position);
-  g_free (params->name);
-  return res;
+/* Передаёт гидролокатору запрос включения/выключения датчика. */
+static gboolean
+hyscan_sonar_control_model_apply_sensor_set_enable (HyScanSonarControl       *sonar_control,
+                                                    HyScanParamsSensorEnable *params)
+{
+  return hyscan_sensor_control_set_enable (HYSCAN_SENSOR_CONTROL (sonar_control), params->name, params->enable);
 }
 
 /* Команда запроса включения/выключения датчика. */
@@ -652,28 +1626,14 @@ static gboolean
 hyscan_sonar_control_model_cmd_sensor_set_enable (HyScanSonarControlModel  *model,
                                                   HyScanParamsSensorEnable *params)
 {
-  HyScanSonarControlModelPrivate *priv = model->priv;
-  gboolean res;
-
-  if (priv->sonar_control == NULL)
-    return FALSE;
-
-  if (params == NULL)
-    return FALSE;
-
-  res = hyscan_sensor_control_set_enable (HYSCAN_SENSOR_CONTROL (priv->sonar_control),
-                                          params->name, params->enable);
-  g_free (params->name);
-  return res;
+  return hyscan_sonar_control_model_run (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_SENSOR_SET_ENABLE, params);
 }
 
 /* Создаёт новый класс асинхронного управления гидролокатором. */
 HyScanSonarControlModel *
 hyscan_sonar_control_model_new (HyScanSonarControl *sonar_control)
 {
-  return g_object_new (HYSCAN_TYPE_SONAR_CONTROL_MODEL,
-                       "sonar-control", sonar_control,
-                       NULL);
+  return g_object_new (HYSCAN_TYPE_SONAR_CONTROL_MODEL, "sonar-control", sonar_control, NULL);
 }
 
 /* Функция асинхронно устанавливает режим работы порта типа HYSCAN_SENSOR_CONTROL_PORT_VIRTUAL. */
@@ -683,18 +1643,17 @@ hyscan_sonar_control_model_sensor_set_virtual_port_param (HyScanSonarControlMode
                                                           guint                    channel,
                                                           gint64                   time_offset)
 {
-  HyScanAsyncCommand command;
   HyScanParamsSensorVirtualPortParam params;
 
   g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model), FALSE);
 
-  command = (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_sensor_set_virtual_port_param;
-
-  params.name = g_strdup (name);
+  memset (&params, 0, sizeof (params));
+  params.name = g_intern_string (name);
   params.channel = channel;
   params.time_offset = time_offset;
 
-  return hyscan_async_append_query (HYSCAN_ASYNC (model), command, model, &params, sizeof (params));
+  return hyscan_sonar_control_model_append (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_SENSOR_SET_VIRTUAL_PORT_PARAM,
+                                            HYSCAN_ASYNC_PRIORITY_DEFAULT, &params);
 }
 
 /* Функция асинхронно устанавливает режим работы порта типа HYSCAN_SENSOR_CONTROL_PORT_UART. */
@@ -707,21 +1666,20 @@ hyscan_sonar_control_model_sensor_set_uart_port_param (HyScanSonarControlModel
                                                        guint                     uart_device,
                                                        guint                     uart_mode)
 {
-  HyScanAsyncCommand command;
   HyScanParamsSensorUartPortParam params;
 
   g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model), FALSE);
 
-  command = (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_sensor_set_uart_port_param;
-
-  params.name = g_strdup (name);
+  memset (&params, 0, sizeof (params));
+  params.name = g_intern_string (name);
   params.channel = channel;
   params.time_offset = time_offset;
   params.protocol = protocol;
   params.uart_device = uart_device;
   params.uart_mode = uart_mode;
 
-  return hyscan_async_append_query (HYSCAN_ASYNC (model), command, model, &params, sizeof (params));
+  return hyscan_sonar_control_model_append (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_SENSOR_SET_UART_PORT_PARAM,
+                                            HYSCAN_ASYNC_PRIORITY_DEFAULT, &params);
 }
 
 /* Функция асинхронно устанавливает режим работы порта типа HYSCAN_SENSOR_CONTROL_PORT_UDP_IP. */
@@ -734,21 +1692,20 @@ hyscan_sonar_control_model_sensor_set_udp_ip_port_param (HyScanSonarControlModel
                                                          guint                     ip_address,
                                                          guint16                   udp_port)
 {
-  HyScanAsyncCommand command;
   HyScanParamsSensorUdpIpPortParam params;
 
   g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model), FALSE);
 
-  command = (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_sensor_set_udp_ip_port_param;
-
-  params.name = g_strdup (name);
+  memset (&params, 0, sizeof (params));
+  params.name = g_intern_string (name);
   params.channel = channel;
   params.time_offset = time_offset;
   params.protocol = protocol;
   params.ip_address = ip_address;
   params.udp_port = udp_port;
 
-  return hyscan_async_append_query (HYSCAN_ASYNC (model), command, model, &params, sizeof (params));
+  return hyscan_sonar_control_model_append (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_SENSOR_SET_UDP_IP_PORT_PARAM,
+                                            HYSCAN_ASYNC_PRIORITY_DEFAULT, &params);
 }
 
 /* Функция асинхронно устанавливает информацию о местоположении приёмных антенн относительно центра масс судна. */
@@ -757,16 +1714,16 @@ hyscan_sonar_control_model_sensor_set_position (HyScanSonarControlModel *model,
                                                 const gchar             *name,
                                                 HyScanAntennaPosition   *position)
 {
-  HyScanAsyncCommand command;
   HyScanParamsSensorPosition params;
-  g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model), FALSE);
 
-  command = (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_sensor_set_position;
+  g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model), FALSE);
 
-  params.name = g_strdup (name);
+  memset (&params, 0, sizeof (params));
+  params.name = g_intern_string (name);
   params.position = *position;
 
-  return hyscan_async_append_query (HYSCAN_ASYNC (model), command, model, &params, sizeof (params));
+  return hyscan_sonar_control_model_append (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_SENSOR_SET_POSITION,
+                                            HYSCAN_ASYNC_PRIORITY_DEFAULT, &params);
 }
 
 /* Функция асинхронно включает или выключает приём данных на указанном порту. */
@@ -775,17 +1732,16 @@ hyscan_sonar_control_model_sensor_set_enable (HyScanSonarControlModel *model,
                                               const gchar             *name,
                                               gboolean                 enable)
 {
-  HyScanAsyncCommand command;
   HyScanParamsSensorEnable params;
 
   g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model), FALSE);
 
-  command = (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_sensor_set_enable;
-
-  params.name = g_strdup (name);
+  memset (&params, 0, sizeof (params));
+  params.name = g_intern_string (name);
   params.enable = enable;
 
-  return hyscan_async_append_query (HYSCAN_ASYNC (model), command, model, &params, sizeof (params));
+  return hyscan_sonar_control_model_append (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_SENSOR_SET_ENABLE,
+                                            HYSCAN_ASYNC_PRIORITY_DEFAULT, &params);
 }
 
 /* Функция асинхронно включает преднастроенный режим работы генератора. */
@@ -794,17 +1750,16 @@ hyscan_sonar_control_model_generator_set_preset (HyScanSonarControlModel *model,
                                                  HyScanSourceType         source,
                                                  guint                    preset)
 {
-  HyScanAsyncCommand command;
   HyScanParamsGeneratorPreset params;
 
   g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model), FALSE);
 
-  command = (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_generator_set_preset;
-
+  memset (&params, 0, sizeof (params));
   params.source = source;
   params.preset = preset;
 
-  return hyscan_async_append_query (HYSCAN_ASYNC (model), command, model, &params, sizeof (params));
+  return hyscan_sonar_control_model_append (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_GENERATOR_SET_PRESET,
+                                            HYSCAN_ASYNC_PRIORITY_DEFAULT, &params);
 }
 
 /* Функция асинхронно включает автоматический режим работы генератора. */
@@ -813,17 +1768,16 @@ hyscan_sonar_control_model_generator_set_auto (HyScanSonarControlModel    *model
                                                HyScanSourceType            source,
                                                HyScanGeneratorSignalType   signal)
 {
-  HyScanAsyncCommand command;
   HyScanParamsGeneratorAuto params;
 
   g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model), FALSE);
 
-  command = (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_generator_set_auto;
-
+  memset (&params, 0, sizeof (params));
   params.source = source;
   params.signal = signal;
 
-  return hyscan_async_append_query (HYSCAN_ASYNC (model), command, model, &params, sizeof (params));
+  return hyscan_sonar_control_model_append (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_GENERATOR_SET_AUTO,
+                                            HYSCAN_ASYNC_PRIORITY_DEFAULT, &params);
 }
 
 /* Функция асинхронно включает упрощённый режим работы генератора. */
@@ -833,18 +1787,17 @@ hyscan_sonar_control_model_generator_set_simple (HyScanSonarControlModel    *mod
                                                  HyScanGeneratorSignalType   signal,
                                                  gdouble                     power)
 {
-  HyScanAsyncCommand  command;
   HyScanParamsGeneratorSimple params;
 
   g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model), FALSE);
 
-  command = (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_generator_set_simple;
-
+  memset (&params, 0, sizeof (params));
   params.source = source;
   params.signal = signal;
   params.power = power;
 
-  return hyscan_async_append_query (HYSCAN_ASYNC (model), command, model, &params, sizeof (params));
+  return hyscan_sonar_control_model_append (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_GENERATOR_SET_SIMPLE,
+                                            HYSCAN_ASYNC_PRIORITY_DEFAULT, &params);
 }
 
 /* Функция асинхронно включает расширенный режим работы генератора. */
@@ -855,19 +1808,18 @@ hyscan_sonar_control_model_generator_set_extended (HyScanSonarControlModel   *mo
                                                    gdouble                    duration,
                                                    gdouble                    power)
 {
-  HyScanAsyncCommand command;
   HyScanParamsGeneratorExtended params;
 
   g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model), FALSE);
 
-  command = (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_generator_set_extended;
-
+  memset (&params, 0, sizeof (params));
   params.source = source;
   params.signal = signal;
   params.duration = duration;
   params.power = power;
 
-  return hyscan_async_append_query (HYSCAN_ASYNC (model), command, model, &params, sizeof (params));
+  return hyscan_sonar_control_model_append (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_GENERATOR_SET_EXTENDED,
+                                            HYSCAN_ASYNC_PRIORITY_DEFAULT, &params);
 }
 
 
@@ -877,17 +1829,16 @@ hyscan_sonar_control_model_generator_set_enable (HyScanSonarControlModel *model,
                                                  HyScanSourceType         source,
                                                  gboolean                 enable)
 {
-  HyScanAsyncCommand command;
   HyScanParamsGeneratorEnable params;
 
   g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model), FALSE);
 
-  command = (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_generator_set_enable;
-
+  memset (&params, 0, sizeof (params));
   params.source = source;
   params.enable = enable;
 
-  return hyscan_async_append_query (HYSCAN_ASYNC (model), command, model, &params, sizeof (params));
+  return hyscan_sonar_control_model_append (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_GENERATOR_SET_ENABLE,
+                                            HYSCAN_ASYNC_PRIORITY_DEFAULT, &params);
 }
 
 
@@ -898,18 +1849,17 @@ hyscan_sonar_control_model_tvg_set_auto (HyScanSonarControlModel *model,
                                          gdouble                  level,
                                          gdouble                  sensitivity)
 {
-  HyScanAsyncCommand command;
   HyScanParamsTVGAuto params;
 
   g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model), FALSE);
 
-  command = (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_tvg_set_auto;
-
+  memset (&params, 0, sizeof (params));
   params.source = source;
   params.level = level;
   params.sensitivity = sensitivity;
 
-  return hyscan_async_append_query (HYSCAN_ASYNC (model), command, model, &params, sizeof (params));
+  return hyscan_sonar_control_model_append (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_TVG_SET_AUTO,
+                                            HYSCAN_ASYNC_PRIORITY_DEFAULT, &params);
 }
 
 /* Функция асинхронно устанавливает постоянный уровень усиления системой ВАРУ. */
@@ -918,17 +1868,16 @@ hyscan_sonar_control_model_tvg_set_constant (HyScanSonarControlModel *model,
                                              HyScanSourceType         source,
                                              gdouble                  gain)
 {
-  HyScanAsyncCommand command;
   HyScanParamsTVGConstant params;
 
   g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model), FALSE);
 
-  command = (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_tvg_set_constant;
-
+  memset (&params, 0, sizeof (params));
   params.source = source;
   params.gain = gain;
 
-  return hyscan_async_append_query (HYSCAN_ASYNC (model), command, model, &params, sizeof (params));
+  return hyscan_sonar_control_model_append (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_TVG_SET_CONSTANT,
+                                            HYSCAN_ASYNC_PRIORITY_DEFAULT, &params);
 }
 
 /* Функция асинхронно устанавливает линейное увеличение усиления в дБ на 100 метров. */
@@ -938,18 +1887,17 @@ hyscan_sonar_control_model_tvg_set_linear_db (HyScanSonarControlModel *model,
                                               gdouble                  gain0,
                                               gdouble                  step)
 {
-  HyScanAsyncCommand command;
   HyScanParamsTVGLinearDB params;
 
   g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model), FALSE);
 
-  command = (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_tvg_set_linear_db;
-
+  memset (&params, 0, sizeof (params));
   params.source = source;
   params.gain0 = gain0;
   params.step = step;
 
-  return hyscan_async_append_query (HYSCAN_ASYNC (model), command, model, &params, sizeof (params));
+  return hyscan_sonar_control_model_append (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_TVG_SET_LINEAR_DB,
+                                            HYSCAN_ASYNC_PRIORITY_DEFAULT, &params);
 }
 
 /* Функция асинхронно устанавливает логарифмический вид закона усиления системой ВАРУ. */
@@ -960,19 +1908,18 @@ hyscan_sonar_control_model_tvg_set_logarithmic (HyScanSonarControlModel *model,
                                                 gdouble                  beta,
                                                 gdouble                  alpha)
 {
-  HyScanAsyncCommand command;
   HyScanParamsTVGLogarithmic params;
 
   g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model), FALSE);
 
-  command = (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_tvg_set_logarithmic;
-
+  memset (&params, 0, sizeof (params));
   params.source = source;
   params.gain0 = gain0;
   params.beta = beta;
   params.alpha = alpha;
 
-  return hyscan_async_append_query (HYSCAN_ASYNC (model), command, model, &params, sizeof (params));
+  return hyscan_sonar_control_model_append (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_TVG_SET_LOGARITHMIC,
+                                            HYSCAN_ASYNC_PRIORITY_DEFAULT, &params);
 }
 
 /* Функция асинхронно включает или выключает систему ВАРУ. */
@@ -981,17 +1928,16 @@ hyscan_sonar_control_model_tvg_set_enable (HyScanSonarControlModel *model,
                                            HyScanSourceType         source,
                                            gboolean                 enable)
 {
-  HyScanAsyncCommand command;
   HyScanParamsTVGEnable params;
 
   g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model), FALSE);
 
-  command = (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_tvg_set_enable;
-
+  memset (&params, 0, sizeof (params));
   params.source = source;
   params.enable = enable;
 
-  return hyscan_async_append_query (HYSCAN_ASYNC (model), command, model, &params, sizeof (params));
+  return hyscan_sonar_control_model_append (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_TVG_SET_ENABLE,
+                                            HYSCAN_ASYNC_PRIORITY_DEFAULT, &params);
 }
 
 /* Функция асинхронно устанавливает тип синхронизации излучения. */
@@ -999,16 +1945,15 @@ gboolean
 hyscan_sonar_control_model_sonar_set_sync_type (HyScanSonarControlModel *model,
                                                 HyScanSonarSyncType      sync_type)
 {
-  HyScanAsyncCommand command;
   HyScanParamsSonarSyncType params;
 
   g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model), FALSE);
 
-  command = (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_sonar_set_sync_type;
-
+  memset (&params, 0, sizeof (params));
   params.sync_type = sync_type;
 
-  return hyscan_async_append_query (HYSCAN_ASYNC (model), command, model, &params, sizeof (params));
+  return hyscan_sonar_control_model_append (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_SONAR_SET_SYNC_TYPE,
+                                            HYSCAN_ASYNC_PRIORITY_DEFAULT, &params);
 }
 
 /* Функция асинхронно устанавливает информацию о местоположении приёмных антенн
@@ -1018,17 +1963,16 @@ hyscan_sonar_control_model_sonar_set_position (HyScanSonarControlModel *model,
                                                HyScanSourceType         source,
                                                HyScanAntennaPosition   *position)
 {
-  HyScanAsyncCommand command;
   HyScanParamsSonarPosition params;
 
   g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model), FALSE);
 
+  memset (&params, 0, sizeof (params));
   params.source = source;
   params.position = *position;
 
-  command = (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_sonar_set_position;
-
-  return hyscan_async_append_query (HYSCAN_ASYNC (model), command, model, &params, sizeof (params));
+  return hyscan_sonar_control_model_append (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_SONAR_SET_POSITION,
+                                            HYSCAN_ASYNC_PRIORITY_DEFAULT, &params);
 }
 
 /* Функция асинхронно задаёт время приёма эхосигнала источником данных. */
@@ -1037,17 +1981,16 @@ hyscan_sonar_control_model_sonar_set_receive_time (HyScanSonarControlModel *mode
                                                    HyScanSourceType         source,
                                                    gdouble                  receive_time)
 {
-  HyScanAsyncCommand command;
   HyScanParamsSonarReceiveTime params;
 
   g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model), FALSE);
 
-  command = (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_sonar_set_receive_time;
-
+  memset (&params, 0, sizeof (params));
   params.source = source;
   params.receive_time = receive_time;
 
-  return hyscan_async_append_query (HYSCAN_ASYNC (model), command, model, &params, sizeof (params));
+  return hyscan_sonar_control_model_append (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_SONAR_SET_RECEIVE_TIME,
+                                            HYSCAN_ASYNC_PRIORITY_DEFAULT, &params);
 }
 
 /* Функция асинхронно переводит гидролокатор в рабочий режим и включает запись данных. */
@@ -1056,41 +1999,293 @@ hyscan_sonar_control_model_sonar_start (HyScanSonarControlModel *model,
                                         const gchar             *track_name,
                                         HyScanTrackType          track_type)
 {
-  HyScanAsyncCommand command;
-  HyScanParamsSonarStart params;
+  HyScanParamsSonarStart *params;
 
   g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model), FALSE);
 
-  command = (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_sonar_start;
-
-  params.track_name = g_strdup (track_name);
-  params.track_type = track_type;
+  /* Параметры с именем галса передаются во владение запросу и освобождаются,
+   * даже если запрос не будет выполнен. */
+  params = g_new (HyScanParamsSonarStart, 1);
+  params->track_name = g_strdup (track_name);
+  params->track_type = track_type;
 
-  return hyscan_async_append_query (HYSCAN_ASYNC (model), command, model, &params, sizeof (params));
+  /* Повторный пуск после потерянного ответа может создать лишний галс. */
+  return hyscan_sonar_control_model_append_run (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_SONAR_START,
+                                                HYSCAN_ASYNC_PRIORITY_DEFAULT, 1, params,
+                                                (GDestroyNotify) hyscan_sonar_control_model_params_sonar_start_free);
 }
 
 /* Функция асинхронно переводит гидролокатор в ждущий режим и отключает запись данных. */
 gboolean
 hyscan_sonar_control_model_sonar_stop (HyScanSonarControlModel *model)
 {
-  HyScanAsyncCommand command;
-
   g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model), FALSE);
 
-  command =  (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_sonar_stop;
-
-  return hyscan_async_append_query (HYSCAN_ASYNC (model), command, model, NULL, 0);
+  /* Останов выполняется раньше всех изменений параметров, добавленных в тот же пакет,
+   * но после добавленных до него пуска и зондирования. */
+  return hyscan_sonar_control_model_append_run (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_SONAR_STOP,
+                                                HYSCAN_ASYNC_PRIORITY_HIGH, 0, NULL, NULL);
 }
 
 /* Функция асинхронно выполняет один цикл зондирования и приёма данных. */
 gboolean
 hyscan_sonar_control_model_sonar_ping (HyScanSonarControlModel    *model)
+{
+  g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model), FALSE);
+
+  /* Повторное зондирование после потерянного ответа даёт лишний цикл приёма данных. */
+  return hyscan_sonar_control_model_append_run (model, HYSCAN_SONAR_CONTROL_MODEL_CMD_SONAR_PING,
+                                                HYSCAN_ASYNC_PRIORITY_DEFAULT, 1, NULL, NULL);
+}
+
+/* Функция выполняет циклы зондирования и приёма данных по расписанию. */
+guint
+hyscan_sonar_control_model_schedule_ping (HyScanSonarControlModel *model,
+                                          gint64                   start_time,
+                                          gint64                   period)
 {
   HyScanAsyncCommand command;
 
+  g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model), 0);
+
+  command = hyscan_sonar_control_model_commands[HYSCAN_SONAR_CONTROL_MODEL_CMD_SONAR_PING].command;
+
+  return hyscan_async_schedule_query (HYSCAN_ASYNC (model), command, model, NULL, 0, start_time, period);
+}
+
+/* Функция начинает транзакцию изменения параметров. */
+void
+hyscan_sonar_control_model_begin (HyScanSonarControlModel *model)
+{
+  HyScanSonarControlModelPrivate *priv;
+
+  g_return_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model));
+
+  priv = model->priv;
+
+  if (priv->transaction_depth++ > 0)
+    return;
+
+  priv->transaction = g_new0 (HyScanSonarControlModelTransaction, 1);
+  priv->transaction->changes = g_array_new (FALSE, FALSE, sizeof (HyScanSonarControlModelChange));
+}
+
+/* Функция завершает транзакцию и добавляет каждое её изменение отдельным запросом. */
+gboolean
+hyscan_sonar_control_model_commit (HyScanSonarControlModel *model)
+{
+  HyScanSonarControlModelPrivate *priv;
+  HyScanSonarControlModelTransaction *transaction;
+  gboolean status = TRUE;
+  guint i;
+
   g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model), FALSE);
 
-  command = (HyScanAsyncCommand) hyscan_sonar_control_model_cmd_sonar_ping;
+  priv = model->priv;
+
+  if (priv->transaction_depth == 0)
+    {
+      g_warning ("HyScanSonarControlModel: no transaction to commit");
+      return FALSE;
+    }
+
+  /* Изменения вложенной транзакции применяются вместе с внешней. */
+  if (--priv->transaction_depth > 0)
+    return TRUE;
+
+  transaction = priv->transaction;
+  priv->transaction = NULL;
+
+  /* Каждое изменение становится таким же запросом, как вне транзакции: со своей полосой,
+   * приоритетом и политикой повторов, поэтому изменения разных источников и датчиков
+   * выполняются параллельно, ошибка одного изменения в режиме "continue-on-error" не
+   * останавливает остальные, а отмена прерывает транзакцию между изменениями. Параметры
+   * передаются во владение запросам. Если запрос добавить не удалось, оставшиеся
+   * изменения отбрасываются. */
+  for (i = 0; i < transaction->changes->len && status; i++)
+    {
+      HyScanSonarControlModelChange *change;
+
+      change = &g_array_index (transaction->changes, HyScanSonarControlModelChange, i);
+      if (change->slot == HYSCAN_SONAR_CONTROL_MODEL_SLOT_NONE)
+        {
+          status = hyscan_sonar_control_model_append_run (model, change->id, change->priority,
+                                                          change->max_attempts,
+                                                          change->params, change->destroy);
+        }
+      else
+        {
+          status = hyscan_sonar_control_model_append_take (model, change->id, change->lane, change->priority,
+                                                           change->params, change->destroy);
+        }
+      change->destroy = NULL;
+    }
+
+  hyscan_sonar_control_model_transaction_free (transaction);
+
+  return status;
+}
+
+/* Функция отменяет транзакцию и все накопленные в ней изменения. */
+void
+hyscan_sonar_control_model_rollback (HyScanSonarControlModel *model)
+{
+  HyScanSonarControlModelPrivate *priv;
+
+  g_return_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model));
+
+  priv = model->priv;
+
+  priv->transaction_depth = 0;
+  g_clear_pointer (&priv->transaction, hyscan_sonar_control_model_transaction_free);
+}
+
+/* Функция забывает значения параметров, применённые к гидролокатору. */
+void
+hyscan_sonar_control_model_invalidate (HyScanSonarControlModel *model)
+{
+  HyScanSonarControlModelPrivate *priv;
+
+  g_return_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model));
+
+  priv = model->priv;
+
+  g_mutex_lock (&priv->shadow_lock);
+  g_hash_table_remove_all (priv->shadow);
+  g_mutex_unlock (&priv->shadow_lock);
+}
+
+/* Функция повторно выполняет команды журнала. */
+GArray *
+hyscan_sonar_control_model_replay (HyScanSonarControl  *sonar_control,
+                                   const gchar         *journal,
+                                   gdouble              speed,
+                                   GError             **error)
+{
+  HyScanSonarControlModel *model;
+  GArray *records;
+  gchar *data;
+  gsize size, offset;
+  gint64 first_time = 0;
+  gint64 replay_start;
+
+  /* Буфер параметров команды, выровненный для любого поля параметров. */
+  guint64 params[32];
+
+  g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL (sonar_control), NULL);
+  g_return_val_if_fail (journal != NULL, NULL);
+
+  if (!g_file_get_contents (journal, &data, &size, error))
+    return NULL;
+
+  if (!hyscan_sonar_control_model_journal_read_header (data, size, &offset))
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s: unsupported journal format", journal);
+      g_free (data);
+      return NULL;
+    }
+
+  /* Команды выполняются в текущем потоке той же моделью управления, что и при записи. */
+  model = g_object_new (HYSCAN_TYPE_SONAR_CONTROL_MODEL, "sonar-control", sonar_control, NULL);
+  records = g_array_new (FALSE, FALSE, sizeof (HyScanSonarControlModelReplayRecord));
+  replay_start = g_get_monotonic_time ();
+
+  while (offset < size)
+    {
+      const HyScanSonarControlModelCommandInfo *command;
+      HyScanSonarControlModelJournalRecord record;
+      HyScanSonarControlModelReplayRecord replay;
+      gint64 start;
+
+      G_STATIC_ASSERT (sizeof (params) >= sizeof (HyScanParamsSensorUartPortParam));
+
+      command = hyscan_sonar_control_model_journal_read (data, size, &offset, &record, params);
+      if (command == NULL)
+        {
+          g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL, "%s: corrupted record %u", journal, records->len);
+          g_clear_pointer (&records, g_array_unref);
+          break;
+        }
+
+      if (records->len == 0)
+        first_time = record.time;
+
+      /* Команда выполняется в момент, соответствующий журналу, с учётом ускорения. */
+      if (speed > 0.0)
+        {
+          gint64 due = replay_start + (gint64) ((record.time - first_time) / speed);
+          gint64 now = g_get_monotonic_time ();
+
+          if (due > now)
+            g_usleep (due - now);
+        }
+
+      start = g_get_monotonic_time ();
+      replay.replay_result = (*command->command) (model, (command->size > 0) ? params : NULL);
+      replay.replay_duration = g_get_monotonic_time () - start;
+      replay.replay_time = start - replay_start;
+
+      replay.command = command->name;
+      replay.time = record.time - first_time;
+      replay.duration = record.duration;
+      replay.result = record.result;
+
+      g_array_append_val (records, replay);
+    }
+
+  g_object_unref (model);
+  g_free (data);
+
+  return records;
+}
+
+/* Функция возвращает статистику выполнения команд гидролокатора. */
+GArray *
+hyscan_sonar_control_model_get_command_stats (HyScanSonarControlModel *model)
+{
+  HyScanSonarControlModelPrivate *priv;
+  GArray *snapshot;
+  guint i;
 
-  return hyscan_async_append_query (HYSCAN_ASYNC (model), command, model, NULL, 0);
+  g_return_val_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model), NULL);
+
+  priv = model->priv;
+
+  snapshot = g_array_sized_new (FALSE, FALSE, sizeof (HyScanSonarControlModelCommandStats),
+                                G_N_ELEMENTS (hyscan_sonar_control_model_commands));
+
+  for (i = 0; i < G_N_ELEMENTS (hyscan_sonar_control_model_commands); i++)
+    {
+      HyScanSonarControlModelCommandStats stats;
+
+      stats.command = hyscan_sonar_control_model_commands[i].name;
+      stats.n_calls = g_atomic_int_get (&priv->stats[i].n_calls);
+      stats.n_failed = g_atomic_int_get (&priv->stats[i].n_failed);
+      stats.n_cached = g_atomic_int_get (&priv->stats[i].n_cached);
+      hyscan_async_histogram_copy (&priv->stats[i].time, &stats.time);
+
+      g_array_append_val (snapshot, stats);
+    }
+
+  return snapshot;
+}
+
+/* Функция сбрасывает статистику выполнения команд гидролокатора. */
+void
+hyscan_sonar_control_model_reset_command_stats (HyScanSonarControlModel *model)
+{
+  HyScanSonarControlModelPrivate *priv;
+  guint i;
+
+  g_return_if_fail (HYSCAN_IS_SONAR_CONTROL_MODEL (model));
+
+  priv = model->priv;
+
+  for (i = 0; i < G_N_ELEMENTS (hyscan_sonar_control_model_commands); i++)
+    {
+      g_atomic_int_set (&priv->stats[i].n_calls, 0);
+      g_atomic_int_set (&priv->stats[i].n_failed, 0);
+      g_atomic_int_set (&priv->stats[i].n_cached, 0);
+      hyscan_async_histogram_reset (&priv->stats[i].time);
+    }
 }
@@ -23,6 +23,80 @@
  * Если свойство "sonar-control" не установить при конструировании, созданный
  * объект будет нефункционален - все его методы будут возвращать FALSE.
  *
+ * Запросы распределяются по полосам выполнения \link HyScanAsync \endlink: команды одного
+ * источника данных (генератор, ВАРУ, местоположение, время приёма) и команды одного датчика
+ * выполняются в порядке вызова, а общие команды (тип синхронизации, пуск, останов, зондирование)
+ * выполняются после всех ранее добавленных запросов. Останов гидролокатора имеет высокий
+ * приоритет и выполняется раньше изменений параметров, добавленных в тот же пакет.
+ * Пуск, останов и зондирование между собой всегда выполняются в порядке вызова:
+ * останов не обгоняет пуск или зондирование, добавленные до него.
+ * Если при создании объекта задать свойство
+ * "n-workers" больше единицы, команды разных источников и датчиков будут выполняться
+ * параллельно. Это допустимо только для реализаций \link HyScanSonarControl \endlink,
+ * допускающих одновременные вызовы из разных потоков.
+ *
+ * Если при создании объекта задать свойство "coalesce", изменение параметра источника
+ * данных или датчика до выполнения пакета заменит ранее добавленное изменение того же
+ * параметра, даже если оно было сделано другой функцией (например, режим генератора по
+ * преднастройкам и автоматический режим): гидролокатору будет передано только последнее.
+ * Это полезно, когда интерфейс пользователя изменяет параметры чаще, чем гидролокатор
+ * успевает их применить.
+ *
+ * Каждый вызов функций класса становится отдельным запросом, а каждый запрос - отдельным
+ * обменом с гидролокатором. Чтобы применить много изменений сразу (например, при полной
+ * синхронизации параметров), их можно объединить в транзакцию: между вызовами
+ * #hyscan_sonar_control_model_begin и #hyscan_sonar_control_model_commit изменения
+ * накапливаются в модели и добавляются в список запросов все вместе. Из нескольких
+ * изменений одного параметра источника данных или датчика (например, из нескольких
+ * режимов генератора одного источника) гидролокатору передаётся только последнее, так как
+ * \link HyScanSonarControl \endlink не позволяет передать несколько параметров за один
+ * обмен. Каждое оставшееся изменение добавляется отдельным запросом, поэтому полосы,
+ * приоритеты, повторы, "continue-on-error" и отмена действуют так же, как вне транзакции.
+ * Функция #hyscan_sonar_control_model_rollback отменяет накопленные изменения.
+ *
+ * Объект, созданный функцией #hyscan_sonar_control_model_new, выполняет каждую команду
+ * один раз. Если при создании объекта функцией g_object_new задать свойства "max-attempts",
+ * "retry-backoff" и "retry-budget" \link HyScanAsync \endlink, например рекомендуемыми
+ * значениями #HYSCAN_SONAR_CONTROL_MODEL_MAX_ATTEMPTS, #HYSCAN_SONAR_CONTROL_MODEL_RETRY_BACKOFF
+ * и #HYSCAN_SONAR_CONTROL_MODEL_RETRY_BUDGET, команда, завершившаяся с ошибкой, повторяется
+ * с нарастающей задержкой, поэтому потеря одного пакета при обмене с гидролокатором
+ * не приводит к ошибке выполнения всего пакета.
+ * Пуск и зондирование не повторяются, так как повтор создаёт лишний галс или цикл
+ * приёма данных.
+ *
+ * Если при создании объекта задать свойство "shadow-cache", модель запоминает последнее
+ * успешно применённое значение каждой группы параметров (режим генератора, режим ВАРУ,
+ * включение, местоположение и т.п.) для каждого источника данных и датчика. Команда,
+ * совпадающая с запомненным значением, завершается успешно без обмена с гидролокатором,
+ * поэтому повторная передача неизменных параметров, например перед каждым пуском,
+ * не задерживает выполнение. Команда, завершившаяся ошибкой, удаляет запомненное значение
+ * своей группы. Кэш предполагает, что параметры гидролокатора изменяет только эта модель:
+ * после переподключения к гидролокатору или изменения параметров другим клиентом
+ * необходимо вызвать функцию #hyscan_sonar_control_model_invalidate.
+ *
+ * Если при создании объекта задать свойство "journal" - путь к файлу, модель записывает
+ * в него каждую команду, переданную гидролокатору: время её начала (g_get_monotonic_time),
+ * длительность, результат и параметры. Записи накапливаются в буфере без выделения
+ * памяти и сбрасываются в файл после выполнения каждого пакета запросов, а также при
+ * выполнении команды, если с последнего сброса прошло больше 200 мс, например при
+ * зондировании по расписанию. Журнал в двоичном формате
+ * предназначен для анализа задержек управления в реальных условиях: функция
+ * #hyscan_sonar_control_model_replay повторно выполняет его команды на другом
+ * гидролокаторе (например, на виртуальном) и сообщает время их выполнения. Параметры
+ * команд хранятся в представлении архитектуры, записавшей журнал; журнал другой
+ * архитектуры (порядка байтов или разрядности) отвергается при чтении. Строковые
+ * параметры (название датчика или галса), равные NULL, повторно выполняются как NULL,
+ * строки длиннее 65534 байт сохраняются обрезанными.
+ *
+ * Модель ведёт статистику каждой команды гидролокатора: число обращений к гидролокатору,
+ * число ошибок, число команд, пропущенных благодаря кэшу применённых значений, и гистограмму
+ * времени выполнения. Статистика обновляется в рабочем потоке атомарными операциями без
+ * блокировок. Её текущие значения возвращает функция #hyscan_sonar_control_model_get_command_stats,
+ * сбрасывает - функция #hyscan_sonar_control_model_reset_command_stats. В отличие от статистики
+ * запросов \link HyScanAsync \endlink (#hyscan_async_get_command_stats) она учитывает
+ * обращения к гидролокатору: изменения транзакции учитываются по отдельности, а команды,
+ * пропущенные кэшем, не входят во время выполнения.
+ *
  * \warning Данный класс корректно работает только в паре с GMainLoop, кроме того
  * он не является потокобезопасным.
  */
@@ -34,6 +108,34 @@
 
 G_BEGIN_DECLS
 
+/* Рекомендуемые параметры повторного выполнения команд: число попыток, задержка
+ * перед второй попыткой и время, отведённое на повторы, мкс. */
+#define HYSCAN_SONAR_CONTROL_MODEL_MAX_ATTEMPTS    (3)
+#define HYSCAN_SONAR_CONTROL_MODEL_RETRY_BACKOFF   (20 * G_TIME_SPAN_MILLISECOND)
+#define HYSCAN_SONAR_CONTROL_MODEL_RETRY_BUDGET    (250 * G_TIME_SPAN_MILLISECOND)
+
+/* Результат повторного выполнения команды журнала. */
+typedef struct
+{
+  const gchar                      *command;           /* Название команды. */
+  gint64                            time;              /* Время начала команды от начала журнала, мкс. */
+  gint64                            duration;          /* Время выполнения команды по журналу, мкс. */
+  gboolean                          result;            /* Результат выполнения команды по журналу. */
+  gint64                            replay_time;       /* Время начала повторного выполнения от начала, мкс. */
+  gint64                            replay_duration;   /* Время повторного выполнения команды, мкс. */
+  gboolean                          replay_result;     /* Результат повторного выполнения команды. */
+} HyScanSonarControlModelReplayRecord;
+
+/* Статистика выполнения команды гидролокатора. */
+typedef struct
+{
+  const gchar                      *command;           /* Название команды. */
+  guint                             n_calls;           /* Число обращений к гидролокатору. */
+  guint                             n_failed;          /* Число обращений, завершившихся ошибкой. */
+  guint                             n_cached;          /* Число команд, пропущенных благодаря кэшу. */
+  HyScanAsyncHistogram              time;              /* Время выполнения команды, мкс. */
+} HyScanSonarControlModelCommandStats;
+
 #define HYSCAN_TYPE_SONAR_CONTROL_MODEL            \
         (hyscan_sonar_control_model_get_type ())
 
@@ -440,6 +542,109 @@ gboolean   hyscan_sonar_control_model_sonar_stop                      (HyScanSon
 HYSCAN_API
 gboolean   hyscan_sonar_control_model_sonar_ping                      (HyScanSonarControlModel   *model);
 
+/*
+ * Запрос на выполнение циклов зондирования и приёма данных по расписанию.
+ * Циклы выполняются потоком модели в моменты времени start_time + n * period
+ * по монотонным часам (g_get_monotonic_time), без участия главного цикла.
+ * Требования к гидролокатору такие же, как для #hyscan_sonar_control_model_sonar_ping.
+ * Расписание отменяется функцией #hyscan_async_unschedule_query.
+ *
+ * \param model указатель на класс \link HyScanSonarControlModel \endlink;
+ * \param start_time время первого цикла, мкс;
+ * \param period период повторения, мкс, или 0 для однократного цикла.
+ *
+ * \return Идентификатор расписания или 0 в случае ошибки.
+ */
+HYSCAN_API
+guint      hyscan_sonar_control_model_schedule_ping                   (HyScanSonarControlModel   *model,
+                                                                       gint64                     start_time,
+                                                                       gint64                     period);
+
+/*
+ * Начинает транзакцию изменения параметров. До вызова #hyscan_sonar_control_model_commit
+ * функции класса накапливают изменения в транзакции. Транзакции могут быть вложенными,
+ * изменения применяются при завершении внешней транзакции.
+ *
+ * \param model указатель на класс \link HyScanSonarControlModel \endlink.
+ */
+HYSCAN_API
+void       hyscan_sonar_control_model_begin                           (HyScanSonarControlModel   *model);
+
+/*
+ * Завершает транзакцию изменения параметров и добавляет каждое накопленное изменение
+ * в список запросов отдельным запросом. Если добавить запрос не удалось, оставшиеся
+ * изменения отбрасываются. Выполнение запросов запускается, как обычно, функцией
+ * #hyscan_async_execute.
+ *
+ * \param model указатель на класс \link HyScanSonarControlModel \endlink.
+ *
+ * \return TRUE, если изменения приняты к выполнению, FALSE - в случае ошибки.
+ */
+HYSCAN_API
+gboolean   hyscan_sonar_control_model_commit                          (HyScanSonarControlModel   *model);
+
+/*
+ * Отменяет транзакцию изменения параметров, включая все вложенные, вместе
+ * с накопленными изменениями.
+ *
+ * \param model указатель на класс \link HyScanSonarControlModel \endlink.
+ */
+HYSCAN_API
+void       hyscan_sonar_control_model_rollback                        (HyScanSonarControlModel   *model);
+
+/*
+ * Забывает значения параметров, применённые к гидролокатору. После вызова функции
+ * все команды передаются гидролокатору, даже если их параметры не изменились.
+ * Функцию необходимо вызывать после переподключения к гидролокатору. Функцию
+ * можно вызывать из любого потока.
+ *
+ * \param model указатель на класс \link HyScanSonarControlModel \endlink.
+ */
+HYSCAN_API
+void       hyscan_sonar_control_model_invalidate                      (HyScanSonarControlModel   *model);
+
+/*
+ * Возвращает статистику выполнения команд гидролокатора. Повторные попытки выполнения
+ * команды учитываются как отдельные обращения к гидролокатору. Функцию можно вызывать
+ * из любого потока.
+ *
+ * \param model указатель на класс \link HyScanSonarControlModel \endlink.
+ *
+ * \return Массив HyScanSonarControlModelCommandStats, по элементу на каждую команду.
+ * Для удаления g_array_unref.
+ */
+HYSCAN_API
+GArray    *hyscan_sonar_control_model_get_command_stats               (HyScanSonarControlModel   *model);
+
+/*
+ * Сбрасывает статистику выполнения команд гидролокатора. Функцию можно вызывать
+ * из любого потока.
+ *
+ * \param model указатель на класс \link HyScanSonarControlModel \endlink.
+ */
+HYSCAN_API
+void       hyscan_sonar_control_model_reset_command_stats             (HyScanSonarControlModel   *model);
+
+/*
+ * Повторно выполняет команды журнала, записанного моделью со свойством "journal".
+ * Команды выполняются синхронно в текущем потоке. При speed больше нуля команды
+ * выполняются в моменты времени, соответствующие журналу, ускоренные в speed раз
+ * (1.0 - исходная скорость), при speed равном нулю - без пауз.
+ *
+ * \param sonar_control указатель на интерфейс \link HyScanSonarControl \endlink;
+ * \param journal путь к файлу журнала;
+ * \param speed ускорение воспроизведения или 0;
+ * \param error указатель на ошибку или NULL.
+ *
+ * \return Массив HyScanSonarControlModelReplayRecord, по элементу на каждую команду журнала,
+ * или NULL в случае ошибки. Для удаления g_array_unref.
+ */
+HYSCAN_API
+GArray    *hyscan_sonar_control_model_replay                          (HyScanSonarControl        *sonar_control,
+                                                                       const gchar               *journal,
+                                                                       gdouble                    speed,
+                                                                       GError                   **error);
+
 G_END_DECLS
 
 #endif /* __HYSCAN_SONAR_CONTROL_MODEL_H__ */
@@ -34,6 +34,8 @@ typedef struct
   gint64                         time_offset;   /* Коррекция времени приёма данных. */
   gboolean                       modified;      /* Поменялись параметры. */
 
+  HyScanSensorPortType           port_type;     /* Тип порта, возможности датчика. */
+
   /* Местоположение датчика. */
   struct
   {
@@ -166,12 +168,24 @@ typedef struct
   }                              receive_time;
 } HyScanSrcParams;
 
+/* Возможности источника данных. */
+typedef struct
+{
+  HyScanGeneratorModeType        gen_modes;     /* Режимы работы генератора. */
+  HyScanGeneratorSignalType      gen_signals;   /* Типы сигналов генератора. */
+  HyScanTVGModeType              tvg_modes;     /* Режимы работы ВАРУ. */
+  gdouble                        min_gain;      /* Минимальное усиление ВАРУ. */
+  gdouble                        max_gain;      /* Максимальное усиление ВАРУ. */
+  gdouble                        max_receive_time; /* Максимальное время приёма. */
+} HyScanSrcCaps;
+
 /* Контейнер параметров источника. */
 typedef struct
 {
   HyScanGenParams                gen;           /* Параметры ВАРУ. */
   HyScanTVGParams                tvg;           /* Параметры генератора. */
   HyScanSrcParams                src;           /* Параметры источника. */
+  HyScanSrcCaps                  caps;          /* Возможности источника. */
 } HyScanSrcParamsContainer;
 
 /* Параметры гидролокатора. */
@@ -239,6 +253,7 @@ struct _HyScanSonarModelPrivate
   gdouble                   sound_velocity;                   /* Скорость звука. */
 
   gboolean                  sonar_control_state;           /* Флаг, указывающий, что ГЛ в данный момент занят. */
+  HyScanSonarSyncType       sync_caps;                     /* Возможные типы синхронизации. */
   HyScanSonarParams         sonar_params;                  /* Общие параметры ГЛ. */
   GHashTable               *sources_params;                /* Параметры источников данных ГЛ. */
   GHashTable               *sensors_params;                /* Параметры датчиков. */
@@ -254,6 +269,7 @@ static void       hyscan_sonar_model_set_property              (GObject
 static void       hyscan_sonar_model_object_constructed        (GObject            *object);
 static void       hyscan_sonar_model_object_finalize           (GObject            *object);
 static void       hyscan_sonar_model_update_before_start       (HyScanSonarModel   *model);
+static void       hyscan_sonar_model_load_capabilities         (HyScanSonarModel   *model);
 static void       hyscan_sonar_model_set_valid_params          (HyScanSonarModel   *model);
 static void       hyscan_sonar_model_set_sonar_control_state   (HyScanSonarModel   *model,
                                                                 gboolean            state);
@@ -393,7 +409,17 @@ hyscan_sonar_model_object_constructed (GObject *object)
 
   /* Инициализация модели управления гидролокатором.
    */
-  if ((priv->sonar_control_model = hyscan_sonar_control_model_new (priv->sonar_control)) == NULL)
+  /* Ошибка одного датчика или источника данных не должна мешать применению остальных параметров.
+   * Параметры, не изменившиеся с последнего применения, гидролокатору повторно не передаются. */
+  priv->sonar_control_model = g_object_new (HYSCAN_TYPE_SONAR_CONTROL_MODEL,
+                                            "sonar-control", priv->sonar_control,
+                                            "continue-on-error", TRUE,
+                                            "shadow-cache", TRUE,
+                                            "max-attempts", HYSCAN_SONAR_CONTROL_MODEL_MAX_ATTEMPTS,
+                                            "retry-backoff", (gint64) HYSCAN_SONAR_CONTROL_MODEL_RETRY_BACKOFF,
+                                            "retry-budget", (gint64) HYSCAN_SONAR_CONTROL_MODEL_RETRY_BUDGET,
+                                            NULL);
+  if (priv->sonar_control_model == NULL)
     {
       g_clear_object (&priv->sonar_control);
       g_clear_pointer (&priv->sources, g_free);
@@ -423,7 +449,8 @@ hyscan_sonar_model_object_constructed (GObject *object)
         g_hash_table_insert (priv->sensors_params, *ports, g_new0 (HyScanSensorParams, 1));
     }
 
-  /* Задание допустимых значений параметров. */
+  /* Чтение возможностей гидролокатора и задание допустимых значений параметров. */
+  hyscan_sonar_model_load_capabilities (model);
   hyscan_sonar_model_set_valid_params (model);
 
   /* Инициализация периодической проверки буфера настроек на наличие изменений.
@@ -497,6 +524,46 @@ hyscan_sonar_model_update_before_start (HyScanSonarModel *model)
     }
 }
 
+/* Считывает возможности гидролокатора, источников данных и датчиков. Возможности
+ * не изменяются во время работы, поэтому считываются одним проходом при создании
+ * объекта и при переподключении, а не при каждом обращении: при удалённом управлении
+ * каждый запрос - это блокирующий обмен с гидролокатором. */
+static void
+hyscan_sonar_model_load_capabilities (HyScanSonarModel *model)
+{
+  HyScanSonarModelPrivate *priv = model->priv;
+  HyScanSonarControl *sc = priv->sonar_control;
+  HyScanSourceType *source;
+  gchar **port;
+
+  priv->sync_caps = hyscan_sonar_control_get_sync_capabilities (sc);
+
+  for (source = priv->sources; *source != HYSCAN_SOURCE_INVALID; ++source)
+    {
+      HyScanSrcParamsContainer *prm;
+      HyScanSrcCaps *caps;
+
+      prm = g_hash_table_lookup (priv->sources_params, GINT_TO_POINTER (*source));
+      caps = &prm->caps;
+
+      caps->gen_modes = hyscan_generator_control_get_capabilities (HYSCAN_GENERATOR_CONTROL (sc), *source);
+      caps->gen_signals = hyscan_generator_control_get_signals (HYSCAN_GENERATOR_CONTROL (sc), *source);
+      caps->tvg_modes = hyscan_tvg_control_get_capabilities (HYSCAN_TVG_CONTROL (sc), *source);
+      if (!hyscan_tvg_control_get_gain_range (HYSCAN_TVG_CONTROL (sc), *source, &caps->min_gain, &caps->max_gain))
+        caps->min_gain = caps->max_gain = 0.0;
+      caps->max_receive_time = hyscan_sonar_control_get_max_receive_time (sc, *source);
+    }
+
+  if (priv->ports == NULL)
+    return;
+
+  for (port = priv->ports; *port != NULL; ++port)
+    {
+      HyScanSensorParams *prm = g_hash_table_lookup (priv->sensors_params, *port);
+      prm->port_type = hyscan_sensor_control_get_port_type (HYSCAN_SENSOR_CONTROL (sc), *port);
+    }
+}
+
 /*
  * Задаёт докустимые значения параметров.
  *
@@ -512,12 +579,11 @@ hyscan_sonar_model_set_valid_params (HyScanSonarModel *model)
 {
   HyScanSonarSyncType sync_caps;
   HyScanSonarModelPrivate *priv = model->priv;
-  HyScanSonarControl *sc = priv->sonar_control;
   HyScanSourceType *source;
 
   /* Тип синхронизации.
    */
-  sync_caps = hyscan_sonar_control_get_sync_capabilities (sc);
+  sync_caps = priv->sync_caps;
   if (sync_caps & HYSCAN_SONAR_SYNC_SOFTWARE)
     priv->sonar_params.sync_type.cval = HYSCAN_SONAR_SYNC_SOFTWARE;
   else if (sync_caps & HYSCAN_SONAR_SYNC_INTERNAL)
@@ -531,8 +597,6 @@ hyscan_sonar_model_set_valid_params (HyScanSonarModel *model)
    */
   for (source = priv->sources; *source != HYSCAN_SOURCE_INVALID; ++source)
     {
-      HyScanGeneratorControl *gc;
-      HyScanTVGControl *tc;
       HyScanTVGModeType tvg_mode_caps;
       gdouble min_gain, max_gain, gain;
       HyScanGeneratorModeType gen_mode_caps;
@@ -540,8 +604,6 @@ hyscan_sonar_model_set_valid_params (HyScanSonarModel *model)
       HyScanSourceType source_type;
       HyScanSrcParamsContainer *prm;
 
-      gc = HYSCAN_GENERATOR_CONTROL (sc);
-      tc = HYSCAN_TVG_CONTROL (sc);
       source_type = (HyScanSourceType) *source;
       prm = g_hash_table_lookup (priv->sources_params, GINT_TO_POINTER (source_type));
 
@@ -550,7 +612,7 @@ hyscan_sonar_model_set_valid_params (HyScanSonarModel *model)
 
       /* Режим генератора.
        */
-      gen_mode_caps = hyscan_generator_control_get_capabilities (gc, source_type);
+      gen_mode_caps = prm->caps.gen_modes;
       if (gen_mode_caps & HYSCAN_GENERATOR_MODE_PRESET)
         prm->gen.mode.cval = HYSCAN_GENERATOR_MODE_PRESET;
       else if (gen_mode_caps & HYSCAN_GENERATOR_MODE_AUTO)
@@ -564,7 +626,7 @@ hyscan_sonar_model_set_valid_params (HyScanSonarModel *model)
 
       /* Определение доступного сигнала.
        */
-      signals_types = hyscan_generator_control_get_signals (gc, source_type);
+      signals_types = prm->caps.gen_signals;
       if (signals_types & HYSCAN_GENERATOR_SIGNAL_AUTO)
         signal_type = HYSCAN_GENERATOR_SIGNAL_AUTO;
       else if (signals_types & HYSCAN_GENERATOR_SIGNAL_TONE)
@@ -592,7 +654,7 @@ hyscan_sonar_model_set_valid_params (HyScanSonarModel *model)
 
       /* Режим генератора.
        */
-      tvg_mode_caps = hyscan_tvg_control_get_capabilities (tc, source_type);
+      tvg_mode_caps = prm->caps.tvg_modes;
       if (tvg_mode_caps & HYSCAN_TVG_MODE_AUTO)
         prm->tvg.mode.cval = HYSCAN_TVG_MODE_AUTO;
       else if (tvg_mode_caps & HYSCAN_TVG_MODE_CONSTANT)
@@ -605,7 +667,8 @@ hyscan_sonar_model_set_valid_params (HyScanSonarModel *model)
         g_warning ("HyScanSonarModel: invalid TVG capabilities.");
 
       /* Диапазон усилений. */
-      hyscan_tvg_control_get_gain_range (tc, source_type, &min_gain, &max_gain);
+      min_gain = prm->caps.min_gain;
+      max_gain = prm->caps.max_gain;
       gain = (max_gain + min_gain) / 2;
 
       /* Задание автоматических параметров ВАРУ.
@@ -690,6 +753,11 @@ hyscan_sonar_model_on_completed (HyScanSonarModel *model,
                                  gboolean          result,
                                  HyScanAsync      *async)
 {
+  /* После ошибки связь с гидролокатором могла быть потеряна, а его параметры - сброшены,
+   * поэтому при следующем обновлении все параметры передаются заново. */
+  if (!result)
+    hyscan_sonar_control_model_invalidate (model->priv->sonar_control_model);
+
   /* Разрешить общение с гидролокатором и уведомить об этом событии потребителям. */
   hyscan_sonar_model_set_sonar_control_state (model, TRUE);
 
@@ -734,8 +802,7 @@ hyscan_sonar_model_update_sensor_params (HyScanSonarModel *model,
       /* Изменение параметров датчика, если датчик включен. */
       if (prm->enabled.cval && prm->modified)
         {
-          HyScanSensorPortType port_type =
-              hyscan_sensor_control_get_port_type (HYSCAN_SENSOR_CONTROL (model->priv->sonar_control), port_name);
+          HyScanSensorPortType port_type = prm->port_type;
 
           prm->modified = FALSE;
 
@@ -1100,14 +1167,21 @@ hyscan_sonar_model_check_for_updates (gpointer sonar_model_ptr)
   /* Остановка таймера последнего изменения параметров. */
   g_timer_stop (priv->check_for_updates_timer);
 
-  /* Обновление параметров датчиков, параметров источников данных, основных параметров гидролокатора. */
+  /* Обновление параметров датчиков, параметров источников данных, основных параметров гидролокатора.
+   * Все изменения накапливаются в транзакции, частично накопленные изменения отменяются. */
+  hyscan_sonar_control_model_begin (priv->sonar_control_model);
   if (hyscan_sonar_model_update_sensors (model) &&
       hyscan_sonar_model_update_sources (model) &&
       hyscan_sonar_model_update_sonar (model) &&
+      hyscan_sonar_control_model_commit (priv->sonar_control_model) &&
       hyscan_async_execute (HYSCAN_ASYNC (priv->sonar_control_model)))
     {
       hyscan_sonar_model_set_sonar_control_state (model, FALSE);
     }
+  else
+    {
+      hyscan_sonar_control_model_rollback (priv->sonar_control_model);
+    }
 
   /* Сброс флага принудительного обновления делается в любом случае. */
   priv->force_update = FALSE;
@@ -1136,6 +1210,16 @@ void hyscan_sonar_model_flush (HyScanSonarModel *model)
   model->priv->force_update = TRUE;
 }
 
+/* Отменяет применение отправленных изменений. */
+void
+hyscan_sonar_model_cancel (HyScanSonarModel *model)
+{
+  g_return_if_fail (HYSCAN_IS_SONAR_MODEL (model));
+
+  if (model->priv->sonar_control_model != NULL)
+    hyscan_async_cancel (HYSCAN_ASYNC (model->priv->sonar_control_model));
+}
+
 /* Проверяет состояние системы управления гидролокатором. */
 gboolean
 hyscan_sonar_model_get_sonar_control_state (HyScanSonarModel *model)
@@ -2138,12 +2222,14 @@ gdouble
 hyscan_sonar_model_get_max_distance (HyScanSonarModel *model,
                                      HyScanSourceType  source_type)
 {
-  HyScanSonarModelPrivate *priv;
+  HyScanSrcParamsContainer *prm;
+
   g_return_val_if_fail (HYSCAN_IS_SONAR_MODEL (model), -G_MAXDOUBLE);
 
-  priv = model->priv;
+  if ((prm = g_hash_table_lookup (model->priv->sources_params, GINT_TO_POINTER (source_type))) == NULL)
+    return -G_MAXDOUBLE;
 
-  return hyscan_sonar_control_get_max_receive_time (priv->sonar_control, source_type) * priv->sound_velocity / 2.0;
+  return prm->caps.max_receive_time * model->priv->sound_velocity / 2.0;
 }
 
 /* Получает скорость звука. */
@@ -2177,3 +2263,116 @@ hyscan_sonar_model_get_record_state (HyScanSonarModel *model)
   g_return_val_if_fail (HYSCAN_IS_SONAR_MODEL (model), FALSE);
   return model->priv->sonar_params.record_state.cval;
 }
+
+/* Получает возможные типы синхронизации. */
+HyScanSonarSyncType
+hyscan_sonar_model_get_sync_capabilities (HyScanSonarModel *model)
+{
+  g_return_val_if_fail (HYSCAN_IS_SONAR_MODEL (model), HYSCAN_SONAR_SYNC_INVALID);
+  return model->priv->sync_caps;
+}
+
+/* Получает возможные режимы работы генератора. */
+HyScanGeneratorModeType
+hyscan_sonar_model_gen_get_capabilities (HyScanSonarModel *model,
+                                         HyScanSourceType  source_type)
+{
+  HyScanSrcParamsContainer *prm;
+
+  g_return_val_if_fail (HYSCAN_IS_SONAR_MODEL (model), HYSCAN_GENERATOR_MODE_INVALID);
+
+  if ((prm = g_hash_table_lookup (model->priv->sources_params, GINT_TO_POINTER (source_type))) == NULL)
+    return HYSCAN_GENERATOR_MODE_INVALID;
+
+  return prm->caps.gen_modes;
+}
+
+/* Получает возможные типы сигналов генератора. */
+HyScanGeneratorSignalType
+hyscan_sonar_model_gen_get_signals (HyScanSonarModel *model,
+                                    HyScanSourceType  source_type)
+{
+  HyScanSrcParamsContainer *prm;
+
+  g_return_val_if_fail (HYSCAN_IS_SONAR_MODEL (model), HYSCAN_GENERATOR_SIGNAL_INVALID);
+
+  if ((prm = g_hash_table_lookup (model->priv->sources_params, GINT_TO_POINTER (source_type))) == NULL)
+    return HYSCAN_GENERATOR_SIGNAL_INVALID;
+
+  return prm->caps.gen_signals;
+}
+
+/* Получает возможные режимы работы ВАРУ. */
+HyScanTVGModeType
+hyscan_sonar_model_tvg_get_capabilities (HyScanSonarModel *model,
+                                         HyScanSourceType  source_type)
+{
+  HyScanSrcParamsContainer *prm;
+
+  g_return_val_if_fail (HYSCAN_IS_SONAR_MODEL (model), HYSCAN_TVG_MODE_INVALID);
+
+  if ((prm = g_hash_table_lookup (model->priv->sources_params, GINT_TO_POINTER (source_type))) == NULL)
+    return HYSCAN_TVG_MODE_INVALID;
+
+  return prm->caps.tvg_modes;
+}
+
+/* Получает допустимые пределы усиления ВАРУ. */
+gboolean
+hyscan_sonar_model_tvg_get_gain_range (HyScanSonarModel *model,
+                                       HyScanSourceType  source_type,
+                                       gdouble          *min_gain,
+                                       gdouble          *max_gain)
+{
+  HyScanSrcParamsContainer *prm;
+
+  g_return_val_if_fail (HYSCAN_IS_SONAR_MODEL (model), FALSE);
+
+  if ((prm = g_hash_table_lookup (model->priv->sources_params, GINT_TO_POINTER (source_type))) == NULL)
+    return FALSE;
+
+  if (min_gain != NULL)
+    *min_gain = prm->caps.min_gain;
+  if (max_gain != NULL)
+    *max_gain = prm->caps.max_gain;
+
+  return TRUE;
+}
+
+/* Получает тип порта датчика. */
+HyScanSensorPortType
+hyscan_sonar_model_sensor_get_port_type (HyScanSonarModel *model,
+                                         const gchar      *port_name)
+{
+  HyScanSensorParams *prm;
+
+  g_return_val_if_fail (HYSCAN_IS_SONAR_MODEL (model), HYSCAN_SENSOR_PORT_INVALID);
+
+  if ((prm = g_hash_table_lookup (model->priv->sensors_params, port_name)) == NULL)
+    return HYSCAN_SENSOR_PORT_INVALID;
+
+  return prm->port_type;
+}
+
+/* Заново считывает возможности гидролокатора после переподключения. */
+void
+hyscan_sonar_model_refresh_capabilities (HyScanSonarModel *model)
+{
+  HyScanSonarModelPrivate *priv;
+
+  g_return_if_fail (HYSCAN_IS_SONAR_MODEL (model));
+
+  priv = model->priv;
+
+  /* Без источников данных гидролокатор не инициализирован. */
+  if (priv->sources == NULL)
+    return;
+
+  /* Значения параметров должны соответствовать новым возможностям гидролокатора. */
+  hyscan_sonar_model_load_capabilities (model);
+  hyscan_sonar_model_set_valid_params (model);
+
+  /* После переподключения параметры гидролокатора неизвестны. */
+  if (priv->sonar_control_model != NULL)
+    hyscan_sonar_control_model_invalidate (priv->sonar_control_model);
+}
@@ -60,6 +60,14 @@
  *                               gpointer          user_data);
  * \endcode
  *
+ * Возможности гидролокатора (типы синхронизации, режимы и сигналы генератора, режимы
+ * и диапазоны усиления ВАРУ, максимальное время приёма, типы портов датчиков) считываются
+ * один раз при создании объекта и далее возвращаются без обращения к гидролокатору,
+ * например функциями #hyscan_sonar_model_gen_get_capabilities,
+ * #hyscan_sonar_model_tvg_get_gain_range и #hyscan_sonar_model_get_max_distance.
+ * После переподключения к гидролокатору их необходимо считать заново функцией
+ * #hyscan_sonar_model_refresh_capabilities.
+ *
  * \warning Данный класс корректно работает только с GMainLoop, кроме того
  * он не является потокобезопасным.
  */
@@ -129,6 +137,15 @@ HyScanSonarModel*        hyscan_sonar_model_new                         (HyScanS
 HYSCAN_API
 void                     hyscan_sonar_model_flush                       (HyScanSonarModel           *model);
 
+/**
+ * Отменяет применение отправленных изменений, которые ещё не переданы гидролокатору.
+ * Система управления освобождается после завершения выполняющейся команды.
+ *
+ * \param model указатель на объект \link HyScanSonarModel \endlink.
+ */
+HYSCAN_API
+void                     hyscan_sonar_model_cancel                      (HyScanSonarModel           *model);
+
 /**
  * Проверяет состояние системы управления гидролокатором.
  *
@@ -839,6 +856,92 @@ HyScanTrackType          hyscan_sonar_model_get_track_type              (HyScanS
 HYSCAN_API
 gboolean                 hyscan_sonar_model_get_record_state            (HyScanSonarModel           *model);
 
+/**
+ * Получает возможные типы синхронизации.
+ *
+ * \param model указатель на объект \link HyScanSonarModel \endlink.
+ *
+ * \return Маска типов синхронизации \link HyScanSonarSyncType \endlink, либо HYSCAN_SONAR_SYNC_INVALID, в случае ошибки.
+ */
+HYSCAN_API
+HyScanSonarSyncType      hyscan_sonar_model_get_sync_capabilities       (HyScanSonarModel           *model);
+
+/**
+ * Получает возможные режимы работы генератора.
+ *
+ * \param model указатель на объект \link HyScanSonarModel \endlink;
+ * \param source_type идентификатор источника данных.
+ *
+ * \return Маска режимов \link HyScanGeneratorModeType \endlink, либо HYSCAN_GENERATOR_MODE_INVALID, в случае ошибки.
+ */
+HYSCAN_API
+HyScanGeneratorModeType  hyscan_sonar_model_gen_get_capabilities        (HyScanSonarModel           *model,
+                                                                         HyScanSourceType            source_type);
+
+/**
+ * Получает возможные типы сигналов генератора.
+ *
+ * \param model указатель на объект \link HyScanSonarModel \endlink;
+ * \param source_type идентификатор источника данных.
+ *
+ * \return Маска типов сигналов \link HyScanGeneratorSignalType \endlink, либо HYSCAN_GENERATOR_SIGNAL_INVALID, в случае ошибки.
+ */
+HYSCAN_API
+HyScanGeneratorSignalType hyscan_sonar_model_gen_get_signals            (HyScanSonarModel           *model,
+                                                                         HyScanSourceType            source_type);
+
+/**
+ * Получает возможные режимы работы ВАРУ.
+ *
+ * \param model указатель на объект \link HyScanSonarModel \endlink;
+ * \param source_type идентификатор источника данных.
+ *
+ * \return Маска режимов \link HyScanTVGModeType \endlink, либо HYSCAN_TVG_MODE_INVALID, в случае ошибки.
+ */
+HYSCAN_API
+HyScanTVGModeType        hyscan_sonar_model_tvg_get_capabilities        (HyScanSonarModel           *model,
+                                                                         HyScanSourceType            source_type);
+
+/**
+ * Получает допустимые пределы усиления ВАРУ.
+ *
+ * \param model указатель на объект \link HyScanSonarModel \endlink;
+ * \param source_type идентификатор источника данных;
+ * \param min_gain минимальное усиление, дБ, или NULL;
+ * \param max_gain максимальное усиление, дБ, или NULL.
+ *
+ * \return TRUE - если пределы усиления получены, FALSE - в случае ошибки.
+ */
+HYSCAN_API
+gboolean                 hyscan_sonar_model_tvg_get_gain_range          (HyScanSonarModel           *model,
+                                                                         HyScanSourceType            source_type,
+                                                                         gdouble                    *min_gain,
+                                                                         gdouble                    *max_gain);
+
+/**
+ * Получает тип порта датчика.
+ *
+ * \param model указатель на объект \link HyScanSonarModel \endlink;
+ * \param port_name название порта.
+ *
+ * \return Тип порта \link HyScanSensorPortType \endlink, либо HYSCAN_SENSOR_PORT_INVALID, в случае ошибки.
+ */
+HYSCAN_API
+HyScanSensorPortType     hyscan_sonar_model_sensor_get_port_type        (HyScanSonarModel           *model,
+                                                                         const gchar                *port_name);
+
+/**
+ * Заново считывает возможности гидролокатора. Функцию необходимо вызывать после
+ * переподключения к гидролокатору, она выполняет запросы к гидролокатору и блокирует
+ * выполнение до их завершения. Текущие значения параметров заменяются значениями
+ * по умолчанию, допустимыми для новых возможностей гидролокатора. Кроме того, функция
+ * забывает значения параметров, применённые к гидролокатору до переподключения.
+ *
+ * \param model указатель на объект \link HyScanSonarModel \endlink.
+ */
+HYSCAN_API
+void                     hyscan_sonar_model_refresh_capabilities        (HyScanSonarModel           *model);
+
 G_END_DECLS
 
 #endif /* __HYSCAN_SONAR_MODEL_H__ */
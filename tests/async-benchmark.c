@@ -0,0 +1,147 @@
+#include <hyscan-async.h>
+
+#define N_QUERIES 10000
+#define N_ROUNDS  20
+
+/* Данные запроса, по размеру близкие к параметрам команд управления гидролокатором. */
+typedef struct
+{
+  gint64  time;
+  gdouble values[4];
+  gint    index;
+} BenchmarkData;
+
+static HyScanAsync   *async;
+static gint           counter;
+static gint           round_id;
+static gint64         append_time;
+static gint64         execute_start;
+static gint64         append_sum;
+static gint64         execute_sum;
+
+gboolean    benchmark_cmd  (gint            *counter,
+                            BenchmarkData   *data);
+
+void        completed_cb   (HyScanAsync     *async,
+                            gboolean         result,
+                            gpointer         user_data);
+
+gboolean    benchmark_round (gpointer        user_data);
+
+int
+main (int    argc,
+      char **argv)
+{
+  GMainLoop *loop;
+
+  async = hyscan_async_new ();
+
+  loop = g_main_loop_new (NULL, TRUE);
+  g_signal_connect (async, "completed", G_CALLBACK (completed_cb), loop);
+
+  g_message ("Appending and executing %d queries, %d rounds.", N_QUERIES, N_ROUNDS);
+
+  round_id = 0;
+  g_idle_add (benchmark_round, loop);
+
+  g_main_loop_run (loop);
+
+  g_main_loop_unref (loop);
+  g_object_unref (async);
+
+  return 0;
+}
+
+gboolean
+benchmark_cmd (gint          *counter,
+               BenchmarkData *data)
+{
+  if (data->index != *counter)
+    return FALSE;
+
+  (*counter)++;
+  return TRUE;
+}
+
+void
+completed_cb (HyScanAsync *async,
+              gboolean     result,
+              gpointer     user_data)
+{
+  GMainLoop *loop = user_data;
+  HyScanAsyncStats stats;
+  gint64 execute_time;
+
+  execute_time = g_get_monotonic_time () - execute_start;
+
+  if (!result || counter != N_QUERIES)
+    {
+      g_message ("Round %d failed [Queries counter: %d].", round_id, counter);
+      g_main_loop_quit (loop);
+      return;
+    }
+
+  g_message ("Round %2d: append %" G_GINT64_FORMAT " us (%.1f ns/query), execute %" G_GINT64_FORMAT " us.",
+             round_id, append_time, 1000.0 * append_time / N_QUERIES, execute_time);
+
+  /* Первый раунд - прогрев, в статистику не входит. */
+  if (round_id > 0)
+    {
+      append_sum += append_time;
+      execute_sum += execute_time;
+    }
+
+  if (++round_id < N_ROUNDS)
+    {
+      g_idle_add (benchmark_round, loop);
+      return;
+    }
+
+  g_message ("Average: append %.1f ns/query, execute %" G_GINT64_FORMAT " us/batch.",
+             1000.0 * append_sum / ((N_ROUNDS - 1) * N_QUERIES), execute_sum / (N_ROUNDS - 1));
+
+  hyscan_async_get_stats (async, &stats);
+  g_message ("Stats: %u batches, %u commands, queue wait p50 %u us p99 %u us, "
+             "command p99 %u us, delivery delay p50 %u us p99 %u us.",
+             stats.n_batches, stats.n_queries,
+             hyscan_async_histogram_percentile (&stats.queue_wait, 50.0),
+             hyscan_async_histogram_percentile (&stats.queue_wait, 99.0),
+             hyscan_async_histogram_percentile (&stats.command_time, 99.0),
+             hyscan_async_histogram_percentile (&stats.delivery_delay, 50.0),
+             hyscan_async_histogram_percentile (&stats.delivery_delay, 99.0));
+  g_main_loop_quit (loop);
+}
+
+gboolean
+benchmark_round (gpointer user_data)
+{
+  GMainLoop *loop = user_data;
+  BenchmarkData data = { 0 };
+  gint64 start;
+  gint i;
+
+  counter = 0;
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < N_QUERIES; i++)
+    {
+      data.time = start;
+      data.index = i;
+      if (!hyscan_async_append_query (async, (HyScanAsyncCommand) benchmark_cmd, &counter, &data, sizeof (data)))
+        {
+          g_message ("Failed to append query %d.", i);
+          g_main_loop_quit (loop);
+          return G_SOURCE_REMOVE;
+        }
+    }
+  append_time = g_get_monotonic_time () - start;
+
+  execute_start = g_get_monotonic_time ();
+  if (!hyscan_async_execute (async))
+    {
+      g_message ("Failed to execute queries.");
+      g_main_loop_quit (loop);
+    }
+
+  return G_SOURCE_REMOVE;
+}
@@ -0,0 +1,115 @@
+#include <hyscan-async.h>
+
+#define N_PRODUCERS  16
+#define N_QUERIES    20000
+#define BATCH_SIZE   100
+#define WAIT_TIMEOUT (60 * G_TIME_SPAN_SECOND)
+
+/* Данные запроса: номер потока-источника и порядковый номер запроса в нём. */
+typedef struct
+{
+  guint   producer;
+  guint   seq;
+} StressData;
+
+static HyScanAsync   *async;
+static gint           last_seq[N_PRODUCERS];
+static gint           n_executed;
+static gint           n_rejected;
+static gint           n_disorders;
+
+gboolean    stress_cmd        (gpointer     object,
+                               StressData  *data);
+
+gpointer    producer_func     (gpointer     user_data);
+
+int
+main (int    argc,
+      char **argv)
+{
+  GThread *producers[N_PRODUCERS];
+  gboolean test_result;
+  guint i;
+
+  async = g_object_new (HYSCAN_TYPE_ASYNC,
+                        "pipeline", TRUE,
+                        "n-workers", 4,
+                        NULL);
+
+  for (i = 0; i < N_PRODUCERS; i++)
+    last_seq[i] = -1;
+
+  g_message ("Appending %d queries from each of %d threads.", N_QUERIES, N_PRODUCERS);
+
+  for (i = 0; i < N_PRODUCERS; i++)
+    producers[i] = g_thread_new ("producer", producer_func, GUINT_TO_POINTER (i));
+
+  /* Каждый поток перед завершением запускает свои последние запросы, поэтому после
+   * завершения всех потоков остаётся только дождаться выполнения запущенных пакетов. */
+  for (i = 0; i < N_PRODUCERS; i++)
+    g_thread_join (producers[i]);
+
+  test_result = hyscan_async_wait (async, WAIT_TIMEOUT);
+  if (!test_result)
+    g_message ("Timeout.");
+  hyscan_async_dispatch (async);
+
+  test_result = test_result &&
+                (g_atomic_int_get (&n_executed) == N_PRODUCERS * N_QUERIES) &&
+                (n_rejected == 0) && (n_disorders == 0);
+
+  g_message ("Executed %d of %d queries, %d disorders, %d rejected appends.",
+             g_atomic_int_get (&n_executed), N_PRODUCERS * N_QUERIES, n_disorders, n_rejected);
+  g_message ("Test %s.", test_result ? "done" : "FAILED");
+
+  g_object_unref (async);
+
+  return test_result ? 0 : -1;
+}
+
+/* Команда проверяет, что запросы одного потока выполняются в порядке добавления.
+ * Каждый поток использует свою полосу, поэтому его запросы выполняются последовательно. */
+gboolean
+stress_cmd (gpointer    object,
+            StressData *data)
+{
+  if (last_seq[data->producer] + 1 != (gint) data->seq)
+    g_atomic_int_inc (&n_disorders);
+
+  last_seq[data->producer] = data->seq;
+  g_atomic_int_inc (&n_executed);
+
+  return TRUE;
+}
+
+/* Поток добавляет запросы и периодически запускает их выполнение. */
+gpointer
+producer_func (gpointer user_data)
+{
+  HyScanAsyncQueryOptions options = { 0 };
+  StressData data;
+  guint i;
+
+  data.producer = GPOINTER_TO_UINT (user_data);
+  options.lane = data.producer + 1;
+
+  for (i = 0; i < N_QUERIES; i++)
+    {
+      data.seq = i;
+
+      /* Запрос не может быть отклонён в конвейерном режиме. */
+      if (hyscan_async_append_query_full (async, (HyScanAsyncCommand) stress_cmd, NULL,
+                                          &data, sizeof (data), &options) == 0)
+        {
+          g_atomic_int_inc (&n_rejected);
+        }
+
+      if ((i + 1) % BATCH_SIZE == 0)
+        hyscan_async_execute (async);
+    }
+
+  /* Последние запросы потока попадают в пакет, запущенный здесь или другим потоком. */
+  hyscan_async_execute (async);
+
+  return NULL;
+}
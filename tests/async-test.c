@@ -1,81 +1,119 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
 #include <hyscan-async.h>
+#include <gio/gio.h>
+#include <string.h>
 
-#define N_TEST_REPEATS 5
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
-enum
-{
-  TEST_PRM = 0,
-  TEST_LIST,
-  TEST_WAIT,
-  TEST_EXIT
-};
+#define TEST_TIMEOUT 10
 
-typedef struct
-{
-  gint counter;
-  gint prm;
-} CounterObject;
+#define N_TEST_REPEATS 5
+#define N_LATENCY_REPEATS 100
 
-static int            wait;
-static int            test_repeats_counter;
-static int            test_id;
-static int            expected_count;
-static GRand         *rnd;
-static CounterObject  obj;
-static HyScanAsync   *async;
+#define N_PRIORITY_QUERIES 8
 
+#define N_LANES 4
+#define N_LANE_QUERIES 4
+#define LANE_QUERY_TIME (20 * G_TIME_SPAN_MILLISECOND)
 
-gboolean    async_cmd_prm  (CounterObject   *obj,
-                            gint            *prm);
+#define N_COALESCE_KEYS 4
+#define N_COALESCE_VALUES 10
 
-gboolean    async_cmd_list (CounterObject   *obj,
-                            gint            *prm);
+#define N_CANCEL_QUERIES 3
+#define CANCEL_DELAY 20
 
-gboolean    async_cmd_wait (CounterObject   *obj,
-                            gint            *prm);
+#define ERROR_MESSAGE "test error"
 
-void        compelted_cb   (HyScanAsync     *async,
-                            gboolean         result,
-                            gpointer         user_data);
+#define N_EXECUTOR_WORKERS 2
+#define N_EXECUTOR_CLIENTS 4
+#define N_EXECUTOR_QUERIES 10
+#define EXECUTOR_QUERY_TIME (2 * G_TIME_SPAN_MILLISECOND)
 
-void        started_cb     (HyScanAsync     *async,
-                            gpointer         user_data);
+#define N_TASK_QUERIES 8
 
-gboolean    test_prm       (gpointer         user_data);
+#define N_BLOCKING_QUERIES 8
+#define BLOCKING_TIMEOUT (10 * G_TIME_SPAN_MILLISECOND)
 
-gboolean    test_list      (gpointer         user_data);
+#define N_TAKE_QUERIES 8
 
-gboolean    test_wait      (gpointer         user_data);
+#define N_STATS_QUERIES 16
 
-int
-main (int    argc,
-      char **argv)
-{
-  GMainLoop *loop;
+#define N_SCHEDULE_RUNS 10
+#define SCHEDULE_PERIOD (5 * G_TIME_SPAN_MILLISECOND)
 
-  rnd = g_rand_new_with_seed ((guint32)g_get_monotonic_time ());
-  async = hyscan_async_new ();
+#define N_DAG_NODES 5
+#define DAG_QUERY_TIME (20 * G_TIME_SPAN_MILLISECOND)
 
-  /* Настройка Mainloop. */
-  loop = g_main_loop_new (NULL, TRUE);
-  g_signal_connect (async, "completed", G_CALLBACK (compelted_cb), loop);
-  g_signal_connect (async, "started", G_CALLBACK (started_cb), loop);
+#define MAX_QUEUE_DEPTH 4
+#define N_OVERFLOW_QUERIES (2 * MAX_QUEUE_DEPTH)
 
-  test_repeats_counter = 0;
-  test_id = TEST_PRM;
-  g_message ("1. Parameter test.");
-  g_idle_add (test_prm, loop);
+#define N_RETRY_ATTEMPTS 3
+#define N_RETRY_QUERIES (N_RETRY_ATTEMPTS + 1)
+#define RETRY_BACKOFF (G_TIME_SPAN_MILLISECOND)
 
-  g_main_loop_run (loop);
+typedef struct
+{
+  gint counter;
+  gint prm;
+} CounterObject;
 
-  g_main_loop_unref (loop);
-  g_rand_free (rnd);
-  g_object_unref (async);
+typedef struct
+{
+  guint lane;
+  gint  seq;
+} LaneQuery;
 
-  return 0;
-}
+typedef struct
+{
+  guint key;
+  gint  value;
+} CoalesceQuery;
+
+static GMainLoop     *loop;
+static gint           n_completed;
+static gboolean       completed_result = TRUE;
+static gint64         completed_time;
+static CounterObject  obj;
+static int            wait;
+static int            wait_entered;
+static gint           retry_attempts[N_RETRY_QUERIES];
+static gint           executor_order[N_EXECUTOR_CLIENTS * N_EXECUTOR_QUERIES];
+static gint           executor_counter;
+static gint           executor_warnings;
+static gint           executor_policy;
+static gboolean       affinity_failed;
+static gboolean       task_cancelled;
+static gint           take_executed;
+static gint           take_destroyed;
+static gint           take_value;
+static gint           schedule_runs;
+static gint           schedule_once_runs;
+static gint64         dag_start[N_DAG_NODES];
+static gint64         dag_end[N_DAG_NODES];
+static gint           overflow_values[N_OVERFLOW_QUERIES];
+static gint           overflow_counter;
+static gint           overflow_pressure[2];
+static gint           priority_order[N_PRIORITY_QUERIES + 2];
+static gint           priority_counter;
+static GMutex         lanes_mutex;
+static gint           lane_counters[N_LANES];
+static gint           lanes_running;
+static gint           lanes_max_running;
+static gboolean       lanes_order_failed;
+static gint           coalesce_values[N_COALESCE_KEYS + 1];
+static gint           coalesce_calls;
+static gint64         latency_start;
+static gint64         wakeup_start;
+static gint64         wakeup_sum;
+static gint64         wakeup_max;
 
-gboolean
+static gboolean
 async_cmd_prm (CounterObject *obj,
                gint          *prm)
 {
@@ -95,7 +133,7 @@ async_cmd_prm (CounterObject *obj,
   return TRUE;
 }
 
-gboolean
+static gboolean
 async_cmd_list (CounterObject *obj,
                 gint          *prm)
 {
@@ -103,156 +141,1319 @@ async_cmd_list (CounterObject *obj,
   return TRUE;
 }
 
-gboolean
+static gboolean
 async_cmd_wait (CounterObject *obj,
                 gint          *prm)
 {
+  g_atomic_int_set (&wait_entered, 1);
   while (g_atomic_int_get (&wait))
-    g_usleep (100000);
+    g_usleep (10000);
+  return TRUE;
+}
+
+static gboolean
+async_cmd_order (CounterObject *obj,
+                 gint          *prm)
+{
+  priority_order[priority_counter++] = *prm;
   return TRUE;
 }
 
-void
-compelted_cb (HyScanAsync *async,
+static gboolean
+async_cmd_lane (CounterObject *obj,
+                LaneQuery     *prm)
+{
+  g_mutex_lock (&lanes_mutex);
+  lanes_running++;
+  lanes_max_running = MAX (lanes_max_running, lanes_running);
+  g_mutex_unlock (&lanes_mutex);
+
+  g_usleep (LANE_QUERY_TIME);
+
+  /* Запросы одной полосы выполняются в порядке добавления. */
+  g_mutex_lock (&lanes_mutex);
+  if (lane_counters[prm->lane] != prm->seq)
+    lanes_order_failed = TRUE;
+  lane_counters[prm->lane]++;
+  lanes_running--;
+  g_mutex_unlock (&lanes_mutex);
+
+  return TRUE;
+}
+
+static gboolean
+async_cmd_lane_barrier (CounterObject *obj,
+                        gint          *prm)
+{
+  guint i;
+
+  /* Барьер выполняется после первой половины запросов каждой полосы и один. */
+  g_mutex_lock (&lanes_mutex);
+  if (lanes_running != 0)
+    lanes_order_failed = TRUE;
+  for (i = 0; i < N_LANES; i++)
+    if (lane_counters[i] != N_LANE_QUERIES / 2)
+      lanes_order_failed = TRUE;
+  g_mutex_unlock (&lanes_mutex);
+
+  return TRUE;
+}
+
+static gboolean
+async_cmd_coalesce (CounterObject *obj,
+                    CoalesceQuery *prm)
+{
+  coalesce_values[prm->key] = prm->value;
+  coalesce_calls++;
+  return TRUE;
+}
+
+static gboolean
+async_cmd_cancel_wait (CounterObject *obj,
+                       gint          *prm)
+{
+  GCancellable *cancellable = g_cancellable_get_current ();
+  gint64 end = g_get_monotonic_time () + G_TIME_SPAN_SECOND;
+
+  /* Команда ожидает отмены пакета, но не дольше секунды. */
+  while (!g_cancellable_is_cancelled (cancellable) && g_get_monotonic_time () < end)
+    g_usleep (1000);
+
+  return g_cancellable_is_cancelled (cancellable);
+}
+
+static gboolean
+async_cmd_error (CounterObject *obj,
+                 gint          *prm)
+{
+  hyscan_async_set_command_error (g_error_new_literal (HYSCAN_ASYNC_ERROR, HYSCAN_ASYNC_ERROR_FAILED,
+                                                       ERROR_MESSAGE));
+  return FALSE;
+}
+
+static gboolean
+async_cmd_executor (CounterObject *obj,
+                    gint          *prm)
+{
+  gint counter = g_atomic_int_add (&executor_counter, 1);
+
+  executor_order[counter] = *prm;
+
+#ifdef __linux__
+  {
+    struct sched_param param;
+    gint policy;
+
+    if (pthread_getschedparam (pthread_self (), &policy, &param) == 0)
+      g_atomic_int_set (&executor_policy, policy);
+  }
+#endif
+
+  g_usleep (EXECUTOR_QUERY_TIME);
+  return TRUE;
+}
+
+#ifdef __linux__
+static gboolean
+async_cmd_affinity (CounterObject *obj,
+                    gint          *prm)
+{
+  cpu_set_t cpu_set;
+
+  /* Поток пула закреплён за процессором 0 и выполняется на нём. */
+  if (pthread_getaffinity_np (pthread_self (), sizeof (cpu_set), &cpu_set) != 0 ||
+      CPU_COUNT (&cpu_set) != 1 || !CPU_ISSET (0, &cpu_set) || sched_getcpu () != 0)
+    {
+      affinity_failed = TRUE;
+    }
+
+  g_atomic_int_inc (&executor_counter);
+  return TRUE;
+}
+#endif
+
+static gboolean
+async_cmd_take (CounterObject *obj,
+                gint          *prm)
+{
+  take_value = *prm;
+  take_executed++;
+  return TRUE;
+}
+
+static void
+take_destroy (gint *prm)
+{
+  take_destroyed++;
+  g_free (prm);
+}
+
+static gboolean
+async_cmd_schedule (gint     *counter,
+                    gpointer  prm)
+{
+  g_atomic_int_inc (counter);
+  return TRUE;
+}
+
+static gboolean
+async_cmd_dag (CounterObject *obj,
+               gint          *node)
+{
+  g_mutex_lock (&lanes_mutex);
+  dag_start[*node] = g_get_monotonic_time ();
+  lanes_running++;
+  lanes_max_running = MAX (lanes_max_running, lanes_running);
+  g_mutex_unlock (&lanes_mutex);
+
+  g_usleep (DAG_QUERY_TIME);
+
+  g_mutex_lock (&lanes_mutex);
+  dag_end[*node] = g_get_monotonic_time ();
+  lanes_running--;
+  g_mutex_unlock (&lanes_mutex);
+
+  return TRUE;
+}
+
+static gboolean
+async_cmd_overflow (CounterObject *obj,
+                    gint          *prm)
+{
+  overflow_values[overflow_counter++] = *prm;
+  return TRUE;
+}
+
+/* Запрос с номером prm завершается с ошибкой в первых prm попытках. */
+static gboolean
+async_cmd_retry (CounterObject *obj,
+                 gint          *prm)
+{
+  if (++retry_attempts[*prm] > *prm)
+    return TRUE;
+
+  hyscan_async_set_command_error (g_error_new (HYSCAN_ASYNC_ERROR, HYSCAN_ASYNC_ERROR_FAILED,
+                                               "attempt %d failed", retry_attempts[*prm]));
+  return FALSE;
+}
+
+static gboolean
+async_cmd_latency (CounterObject *obj,
+                   gint          *prm)
+{
+  gint64 wakeup;
+
+  /* Задержка между запуском выполнения и началом выполнения команды. */
+  wakeup = g_get_monotonic_time () - wakeup_start;
+  wakeup_sum += wakeup;
+  wakeup_max = MAX (wakeup_max, wakeup);
+
+  /* Время окончания выполнения последней команды. */
+  latency_start = g_get_monotonic_time ();
+  return TRUE;
+}
+
+static void
+queue_pressure_cb (HyScanAsync *async,
+                   gboolean     pressure,
+                   gpointer     user_data)
+{
+  overflow_pressure[pressure ? 1 : 0]++;
+}
+
+/* Запоминает результат выполнения пакета и останавливает главный цикл. */
+static void
+completed_cb (HyScanAsync *async,
               gboolean     result,
               gpointer     user_data)
 {
-  GMainLoop *loop = user_data;
+  completed_time = g_get_monotonic_time ();
+  completed_result = completed_result && result;
+  n_completed++;
+
+  g_main_loop_quit (loop);
+}
+
+static gboolean
+completed_timeout_cb (gpointer user_data)
+{
+  g_error ("Timeout waiting for the \"completed\" signal.");
 
-  test_repeats_counter++;
-  switch (test_id)
+  return G_SOURCE_REMOVE;
+}
+
+/* Выполняет главный цикл, пока не будут завершены n пакетов. Возвращает TRUE,
+ * если все пакеты выполнены успешно. */
+static gboolean
+wait_completed (gint n)
+{
+  gboolean result;
+  guint timeout_id;
+
+  timeout_id = g_timeout_add_seconds (TEST_TIMEOUT, completed_timeout_cb, NULL);
+  while (n_completed < n)
+    g_main_loop_run (loop);
+  g_source_remove (timeout_id);
+
+  result = completed_result;
+  completed_result = TRUE;
+  n_completed = 0;
+
+  return result;
+}
+
+/* Создаёт объект с указанными свойствами и подключает обработчик сигнала "completed". */
+static HyScanAsync *
+test_async_new (const gchar *first_property_name,
+                ...)
+{
+  HyScanAsync *async;
+  va_list args;
+
+  va_start (args, first_property_name);
+  async = HYSCAN_ASYNC (g_object_new_valist (HYSCAN_TYPE_ASYNC, first_property_name, args));
+  va_end (args);
+
+  g_signal_connect (async, "completed", G_CALLBACK (completed_cb), NULL);
+
+  return async;
+}
+
+/* Параметры запроса передаются команде. */
+static void
+test_prm (void)
+{
+  HyScanAsync *async = test_async_new (NULL);
+  gint i;
+
+  for (i = 0; i < N_TEST_REPEATS; i++)
     {
-    case TEST_PRM:
-      if (!result)
-        {
-          g_message ("Parameter test failed.");
-          g_main_loop_quit (loop);
-          return;
-        }
-      g_message ("Success [Obtained param: %d].", obj.prm);
-      if (test_repeats_counter < N_TEST_REPEATS)
+      obj.prm = g_random_int ();
+      g_assert_true (hyscan_async_append_query (async, (HyScanAsyncCommand) async_cmd_prm,
+                                                &obj, &obj.prm, sizeof (obj.prm)));
+      g_assert_true (hyscan_async_execute (async));
+      g_assert_true (wait_completed (1));
+    }
+
+  g_object_unref (async);
+}
+
+/* Все запросы пакета выполняются. */
+static void
+test_list (void)
+{
+  HyScanAsync *async = test_async_new (NULL);
+  gint expected_count;
+  gint i, j;
+
+  for (i = 0; i < N_TEST_REPEATS; i++)
+    {
+      obj.counter = 0;
+      expected_count = g_random_int_range (2, 12);
+      for (j = 0; j < expected_count; ++j)
+        hyscan_async_append_query (async, (HyScanAsyncCommand) async_cmd_list, &obj, &obj.prm, sizeof (obj.prm));
+      hyscan_async_execute (async);
+
+      g_assert_true (wait_completed (1));
+      g_assert_cmpint (obj.counter, ==, expected_count);
+    }
+
+  g_object_unref (async);
+}
+
+/* Во время выполнения пакета запросы не добавляются и пакет не запускается. */
+static void
+test_wait (void)
+{
+  HyScanAsync *async = test_async_new (NULL);
+  gint i;
+
+  for (i = 0; i < N_TEST_REPEATS; i++)
+    {
+      g_atomic_int_set (&wait, 1);
+      hyscan_async_append_query (async, (HyScanAsyncCommand) async_cmd_wait, &obj, &obj.prm, sizeof (obj.prm));
+      hyscan_async_execute (async);
+
+      g_assert_false (hyscan_async_append_query (async, (HyScanAsyncCommand) async_cmd_wait,
+                                                 &obj, &obj.prm, sizeof (obj.prm)));
+      g_assert_false (hyscan_async_execute (async));
+
+      g_atomic_int_set (&wait, 0);
+      g_assert_true (wait_completed (1));
+    }
+
+  g_object_unref (async);
+}
+
+/* Запросы выполняются в порядке приоритетов, запросы одного приоритета - в порядке добавления. */
+static void
+test_priority (void)
+{
+  HyScanAsync *async = test_async_new (NULL);
+  HyScanAsyncQueryOptions options = { 0 };
+  gint order;
+  gint i;
+
+  for (i = 0; i < N_TEST_REPEATS; i++)
+    {
+      priority_counter = 0;
+      memset (priority_order, -1, sizeof (priority_order));
+
+      /* Запрос с низким приоритетом добавляется первым, с высоким - последним. */
+      order = N_PRIORITY_QUERIES + 1;
+      options.priority = HYSCAN_ASYNC_PRIORITY_LOW;
+      hyscan_async_append_query_full (async, (HyScanAsyncCommand) async_cmd_order,
+                                      &obj, &order, sizeof (order), &options);
+
+      options.priority = HYSCAN_ASYNC_PRIORITY_DEFAULT;
+      for (order = 1; order <= N_PRIORITY_QUERIES; order++)
         {
-          test_id = TEST_PRM;
-          g_idle_add (test_prm, loop);
-          return;
+          hyscan_async_append_query_full (async, (HyScanAsyncCommand) async_cmd_order,
+                                          &obj, &order, sizeof (order), &options);
         }
-      else
+
+      order = 0;
+      options.priority = HYSCAN_ASYNC_PRIORITY_HIGH;
+      hyscan_async_append_query_full (async, (HyScanAsyncCommand) async_cmd_order,
+                                      &obj, &order, sizeof (order), &options);
+
+      hyscan_async_execute (async);
+      g_assert_true (wait_completed (1));
+
+      g_assert_cmpint (priority_counter, ==, N_PRIORITY_QUERIES + 2);
+      for (order = 0; order < N_PRIORITY_QUERIES + 2; order++)
+        g_assert_cmpint (priority_order[order], ==, order);
+    }
+
+  g_object_unref (async);
+}
+
+/* В режиме конвейера следующий пакет заполняется и запускается, пока выполняется предыдущий. */
+static void
+test_pipeline (void)
+{
+  HyScanAsync *async = test_async_new ("pipeline", TRUE, NULL);
+  gint expected_count;
+  gint i, j;
+
+  for (i = 0; i < N_TEST_REPEATS; i++)
+    {
+      obj.counter = 0;
+      expected_count = g_random_int_range (2, 12);
+
+      /* Первый пакет блокирует поток выполнения запросов. */
+      g_atomic_int_set (&wait_entered, 0);
+      g_atomic_int_set (&wait, 1);
+      hyscan_async_append_query (async, (HyScanAsyncCommand) async_cmd_wait, &obj, NULL, 0);
+      hyscan_async_execute (async);
+      while (!g_atomic_int_get (&wait_entered))
+        g_usleep (1000);
+
+      /* Запуск после первого запроса, остальные запросы добавляются в уже запущенный пакет. */
+      for (j = 0; j < expected_count; ++j)
         {
-          test_id = TEST_LIST;
+          g_assert_true (hyscan_async_append_query (async, (HyScanAsyncCommand) async_cmd_list, &obj, NULL, 0));
+          if (j == 0)
+            g_assert_true (hyscan_async_execute (async));
         }
-       break;
+      g_assert_true (hyscan_async_execute (async));
 
-    case TEST_LIST:
-      if (expected_count != obj.counter)
+      g_atomic_int_set (&wait, 0);
+      g_assert_true (wait_completed (2));
+      g_assert_cmpint (obj.counter, ==, expected_count);
+    }
+
+  g_object_unref (async);
+}
+
+/* Полосы выполняются параллельно, запросы одной полосы - последовательно,
+ * барьер - после всех предшествующих запросов. */
+static void
+test_lanes (void)
+{
+  HyScanAsync *async = test_async_new ("n-workers", N_LANES, NULL);
+  HyScanAsyncQueryOptions options = { 0 };
+  LaneQuery query;
+  gint64 start;
+  gint seq;
+  gint i;
+
+  for (i = 0; i < N_TEST_REPEATS; i++)
+    {
+      memset (lane_counters, 0, sizeof (lane_counters));
+      lanes_running = 0;
+      lanes_max_running = 0;
+      lanes_order_failed = FALSE;
+
+      /* Половина запросов каждой полосы, барьер, вторая половина запросов. */
+      for (seq = 0; seq < N_LANE_QUERIES; seq++)
         {
-          g_message ("Multiple queries test failed.");
-          g_main_loop_quit (loop);
-          return;
+          if (seq == N_LANE_QUERIES / 2)
+            {
+              options.lane = HYSCAN_ASYNC_LANE_BARRIER;
+              hyscan_async_append_query_full (async, (HyScanAsyncCommand) async_cmd_lane_barrier,
+                                              &obj, NULL, 0, &options);
+            }
+
+          for (query.lane = 0; query.lane < N_LANES; query.lane++)
+            {
+              query.seq = seq;
+              options.lane = query.lane + 1;
+              hyscan_async_append_query_full (async, (HyScanAsyncCommand) async_cmd_lane,
+                                              &obj, &query, sizeof (query), &options);
+            }
         }
-      g_message ("Success [Queries counter: %d].", obj.counter);
-      if (test_repeats_counter < N_TEST_REPEATS)
+
+      start = g_get_monotonic_time ();
+      hyscan_async_execute (async);
+      g_assert_true (wait_completed (1));
+
+      g_assert_false (lanes_order_failed);
+      g_assert_cmpint (lanes_max_running, >=, 2);
+
+      g_test_message ("Max parallel queries: %d, time: %" G_GINT64_FORMAT " ms, sequential: %" G_GINT64_FORMAT " ms.",
+                      lanes_max_running, (g_get_monotonic_time () - start) / G_TIME_SPAN_MILLISECOND,
+                      (N_LANES * N_LANE_QUERIES) * LANE_QUERY_TIME / G_TIME_SPAN_MILLISECOND);
+    }
+
+  g_object_unref (async);
+}
+
+/* Запросы с ненулевым ключом замещают предыдущие с тем же ключом и сохраняют
+ * их идентификаторы, запросы с нулевым ключом выполняются все. */
+static void
+test_coalesce (void)
+{
+  HyScanAsync *async = test_async_new ("coalesce", TRUE, NULL);
+  HyScanAsyncQueryOptions options = { 0 };
+  CoalesceQuery query;
+  guint ids[N_COALESCE_KEYS + 1];
+  guint id;
+  guint key;
+  gint i;
+
+  for (i = 0; i < N_TEST_REPEATS; i++)
+    {
+      memset (coalesce_values, -1, sizeof (coalesce_values));
+      coalesce_calls = 0;
+
+      for (query.value = 0; query.value < N_COALESCE_VALUES; query.value++)
+        for (query.key = 0; query.key <= N_COALESCE_KEYS; query.key++)
+          {
+            options.key = query.key;
+            id = hyscan_async_append_query_full (async, (HyScanAsyncCommand) async_cmd_coalesce,
+                                                 &obj, &query, sizeof (query), &options);
+
+            g_assert_cmpuint (id, !=, 0);
+            if (query.key > 0 && query.value > 0)
+              g_assert_cmpuint (id, ==, ids[query.key]);
+            ids[query.key] = id;
+          }
+
+      hyscan_async_execute (async);
+      g_assert_true (wait_completed (1));
+
+      g_assert_cmpint (coalesce_calls, ==, N_COALESCE_KEYS + N_COALESCE_VALUES);
+      for (key = 1; key <= N_COALESCE_KEYS; key++)
+        g_assert_cmpint (coalesce_values[key], ==, N_COALESCE_VALUES - 1);
+    }
+
+  g_object_unref (async);
+}
+
+/* Запрос замещает запрос с тем же ключом и другой командой, но не замещает его,
+ * если зависит от него или от более поздних запросов. */
+static void
+test_coalesce_deps (void)
+{
+  HyScanAsync *async = test_async_new ("coalesce", TRUE, NULL);
+  HyScanAsyncQueryOptions options = { 0 };
+  guint ids[4];
+  gint value;
+
+  obj.counter = 0;
+  priority_counter = 0;
+
+  options.key = 1;
+  ids[0] = hyscan_async_append_query_full (async, (HyScanAsyncCommand) async_cmd_list,
+                                           &obj, NULL, 0, &options);
+  value = 1;
+  g_assert_cmpuint (hyscan_async_append_query_full (async, (HyScanAsyncCommand) async_cmd_order,
+                                                    &obj, &value, sizeof (value), &options), ==, ids[0]);
+
+  options.key = 2;
+  value = 2;
+  ids[1] = hyscan_async_append_query_full (async, (HyScanAsyncCommand) async_cmd_order,
+                                           &obj, &value, sizeof (value), &options);
+
+  options.key = 0;
+  value = 3;
+  ids[2] = hyscan_async_append_query_full (async, (HyScanAsyncCommand) async_cmd_order,
+                                           &obj, &value, sizeof (value), &options);
+
+  /* Зависимость от более позднего запроса. */
+  options.key = 2;
+  options.depends_on = &ids[2];
+  options.n_depends_on = 1;
+  value = 4;
+  ids[3] = hyscan_async_append_query_full (async, (HyScanAsyncCommand) async_cmd_order,
+                                           &obj, &value, sizeof (value), &options);
+  g_assert_cmpuint (ids[3], !=, ids[1]);
+
+  /* Зависимость от замещаемого запроса. */
+  options.depends_on = &ids[3];
+  value = 5;
+  g_assert_cmpuint (hyscan_async_append_query_full (async, (HyScanAsyncCommand) async_cmd_order,
+                                                    &obj, &value, sizeof (value), &options), !=, ids[3]);
+
+  hyscan_async_execute (async);
+  g_assert_true (wait_completed (1));
+
+  g_assert_cmpint (obj.counter, ==, 0);
+  g_assert_cmpint (priority_counter, ==, 5);
+  for (value = 0; value < priority_counter; value++)
+    g_assert_cmpint (priority_order[value], ==, value + 1);
+
+  g_object_unref (async);
+}
+
+static gboolean
+test_cancel_timeout (gpointer user_data)
+{
+  hyscan_async_cancel (user_data);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Запрос с истёкшим сроком пропускается, ожидающий отмены запрос выполняется,
+ * остальные отменяются. */
+static void
+test_cancel (void)
+{
+  HyScanAsync *async = test_async_new (NULL);
+  HyScanAsyncQueryOptions options = { 0 };
+  const HyScanAsyncQueryResult *results;
+  guint n_results;
+  guint j;
+  gint i;
+
+  for (i = 0; i < N_TEST_REPEATS; i++)
+    {
+      obj.counter = 0;
+
+      options.deadline = g_get_monotonic_time () - 1;
+      hyscan_async_append_query_full (async, (HyScanAsyncCommand) async_cmd_list, &obj, NULL, 0, &options);
+      hyscan_async_append_query (async, (HyScanAsyncCommand) async_cmd_cancel_wait, &obj, NULL, 0);
+      for (j = 0; j < N_CANCEL_QUERIES; j++)
+        hyscan_async_append_query (async, (HyScanAsyncCommand) async_cmd_list, &obj, NULL, 0);
+
+      hyscan_async_execute (async);
+      g_timeout_add (CANCEL_DELAY, test_cancel_timeout, async);
+      g_assert_false (wait_completed (1));
+
+      results = hyscan_async_get_results (async, &n_results);
+      g_assert_cmpint (obj.counter, ==, 0);
+      g_assert_cmpuint (n_results, ==, N_CANCEL_QUERIES + 2);
+      g_assert_cmpint (results[0].status, ==, HYSCAN_ASYNC_QUERY_EXPIRED);
+      g_assert_cmpint (results[1].status, ==, HYSCAN_ASYNC_QUERY_SUCCESS);
+      for (j = 2; j < n_results; j++)
+        g_assert_cmpint (results[j].status, ==, HYSCAN_ASYNC_QUERY_CANCELLED);
+    }
+
+  g_object_unref (async);
+}
+
+/* Ошибка в первой полосе пропускает следующий запрос этой полосы и барьер,
+ * запросы второй полосы выполняются. */
+static void
+test_errors (void)
+{
+  HyScanAsync *async = test_async_new ("continue-on-error", TRUE, NULL);
+  HyScanAsyncQueryOptions options = { 0 };
+  const HyScanAsyncQueryResult *results;
+  guint n_results;
+  gint i;
+
+  for (i = 0; i < N_TEST_REPEATS; i++)
+    {
+      obj.counter = 0;
+
+      options.lane = 1;
+      hyscan_async_append_query_full (async, (HyScanAsyncCommand) async_cmd_error, &obj, NULL, 0, &options);
+      hyscan_async_append_query_full (async, (HyScanAsyncCommand) async_cmd_list, &obj, NULL, 0, &options);
+
+      options.lane = 2;
+      hyscan_async_append_query_full (async, (HyScanAsyncCommand) async_cmd_list, &obj, NULL, 0, &options);
+      hyscan_async_append_query_full (async, (HyScanAsyncCommand) async_cmd_list, &obj, NULL, 0, &options);
+
+      options.lane = HYSCAN_ASYNC_LANE_BARRIER;
+      hyscan_async_append_query_full (async, (HyScanAsyncCommand) async_cmd_list, &obj, NULL, 0, &options);
+
+      hyscan_async_execute (async);
+      g_assert_false (wait_completed (1));
+
+      results = hyscan_async_get_results (async, &n_results);
+      g_assert_cmpint (obj.counter, ==, 2);
+      g_assert_cmpuint (n_results, ==, 5);
+      g_assert_cmpint (results[0].status, ==, HYSCAN_ASYNC_QUERY_FAILED);
+      g_assert_cmpstr (results[0].error->message, ==, ERROR_MESSAGE);
+      g_assert_cmpint (results[1].status, ==, HYSCAN_ASYNC_QUERY_SKIPPED);
+      g_assert_cmpint (results[2].status, ==, HYSCAN_ASYNC_QUERY_SUCCESS);
+      g_assert_cmpint (results[3].status, ==, HYSCAN_ASYNC_QUERY_SUCCESS);
+      g_assert_cmpint (results[4].status, ==, HYSCAN_ASYNC_QUERY_SKIPPED);
+      g_assert_error (results[4].error, HYSCAN_ASYNC_ERROR, HYSCAN_ASYNC_ERROR_SKIPPED);
+    }
+
+  g_object_unref (async);
+}
+
+/* Предупреждения пула потоков о неприменённых параметрах потоков не прерывают проверку,
+ * а подсчитываются. */
+static gboolean
+executor_log_fatal (const gchar    *log_domain,
+                    GLogLevelFlags  log_level,
+                    const gchar    *message,
+                    gpointer        user_data)
+{
+  if (g_str_has_prefix (message, "HyScanAsyncExecutor: "))
+    {
+      g_atomic_int_inc (&executor_warnings);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* Объекты с общим пулом потоков обслуживаются по очереди. Политика реального
+ * времени без прав не применяется, но пул должен продолжать работу. */
+static void
+test_executor (void)
+{
+  HyScanAsyncExecutor *executor;
+  HyScanAsync *clients[N_EXECUTOR_CLIENTS];
+  gint client_ids[N_EXECUTOR_CLIENTS];
+  gboolean served[N_EXECUTOR_CLIENTS];
+  gint i, j, k;
+
+  executor_warnings = 0;
+  executor = g_object_new (HYSCAN_TYPE_ASYNC_EXECUTOR,
+                           "n-workers", N_EXECUTOR_WORKERS,
+                           "sched-policy", HYSCAN_ASYNC_SCHED_RR,
+                           "sched-priority", 1,
+                           NULL);
+  for (i = 0; i < N_EXECUTOR_CLIENTS; i++)
+    {
+      client_ids[i] = i;
+      clients[i] = test_async_new ("executor", executor, NULL);
+    }
+
+  for (k = 0; k < N_TEST_REPEATS; k++)
+    {
+      executor_counter = 0;
+
+      for (i = 0; i < N_EXECUTOR_CLIENTS; i++)
         {
-          test_id = TEST_LIST;
-          obj.counter = 0;
-          g_idle_add (test_list, loop);
-          return;
+          for (j = 0; j < N_EXECUTOR_QUERIES; j++)
+            {
+              hyscan_async_append_query (clients[i], (HyScanAsyncCommand) async_cmd_executor,
+                                         &obj, &client_ids[i], sizeof (gint));
+            }
         }
-      else
+
+      for (i = 0; i < N_EXECUTOR_CLIENTS; i++)
+        hyscan_async_execute (clients[i]);
+
+      g_assert_true (wait_completed (N_EXECUTOR_CLIENTS));
+      g_assert_cmpint (executor_counter, ==, N_EXECUTOR_CLIENTS * N_EXECUTOR_QUERIES);
+
+      /* Первые запросы принадлежат разным объектам. */
+      memset (served, 0, sizeof (served));
+      for (i = 0; i < N_EXECUTOR_CLIENTS; i++)
+        served[executor_order[i]] = TRUE;
+      for (i = 0; i < N_EXECUTOR_CLIENTS; i++)
+        g_assert_true (served[i]);
+    }
+
+  /* Политика либо применена, либо о её неприменении предупреждено. */
+#ifdef __linux__
+  if (executor_policy != SCHED_RR)
+    g_assert_cmpint (g_atomic_int_get (&executor_warnings), >, 0);
+#endif
+
+  for (i = 0; i < N_EXECUTOR_CLIENTS; i++)
+    g_object_unref (clients[i]);
+  g_object_unref (executor);
+}
+
+#ifdef __linux__
+/* Потоки пула с маской "cpu-affinity" выполняют команды только на заданном процессоре. */
+static void
+test_executor_affinity (void)
+{
+  HyScanAsyncExecutor *executor;
+  HyScanAsync *async;
+  gint i;
+
+  executor_warnings = 0;
+  executor = g_object_new (HYSCAN_TYPE_ASYNC_EXECUTOR,
+                           "n-workers", N_EXECUTOR_WORKERS,
+                           "cpu-affinity", G_GUINT64_CONSTANT (1),
+                           NULL);
+  async = test_async_new ("executor", executor, "n-workers", N_EXECUTOR_WORKERS, NULL);
+
+  executor_counter = 0;
+  affinity_failed = FALSE;
+
+  for (i = 0; i < N_EXECUTOR_QUERIES; i++)
+    {
+      HyScanAsyncQueryOptions options = { 0 };
+
+      options.lane = HYSCAN_ASYNC_LANE_NONE;
+      hyscan_async_append_query_full (async, (HyScanAsyncCommand) async_cmd_affinity,
+                                      &obj, NULL, 0, &options);
+    }
+
+  hyscan_async_execute (async);
+  g_assert_true (wait_completed (1));
+  g_assert_cmpint (executor_counter, ==, N_EXECUTOR_QUERIES);
+
+  /* Процессор 0 может быть недоступен процессу, тогда пул только предупреждает. */
+  if (g_atomic_int_get (&executor_warnings) == 0)
+    g_assert_false (affinity_failed);
+  else
+    g_test_message ("CPU affinity is not applied.");
+
+  g_object_unref (async);
+  g_object_unref (executor);
+}
+#endif
+
+static void
+task_ready_cb (GObject      *source,
+               GAsyncResult *res,
+               gpointer      user_data)
+{
+  GError *error = NULL;
+  GArray *results;
+  gboolean result;
+
+  results = hyscan_async_execute_finish (HYSCAN_ASYNC (source), res, &error);
+
+  /* Отменённая задача завершается ошибкой G_IO_ERROR_CANCELLED, запросы не выполняются. */
+  if (task_cancelled)
+    {
+      result = (results == NULL && g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED) && obj.counter == 0);
+    }
+  else
+    {
+      result = (results != NULL && results->len == N_TASK_QUERIES && obj.counter == N_TASK_QUERIES);
+    }
+
+  g_clear_error (&error);
+  g_clear_pointer (&results, g_array_unref);
+
+  completed_cb (HYSCAN_ASYNC (source), result, user_data);
+}
+
+/* Пакет выполняется как GTask, каждый второй запуск отменяется до начала выполнения. */
+static void
+test_task (void)
+{
+  HyScanAsync *async = hyscan_async_new ();
+  GCancellable *cancellable;
+  gint i, j;
+
+  for (i = 0; i < N_TEST_REPEATS; i++)
+    {
+      obj.counter = 0;
+
+      for (j = 0; j < N_TASK_QUERIES; j++)
+        hyscan_async_append_query (async, (HyScanAsyncCommand) async_cmd_list, &obj, NULL, 0);
+
+      task_cancelled = (i % 2) == 1;
+      cancellable = g_cancellable_new ();
+      if (task_cancelled)
+        g_cancellable_cancel (cancellable);
+
+      hyscan_async_execute_async (async, NULL, cancellable, task_ready_cb, NULL);
+      g_object_unref (cancellable);
+
+      g_assert_true (wait_completed (1));
+    }
+
+  g_object_unref (async);
+}
+
+/* Ожидание завершения не доставляет результаты, сигнал испускается при явной доставке. */
+static void
+test_blocking (void)
+{
+  HyScanAsync *async = test_async_new (NULL);
+  gint i, j;
+
+  for (i = 0; i < N_TEST_REPEATS; i++)
+    {
+      obj.counter = 0;
+
+      /* Первая команда ожидает сброса флага wait. */
+      g_atomic_int_set (&wait, 1);
+      hyscan_async_append_query (async, (HyScanAsyncCommand) async_cmd_wait, &obj, NULL, 0);
+      for (j = 0; j < N_BLOCKING_QUERIES; j++)
+        hyscan_async_append_query (async, (HyScanAsyncCommand) async_cmd_list, &obj, NULL, 0);
+      hyscan_async_execute (async);
+
+      /* Пока команда ожидает, время ожидания истекает. */
+      g_assert_false (hyscan_async_wait (async, BLOCKING_TIMEOUT));
+
+      g_atomic_int_set (&wait, 0);
+      g_assert_true (hyscan_async_wait (async, -1));
+      g_assert_cmpint (n_completed, ==, 0);
+
+      g_assert_true (hyscan_async_dispatch (async));
+      g_assert_cmpint (n_completed, ==, 1);
+      g_assert_true (wait_completed (1));
+      g_assert_cmpint (obj.counter, ==, N_BLOCKING_QUERIES);
+    }
+
+  g_object_unref (async);
+}
+
+/* Данные всех запросов, включая замещённые и пропущенные, освобождаются до сигнала. */
+static void
+test_take (void)
+{
+  HyScanAsync *async = test_async_new ("coalesce", TRUE, NULL);
+  HyScanAsyncQueryOptions options = { 0 };
+  gint i, j;
+
+  for (i = 0; i < N_TEST_REPEATS; i++)
+    {
+      take_executed = 0;
+      take_destroyed = 0;
+      take_value = -1;
+
+      /* Запросы с одним ключом замещают друг друга, выполняется только последний. */
+      options.key = 1;
+      for (j = 0; j < N_TAKE_QUERIES; j++)
         {
-          test_id = TEST_WAIT;
+          gint *prm = g_new (gint, 1);
+
+          *prm = j;
+          hyscan_async_append_query_take (async, (HyScanAsyncCommand) async_cmd_take, &obj,
+                                          prm, (GDestroyNotify) take_destroy, &options);
         }
-      break;
 
-    case TEST_WAIT:
-      if (test_repeats_counter < N_TEST_REPEATS)
+      /* Запросы после ошибки не выполняются, но их данные всё равно освобождаются. */
+      hyscan_async_append_query (async, (HyScanAsyncCommand) async_cmd_error, &obj, NULL, 0);
+      for (j = 0; j < N_TAKE_QUERIES; j++)
         {
-          test_id = TEST_WAIT;
-          g_idle_add (test_wait, loop);
-          return;
+          hyscan_async_append_query_take (async, (HyScanAsyncCommand) async_cmd_take, &obj,
+                                          g_new0 (gint, 1), (GDestroyNotify) take_destroy, NULL);
         }
-      else
+
+      hyscan_async_execute (async);
+      g_assert_false (wait_completed (1));
+
+      g_assert_cmpint (take_executed, ==, 1);
+      g_assert_cmpint (take_value, ==, N_TAKE_QUERIES - 1);
+      g_assert_cmpint (take_destroyed, ==, 2 * N_TAKE_QUERIES);
+    }
+
+  g_object_unref (async);
+}
+
+/* Статистика учитывает пакеты, команды и ошибки, в том числе по каждой команде. */
+static void
+test_stats (void)
+{
+  HyScanAsync *async = test_async_new (NULL);
+  HyScanAsyncStats stats;
+  HyScanAsyncHistogram command_stats;
+  guint n_queries;
+  gint i, j;
+
+  for (i = 0; i < N_TEST_REPEATS; i++)
+    {
+      hyscan_async_reset_stats (async);
+
+      /* Последняя команда завершается с ошибкой. */
+      for (j = 0; j < N_STATS_QUERIES; j++)
+        hyscan_async_append_query (async, (HyScanAsyncCommand) async_cmd_list, &obj, NULL, 0);
+      hyscan_async_append_query (async, (HyScanAsyncCommand) async_cmd_error, &obj, NULL, 0);
+
+      hyscan_async_execute (async);
+      g_assert_false (wait_completed (1));
+
+      hyscan_async_get_stats (async, &stats);
+      g_assert_true (hyscan_async_get_command_stats (async, (HyScanAsyncCommand) async_cmd_list, &command_stats));
+      g_object_get (async, "n-queries", &n_queries, NULL);
+
+      g_assert_cmpuint (stats.n_batches, ==, 1);
+      g_assert_cmpuint (stats.n_queries, ==, N_STATS_QUERIES + 1);
+      g_assert_cmpuint (stats.n_failed, ==, 1);
+      g_assert_cmpuint (stats.peak_queue_depth, ==, N_STATS_QUERIES + 1);
+      g_assert_cmpuint (stats.command_time.count, ==, N_STATS_QUERIES + 1);
+      g_assert_cmpuint (stats.queue_wait.count, ==, N_STATS_QUERIES + 1);
+      g_assert_cmpuint (command_stats.count, ==, N_STATS_QUERIES);
+      g_assert_cmpuint (n_queries, ==, stats.n_queries);
+
+      g_test_message ("Queue wait %u us, command time p50 %u us, max %u us.",
+                      stats.queue_wait.max,
+                      hyscan_async_histogram_percentile (&stats.command_time, 50.0),
+                      stats.command_time.max);
+    }
+
+  g_object_unref (async);
+}
+
+/* Периодический запрос выполняется до удаления, однократный удаляется автоматически. */
+static void
+test_schedule (void)
+{
+  HyScanAsync *async = test_async_new (NULL);
+  HyScanAsyncStats stats;
+  guint schedule_id;
+  guint schedule_once_id;
+  gint64 start;
+  gint runs;
+  gint i;
+
+  for (i = 0; i < N_TEST_REPEATS; i++)
+    {
+      schedule_runs = 0;
+      schedule_once_runs = 0;
+      hyscan_async_reset_stats (async);
+
+      /* Периодический запрос и однократный запрос в середине серии. */
+      start = g_get_monotonic_time () + SCHEDULE_PERIOD;
+      schedule_id = hyscan_async_schedule_query (async, (HyScanAsyncCommand) async_cmd_schedule,
+                                                 &schedule_runs, NULL, 0, start, SCHEDULE_PERIOD);
+      schedule_once_id = hyscan_async_schedule_query (async, (HyScanAsyncCommand) async_cmd_schedule,
+                                                      &schedule_once_runs, NULL, 0,
+                                                      start + SCHEDULE_PERIOD * N_SCHEDULE_RUNS / 2, 0);
+
+      /* Проверка через половину периода после последнего выполнения. Поток может
+       * проснуться позже, поэтому допускаются лишние выполнения. */
+      g_usleep (N_SCHEDULE_RUNS * SCHEDULE_PERIOD + SCHEDULE_PERIOD / 2);
+
+      g_assert_false (hyscan_async_unschedule_query (async, schedule_once_id));
+      g_assert_true (hyscan_async_unschedule_query (async, schedule_id));
+
+      runs = g_atomic_int_get (&schedule_runs);
+      hyscan_async_get_stats (async, &stats);
+      g_assert_cmpint (runs, >=, N_SCHEDULE_RUNS);
+      g_assert_cmpint (g_atomic_int_get (&schedule_once_runs), ==, 1);
+      g_assert_cmpuint (stats.schedule_jitter.count + stats.n_missed, >=, (guint) runs);
+
+      g_test_message ("Periodic runs: %d, jitter avg %.0f us, max %u us, missed %u.",
+                      runs, hyscan_async_histogram_mean (&stats.schedule_jitter),
+                      stats.schedule_jitter.max, stats.n_missed);
+    }
+
+  g_object_unref (async);
+}
+
+/* Запросы вне полос упорядочиваются только зависимостями. */
+static void
+test_dag (void)
+{
+  HyScanAsync *async = test_async_new ("n-workers", N_LANES, NULL);
+  HyScanAsyncQueryOptions options = { 0 };
+  guint ids[N_DAG_NODES];
+  gint64 start;
+  gint node;
+  gint i;
+
+  for (i = 0; i < N_TEST_REPEATS; i++)
+    {
+      lanes_running = 0;
+      lanes_max_running = 0;
+
+      /* Граф: 0, 1 и 3 независимы, 2 зависит от 0 и 1, 4 зависит от 2. Запрос 2 имеет
+       * высокий приоритет, который передаётся запросам 0 и 1. */
+      options.lane = HYSCAN_ASYNC_LANE_NONE;
+      for (node = 0; node < N_DAG_NODES; node++)
         {
-          test_id = TEST_EXIT;
+          options.priority = HYSCAN_ASYNC_PRIORITY_DEFAULT;
+          options.depends_on = NULL;
+          options.n_depends_on = 0;
+
+          if (node == 2)
+            {
+              options.priority = HYSCAN_ASYNC_PRIORITY_HIGH;
+              options.depends_on = ids;
+              options.n_depends_on = 2;
+            }
+          else if (node == 4)
+            {
+              options.depends_on = &ids[2];
+              options.n_depends_on = 1;
+            }
+
+          ids[node] = hyscan_async_append_query_full (async, (HyScanAsyncCommand) async_cmd_dag,
+                                                      &obj, &node, sizeof (node), &options);
         }
-      break;
-      default:
-        g_main_loop_quit (loop);
-        return;
+
+      start = g_get_monotonic_time ();
+      hyscan_async_execute (async);
+      g_assert_true (wait_completed (1));
+
+      g_assert_cmpint (dag_start[2], >=, MAX (dag_end[0], dag_end[1]));
+      g_assert_cmpint (dag_start[4], >=, dag_end[2]);
+      g_assert_cmpint (lanes_max_running, >=, 3);
+
+      g_test_message ("Max parallel queries: %d, time: %" G_GINT64_FORMAT " ms, sequential: %" G_GINT64_FORMAT " ms.",
+                      lanes_max_running, (g_get_monotonic_time () - start) / G_TIME_SPAN_MILLISECOND,
+                      N_DAG_NODES * DAG_QUERY_TIME / G_TIME_SPAN_MILLISECOND);
     }
 
-  switch (test_id)
+  g_object_unref (async);
+}
+
+/* Добавляет в пакет вдвое больше запросов, чем допустимо, и проверяет выполненные запросы.
+ * Выполнение ожидается функцией hyscan_async_wait, сигналы испускает hyscan_async_dispatch. */
+static void
+test_overflow_policy (HyScanAsyncOverflowPolicy  policy,
+                      const gint                *expected)
+{
+  HyScanAsync *async;
+  HyScanAsyncStats stats;
+  gboolean pressure;
+  guint ids[N_OVERFLOW_QUERIES];
+  gint i;
+
+  async = g_object_new (HYSCAN_TYPE_ASYNC,
+                        "max-queue-depth", MAX_QUEUE_DEPTH,
+                        "overflow-policy", policy,
+                        NULL);
+  g_signal_connect (async, "queue-pressure", G_CALLBACK (queue_pressure_cb), NULL);
+
+  overflow_counter = 0;
+  memset (overflow_pressure, 0, sizeof (overflow_pressure));
+
+  for (i = 0; i < N_OVERFLOW_QUERIES; i++)
     {
-    case TEST_LIST:
-      test_repeats_counter = 0;
-      test_id = TEST_LIST;
-      obj.counter = 0;
-      g_message (" ");
-      g_message ("2. Multiple queries test.");
-      g_idle_add (test_list, loop);
-      break;
-    case TEST_WAIT:
-      test_repeats_counter = 0;
-      g_message (" ");
-      g_message ("3. Wait test.");
-      g_idle_add (test_wait, loop);
-      break;
-    default:
-      g_message (" ");
-      g_message ("All done.");
-      g_main_loop_quit (loop);
-      return;
+      ids[i] = hyscan_async_append_query_full (async, (HyScanAsyncCommand) async_cmd_overflow,
+                                               &obj, &i, sizeof (i), NULL);
+
+      /* Отклоняются только запросы сверх предела, замена сохраняет идентификатор. */
+      if (policy == HYSCAN_ASYNC_OVERFLOW_REJECT)
+        g_assert_cmpint (ids[i] == 0, ==, i >= MAX_QUEUE_DEPTH);
+      if (policy == HYSCAN_ASYNC_OVERFLOW_COALESCE && i >= MAX_QUEUE_DEPTH)
+        g_assert_cmpuint (ids[i], ==, ids[MAX_QUEUE_DEPTH - 1]);
     }
+
+  g_object_get (async, "queue-pressure", &pressure, NULL);
+
+  hyscan_async_execute (async);
+  hyscan_async_wait (async, -1);
+  hyscan_async_dispatch (async);
+  hyscan_async_get_stats (async, &stats);
+
+  g_assert_true (pressure);
+  g_assert_cmpint (overflow_counter, ==, MAX_QUEUE_DEPTH);
+  g_assert_cmpint (overflow_pressure[0], ==, 1);
+  g_assert_cmpint (overflow_pressure[1], ==, 1);
+  g_assert_cmpmem (overflow_values, MAX_QUEUE_DEPTH * sizeof (gint), expected, MAX_QUEUE_DEPTH * sizeof (gint));
+  if (policy == HYSCAN_ASYNC_OVERFLOW_DROP_OLDEST)
+    g_assert_cmpuint (stats.n_dropped, ==, MAX_QUEUE_DEPTH);
+  else
+    g_assert_cmpuint (stats.n_rejected, ==, policy == HYSCAN_ASYNC_OVERFLOW_REJECT ? MAX_QUEUE_DEPTH : 0);
+
+  g_object_unref (async);
 }
 
-void
-started_cb (HyScanAsync *async,
-            gpointer     user_data)
+static void
+test_overflow_reject (void)
 {
+  const gint expected[MAX_QUEUE_DEPTH] = { 0, 1, 2, 3 };
+
+  test_overflow_policy (HYSCAN_ASYNC_OVERFLOW_REJECT, expected);
 }
 
-gboolean
-test_prm (gpointer user_data)
+static void
+test_overflow_drop_oldest (void)
 {
-  obj.prm = g_random_int ();
-  hyscan_async_append_query (async, (HyScanAsyncCommand) async_cmd_prm, &obj, &obj.prm, sizeof (obj.prm));
-  g_message ("Expected param: %d.", obj.prm);
-  hyscan_async_execute (async);
-  return G_SOURCE_REMOVE;
+  const gint expected[MAX_QUEUE_DEPTH] = { 4, 5, 6, 7 };
+
+  test_overflow_policy (HYSCAN_ASYNC_OVERFLOW_DROP_OLDEST, expected);
 }
 
-gboolean
-test_list (gpointer user_data)
+static void
+test_overflow_coalesce (void)
 {
+  const gint expected[MAX_QUEUE_DEPTH] = { 0, 1, 2, 7 };
+
+  test_overflow_policy (HYSCAN_ASYNC_OVERFLOW_COALESCE, expected);
+}
+
+/* Вытесняет запросы с ключами объединения, пока вытесненные запросы не будут удалены
+ * из пакета несколько раз, и проверяет, что ключи оставшихся запросов действительны. */
+static void
+test_overflow_drop_keys (void)
+{
+  const gint expected[MAX_QUEUE_DEPTH] = { 16, 17, 18, 100 };
+  HyScanAsyncQueryOptions options = { 0 };
+  HyScanAsync *async;
+  HyScanAsyncStats stats;
+  guint id = 0;
   gint i;
-  obj.counter = 0;
-  expected_count = g_rand_int (rnd) % 10 + 2;
-  for (i = 0; i < expected_count; ++i)
-    hyscan_async_append_query (async, (HyScanAsyncCommand) async_cmd_list, &obj, &obj.prm, sizeof (obj.prm));
-  g_message ("Appended %d queries.", expected_count);
+
+  async = g_object_new (HYSCAN_TYPE_ASYNC,
+                        "max-queue-depth", MAX_QUEUE_DEPTH,
+                        "overflow-policy", HYSCAN_ASYNC_OVERFLOW_DROP_OLDEST,
+                        "coalesce", TRUE,
+                        NULL);
+
+  overflow_counter = 0;
+
+  for (i = 0; i < 5 * MAX_QUEUE_DEPTH; i++)
+    {
+      options.key = i + 1;
+      id = hyscan_async_append_query_full (async, (HyScanAsyncCommand) async_cmd_overflow,
+                                           &obj, &i, sizeof (i), &options);
+    }
+
+  /* Запрос с ключом последнего запроса заменяет его, а не вытесняет самый старый. */
+  i = 100;
+  g_assert_cmpuint (hyscan_async_append_query_full (async, (HyScanAsyncCommand) async_cmd_overflow,
+                                                    &obj, &i, sizeof (i), &options), ==, id);
+
   hyscan_async_execute (async);
-  return G_SOURCE_REMOVE;
+  hyscan_async_wait (async, -1);
+  hyscan_async_dispatch (async);
+  hyscan_async_get_stats (async, &stats);
+
+  g_assert_cmpint (overflow_counter, ==, MAX_QUEUE_DEPTH);
+  g_assert_cmpmem (overflow_values, sizeof (expected), expected, sizeof (expected));
+  g_assert_cmpuint (stats.n_dropped, ==, 4 * MAX_QUEUE_DEPTH);
+
+  g_object_unref (async);
 }
 
-gboolean
-test_wait (gpointer user_data)
+/* Запросы, которым хватило попыток, выполняются, последний запрос завершается
+ * ошибкой последней попытки. Повторы выдерживают задержку: 1 + (1 + 2) + (1 + 2). */
+static void
+test_retry (void)
 {
-  g_atomic_int_set (&wait, 1);
-  hyscan_async_append_query (async, (HyScanAsyncCommand) async_cmd_wait, &obj, &obj.prm, sizeof (obj.prm));
-  hyscan_async_execute (async);
-  if (hyscan_async_append_query (async, (HyScanAsyncCommand) async_cmd_wait, &obj, &obj.prm, sizeof (obj.prm)))
+  HyScanAsync *async;
+  const HyScanAsyncQueryResult *results;
+  HyScanAsyncStats stats;
+  guint n_results;
+  gint64 start;
+  gint64 elapsed;
+  gint i, j;
+
+  async = test_async_new ("continue-on-error", TRUE,
+                          "max-attempts", N_RETRY_ATTEMPTS,
+                          "retry-backoff", (gint64) RETRY_BACKOFF,
+                          NULL);
+
+  for (i = 0; i < N_TEST_REPEATS; i++)
     {
-      g_message ("Test failed");
-      g_atomic_int_set (&wait, 0);
-      return G_SOURCE_REMOVE;
+      memset (retry_attempts, 0, sizeof (retry_attempts));
+      hyscan_async_reset_stats (async);
+
+      for (j = 0; j < N_RETRY_QUERIES; j++)
+        hyscan_async_append_query (async, (HyScanAsyncCommand) async_cmd_retry, &obj, &j, sizeof (j));
+
+      start = g_get_monotonic_time ();
+      hyscan_async_execute (async);
+      g_assert_false (wait_completed (1));
+      elapsed = g_get_monotonic_time () - start;
+
+      results = hyscan_async_get_results (async, &n_results);
+      hyscan_async_get_stats (async, &stats);
+
+      g_assert_cmpuint (n_results, ==, N_RETRY_QUERIES);
+      g_assert_cmpuint (stats.n_retries, ==, 5);
+      g_assert_cmpint (elapsed, >=, 7 * RETRY_BACKOFF);
+      for (j = 0; j < N_RETRY_QUERIES; j++)
+        g_assert_cmpint (retry_attempts[j], ==, MIN (j + 1, N_RETRY_ATTEMPTS));
+      for (j = 0; j < N_RETRY_ATTEMPTS; j++)
+        g_assert_cmpint (results[j].status, ==, HYSCAN_ASYNC_QUERY_SUCCESS);
+      g_assert_cmpint (results[N_RETRY_ATTEMPTS].status, ==, HYSCAN_ASYNC_QUERY_FAILED);
+      g_assert_cmpstr (results[N_RETRY_ATTEMPTS].error->message, ==, "attempt 3 failed");
     }
-  if (hyscan_async_execute (async))
+
+  g_object_unref (async);
+}
+
+/* Задержки между запуском пакета и началом выполнения команды и между окончанием
+ * выполнения команды и сигналом "completed". */
+static void
+test_latency (void)
+{
+  HyScanAsync *async = test_async_new (NULL);
+  gint64 latency_sum = 0;
+  gint64 latency_max = 0;
+  gint64 latency;
+  gint i;
+
+  wakeup_sum = 0;
+  wakeup_max = 0;
+
+  for (i = 0; i < N_LATENCY_REPEATS; i++)
     {
-      g_message ("Test failed");
-      g_atomic_int_set (&wait, 0);
-      return G_SOURCE_REMOVE;
+      hyscan_async_append_query (async, (HyScanAsyncCommand) async_cmd_latency, &obj, NULL, 0);
+      wakeup_start = g_get_monotonic_time ();
+      hyscan_async_execute (async);
+      g_assert_true (wait_completed (1));
+
+      latency = completed_time - latency_start;
+      latency_sum += latency;
+      latency_max = MAX (latency_max, latency);
     }
 
-  g_atomic_int_set (&wait, 0);
-  g_message ("Success");
-  return G_SOURCE_REMOVE;
+  g_test_message ("Completion latency: avg %" G_GINT64_FORMAT " us, max %" G_GINT64_FORMAT " us.",
+                  latency_sum / N_LATENCY_REPEATS, latency_max);
+  g_test_message ("Wakeup latency: avg %" G_GINT64_FORMAT " us, max %" G_GINT64_FORMAT " us.",
+                  wakeup_sum / N_LATENCY_REPEATS, wakeup_max);
+
+  g_object_unref (async);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  int status;
+
+  g_test_init (&argc, &argv, NULL);
+  g_test_log_set_fatal_handler (executor_log_fatal, NULL);
+
+  loop = g_main_loop_new (NULL, FALSE);
+
+  g_test_add_func ("/async/parameter", test_prm);
+  g_test_add_func ("/async/list", test_list);
+  g_test_add_func ("/async/wait", test_wait);
+  g_test_add_func ("/async/priority", test_priority);
+  g_test_add_func ("/async/pipeline", test_pipeline);
+  g_test_add_func ("/async/lanes", test_lanes);
+  g_test_add_func ("/async/coalesce", test_coalesce);
+  g_test_add_func ("/async/coalesce-deps", test_coalesce_deps);
+  g_test_add_func ("/async/cancel", test_cancel);
+  g_test_add_func ("/async/continue-on-error", test_errors);
+  g_test_add_func ("/async/executor", test_executor);
+#ifdef __linux__
+  g_test_add_func ("/async/executor/affinity", test_executor_affinity);
+#endif
+  g_test_add_func ("/async/task", test_task);
+  g_test_add_func ("/async/blocking", test_blocking);
+  g_test_add_func ("/async/take", test_take);
+  g_test_add_func ("/async/stats", test_stats);
+  g_test_add_func ("/async/schedule", test_schedule);
+  g_test_add_func ("/async/dag", test_dag);
+  g_test_add_func ("/async/overflow/reject", test_overflow_reject);
+  g_test_add_func ("/async/overflow/drop-oldest", test_overflow_drop_oldest);
+  g_test_add_func ("/async/overflow/coalesce", test_overflow_coalesce);
+  g_test_add_func ("/async/overflow/drop-keys", test_overflow_drop_keys);
+  g_test_add_func ("/async/retry", test_retry);
+  g_test_add_func ("/async/latency", test_latency);
+
+  status = g_test_run ();
+
+  g_main_loop_unref (loop);
+
+  return status;
 }
@@ -0,0 +1,305 @@
+#include "hyscan-sonar-control-model.h"
+#include "virtual-sonar.h"
+
+#include <string.h>
+
+#define N_ROUNDS       20
+#define LINK_DELAY     (2 * G_TIME_SPAN_MILLISECOND)
+
+static HyScanSonarControlModel *models[2];
+static HyScanSonarControlModel *model;
+static VirtualSonar            *server;
+static GMainLoop               *loop;
+
+static gint                     round_trips;
+static gint                     round_id;
+static gint                     phase;
+static gint64                   execute_start;
+static gint64                   time_sum[3];
+static gint                     round_trips_sum[3];
+static gboolean                 benchmark_result;
+
+static gboolean server_call            (void);
+static gboolean generator_set_auto     (VirtualSonar              *server,
+                                        HyScanSourceType           source,
+                                        HyScanGeneratorSignalType  signal);
+static gboolean generator_set_enable   (VirtualSonar              *server,
+                                        HyScanSourceType           source,
+                                        gboolean                   enable);
+static gboolean tvg_set_auto           (VirtualSonar              *server,
+                                        HyScanSourceType           source,
+                                        gdouble                    level,
+                                        gdouble                    sensitivity);
+static gboolean tvg_set_constant       (VirtualSonar              *server,
+                                        HyScanSourceType           source,
+                                        gdouble                    gain);
+static gboolean tvg_set_enable         (VirtualSonar              *server,
+                                        HyScanSourceType           source,
+                                        gboolean                   enable);
+static gboolean sonar_set_position     (VirtualSonar              *server,
+                                        HyScanSourceType           source,
+                                        HyScanAntennaPosition     *position);
+static gboolean sonar_set_receive_time (VirtualSonar              *server,
+                                        HyScanSourceType           source,
+                                        gdouble                    receive_time);
+static gboolean sonar_set_sync_type    (VirtualSonar              *server,
+                                        HyScanSonarSyncType        sync_type);
+
+static void     resync                 (void);
+static void     print_command_stats    (HyScanSonarControlModel   *model);
+static gboolean benchmark_round        (gpointer                   user_data);
+static void     completed_cb           (HyScanAsync               *async,
+                                        gboolean                   result,
+                                        gpointer                   user_data);
+
+/* Каждый вызов сервера - один обмен с гидролокатором, который занимает время LINK_DELAY. */
+static gboolean
+server_call (void)
+{
+  g_atomic_int_inc (&round_trips);
+  g_usleep (LINK_DELAY);
+
+  return TRUE;
+}
+
+static gboolean
+generator_set_auto (VirtualSonar              *server,
+                    HyScanSourceType           source,
+                    HyScanGeneratorSignalType  signal)
+{
+  return server_call ();
+}
+
+static gboolean
+generator_set_enable (VirtualSonar     *server,
+                      HyScanSourceType  source,
+                      gboolean          enable)
+{
+  return server_call ();
+}
+
+static gboolean
+tvg_set_auto (VirtualSonar     *server,
+              HyScanSourceType  source,
+              gdouble           level,
+              gdouble           sensitivity)
+{
+  return server_call ();
+}
+
+static gboolean
+tvg_set_constant (VirtualSonar     *server,
+                  HyScanSourceType  source,
+                  gdouble           gain)
+{
+  return server_call ();
+}
+
+static gboolean
+tvg_set_enable (VirtualSonar     *server,
+                HyScanSourceType  source,
+                gboolean          enable)
+{
+  return server_call ();
+}
+
+static gboolean
+sonar_set_position (VirtualSonar          *server,
+                    HyScanSourceType       source,
+                    HyScanAntennaPosition *position)
+{
+  return server_call ();
+}
+
+static gboolean
+sonar_set_receive_time (VirtualSonar     *server,
+                        HyScanSourceType  source,
+                        gdouble           receive_time)
+{
+  return server_call ();
+}
+
+static gboolean
+sonar_set_sync_type (VirtualSonar        *server,
+                     HyScanSonarSyncType  sync_type)
+{
+  return server_call ();
+}
+
+/* Полная синхронизация параметров, как её выполняет HyScanSonarModel после изменения
+ * параметров: каждый параметр каждого источника передаётся один раз. Между раундами
+ * пользователь изменяет только усиление первого источника. */
+static void
+resync (void)
+{
+  HyScanAntennaPosition position;
+  guint i;
+
+  memset (&position, 0, sizeof (position));
+
+  hyscan_sonar_control_model_sonar_set_sync_type (model, HYSCAN_SONAR_SYNC_INTERNAL);
+
+  for (i = 0; i < VIRTUAL_SONAR_N_SOURCES; i++)
+    {
+      HyScanSourceType source = virtual_sonar_sources[i];
+      gdouble gain = (i == 0) ? VIRTUAL_SONAR_MIN_GAIN + round_id % N_ROUNDS : VIRTUAL_SONAR_MAX_GAIN / 2.0;
+
+      hyscan_sonar_control_model_sonar_set_position (model, source, &position);
+      hyscan_sonar_control_model_sonar_set_receive_time (model, source, VIRTUAL_SONAR_MAX_RECEIVE_TIME / 2.0);
+
+      hyscan_sonar_control_model_generator_set_auto (model, source, HYSCAN_GENERATOR_SIGNAL_AUTO);
+      hyscan_sonar_control_model_generator_set_enable (model, source, TRUE);
+
+      hyscan_sonar_control_model_tvg_set_constant (model, source, gain);
+      hyscan_sonar_control_model_tvg_set_enable (model, source, TRUE);
+    }
+}
+
+/* Выводит статистику выполнения команд модели. */
+static void
+print_command_stats (HyScanSonarControlModel *model)
+{
+  GArray *stats;
+  guint i;
+
+  stats = hyscan_sonar_control_model_get_command_stats (model);
+
+  for (i = 0; i < stats->len; i++)
+    {
+      HyScanSonarControlModelCommandStats *command;
+
+      command = &g_array_index (stats, HyScanSonarControlModelCommandStats, i);
+      if (command->n_calls == 0 && command->n_cached == 0)
+        continue;
+
+      g_message ("  %-28s calls %5u, failed %3u, cached %5u, mean %6.1f us, p99 %6u us",
+                 command->command, command->n_calls, command->n_failed, command->n_cached,
+                 hyscan_async_histogram_mean (&command->time),
+                 hyscan_async_histogram_percentile (&command->time, 99.0));
+    }
+
+  g_array_unref (stats);
+}
+
+/* Раунд: треть раундов без транзакции, треть - с транзакцией и треть - с транзакцией
+ * и кэшем применённых параметров. */
+static gboolean
+benchmark_round (gpointer user_data)
+{
+  phase = round_id / N_ROUNDS;
+  model = models[phase == 2];
+  round_trips = 0;
+
+  if (phase > 0)
+    hyscan_sonar_control_model_begin (model);
+
+  resync ();
+
+  if (phase > 0 && !hyscan_sonar_control_model_commit (model))
+    {
+      g_message ("Failed to commit transaction.");
+      benchmark_result = FALSE;
+      g_main_loop_quit (loop);
+      return G_SOURCE_REMOVE;
+    }
+
+  execute_start = g_get_monotonic_time ();
+  if (!hyscan_async_execute (HYSCAN_ASYNC (model)))
+    {
+      g_message ("Failed to execute queries.");
+      benchmark_result = FALSE;
+      g_main_loop_quit (loop);
+    }
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+completed_cb (HyScanAsync *async,
+              gboolean     result,
+              gpointer     user_data)
+{
+  gint64 time = g_get_monotonic_time () - execute_start;
+
+  if (!result)
+    {
+      g_message ("Round %d failed.", round_id);
+      benchmark_result = FALSE;
+      g_main_loop_quit (loop);
+      return;
+    }
+
+  time_sum[phase] += time;
+  round_trips_sum[phase] += round_trips;
+
+  if (++round_id < 3 * N_ROUNDS)
+    {
+      g_idle_add (benchmark_round, NULL);
+      return;
+    }
+
+  g_message ("Without transaction: %d round-trips, %" G_GINT64_FORMAT " us per resync.",
+             round_trips_sum[0] / N_ROUNDS, time_sum[0] / N_ROUNDS);
+  g_message ("With transaction:    %d round-trips, %" G_GINT64_FORMAT " us per resync.",
+             round_trips_sum[1] / N_ROUNDS, time_sum[1] / N_ROUNDS);
+  g_message ("With shadow cache:   %d round-trips, %" G_GINT64_FORMAT " us per resync.",
+             round_trips_sum[2] / N_ROUNDS, time_sum[2] / N_ROUNDS);
+
+  g_message ("Commands without shadow cache:");
+  print_command_stats (models[0]);
+  g_message ("Commands with shadow cache:");
+  print_command_stats (models[1]);
+
+  g_main_loop_quit (loop);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  HyScanSonarControl *sonar_control;
+
+  server = virtual_sonar_new (NULL);
+
+  g_signal_connect_swapped (server->generator, "generator-set-auto", G_CALLBACK (generator_set_auto), server);
+  g_signal_connect_swapped (server->generator, "generator-set-enable", G_CALLBACK (generator_set_enable), server);
+  g_signal_connect_swapped (server->tvg, "tvg-set-auto", G_CALLBACK (tvg_set_auto), server);
+  g_signal_connect_swapped (server->tvg, "tvg-set-constant", G_CALLBACK (tvg_set_constant), server);
+  g_signal_connect_swapped (server->tvg, "tvg-set-enable", G_CALLBACK (tvg_set_enable), server);
+  g_signal_connect_swapped (server->sonar, "sonar-set-position", G_CALLBACK (sonar_set_position), server);
+  g_signal_connect_swapped (server->sonar, "sonar-set-receive-time", G_CALLBACK (sonar_set_receive_time), server);
+  g_signal_connect_swapped (server->sonar, "sonar-set-sync-type", G_CALLBACK (sonar_set_sync_type), server);
+
+  /* Модели отличаются только кэшем применённых параметров. */
+  sonar_control = hyscan_sonar_control_new (HYSCAN_PARAM (server->sonar_box), 0, 0, NULL);
+  models[0] = g_object_new (HYSCAN_TYPE_SONAR_CONTROL_MODEL,
+                            "sonar-control", sonar_control,
+                            "shadow-cache", FALSE,
+                            NULL);
+  models[1] = g_object_new (HYSCAN_TYPE_SONAR_CONTROL_MODEL,
+                            "sonar-control", sonar_control,
+                            "shadow-cache", TRUE,
+                            NULL);
+
+  loop = g_main_loop_new (NULL, TRUE);
+  g_signal_connect (models[0], "completed", G_CALLBACK (completed_cb), NULL);
+  g_signal_connect (models[1], "completed", G_CALLBACK (completed_cb), NULL);
+
+  g_message ("Resyncing %d sources with %" G_GINT64_FORMAT " us link delay, %d rounds without "
+             "transaction, with transaction and with shadow cache.",
+             VIRTUAL_SONAR_N_SOURCES, (gint64) LINK_DELAY, N_ROUNDS);
+
+  benchmark_result = TRUE;
+  round_id = 0;
+  g_idle_add (benchmark_round, NULL);
+
+  g_main_loop_run (loop);
+
+  g_main_loop_unref (loop);
+  g_object_unref (models[0]);
+  g_object_unref (models[1]);
+  g_object_unref (sonar_control);
+  virtual_sonar_free (server);
+
+  return benchmark_result ? 0 : -1;
+}
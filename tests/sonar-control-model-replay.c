@@ -0,0 +1,302 @@
+#include "hyscan-sonar-control-model.h"
+#include "virtual-sonar.h"
+
+#include <string.h>
+
+/* Статистика повторного выполнения одной команды. */
+typedef struct
+{
+  const gchar *command;       /* Название команды. */
+  guint        n_commands;    /* Число выполнений. */
+  guint        n_mismatches;  /* Число несовпадений результата. */
+  gint64       duration;      /* Суммарное время выполнения по журналу, мкс. */
+  gint64       replay;        /* Суммарное время повторного выполнения, мкс. */
+  gint64       max_delta;     /* Максимальная разница времени выполнения, мкс. */
+} CommandStats;
+
+static GMainLoop               *loop;
+static gint                     command_delay;
+static gint                     n_rounds;
+
+static gboolean server_command     (VirtualSonar        *server);
+static gboolean record_round       (gpointer             user_data);
+static void     record_completed   (HyScanAsync         *async,
+                                    gboolean             result,
+                                    gpointer             user_data);
+static void     record_journal     (HyScanSonarControl  *sonar_control,
+                                    const gchar         *journal);
+static void     print_report       (GArray              *records,
+                                    gdouble              speed);
+
+/* Обработчик команд виртуального гидролокатора. Параметры команд не важны, время
+ * обмена с гидролокатором имитируется задержкой. */
+static gboolean
+server_command (VirtualSonar *server)
+{
+  if (command_delay > 0)
+    g_usleep (command_delay);
+
+  return TRUE;
+}
+
+/* Раунд записи журнала: синхронизация параметров и изменение усиления. */
+static gboolean
+record_round (gpointer user_data)
+{
+  HyScanSonarControlModel *model = user_data;
+  guint i;
+
+  hyscan_sonar_control_model_sonar_set_sync_type (model, HYSCAN_SONAR_SYNC_INTERNAL);
+
+  for (i = 0; i < VIRTUAL_SONAR_N_SOURCES; i++)
+    {
+      HyScanSourceType source = virtual_sonar_sources[i];
+      gdouble gain = g_random_double_range (VIRTUAL_SONAR_MIN_GAIN, VIRTUAL_SONAR_MAX_GAIN);
+
+      hyscan_sonar_control_model_sonar_set_receive_time (model, source, VIRTUAL_SONAR_MAX_RECEIVE_TIME / 2.0);
+      hyscan_sonar_control_model_generator_set_auto (model, source, HYSCAN_GENERATOR_SIGNAL_AUTO);
+      hyscan_sonar_control_model_generator_set_enable (model, source, TRUE);
+      hyscan_sonar_control_model_tvg_set_constant (model, source, gain);
+      hyscan_sonar_control_model_tvg_set_enable (model, source, TRUE);
+    }
+
+  if (!hyscan_async_execute (HYSCAN_ASYNC (model)))
+    {
+      g_message ("Failed to execute queries.");
+      g_main_loop_quit (loop);
+    }
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+record_completed (HyScanAsync *async,
+                  gboolean     result,
+                  gpointer     user_data)
+{
+  if (--n_rounds > 0)
+    g_timeout_add (10, record_round, async);
+  else
+    g_main_loop_quit (loop);
+}
+
+/* Записывает журнал команд виртуального гидролокатора со схемой по умолчанию. */
+static void
+record_journal (HyScanSonarControl *sonar_control,
+                const gchar        *journal)
+{
+  HyScanSonarControlModel *model;
+
+  model = g_object_new (HYSCAN_TYPE_SONAR_CONTROL_MODEL,
+                        "sonar-control", sonar_control,
+                        "journal", journal,
+                        NULL);
+
+  g_signal_connect (model, "completed", G_CALLBACK (record_completed), NULL);
+
+  loop = g_main_loop_new (NULL, TRUE);
+  g_idle_add (record_round, model);
+  g_main_loop_run (loop);
+  g_main_loop_unref (loop);
+
+  /* Журнал закрывается при удалении модели. */
+  g_object_unref (model);
+}
+
+/* Выводит разницу времени выполнения команд журнала и их повторного выполнения. */
+static void
+print_report (GArray  *records,
+              gdouble  speed)
+{
+  GHashTable *stats;
+  GHashTableIter iter;
+  CommandStats *cstats;
+  gint64 skew = 0;
+  gint64 max_skew = 0;
+  guint i;
+
+  stats = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+
+  for (i = 0; i < records->len; i++)
+    {
+      HyScanSonarControlModelReplayRecord *record;
+      gint64 delta;
+
+      record = &g_array_index (records, HyScanSonarControlModelReplayRecord, i);
+
+      if ((cstats = g_hash_table_lookup (stats, record->command)) == NULL)
+        {
+          cstats = g_new0 (CommandStats, 1);
+          cstats->command = record->command;
+          g_hash_table_insert (stats, (gpointer) record->command, cstats);
+        }
+
+      delta = record->replay_duration - record->duration;
+
+      cstats->n_commands++;
+      cstats->n_mismatches += (!record->result != !record->replay_result);
+      cstats->duration += record->duration;
+      cstats->replay += record->replay_duration;
+      if (ABS (delta) > ABS (cstats->max_delta))
+        cstats->max_delta = delta;
+
+      /* Отставание повторного выполнения от журнала. */
+      if (speed > 0.0)
+        {
+          gint64 lag = record->replay_time - (gint64) (record->time / speed);
+
+          skew += lag;
+          max_skew = MAX (max_skew, lag);
+        }
+    }
+
+  g_message ("%-30s %8s %12s %12s %12s %10s", "command", "count", "journal, us", "replay, us", "max diff, us", "mismatch");
+
+  g_hash_table_iter_init (&iter, stats);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &cstats))
+    {
+      g_message ("%-30s %8u %12" G_GINT64_FORMAT " %12" G_GINT64_FORMAT " %12" G_GINT64_FORMAT " %10u",
+                 cstats->command, cstats->n_commands,
+                 cstats->duration / cstats->n_commands, cstats->replay / cstats->n_commands,
+                 cstats->max_delta, cstats->n_mismatches);
+    }
+
+  if (speed > 0.0 && records->len > 0)
+    {
+      g_message ("Start lag: mean %" G_GINT64_FORMAT " us, max %" G_GINT64_FORMAT " us.",
+                 skew / (gint64) records->len, max_skew);
+    }
+
+  g_hash_table_unref (stats);
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+  HyScanSonarControl *sonar_control;
+  VirtualSonar *server;
+  GArray *records;
+  GError *error = NULL;
+  gchar *journal;
+  gchar *schema = NULL;
+  gchar *schema_data = NULL;
+  gdouble speed = 1.0;
+  gint status = 0;
+
+  {
+    gchar **args;
+    GOptionContext *context;
+    GOptionEntry entries[] =
+      {
+        { "speed", 's', 0, G_OPTION_ARG_DOUBLE, &speed, "Replay speed, 0 - no pauses", NULL },
+        { "delay", 'd', 0, G_OPTION_ARG_INT, &command_delay, "Virtual sonar command delay, us", NULL },
+        { "record", 'r', 0, G_OPTION_ARG_INT, &n_rounds, "Record a journal of N rounds before replay", NULL },
+        { "schema", 'c', 0, G_OPTION_ARG_STRING, &schema, "Virtual sonar schema file, default - three sources", NULL },
+        { NULL }
+      };
+
+#ifdef G_OS_WIN32
+    args = g_win32_get_command_line ();
+#else
+    args = g_strdupv (argv);
+#endif
+
+    context = g_option_context_new ("<journal>");
+    g_option_context_set_help_enabled (context, TRUE);
+    g_option_context_add_main_entries (context, entries, NULL);
+    g_option_context_set_ignore_unknown_options (context, FALSE);
+    if (!g_option_context_parse_strv (context, &args, &error))
+      {
+        g_print ("%s\n", error->message);
+        return -1;
+      }
+
+    if (g_strv_length (args) != 2)
+      {
+        g_print ("%s", g_option_context_get_help (context, FALSE, NULL));
+        return 0;
+      }
+
+    /* Журнал записывается командами источников схемы по умолчанию. */
+    if (schema != NULL && n_rounds > 0)
+      {
+        g_print ("--record can't be used with --schema\n");
+        return -1;
+      }
+
+    g_option_context_free (context);
+
+    journal = g_strdup (args[1]);
+    g_strfreev (args);
+  }
+
+  /* Виртуальный гидролокатор со схемой из файла, например схемой гидролокатора,
+   * на котором записан журнал, или со схемой по умолчанию. */
+  if (schema != NULL && !g_file_get_contents (schema, &schema_data, NULL, &error))
+    {
+      g_print ("%s\n", error->message);
+      return -1;
+    }
+
+  server = virtual_sonar_new (schema_data);
+  if (server == NULL)
+    {
+      g_print ("%s: invalid sonar schema\n", schema);
+      return -1;
+    }
+
+  g_signal_connect_swapped (server->generator, "generator-set-preset", G_CALLBACK (server_command), server);
+  g_signal_connect_swapped (server->generator, "generator-set-auto", G_CALLBACK (server_command), server);
+  g_signal_connect_swapped (server->generator, "generator-set-simple", G_CALLBACK (server_command), server);
+  g_signal_connect_swapped (server->generator, "generator-set-extended", G_CALLBACK (server_command), server);
+  g_signal_connect_swapped (server->generator, "generator-set-enable", G_CALLBACK (server_command), server);
+  g_signal_connect_swapped (server->tvg, "tvg-set-auto", G_CALLBACK (server_command), server);
+  g_signal_connect_swapped (server->tvg, "tvg-set-constant", G_CALLBACK (server_command), server);
+  g_signal_connect_swapped (server->tvg, "tvg-set-linear-db", G_CALLBACK (server_command), server);
+  g_signal_connect_swapped (server->tvg, "tvg-set-logarithmic", G_CALLBACK (server_command), server);
+  g_signal_connect_swapped (server->tvg, "tvg-set-enable", G_CALLBACK (server_command), server);
+  g_signal_connect_swapped (server->sonar, "sonar-set-sync-type", G_CALLBACK (server_command), server);
+  g_signal_connect_swapped (server->sonar, "sonar-set-position", G_CALLBACK (server_command), server);
+  g_signal_connect_swapped (server->sonar, "sonar-set-receive-time", G_CALLBACK (server_command), server);
+  g_signal_connect_swapped (server->sonar, "sonar-start", G_CALLBACK (server_command), server);
+  g_signal_connect_swapped (server->sonar, "sonar-stop", G_CALLBACK (server_command), server);
+  g_signal_connect_swapped (server->sonar, "sonar-ping", G_CALLBACK (server_command), server);
+  g_signal_connect_swapped (server->sensor, "sensor-virtual-port-param", G_CALLBACK (server_command), server);
+  g_signal_connect_swapped (server->sensor, "sensor-uart-port-param", G_CALLBACK (server_command), server);
+  g_signal_connect_swapped (server->sensor, "sensor-udp-ip-port-param", G_CALLBACK (server_command), server);
+  g_signal_connect_swapped (server->sensor, "sensor-set-position", G_CALLBACK (server_command), server);
+  g_signal_connect_swapped (server->sensor, "sensor-set-enable", G_CALLBACK (server_command), server);
+
+  sonar_control = hyscan_sonar_control_new (HYSCAN_PARAM (server->sonar_box), 0, 0, NULL);
+
+  if (n_rounds > 0)
+    {
+      g_message ("Recording %d rounds to %s.", n_rounds, journal);
+      record_journal (sonar_control, journal);
+    }
+
+  g_message ("Replaying %s at speed %.2f.", journal, speed);
+
+  records = hyscan_sonar_control_model_replay (sonar_control, journal, speed, &error);
+  if (records == NULL)
+    {
+      g_message ("Replay failed: %s", error->message);
+      g_error_free (error);
+      status = -1;
+    }
+  else
+    {
+      g_message ("Replayed %u commands.", records->len);
+      print_report (records, speed);
+      g_array_unref (records);
+    }
+
+  g_object_unref (sonar_control);
+  virtual_sonar_free (server);
+  g_free (schema_data);
+  g_free (schema);
+  g_free (journal);
+
+  return status;
+}
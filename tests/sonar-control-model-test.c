@@ -5,6 +5,7 @@
 #include "hyscan-sonar-control-server.h"
 #include "hyscan-control-common.h"
 
+#include <glib/gstdio.h>
 #include <libxml/parser.h>
 #include <string.h>
 #include <math.h>
@@ -129,6 +130,7 @@ typedef struct
 static GMainLoop                *main_loop    = NULL;
 
 static int                       n_test_repeats;
+static gboolean                  test_result;
 
 static GHashTable               *ports;
 static SourceInfo                starboard;
@@ -1111,6 +1113,7 @@ on_sonar_control_model_completed (HyScanSonarControlModel *model,
       g_message ("Test failed (%s)", identifier);
     }
 
+  test_result = result;
   g_main_loop_quit (main_loop);
 }
 
@@ -1620,10 +1623,11 @@ test_entry (gpointer udata)
   return G_SOURCE_REMOVE;
 }
 
-int main (int argc, char **argv)
-{
-  g_random_set_seed ((guint32) (g_get_monotonic_time () % G_MAXUINT32));
 
+/* Случайные значения параметров всех команд, повторяется TEST_N_REPEATS раз. */
+static void
+test_random (void)
+{
   /* Инициализация виртуального гидролокатора. */
   sonar_box = create_sonar ();
   init_servers (sonar_box);
@@ -1695,6 +1699,734 @@ int main (int argc, char **argv)
       }
   }
 
+  g_assert_true (test_result);
+}
+
+/*
+ * Проверки отдельных свойств модели. Каждая проверка использует свой небольшой
+ * виртуальный гидролокатор, серверы которого записывают вызовы в журнал.
+ */
+
+#define FIXTURE_N_SOURCES              3
+#define FIXTURE_MAX_RECEIVE_TIME       1.0
+#define FIXTURE_MAX_GAIN               100.0
+
+typedef struct
+{
+  HyScanSonarBox                      *sonar_box;
+  HyScanGeneratorControlServer        *generator;
+  HyScanTVGControlServer              *tvg;
+  HyScanSonarControlServer            *sonar;
+  HyScanSonarControl                  *sonar_control;
+  HyScanSonarControlModel             *model;
+
+  GString                             *calls;          /* Журнал вызовов серверов. */
+  gint                                 n_fail;         /* Число вызовов, завершаемых ошибкой. */
+  gboolean                             completed;      /* Признак завершения выполнения пакета. */
+  gboolean                             result;         /* Результат выполнения пакета. */
+} Fixture;
+
+static const HyScanSourceType fixture_sources[FIXTURE_N_SOURCES] = { HYSCAN_SOURCE_SIDE_SCAN_STARBOARD,
+                                                                     HYSCAN_SOURCE_SIDE_SCAN_PORT,
+                                                                     HYSCAN_SOURCE_ECHOSOUNDER };
+
+/* Записывает вызов сервера в журнал. Пока счётчик ошибок не исчерпан, вызов завершается ошибкой. */
+static gboolean
+fixture_call (Fixture     *fixture,
+              const gchar *format,
+              ...)
+{
+  va_list args;
+
+  va_start (args, format);
+  g_string_append_vprintf (fixture->calls, format, args);
+  va_end (args);
+
+  if (fixture->n_fail > 0)
+    {
+      fixture->n_fail--;
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+fixture_generator_set_auto (Fixture                   *fixture,
+                            HyScanSourceType           source,
+                            HyScanGeneratorSignalType  signal)
+{
+  return fixture_call (fixture, "generator-auto:%d:%d;", source, signal);
+}
+
+static gboolean
+fixture_tvg_set_auto (Fixture          *fixture,
+                      HyScanSourceType  source,
+                      gdouble           level,
+                      gdouble           sensitivity)
+{
+  return fixture_call (fixture, "tvg-auto:%d;", source);
+}
+
+static gboolean
+fixture_tvg_set_constant (Fixture          *fixture,
+                          HyScanSourceType  source,
+                          gdouble           gain)
+{
+  return fixture_call (fixture, "tvg-constant:%d:%.1f;", source, gain);
+}
+
+static gboolean
+fixture_tvg_set_enable (Fixture          *fixture,
+                        HyScanSourceType  source,
+                        gboolean          enable)
+{
+  return fixture_call (fixture, "tvg-enable:%d:%d;", source, enable);
+}
+
+static gboolean
+fixture_sonar_set_receive_time (Fixture          *fixture,
+                                HyScanSourceType  source,
+                                gdouble           receive_time)
+{
+  return fixture_call (fixture, "receive-time:%d:%.1f;", source, receive_time);
+}
+
+static gboolean
+fixture_sonar_set_sync_type (Fixture             *fixture,
+                             HyScanSonarSyncType  sync_type)
+{
+  return fixture_call (fixture, "sync:%d;", sync_type);
+}
+
+static gboolean
+fixture_sonar_start (Fixture         *fixture,
+                     const gchar     *track_name,
+                     HyScanTrackType  track_type)
+{
+  return fixture_call (fixture, "start:%s;", (track_name != NULL) ? track_name : "<null>");
+}
+
+static gboolean
+fixture_sonar_stop (Fixture *fixture)
+{
+  return fixture_call (fixture, "stop;");
+}
+
+static gboolean
+fixture_sonar_ping (Fixture *fixture)
+{
+  return fixture_call (fixture, "ping;");
+}
+
+static void
+fixture_completed (HyScanSonarControlModel *model,
+                   gboolean                 result,
+                   Fixture                 *fixture)
+{
+  fixture->result = result;
+  fixture->completed = TRUE;
+}
+
+/* Создаёт виртуальный гидролокатор с тремя источниками. */
+static HyScanSonarBox *
+fixture_create_sonar (void)
+{
+  HyScanSonarBox *sonar_box;
+  HyScanSonarSchema *schema;
+  gchar *schema_data;
+  guint i;
+
+  schema = hyscan_sonar_schema_new (HYSCAN_SONAR_SCHEMA_DEFAULT_TIMEOUT);
+
+  hyscan_sonar_schema_sync_add (schema, HYSCAN_SONAR_SYNC_INTERNAL | HYSCAN_SONAR_SYNC_SOFTWARE);
+
+  for (i = 0; i < FIXTURE_N_SOURCES; i++)
+    {
+      hyscan_sonar_schema_source_add (schema, fixture_sources[i], 1.0, 1.0, 100000.0, 10000.0,
+                                      FIXTURE_MAX_RECEIVE_TIME, FALSE);
+      hyscan_sonar_schema_generator_add (schema, fixture_sources[i],
+                                         HYSCAN_GENERATOR_MODE_AUTO,
+                                         HYSCAN_GENERATOR_SIGNAL_AUTO,
+                                         0.0, 0.0, 0.0, 0.0);
+      hyscan_sonar_schema_tvg_add (schema, fixture_sources[i],
+                                   HYSCAN_TVG_MODE_AUTO | HYSCAN_TVG_MODE_CONSTANT,
+                                   0.0, FIXTURE_MAX_GAIN);
+      hyscan_sonar_schema_channel_add (schema, fixture_sources[i], 1, 0.0, 0.0, 0, 1.0);
+      hyscan_sonar_schema_source_add_acoustic (schema, fixture_sources[i]);
+    }
+
+  schema_data = hyscan_data_schema_builder_get_data (HYSCAN_DATA_SCHEMA_BUILDER (schema));
+  g_object_unref (schema);
+
+  sonar_box = hyscan_sonar_box_new ();
+  hyscan_sonar_box_set_schema (sonar_box, schema_data, "sonar");
+  g_free (schema_data);
+
+  return sonar_box;
+}
+
+static void
+fixture_setup (Fixture       *fixture,
+               gconstpointer  user_data)
+{
+  fixture->sonar_box = fixture_create_sonar ();
+
+  fixture->generator = hyscan_generator_control_server_new (fixture->sonar_box);
+  fixture->tvg = hyscan_tvg_control_server_new (fixture->sonar_box);
+  fixture->sonar = hyscan_sonar_control_server_new (fixture->sonar_box);
+
+  g_signal_connect_swapped (fixture->generator, "generator-set-auto",
+                            G_CALLBACK (fixture_generator_set_auto), fixture);
+  g_signal_connect_swapped (fixture->tvg, "tvg-set-auto",
+                            G_CALLBACK (fixture_tvg_set_auto), fixture);
+  g_signal_connect_swapped (fixture->tvg, "tvg-set-constant",
+                            G_CALLBACK (fixture_tvg_set_constant), fixture);
+  g_signal_connect_swapped (fixture->tvg, "tvg-set-enable",
+                            G_CALLBACK (fixture_tvg_set_enable), fixture);
+  g_signal_connect_swapped (fixture->sonar, "sonar-set-receive-time",
+                            G_CALLBACK (fixture_sonar_set_receive_time), fixture);
+  g_signal_connect_swapped (fixture->sonar, "sonar-set-sync-type",
+                            G_CALLBACK (fixture_sonar_set_sync_type), fixture);
+  g_signal_connect_swapped (fixture->sonar, "sonar-start",
+                            G_CALLBACK (fixture_sonar_start), fixture);
+  g_signal_connect_swapped (fixture->sonar, "sonar-stop",
+                            G_CALLBACK (fixture_sonar_stop), fixture);
+  g_signal_connect_swapped (fixture->sonar, "sonar-ping",
+                            G_CALLBACK (fixture_sonar_ping), fixture);
+
+  fixture->sonar_control = hyscan_sonar_control_new (HYSCAN_PARAM (fixture->sonar_box), 0, 0, NULL);
+
+  /* Данные проверки - название логического свойства модели, которое нужно включить. */
+  if (user_data != NULL)
+    {
+      fixture->model = g_object_new (HYSCAN_TYPE_SONAR_CONTROL_MODEL,
+                                     "sonar-control", fixture->sonar_control,
+                                     user_data, TRUE,
+                                     NULL);
+    }
+  else
+    {
+      fixture->model = hyscan_sonar_control_model_new (fixture->sonar_control);
+    }
+  g_signal_connect (fixture->model, "completed", G_CALLBACK (fixture_completed), fixture);
+
+  fixture->calls = g_string_new (NULL);
+  fixture->n_fail = 0;
+}
+
+/* Заменяет модель проверки моделью, повторяющей команды, завершившиеся ошибкой. */
+static void
+fixture_setup_retry (Fixture       *fixture,
+                     gconstpointer  user_data)
+{
+  fixture_setup (fixture, NULL);
+
+  g_object_unref (fixture->model);
+  fixture->model = g_object_new (HYSCAN_TYPE_SONAR_CONTROL_MODEL,
+                                 "sonar-control", fixture->sonar_control,
+                                 "max-attempts", HYSCAN_SONAR_CONTROL_MODEL_MAX_ATTEMPTS,
+                                 "retry-backoff", (gint64) HYSCAN_SONAR_CONTROL_MODEL_RETRY_BACKOFF,
+                                 "retry-budget", (gint64) HYSCAN_SONAR_CONTROL_MODEL_RETRY_BUDGET,
+                                 NULL);
+  g_signal_connect (fixture->model, "completed", G_CALLBACK (fixture_completed), fixture);
+}
+
+static void
+fixture_teardown (Fixture       *fixture,
+                  gconstpointer  user_data)
+{
+  g_object_unref (fixture->model);
+  g_object_unref (fixture->sonar_control);
+  g_object_unref (fixture->generator);
+  g_object_unref (fixture->tvg);
+  g_object_unref (fixture->sonar);
+  g_object_unref (fixture->sonar_box);
+  g_string_free (fixture->calls, TRUE);
+}
+
+/* Выполняет накопленные запросы и ожидает сигнала "completed". Журнал вызовов
+ * перед выполнением очищается. */
+static gboolean
+fixture_execute (Fixture *fixture)
+{
+  g_string_truncate (fixture->calls, 0);
+  fixture->completed = FALSE;
+
+  if (!hyscan_async_execute (HYSCAN_ASYNC (fixture->model)))
+    return FALSE;
+
+  while (!fixture->completed)
+    g_main_context_iteration (NULL, TRUE);
+
+  return fixture->result;
+}
+
+/* Сравнивает журнал вызовов серверов с ожидаемым. */
+static void
+fixture_assert_calls (Fixture     *fixture,
+                      const gchar *format,
+                      ...)
+{
+  gchar *expected;
+  va_list args;
+
+  va_start (args, format);
+  expected = g_strdup_vprintf (format, args);
+  va_end (args);
+
+  g_assert_cmpstr (fixture->calls->str, ==, expected);
+  g_free (expected);
+}
+
+/* Пуск, останов и зондирование выполняются в порядке вызова, хотя останов
+ * имеет высокий приоритет. */
+static void
+test_run_order (Fixture       *fixture,
+                gconstpointer  user_data)
+{
+  HyScanSonarControlModel *model = fixture->model;
+
+  hyscan_sonar_control_model_sonar_start (model, "Track", HYSCAN_TRACK_SURVEY);
+  hyscan_sonar_control_model_sonar_stop (model);
+  g_assert_true (fixture_execute (fixture));
+  g_assert_cmpstr (fixture->calls->str, ==, "start:Track;stop;");
+
+  hyscan_sonar_control_model_sonar_start (model, "Track", HYSCAN_TRACK_SURVEY);
+  hyscan_sonar_control_model_sonar_ping (model);
+  hyscan_sonar_control_model_sonar_stop (model);
+  g_assert_true (fixture_execute (fixture));
+  g_assert_cmpstr (fixture->calls->str, ==, "start:Track;ping;stop;");
+
+  /* Останов обгоняет изменение параметров, добавленное до него. */
+  hyscan_sonar_control_model_sonar_set_receive_time (model, fixture_sources[0], 0.5);
+  hyscan_sonar_control_model_sonar_stop (model);
+  g_assert_true (fixture_execute (fixture));
+  fixture_assert_calls (fixture, "stop;receive-time:%d:0.5;", fixture_sources[0]);
+}
+
+/* Модель, созданная функцией hyscan_sonar_control_model_new, не повторяет команды. */
+static void
+test_single_attempt (Fixture       *fixture,
+                     gconstpointer  user_data)
+{
+  HyScanSonarControlModel *model = fixture->model;
+  HyScanSourceType source = fixture_sources[0];
+
+  hyscan_sonar_control_model_tvg_set_constant (model, source, 10.0);
+  fixture->n_fail = 1;
+  g_assert_false (fixture_execute (fixture));
+  fixture_assert_calls (fixture, "tvg-constant:%d:10.0;", source);
+}
+
+/* Изменения одной группы параметров в транзакции объединяются, остальные
+ * применяются в порядке вызова. */
+static void
+test_transaction_merge (Fixture       *fixture,
+                        gconstpointer  user_data)
+{
+  HyScanSonarControlModel *model = fixture->model;
+  HyScanSourceType source = fixture_sources[0];
+
+  hyscan_sonar_control_model_begin (model);
+  hyscan_sonar_control_model_tvg_set_constant (model, source, 10.0);
+  hyscan_sonar_control_model_sonar_set_receive_time (model, source, 0.5);
+  hyscan_sonar_control_model_tvg_set_constant (model, source, 20.0);
+  hyscan_sonar_control_model_tvg_set_enable (model, source, TRUE);
+
+  /* Вложенная транзакция применяется вместе с внешней. */
+  hyscan_sonar_control_model_begin (model);
+  hyscan_sonar_control_model_sonar_set_receive_time (model, source, 0.8);
+  hyscan_sonar_control_model_commit (model);
+
+  /* До завершения транзакции изменения не добавляются в список запросов. */
+  g_assert_false (hyscan_async_execute (HYSCAN_ASYNC (model)));
+
+  g_assert_true (hyscan_sonar_control_model_commit (model));
+  g_assert_true (fixture_execute (fixture));
+  fixture_assert_calls (fixture, "tvg-constant:%d:20.0;tvg-enable:%d:1;receive-time:%d:0.8;",
+                        source, source, source);
+
+  /* Отменённая транзакция ничего не передаёт гидролокатору. */
+  hyscan_sonar_control_model_begin (model);
+  hyscan_sonar_control_model_tvg_set_constant (model, source, 30.0);
+  hyscan_sonar_control_model_rollback (model);
+  g_assert_false (hyscan_async_execute (HYSCAN_ASYNC (model)));
+}
+
+/* Пуск, останов и зондирование в транзакции выполняются в порядке вызова,
+ * в том числе относительно таких же команд вне транзакции. */
+static void
+test_transaction_order (Fixture       *fixture,
+                        gconstpointer  user_data)
+{
+  HyScanSonarControlModel *model = fixture->model;
+  HyScanSourceType source = fixture_sources[0];
+
+  hyscan_sonar_control_model_begin (model);
+  hyscan_sonar_control_model_sonar_start (model, "Track", HYSCAN_TRACK_SURVEY);
+  hyscan_sonar_control_model_sonar_set_receive_time (model, source, 0.5);
+  hyscan_sonar_control_model_sonar_ping (model);
+  hyscan_sonar_control_model_sonar_stop (model);
+  hyscan_sonar_control_model_commit (model);
+  g_assert_true (fixture_execute (fixture));
+  fixture_assert_calls (fixture, "start:Track;ping;stop;receive-time:%d:0.5;", source);
+
+  /* Останов после транзакции с пуском не обгоняет её. */
+  hyscan_sonar_control_model_begin (model);
+  hyscan_sonar_control_model_sonar_start (model, "Track", HYSCAN_TRACK_SURVEY);
+  hyscan_sonar_control_model_commit (model);
+  hyscan_sonar_control_model_sonar_stop (model);
+  g_assert_true (fixture_execute (fixture));
+  fixture_assert_calls (fixture, "start:Track;stop;");
+}
+
+/* Изменение транзакции, завершившееся ошибкой, повторяется отдельно от остальных.
+ * Зондирование в транзакции не повторяется. */
+static void
+test_transaction_retry (Fixture       *fixture,
+                        gconstpointer  user_data)
+{
+  HyScanSonarControlModel *model = fixture->model;
+  HyScanSourceType source = fixture_sources[0];
+
+  hyscan_sonar_control_model_begin (model);
+  hyscan_sonar_control_model_tvg_set_constant (model, source, 10.0);
+  hyscan_sonar_control_model_sonar_set_receive_time (model, source, 0.5);
+  hyscan_sonar_control_model_commit (model);
+  fixture->n_fail = 1;
+  g_assert_true (fixture_execute (fixture));
+  fixture_assert_calls (fixture, "tvg-constant:%d:10.0;tvg-constant:%d:10.0;receive-time:%d:0.5;",
+                        source, source, source);
+
+  hyscan_sonar_control_model_begin (model);
+  hyscan_sonar_control_model_sonar_ping (model);
+  hyscan_sonar_control_model_commit (model);
+  fixture->n_fail = 1;
+  g_assert_false (fixture_execute (fixture));
+  fixture_assert_calls (fixture, "ping;");
+}
+
+/* Изменение параметра замещает ожидающее изменение той же группы для того же
+ * источника, даже если оно сделано другой функцией. */
+static void
+test_coalesce (Fixture       *fixture,
+               gconstpointer  user_data)
+{
+  HyScanSonarControlModel *model = fixture->model;
+  HyScanSourceType source = fixture_sources[0];
+
+  hyscan_sonar_control_model_tvg_set_constant (model, source, 10.0);
+  hyscan_sonar_control_model_tvg_set_enable (model, source, TRUE);
+  hyscan_sonar_control_model_tvg_set_auto (model, source, 0.5, 0.5);
+  hyscan_sonar_control_model_tvg_set_constant (model, source, 20.0);
+  g_assert_true (fixture_execute (fixture));
+  fixture_assert_calls (fixture, "tvg-constant:%d:20.0;tvg-enable:%d:1;", source, source);
+
+  hyscan_sonar_control_model_tvg_set_constant (model, source, 30.0);
+  hyscan_sonar_control_model_tvg_set_auto (model, source, 0.5, 0.5);
+  g_assert_true (fixture_execute (fixture));
+  fixture_assert_calls (fixture, "tvg-auto:%d;", source);
+}
+
+/* В режиме "continue-on-error" ошибка одного изменения транзакции не мешает
+ * применению остальных. */
+static void
+test_transaction_errors (Fixture       *fixture,
+                         gconstpointer  user_data)
+{
+  HyScanSonarControlModel *model = fixture->model;
+
+  hyscan_sonar_control_model_begin (model);
+  hyscan_sonar_control_model_tvg_set_constant (model, fixture_sources[0], 10.0);
+  hyscan_sonar_control_model_tvg_set_constant (model, fixture_sources[1], 20.0);
+  hyscan_sonar_control_model_sonar_set_receive_time (model, fixture_sources[1], 0.5);
+  hyscan_sonar_control_model_commit (model);
+  fixture->n_fail = 1;
+  g_assert_false (fixture_execute (fixture));
+  fixture_assert_calls (fixture, "tvg-constant:%d:10.0;tvg-constant:%d:20.0;receive-time:%d:0.5;",
+                        fixture_sources[0], fixture_sources[1], fixture_sources[1]);
+}
+
+/* Возвращает статистику команды с указанным названием. */
+static HyScanSonarControlModelCommandStats
+fixture_command_stats (Fixture     *fixture,
+                       const gchar *command)
+{
+  HyScanSonarControlModelCommandStats command_stats = { 0 };
+  GArray *stats;
+  guint i;
+
+  stats = hyscan_sonar_control_model_get_command_stats (fixture->model);
+  for (i = 0; i < stats->len; i++)
+    {
+      if (g_strcmp0 (g_array_index (stats, HyScanSonarControlModelCommandStats, i).command, command) == 0)
+        command_stats = g_array_index (stats, HyScanSonarControlModelCommandStats, i);
+    }
+  g_array_unref (stats);
+
+  g_assert_cmpstr (command_stats.command, ==, command);
+
+  return command_stats;
+}
+
+/* Команда, совпадающая с последним применённым значением своей группы, не передаётся
+ * гидролокатору до вызова hyscan_sonar_control_model_invalidate. */
+static void
+test_shadow_cache (Fixture       *fixture,
+                   gconstpointer  user_data)
+{
+  HyScanSonarControlModel *model = fixture->model;
+  HyScanSourceType source = fixture_sources[0];
+
+  hyscan_sonar_control_model_tvg_set_constant (model, source, 10.0);
+  g_assert_true (fixture_execute (fixture));
+  fixture_assert_calls (fixture, "tvg-constant:%d:10.0;", source);
+
+  /* Совпадающее значение пропускается. */
+  hyscan_sonar_control_model_tvg_set_constant (model, source, 10.0);
+  g_assert_true (fixture_execute (fixture));
+  g_assert_cmpstr (fixture->calls->str, ==, "");
+  g_assert_cmpuint (fixture_command_stats (fixture, "tvg-set-constant").n_cached, ==, 1);
+
+  /* Изменённое значение и значение другого источника передаются. */
+  hyscan_sonar_control_model_tvg_set_constant (model, source, 20.0);
+  hyscan_sonar_control_model_tvg_set_constant (model, fixture_sources[1], 10.0);
+  g_assert_true (fixture_execute (fixture));
+  fixture_assert_calls (fixture, "tvg-constant:%d:20.0;tvg-constant:%d:10.0;", source, fixture_sources[1]);
+
+  /* Команды без группы не кэшируются. */
+  hyscan_sonar_control_model_sonar_ping (model);
+  hyscan_sonar_control_model_sonar_ping (model);
+  g_assert_true (fixture_execute (fixture));
+  g_assert_cmpstr (fixture->calls->str, ==, "ping;ping;");
+
+  /* Ошибка удаляет применённое значение группы. */
+  hyscan_sonar_control_model_tvg_set_enable (model, source, TRUE);
+  fixture->n_fail = 1;
+  g_assert_false (fixture_execute (fixture));
+  hyscan_sonar_control_model_tvg_set_enable (model, source, TRUE);
+  g_assert_true (fixture_execute (fixture));
+  fixture_assert_calls (fixture, "tvg-enable:%d:1;", source);
+
+  /* После сброса кэша совпадающее значение передаётся. */
+  hyscan_sonar_control_model_invalidate (model);
+  hyscan_sonar_control_model_tvg_set_constant (model, source, 20.0);
+  g_assert_true (fixture_execute (fixture));
+  fixture_assert_calls (fixture, "tvg-constant:%d:20.0;", source);
+  g_assert_cmpuint (fixture_command_stats (fixture, "tvg-set-constant").n_cached, ==, 1);
+}
+
+/* Возвращает размер файла или 0, если файл не удалось прочитать. */
+static gsize
+fixture_file_size (const gchar *path)
+{
+  gchar *data;
+  gsize size;
+
+  if (!g_file_get_contents (path, &data, &size, NULL))
+    return 0;
+
+  g_free (data);
+
+  return size;
+}
+
+/* Проверяет, что повреждённый журнал отвергается. В копии журнала изменяется
+ * байт со смещением offset либо, при отрицательном offset, отбрасывается
+ * последний байт. */
+static void
+fixture_assert_journal_rejected (Fixture     *fixture,
+                                 const gchar *path,
+                                 const gchar *data,
+                                 gsize        size,
+                                 gssize       offset)
+{
+  GError *error = NULL;
+  GArray *records;
+  gchar *corrupted;
+
+  corrupted = g_memdup (data, size);
+  if (offset >= 0)
+    corrupted[offset] ^= 0x5a;
+  else
+    size -= 1;
+
+  g_assert_true (g_file_set_contents (path, corrupted, size, NULL));
+  records = hyscan_sonar_control_model_replay (fixture->sonar_control, path, 0.0, &error);
+  g_assert_null (records);
+  g_assert_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL);
+
+  g_clear_error (&error);
+  g_free (corrupted);
+}
+
+/* Статистика учитывает каждое обращение к гидролокатору, в том числе повторные
+ * попытки и отдельные изменения транзакции, и обнуляется при сбросе. */
+static void
+test_command_stats (Fixture       *fixture,
+                    gconstpointer  user_data)
+{
+  HyScanSonarControlModel *model = fixture->model;
+  HyScanSonarControlModelCommandStats stats;
+  HyScanSourceType source = fixture_sources[0];
+
+  hyscan_sonar_control_model_tvg_set_constant (model, source, 10.0);
+  fixture->n_fail = 1;
+  g_assert_true (fixture_execute (fixture));
+
+  stats = fixture_command_stats (fixture, "tvg-set-constant");
+  g_assert_cmpuint (stats.n_calls, ==, 2);
+  g_assert_cmpuint (stats.n_failed, ==, 1);
+  g_assert_cmpuint (stats.n_cached, ==, 0);
+  g_assert_cmpuint (stats.time.count, ==, 2);
+  g_assert_cmpuint (fixture_command_stats (fixture, "sonar-ping").n_calls, ==, 0);
+
+  hyscan_sonar_control_model_begin (model);
+  hyscan_sonar_control_model_tvg_set_enable (model, source, TRUE);
+  hyscan_sonar_control_model_sonar_set_receive_time (model, source, 0.5);
+  hyscan_sonar_control_model_commit (model);
+  g_assert_true (fixture_execute (fixture));
+
+  g_assert_cmpuint (fixture_command_stats (fixture, "tvg-set-enable").n_calls, ==, 1);
+  g_assert_cmpuint (fixture_command_stats (fixture, "sonar-set-receive-time").n_calls, ==, 1);
+
+  hyscan_sonar_control_model_reset_command_stats (model);
+
+  stats = fixture_command_stats (fixture, "tvg-set-constant");
+  g_assert_cmpuint (stats.n_calls, ==, 0);
+  g_assert_cmpuint (stats.n_failed, ==, 0);
+  g_assert_cmpuint (stats.time.count, ==, 0);
+  g_assert_cmpuint (fixture_command_stats (fixture, "tvg-set-enable").n_calls, ==, 0);
+
+  /* После сброса статистика накапливается заново. */
+  hyscan_sonar_control_model_sonar_ping (model);
+  g_assert_true (fixture_execute (fixture));
+  g_assert_cmpuint (fixture_command_stats (fixture, "sonar-ping").n_calls, ==, 1);
+}
+
+/* Журнал команд сбрасывается в файл после пакета и при зондировании по расписанию,
+ * повторно выполняется функцией hyscan_sonar_control_model_replay с теми же параметрами,
+ * в том числе строкой NULL, а повреждённый журнал или журнал другой архитектуры
+ * отвергается. */
+static void
+test_journal (Fixture       *fixture,
+              gconstpointer  user_data)
+{
+  HyScanSonarControlModel *model;
+  HyScanSonarControlModelReplayRecord *record;
+  HyScanSourceType source = fixture_sources[0];
+  GError *error = NULL;
+  GArray *records;
+  gchar *dir, *path, *data, *recorded;
+  gsize size, batch_size;
+  gint64 timeout;
+  guint id;
+
+  dir = g_dir_make_tmp ("sonar-control-model-XXXXXX", NULL);
+  g_assert_nonnull (dir);
+  path = g_build_filename (dir, "journal", NULL);
+
+  g_object_unref (fixture->model);
+  fixture->model = model = g_object_new (HYSCAN_TYPE_SONAR_CONTROL_MODEL,
+                                         "sonar-control", fixture->sonar_control,
+                                         "journal", path,
+                                         NULL);
+  g_signal_connect (model, "completed", G_CALLBACK (fixture_completed), fixture);
+
+  g_string_truncate (fixture->calls, 0);
+  hyscan_sonar_control_model_tvg_set_constant (model, source, 10.0);
+  hyscan_sonar_control_model_sonar_start (model, "Track", HYSCAN_TRACK_SURVEY);
+  hyscan_sonar_control_model_sonar_start (model, NULL, HYSCAN_TRACK_SURVEY);
+  g_assert_true (fixture_execute (fixture));
+  recorded = g_strdup (fixture->calls->str);
+
+  batch_size = fixture_file_size (path);
+  g_assert_cmpuint (batch_size, >, 0);
+
+  /* Зондирования по расписанию не завершают пакет, но их записи тоже попадают в файл. */
+  id = hyscan_sonar_control_model_schedule_ping (model, g_get_monotonic_time (), 20 * G_TIME_SPAN_MILLISECOND);
+  timeout = g_get_monotonic_time () + 2 * G_TIME_SPAN_SECOND;
+  while (fixture_file_size (path) == batch_size && g_get_monotonic_time () < timeout)
+    g_usleep (10 * G_TIME_SPAN_MILLISECOND);
+  g_assert_cmpuint (fixture_file_size (path), >, batch_size);
+  hyscan_async_unschedule_query (HYSCAN_ASYNC (model), id);
+
+  /* При удалении модели журнал закрывается. */
+  g_clear_object (&fixture->model);
+  fixture->model = hyscan_sonar_control_model_new (fixture->sonar_control);
+
+  g_string_truncate (fixture->calls, 0);
+  records = hyscan_sonar_control_model_replay (fixture->sonar_control, path, 0.0, &error);
+  g_assert_no_error (error);
+  g_assert_nonnull (records);
+  g_assert_cmpuint (records->len, >=, 4);
+
+  record = &g_array_index (records, HyScanSonarControlModelReplayRecord, 0);
+  g_assert_cmpstr (record->command, ==, "tvg-set-constant");
+  g_assert_true (record->result && record->replay_result);
+  record = &g_array_index (records, HyScanSonarControlModelReplayRecord, 1);
+  g_assert_cmpstr (record->command, ==, "sonar-start");
+  g_assert_true (record->result && record->replay_result);
+  record = &g_array_index (records, HyScanSonarControlModelReplayRecord, 2);
+  g_assert_cmpstr (record->command, ==, "sonar-start");
+  g_assert_true (!record->result == !record->replay_result);
+  record = &g_array_index (records, HyScanSonarControlModelReplayRecord, 3);
+  g_assert_cmpstr (record->command, ==, "sonar-ping");
+  g_assert_true (record->result && record->replay_result);
+  g_array_unref (records);
+
+  /* Параметры команд восстанавливаются из журнала, имя галса NULL не заменяется
+   * пустой строкой. */
+  data = g_strdup_printf ("tvg-constant:%d:10.0;start:Track;", source);
+  g_assert_true (g_str_has_prefix (recorded, data));
+  g_assert_true (g_str_has_prefix (fixture->calls->str, recorded));
+  g_assert_null (strstr (fixture->calls->str, "start:;"));
+  g_free (recorded);
+  g_free (data);
+
+  /* Повреждённые журналы: обрезанная запись, другой порядок байтов, другой
+   * размер параметров первой команды. */
+  g_assert_true (g_file_get_contents (path, &data, &size, NULL));
+  fixture_assert_journal_rejected (fixture, path, data, size, -1);
+  fixture_assert_journal_rejected (fixture, path, data, size, 8);
+  fixture_assert_journal_rejected (fixture, path, data, size, 16);
+  g_free (data);
+
+  g_unlink (path);
+  g_rmdir (dir);
+  g_free (path);
+  g_free (dir);
+}
+
+int main (int argc, char **argv)
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_random_set_seed ((guint32) (g_get_monotonic_time () % G_MAXUINT32));
+
+  g_test_add_func ("/sonar-control-model/random", test_random);
+  g_test_add ("/sonar-control-model/run-order", Fixture, NULL, fixture_setup, test_run_order, fixture_teardown);
+  g_test_add ("/sonar-control-model/single-attempt", Fixture, NULL,
+              fixture_setup, test_single_attempt, fixture_teardown);
+  g_test_add ("/sonar-control-model/transaction/merge", Fixture, NULL,
+              fixture_setup, test_transaction_merge, fixture_teardown);
+  g_test_add ("/sonar-control-model/transaction/order", Fixture, NULL,
+              fixture_setup, test_transaction_order, fixture_teardown);
+  g_test_add ("/sonar-control-model/transaction/retry", Fixture, NULL,
+              fixture_setup_retry, test_transaction_retry, fixture_teardown);
+  g_test_add ("/sonar-control-model/transaction/errors", Fixture, "continue-on-error",
+              fixture_setup, test_transaction_errors, fixture_teardown);
+  g_test_add ("/sonar-control-model/coalesce", Fixture, "coalesce",
+              fixture_setup, test_coalesce, fixture_teardown);
+  g_test_add ("/sonar-control-model/shadow-cache", Fixture, "shadow-cache",
+              fixture_setup, test_shadow_cache, fixture_teardown);
+  g_test_add ("/sonar-control-model/command-stats", Fixture, NULL,
+              fixture_setup_retry, test_command_stats, fixture_teardown);
+  g_test_add ("/sonar-control-model/journal", Fixture, NULL, fixture_setup, test_journal, fixture_teardown);
+
+  g_test_run ();
+
   xmlCleanupParser ();
 
   return 0;
@@ -18,6 +18,7 @@
 #include <math.h>
 
 #define TEST_N_REPEATS                 100
+#define TEST_TIMEOUT                   10
 
 #define SONAR_N_SOURCES                3
 
@@ -28,8 +29,6 @@
 
 #define GENERATOR_N_PRESETS            32
 
-static gboolean test_result = TRUE;
-
 typedef struct
 {
   HyScanSensorPortType                 type;
@@ -138,7 +137,8 @@ typedef struct
 
 static GMainLoop                *main_loop    = NULL;
 
-static int                       n_test_repeats;
+static gboolean                  params_updated;
+static gboolean                  params_result;
 
 static GHashTable               *ports;
 static SourceInfo                starboard;
@@ -496,7 +496,13 @@ static HyScanSonarBox   *create_sonar   (void);
 
 static void              init_servers   (HyScanSonarBox                 *sonar_box);
 
-static gboolean          test_entry     (gpointer                        udata);
+static void              apply_params       (void);
+static void              check_params       (HyScanSonarModel           *model);
+static void              check_capabilities (HyScanSonarModel           *model);
+static gboolean          params_timeout_cb  (gpointer                    udata);
+
+static void              test_capabilities  (void);
+static void              test_params        (void);
 
 
 /* Сравнивает структуры HyScanAntennaPosition. */
@@ -1101,289 +1107,216 @@ on_sonar_model_params_updated (HyScanSonarModel *model,
                                gboolean          result,
                                gpointer          udata)
 {
+  params_updated = TRUE;
+  params_result = result;
 
-  if (result)
-    {
-      gboolean retval = TRUE;
-
-      /* Сверка параметров VIRTUAL-порта. */
-      if (retval && frames.sensor_virtual_port_param_frame.test)
-        {
-          guint channel;
-          gint64 time_offset;
+  g_main_loop_quit (main_loop);
+}
 
-          hyscan_sonar_model_sensor_get_virtual_params (model, frames.sensor_virtual_port_param_frame.name,
-                                                        &channel, &time_offset);
+static gboolean
+params_timeout_cb (gpointer udata)
+{
+  g_error ("Timeout waiting for the \"sonar-params-updated\" signal.");
 
-          retval = retval &&
-                   (channel == frames.sensor_virtual_port_param_frame.channel) &&
-                   (time_offset == frames.sensor_virtual_port_param_frame.time_offset);
+  return G_SOURCE_REMOVE;
+}
 
-          if (!retval)
-            g_warning ("sensor_virtual_port_param_frame");
-        }
+/* Сверяет параметры, считанные из модели, с параметрами, установленными функцией
+ * apply_params. */
+static void
+check_params (HyScanSonarModel *model)
+{
+  /* Сверка параметров VIRTUAL-порта. */
+  if (frames.sensor_virtual_port_param_frame.test)
+    {
+      guint channel;
+      gint64 time_offset;
 
-      /* Сверка параметров UART-порта. */
-      if (retval && frames.sensor_uart_port_param_frame.test)
-        {
-          guint channel;
-          gint64 time_offset;
-          HyScanSensorProtocolType protocol;
-          guint uart_device;
-          guint uart_mode;
-
-          hyscan_sonar_model_sensor_get_uart_params (model, frames.sensor_uart_port_param_frame.name,
-                                                     &channel, &time_offset, &protocol, &uart_device, &uart_mode);
-
-          retval = retval &&
-                   (channel == frames.sensor_uart_port_param_frame.channel) &&
-                   (time_offset == frames.sensor_uart_port_param_frame.time_offset) &&
-                   (protocol == frames.sensor_uart_port_param_frame.protocol) &&
-                   (uart_device == frames.sensor_uart_port_param_frame.uart_device) &&
-                   (uart_mode == frames.sensor_uart_port_param_frame.uart_mode);
-
-          if (!retval)
-            g_warning ("sensor_uart_port_param_frame");
-        }
+      hyscan_sonar_model_sensor_get_virtual_params (model, frames.sensor_virtual_port_param_frame.name,
+                                                    &channel, &time_offset);
 
-      /* Сверка параметров UDP/IP-порта. */
-      if (retval && frames.sensor_udp_ip_port_param_frame.test)
-        {
-          guint channel;
-          gint64 time_offset;
-          HyScanSensorProtocolType protocol;
-          guint ip_address;
-          guint16 udp_port;
-
-          hyscan_sonar_model_sensor_get_udp_ip_params (model, frames.sensor_udp_ip_port_param_frame.name,
-                                                       &channel, &time_offset, &protocol, &ip_address, &udp_port);
-
-          retval = retval &&
-                   (channel == frames.sensor_udp_ip_port_param_frame.channel) &&
-                   (time_offset == frames.sensor_udp_ip_port_param_frame.time_offset) &&
-                   (protocol == frames.sensor_udp_ip_port_param_frame.protocol) &&
-                   (ip_address == frames.sensor_udp_ip_port_param_frame.ip_address) &&
-                   (udp_port == frames.sensor_udp_ip_port_param_frame.udp_port);
-
-          if (!retval)
-            g_warning ("sensor_udp_ip_port_param_frame");
-        }
+      g_assert_cmpuint (channel, ==, frames.sensor_virtual_port_param_frame.channel);
+      g_assert_cmpint (time_offset, ==, frames.sensor_virtual_port_param_frame.time_offset);
+    }
 
-      /* Сверка местоположения. */
-      if (retval && frames.sonar_set_position_frame.test)
-        {
-          HyScanAntennaPosition *pos;
-          pos = hyscan_sonar_model_sensor_get_position (model, frames.sensor_set_position_frame.name);
-          retval = retval &&
-                   pos != NULL &&
-                   memcmp (pos, &frames.sensor_set_position_frame.position, sizeof (HyScanAntennaPosition)) == 0;
-          g_free (pos);
-
-          if (!retval)
-            g_warning ("sensor_set_position_frame");
-        }
+  /* Сверка параметров UART-порта. */
+  if (frames.sensor_uart_port_param_frame.test)
+    {
+      guint channel;
+      gint64 time_offset;
+      HyScanSensorProtocolType protocol;
+      guint uart_device;
+      guint uart_mode;
+
+      hyscan_sonar_model_sensor_get_uart_params (model, frames.sensor_uart_port_param_frame.name,
+                                                 &channel, &time_offset, &protocol, &uart_device, &uart_mode);
+
+      g_assert_cmpuint (channel, ==, frames.sensor_uart_port_param_frame.channel);
+      g_assert_cmpint (time_offset, ==, frames.sensor_uart_port_param_frame.time_offset);
+      g_assert_cmpint (protocol, ==, frames.sensor_uart_port_param_frame.protocol);
+      g_assert_cmpuint (uart_device, ==, frames.sensor_uart_port_param_frame.uart_device);
+      g_assert_cmpuint (uart_mode, ==, frames.sensor_uart_port_param_frame.uart_mode);
+    }
 
-      /* Сверка состояния датчика. */
-      if (retval && frames.sensor_set_enable_frame.test)
-        {
-          gboolean enabled = hyscan_sonar_model_sensor_is_enabled (model, frames.sensor_set_enable_frame.name);
-          retval = retval && (frames.sensor_set_enable_frame.enable == enabled);
+  /* Сверка параметров UDP/IP-порта. */
+  if (frames.sensor_udp_ip_port_param_frame.test)
+    {
+      guint channel;
+      gint64 time_offset;
+      HyScanSensorProtocolType protocol;
+      guint ip_address;
+      guint16 udp_port;
+
+      hyscan_sonar_model_sensor_get_udp_ip_params (model, frames.sensor_udp_ip_port_param_frame.name,
+                                                   &channel, &time_offset, &protocol, &ip_address, &udp_port);
+
+      g_assert_cmpuint (channel, ==, frames.sensor_udp_ip_port_param_frame.channel);
+      g_assert_cmpint (time_offset, ==, frames.sensor_udp_ip_port_param_frame.time_offset);
+      g_assert_cmpint (protocol, ==, frames.sensor_udp_ip_port_param_frame.protocol);
+      g_assert_cmpuint (ip_address, ==, frames.sensor_udp_ip_port_param_frame.ip_address);
+      g_assert_cmpuint (udp_port, ==, frames.sensor_udp_ip_port_param_frame.udp_port);
+    }
 
-          if (!retval)
-            g_warning ("sensor_set_enable_frame");
-        }
+  /* Сверка местоположения датчика. */
+  if (frames.sensor_set_position_frame.test)
+    {
+      HyScanAntennaPosition *pos;
 
-      /* Сверка преднастроек генератора. */
-      if (retval && frames.generator_set_preset_frame.test)
-        {
-          guint preset;
-          hyscan_sonar_model_gen_get_preset_params (model, frames.generator_set_preset_frame.source, &preset);
-          retval = retval && frames.generator_set_preset_frame.preset == preset;
+      pos = hyscan_sonar_model_sensor_get_position (model, frames.sensor_set_position_frame.name);
+      g_assert_nonnull (pos);
+      g_assert_cmpint (memcmp (pos, &frames.sensor_set_position_frame.position, sizeof (HyScanAntennaPosition)), ==, 0);
+      g_free (pos);
+    }
 
-          if (!retval)
-            g_warning ("generator_set_preset_frame");
-        }
+  /* Сверка состояния датчика. */
+  if (frames.sensor_set_enable_frame.test)
+    {
+      g_assert_cmpint (hyscan_sonar_model_sensor_is_enabled (model, frames.sensor_set_enable_frame.name),
+                       ==, frames.sensor_set_enable_frame.enable);
+    }
 
-      /* Сверка автоматических параметров генератора. */
-      if (retval && frames.generator_set_auto_frame.test)
-        {
-          HyScanGeneratorSignalType signal;
-          hyscan_sonar_model_gen_get_auto_params (model, frames.generator_set_auto_frame.source, &signal);
-          retval = retval && frames.generator_set_auto_frame.signal == signal;
+  /* Сверка преднастроек генератора. */
+  if (frames.generator_set_preset_frame.test)
+    {
+      guint preset;
 
-          if (!retval)
-            g_warning ("generator_set_auto_frame");
-        }
+      hyscan_sonar_model_gen_get_preset_params (model, frames.generator_set_preset_frame.source, &preset);
+      g_assert_cmpuint (preset, ==, frames.generator_set_preset_frame.preset);
+    }
 
-      /* Сверка упрощенных параметров генератора. */
-      if (retval && frames.generator_set_simple_frame.test)
-        {
-          HyScanGeneratorSignalType signal;
-          gdouble power;
-          hyscan_sonar_model_gen_get_simple_params (model, frames.generator_set_simple_frame.source, &signal, &power);
-          retval = retval &&
-                   frames.generator_set_simple_frame.signal == signal &&
-                   frames.generator_set_simple_frame.power == power;
-
-          if (!retval)
-            g_warning ("generator_set_simple_frame");
-        }
+  /* Сверка автоматических параметров генератора. */
+  if (frames.generator_set_auto_frame.test)
+    {
+      HyScanGeneratorSignalType signal;
 
-      /* Сверка расширенных параметров генератора. */
-      if (retval && frames.generator_set_extended_frame.test)
-        {
-          HyScanGeneratorSignalType signal;
-          gdouble power, duration;
-          hyscan_sonar_model_gen_get_extended_params (model, frames.generator_set_extended_frame.source,
-                                                      &signal, &duration, &power);
-          retval = retval &&
-                   frames.generator_set_extended_frame.signal == signal &&
-                   frames.generator_set_extended_frame.duration == duration &&
-                   frames.generator_set_extended_frame.power == power;
-
-          if (!retval)
-            g_warning ("generator_set_extended_frame");
-        }
+      hyscan_sonar_model_gen_get_auto_params (model, frames.generator_set_auto_frame.source, &signal);
+      g_assert_cmpint (signal, ==, frames.generator_set_auto_frame.signal);
+    }
 
-      /* Сверка состояния генератора. */
-      if (retval && frames.generator_set_enable_frame.test)
-        {
-          gdouble enabled = hyscan_sonar_model_gen_is_enabled (model, frames.generator_set_enable_frame.source);
-          retval = retval && frames.generator_set_enable_frame.enable == enabled;
+  /* Сверка упрощенных параметров генератора. */
+  if (frames.generator_set_simple_frame.test)
+    {
+      HyScanGeneratorSignalType signal;
+      gdouble power;
 
-          if (!retval)
-            g_warning ("generator_set_enable_frame");
-        }
+      hyscan_sonar_model_gen_get_simple_params (model, frames.generator_set_simple_frame.source, &signal, &power);
+      g_assert_cmpint (signal, ==, frames.generator_set_simple_frame.signal);
+      g_assert_cmpfloat (power, ==, frames.generator_set_simple_frame.power);
+    }
 
-      /* Сверка автоматических ВАРУ. */
-      if (retval && frames.tvg_set_auto_frame.test)
-        {
-          gdouble level, sensitivity;
-          hyscan_sonar_model_tvg_get_auto_params (model, frames.tvg_set_auto_frame.source, &level, &sensitivity);
-          retval = retval &&
-                   frames.tvg_set_auto_frame.level == level &&
-                   frames.tvg_set_auto_frame.sensitivity == sensitivity;
-
-          if (!retval)
-            g_warning ("tvg_set_auto_frame");
-        }
+  /* Сверка расширенных параметров генератора. */
+  if (frames.generator_set_extended_frame.test)
+    {
+      HyScanGeneratorSignalType signal;
+      gdouble power, duration;
+
+      hyscan_sonar_model_gen_get_extended_params (model, frames.generator_set_extended_frame.source,
+                                                  &signal, &duration, &power);
+      g_assert_cmpint (signal, ==, frames.generator_set_extended_frame.signal);
+      g_assert_cmpfloat (duration, ==, frames.generator_set_extended_frame.duration);
+      g_assert_cmpfloat (power, ==, frames.generator_set_extended_frame.power);
+    }
 
-      /* Сверка постоянного ВАРУ. */
-      if (retval && frames.tvg_set_constant_frame.test)
-        {
-          gdouble gain;
-          hyscan_sonar_model_tvg_get_const_params (model, frames.tvg_set_constant_frame.source, &gain);
-          retval = retval && frames.tvg_set_constant_frame.gain == gain;
+  /* Сверка состояния генератора. */
+  if (frames.generator_set_enable_frame.test)
+    {
+      g_assert_cmpint (hyscan_sonar_model_gen_is_enabled (model, frames.generator_set_enable_frame.source),
+                       ==, frames.generator_set_enable_frame.enable);
+    }
 
-          if (!retval)
-            g_warning ("tvg_set_constant_frame");
-        }
+  /* Сверка автоматических ВАРУ. */
+  if (frames.tvg_set_auto_frame.test)
+    {
+      gdouble level, sensitivity;
 
-      /* Сверка линейного ВАРУ. */
-      if (retval && frames.tvg_set_linear_db_frame.test)
-        {
-          gdouble gain0, step;
-          hyscan_sonar_model_tvg_get_linear_db_params (model, frames.tvg_set_linear_db_frame.source,
-                                                       &gain0, &step);
-          retval = retval &&
-                   frames.tvg_set_linear_db_frame.gain0 == gain0 &&
-                   frames.tvg_set_linear_db_frame.step == step;
-
-          if (!retval)
-            g_warning ("tvg_set_linear_db_frame");
-        }
+      hyscan_sonar_model_tvg_get_auto_params (model, frames.tvg_set_auto_frame.source, &level, &sensitivity);
+      g_assert_cmpfloat (level, ==, frames.tvg_set_auto_frame.level);
+      g_assert_cmpfloat (sensitivity, ==, frames.tvg_set_auto_frame.sensitivity);
+    }
 
-      /* Сверка логарифмичкеского ВАРУ. */
-      if (retval && frames.tvg_set_logarithmic_frame.test)
-        {
-          gdouble gain0, beta, alpha;
-          hyscan_sonar_model_tvg_get_logarithmic_params (model, frames.tvg_set_logarithmic_frame.source,
-                                                         &gain0, &beta, &alpha);
-          retval = retval &&
-                   frames.tvg_set_logarithmic_frame.gain0 == gain0 &&
-                   frames.tvg_set_logarithmic_frame.beta == beta &&
-                   frames.tvg_set_logarithmic_frame.alpha == alpha;
-
-          if (!retval)
-            g_warning ("tvg_set_logarithmic_frame");
-        }
+  /* Сверка постоянного ВАРУ. */
+  if (frames.tvg_set_constant_frame.test)
+    {
+      gdouble gain;
 
-      /* Сверка состояния ВАРУ. */
-      if (retval && frames.tvg_set_enable_frame.test)
-        {
-          gdouble enabled = hyscan_sonar_model_tvg_is_enabled (model, frames.tvg_set_enable_frame.source);
-          retval = retval && frames.tvg_set_enable_frame.enable == enabled;\
+      hyscan_sonar_model_tvg_get_const_params (model, frames.tvg_set_constant_frame.source, &gain);
+      g_assert_cmpfloat (gain, ==, frames.tvg_set_constant_frame.gain);
+    }
 
-          if (!retval)
-            g_warning ("tvg_set_enable_frame");
-        }
+  /* Сверка линейного ВАРУ. */
+  if (frames.tvg_set_linear_db_frame.test)
+    {
+      gdouble gain0, step;
 
-      /* Сверка времени приёма. */
-      if (retval && frames.sonar_set_receive_time_frame.test)
-        {
-          gdouble recv_time = hyscan_sonar_model_get_receive_time (model, frames.sonar_set_receive_time_frame.source);
-          retval = retval && frames.sonar_set_receive_time_frame.receive_time == recv_time;
+      hyscan_sonar_model_tvg_get_linear_db_params (model, frames.tvg_set_linear_db_frame.source, &gain0, &step);
+      g_assert_cmpfloat (gain0, ==, frames.tvg_set_linear_db_frame.gain0);
+      g_assert_cmpfloat (step, ==, frames.tvg_set_linear_db_frame.step);
+    }
 
-          if (!retval)
-            g_warning ("sonar_set_receive_time_frame");
-        }
+  /* Сверка логарифмического ВАРУ. */
+  if (frames.tvg_set_logarithmic_frame.test)
+    {
+      gdouble gain0, beta, alpha;
 
-      /* Сверка типа синхронизации. */
-      if (retval && frames.sonar_set_sync_type_frame.test)
-        {
-          retval = retval && frames.sonar_set_sync_type_frame.sync_type == hyscan_sonar_model_get_sync_type (model);
+      hyscan_sonar_model_tvg_get_logarithmic_params (model, frames.tvg_set_logarithmic_frame.source,
+                                                     &gain0, &beta, &alpha);
+      g_assert_cmpfloat (gain0, ==, frames.tvg_set_logarithmic_frame.gain0);
+      g_assert_cmpfloat (beta, ==, frames.tvg_set_logarithmic_frame.beta);
+      g_assert_cmpfloat (alpha, ==, frames.tvg_set_logarithmic_frame.alpha);
+    }
 
-          if (!retval)
-            g_warning ("sonar_set_sync_type_frame");
-        }
+  /* Сверка состояния ВАРУ. */
+  if (frames.tvg_set_enable_frame.test)
+    {
+      g_assert_cmpint (hyscan_sonar_model_tvg_is_enabled (model, frames.tvg_set_enable_frame.source),
+                       ==, frames.tvg_set_enable_frame.enable);
+    }
 
-      /* Сверка тип галса. */
-      if (retval && frames.sonar_start_frame.test)
-        {
-          retval = retval && frames.sonar_start_frame.track_type == hyscan_sonar_model_get_track_type (model);
+  /* Сверка времени приёма. */
+  if (frames.sonar_set_receive_time_frame.test)
+    {
+      g_assert_cmpfloat (hyscan_sonar_model_get_receive_time (model, frames.sonar_set_receive_time_frame.source),
+                         ==, frames.sonar_set_receive_time_frame.receive_time);
+    }
 
-          if (!retval)
-            g_warning ("sonar_start_frame");
-        }
+  /* Сверка типа синхронизации. */
+  if (frames.sonar_set_sync_type_frame.test)
+    g_assert_cmpint (hyscan_sonar_model_get_sync_type (model), ==, frames.sonar_set_sync_type_frame.sync_type);
 
-      /* Сверка местоположения. */
-      if (retval && frames.sonar_set_position_frame.test)
-        {
-          HyScanAntennaPosition *pos;
-          pos = hyscan_sonar_model_sonar_get_position (sonar_model, frames.sonar_set_position_frame.source);
-          retval = retval &&
-                   pos != NULL &&
-                   memcmp (pos, &frames.sonar_set_position_frame.position, sizeof (HyScanAntennaPosition)) == 0;
-          g_free (pos);
-
-          if (!retval)
-            g_warning ("sonar_set_position_frame");
-        }
+  /* Сверка типа галса. */
+  if (frames.sonar_start_frame.test)
+    g_assert_cmpint (hyscan_sonar_model_get_track_type (model), ==, frames.sonar_start_frame.track_type);
 
-      g_print ("Attempt %3d (out of %d): ", n_test_repeats + 1, TEST_N_REPEATS);
-      if (retval)
-        {
-          g_print ("PASS\n");
-        }
-      else
-        {
-          g_print ("FAIL\n");
-          test_result = FALSE;
-          g_main_loop_quit (main_loop);
-          return;
-        }
-    }
-  else
+  /* Сверка местоположения антенны. */
+  if (frames.sonar_set_position_frame.test)
     {
-      g_message ("Can't change sonar parameters. Test failed.");
-      g_main_loop_quit (main_loop);
-      return;
-    }
+      HyScanAntennaPosition *pos;
 
-  if (++n_test_repeats < TEST_N_REPEATS)
-    g_timeout_add (100, test_entry, NULL);
-  else
-    g_main_loop_quit (main_loop);
+      pos = hyscan_sonar_model_sonar_get_position (model, frames.sonar_set_position_frame.source);
+      g_assert_nonnull (pos);
+      g_assert_cmpint (memcmp (pos, &frames.sonar_set_position_frame.position, sizeof (HyScanAntennaPosition)), ==, 0);
+      g_free (pos);
+    }
 }
 
 /* Создаёт виртуальный гидролокатор. */
@@ -1580,6 +1513,51 @@ create_sonar (void)
   return sonar_box;
 }
 
+/* Сверяет возможности гидролокатора, считанные моделью, с параметрами виртуального
+ * гидролокатора, а значения параметров по умолчанию - с этими возможностями. */
+static void
+check_capabilities (HyScanSonarModel *model)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  guint i;
+
+  g_assert_cmpint (hyscan_sonar_model_get_sync_capabilities (model), ==,
+                   (HyScanSonarSyncType) sonar_info.sync_capabilities);
+
+  /* Из всех типов синхронизации по умолчанию выбирается программная. */
+  g_assert_cmpint (hyscan_sonar_model_get_sync_type (model), ==, HYSCAN_SONAR_SYNC_SOFTWARE);
+
+  for (i = 0; i < SONAR_N_SOURCES; i++)
+    {
+      HyScanSourceType source = source_type_by_index (i);
+      SourceInfo *info = source_info_by_source_type (source);
+      gdouble min_gain, max_gain;
+
+      g_assert_cmpint (hyscan_sonar_model_gen_get_capabilities (model, source), ==, info->generator.capabilities);
+      g_assert_cmpint (hyscan_sonar_model_gen_get_signals (model, source), ==, info->generator.signals);
+
+      g_assert_cmpint (hyscan_sonar_model_tvg_get_capabilities (model, source), ==, info->tvg.capabilities);
+      g_assert_true (hyscan_sonar_model_tvg_get_gain_range (model, source, &min_gain, &max_gain));
+      g_assert_cmpfloat (min_gain, ==, info->tvg.min_gain);
+      g_assert_cmpfloat (max_gain, ==, info->tvg.max_gain);
+
+      /* Режимы по умолчанию выбираются из доступных в порядке предпочтения. */
+      g_assert_cmpint (hyscan_sonar_model_gen_get_mode (model, source), ==, HYSCAN_GENERATOR_MODE_PRESET);
+      g_assert_cmpint (hyscan_sonar_model_tvg_get_mode (model, source), ==, HYSCAN_TVG_MODE_AUTO);
+    }
+
+  g_hash_table_iter_init (&iter, ports);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      VirtualPortInfo *port = value;
+
+      g_assert_cmpint (hyscan_sonar_model_sensor_get_port_type (model, key), ==, port->type);
+    }
+
+  g_assert_cmpint (hyscan_sonar_model_sensor_get_port_type (model, "unknown"), ==, HYSCAN_SENSOR_PORT_INVALID);
+}
+
 /* Создаёт серверы SENSOR, GENERATOR, TVG, SONAR. */
 static void
 init_servers (HyScanSonarBox *sonar_box)
@@ -1637,9 +1615,10 @@ init_servers (HyScanSonarBox *sonar_box)
                             G_CALLBACK (sonar_ping), &server);
 }
 
-/* Входная точка в тесты. */
-static gboolean
-test_entry (gpointer udata)
+/* Устанавливает случайные параметры датчиков, одного источника данных
+ * и гидролокатора и запускает гидролокатор. */
+static void
+apply_params (void)
 {
   HyScanSourceType source_type;
   gchar *port_name = "";
@@ -1918,12 +1897,48 @@ test_entry (gpointer udata)
   frames.sonar_start_frame.track_type = random_track_type ();
   hyscan_sonar_model_set_track_type (sonar_model, frames.sonar_start_frame.track_type);
   hyscan_sonar_model_sonar_start (sonar_model);
+}
 
-  return G_SOURCE_REMOVE;
+/* Возможности гидролокатора считываются при создании модели и повторно. */
+static void
+test_capabilities (void)
+{
+  check_capabilities (sonar_model);
+
+  hyscan_sonar_model_refresh_capabilities (sonar_model);
+  check_capabilities (sonar_model);
+}
+
+/* Параметры, установленные через модель, передаются гидролокатору и возвращаются
+ * моделью после сигнала "sonar-params-updated". */
+static void
+test_params (void)
+{
+  guint i;
+
+  for (i = 0; i < TEST_N_REPEATS; i++)
+    {
+      guint timeout_id;
+
+      params_updated = FALSE;
+      apply_params ();
+
+      timeout_id = g_timeout_add_seconds (TEST_TIMEOUT, params_timeout_cb, NULL);
+      while (!params_updated)
+        g_main_loop_run (main_loop);
+      g_source_remove (timeout_id);
+
+      g_assert_true (params_result);
+      check_params (sonar_model);
+    }
 }
 
 int main (int argc, char **argv)
 {
+  int status;
+
+  g_test_init (&argc, &argv, NULL);
+
   g_random_set_seed ((guint32) (g_get_monotonic_time () % G_MAXUINT32));
 
   /* Инициализация виртуального гидролокатора. */
@@ -1939,15 +1954,15 @@ int main (int argc, char **argv)
                               NULL);
   g_signal_connect (sonar_model, "sonar-params-updated", G_CALLBACK (on_sonar_model_params_updated), NULL);
 
-  /* Создание MainLoop. */
   main_loop = g_main_loop_new (NULL, TRUE);
 
-  n_test_repeats = 0;
-  g_idle_add (test_entry, NULL);
+  /* Возможности проверяются до изменения параметров по умолчанию. */
+  g_test_add_func ("/sonar-model/capabilities", test_capabilities);
+  g_test_add_func ("/sonar-model/params", test_params);
 
-  g_main_loop_run (main_loop);
+  status = g_test_run ();
 
-  /* MainLoop завершен. Освобождение занятых ресурсов. */
+  /* Освобождение занятых ресурсов. */
   g_main_loop_unref (main_loop);
   g_object_unref (sonar_model);
   g_object_unref (sonar_control);
@@ -2000,5 +2015,5 @@ int main (int argc, char **argv)
 
   xmlCleanupParser ();
 
-  return test_result;
+  return status;
 }
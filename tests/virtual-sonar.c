@@ -0,0 +1,82 @@
+#include "virtual-sonar.h"
+
+const HyScanSourceType virtual_sonar_sources[VIRTUAL_SONAR_N_SOURCES] = { HYSCAN_SOURCE_SIDE_SCAN_STARBOARD,
+                                                                          HYSCAN_SOURCE_SIDE_SCAN_PORT,
+                                                                          HYSCAN_SOURCE_ECHOSOUNDER };
+
+gchar *
+virtual_sonar_default_schema (void)
+{
+  HyScanSonarSchema *schema;
+  gchar *schema_data;
+  guint i;
+
+  schema = hyscan_sonar_schema_new (HYSCAN_SONAR_SCHEMA_DEFAULT_TIMEOUT);
+
+  hyscan_sonar_schema_sync_add (schema, HYSCAN_SONAR_SYNC_INTERNAL | HYSCAN_SONAR_SYNC_SOFTWARE);
+
+  for (i = 0; i < VIRTUAL_SONAR_N_SOURCES; i++)
+    {
+      HyScanSourceType source = virtual_sonar_sources[i];
+
+      hyscan_sonar_schema_source_add (schema, source, 1.0, 1.0, 100000.0, 10000.0,
+                                      VIRTUAL_SONAR_MAX_RECEIVE_TIME, FALSE);
+      hyscan_sonar_schema_generator_add (schema, source,
+                                         HYSCAN_GENERATOR_MODE_AUTO,
+                                         HYSCAN_GENERATOR_SIGNAL_AUTO,
+                                         0.0, 0.0, 0.0, 0.0);
+      hyscan_sonar_schema_tvg_add (schema, source,
+                                   HYSCAN_TVG_MODE_AUTO | HYSCAN_TVG_MODE_CONSTANT,
+                                   VIRTUAL_SONAR_MIN_GAIN, VIRTUAL_SONAR_MAX_GAIN);
+      hyscan_sonar_schema_channel_add (schema, source, 1, 0.0, 0.0, 0, 1.0);
+      hyscan_sonar_schema_source_add_acoustic (schema, source);
+    }
+
+  schema_data = hyscan_data_schema_builder_get_data (HYSCAN_DATA_SCHEMA_BUILDER (schema));
+  g_object_unref (schema);
+
+  return schema_data;
+}
+
+VirtualSonar *
+virtual_sonar_new (const gchar *schema_data)
+{
+  VirtualSonar *sonar;
+  gchar *default_schema = NULL;
+
+  if (schema_data == NULL)
+    schema_data = default_schema = virtual_sonar_default_schema ();
+
+  sonar = g_new0 (VirtualSonar, 1);
+  sonar->sonar_box = hyscan_sonar_box_new ();
+  if (!hyscan_sonar_box_set_schema (sonar->sonar_box, schema_data, "sonar"))
+    {
+      g_object_unref (sonar->sonar_box);
+      g_free (default_schema);
+      g_free (sonar);
+      return NULL;
+    }
+
+  sonar->generator = hyscan_generator_control_server_new (sonar->sonar_box);
+  sonar->tvg = hyscan_tvg_control_server_new (sonar->sonar_box);
+  sonar->sonar = hyscan_sonar_control_server_new (sonar->sonar_box);
+  sonar->sensor = hyscan_sensor_control_server_new (sonar->sonar_box);
+
+  g_free (default_schema);
+
+  return sonar;
+}
+
+void
+virtual_sonar_free (VirtualSonar *sonar)
+{
+  if (sonar == NULL)
+    return;
+
+  g_object_unref (sonar->generator);
+  g_object_unref (sonar->tvg);
+  g_object_unref (sonar->sonar);
+  g_object_unref (sonar->sensor);
+  g_object_unref (sonar->sonar_box);
+  g_free (sonar);
+}
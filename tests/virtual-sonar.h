@@ -0,0 +1,44 @@
+/* Виртуальный гидролокатор для тестов, измерений и повторного выполнения журналов
+ * HyScanSonarControlModel. */
+
+#ifndef __VIRTUAL_SONAR_H__
+#define __VIRTUAL_SONAR_H__
+
+#include "hyscan-generator-control-server.h"
+#include "hyscan-tvg-control-server.h"
+#include "hyscan-sonar-control-server.h"
+#include "hyscan-sensor-control-server.h"
+
+G_BEGIN_DECLS
+
+/* Параметры схемы виртуального гидролокатора по умолчанию. */
+#define VIRTUAL_SONAR_N_SOURCES         3
+#define VIRTUAL_SONAR_MAX_RECEIVE_TIME  1.0
+#define VIRTUAL_SONAR_MIN_GAIN          0.0
+#define VIRTUAL_SONAR_MAX_GAIN          100.0
+
+typedef struct
+{
+  HyScanSonarBox               *sonar_box;   /* Параметры гидролокатора. */
+  HyScanGeneratorControlServer *generator;   /* Сервер управления генераторами. */
+  HyScanTVGControlServer       *tvg;         /* Сервер управления ВАРУ. */
+  HyScanSonarControlServer     *sonar;       /* Сервер управления гидролокатором. */
+  HyScanSensorControlServer    *sensor;      /* Сервер управления датчиками. */
+} VirtualSonar;
+
+/* Источники данных схемы по умолчанию. */
+extern const HyScanSourceType virtual_sonar_sources[VIRTUAL_SONAR_N_SOURCES];
+
+/* Создаёт схему по умолчанию: VIRTUAL_SONAR_N_SOURCES источников данных с генератором
+ * в автоматическом режиме и ВАРУ в автоматическом режиме и с постоянным усилением. */
+gchar         *virtual_sonar_default_schema   (void);
+
+/* Создаёт виртуальный гидролокатор со схемой schema_data или, если она равна NULL,
+ * со схемой по умолчанию. Обработчики команд серверов подключает вызывающий. */
+VirtualSonar  *virtual_sonar_new              (const gchar   *schema_data);
+
+void           virtual_sonar_free             (VirtualSonar  *sonar);
+
+G_END_DECLS
+
+#endif /* __VIRTUAL_SONAR_H__ */